@@ -0,0 +1,30 @@
+#pragma once
+
+#include "fanctl_uapi.h"
+
+/*
+ * Raw byte-stream capture format
+ * ------------------------------
+ * A capture is a sequence of records, each one a fixed-size header
+ * followed by `len` raw UART bytes as seen by the host.
+ *
+ * The kernel driver writes one stream per CPU (debugfs relay files
+ * fanctl/capture0..N); records are ordered by `ts_ns` within a stream,
+ * so streams are merged by timestamp when analysed offline.
+ *
+ * All header fields are in host byte order.
+ */
+
+#define FANCTL_CAP_MAGIC     0xFC5A
+#define FANCTL_CAP_MAX_CHUNK 1024 /* longer chunks are split */
+
+#define FANCTL_CAP_DIR_RX    0 /* node -> host */
+#define FANCTL_CAP_DIR_TX    1 /* host -> node */
+
+struct fanctl_cap_rec {
+	fanctl_u64 ts_ns;          /* CLOCK_MONOTONIC */
+	fanctl_u16 magic;          /* FANCTL_CAP_MAGIC */
+	fanctl_u16 len;            /* number of bytes following the header */
+	fanctl_u8  dir;            /* FANCTL_CAP_DIR_* */
+	fanctl_u8  rsvd[3];
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "fanctl_uapi.h"
+
+/*
+ * Request trace format
+ * --------------------
+ * One record per request handled by the driver, written when the request
+ * returns. The kernel writes one stream per CPU (debugfs relay files
+ * fanctl/trace0..N); streams are merged by `submit_ns` when analysed.
+ *
+ * Host timestamps are CLOCK_MONOTONIC ns, 0 when the request never got
+ * that far. Node timestamps come from the response trailer (proto_trace_t,
+ * FANCTL_TRACE_F_NODE set) in µs of the node's own clock, so only their
+ * differences are meaningful.
+ *
+ * All fields are in host byte order.
+ */
+
+#define FANCTL_TRACE_MAGIC   0xFC7A
+
+#define FANCTL_TRACE_F_NODE  0x01 /* node_* fields are valid */
+
+struct fanctl_trace_rec {
+	fanctl_u64 submit_ns;       /* request submitted */
+	fanctl_u64 grant_ns;        /* wire granted by the scheduler */
+	fanctl_u64 tx_ns;           /* request frame handed to the tty */
+	fanctl_u64 rx_ns;           /* response frame completed in the ldisc */
+	fanctl_u64 done_ns;         /* request returned */
+	fanctl_u32 node_parse_us;   /* frame parsed by the node */
+	fanctl_u32 node_dequeue_us; /* taken from the node's command queue */
+	fanctl_u32 node_handler_us; /* command handler started */
+	fanctl_u32 node_send_us;    /* response handed to the node's UART */
+	fanctl_s32 result;          /* 0 or -errno */
+	fanctl_u16 magic;           /* FANCTL_TRACE_MAGIC */
+	fanctl_u8  addr;            /* node address, FANCTL_ADDR_NONE point-to-point */
+	fanctl_u8  cmd;             /* request PROTO_CMD_* */
+	fanctl_u8  seq;
+	fanctl_u8  flags;           /* FANCTL_TRACE_F_* */
+	fanctl_u8  rsvd[6];
+};
@@ -7,7 +7,9 @@
 typedef __u8   fanctl_u8;
 typedef __u16  fanctl_u16;
 typedef __s16  fanctl_s16;
+typedef __s32  fanctl_s32;
 typedef __u32  fanctl_u32;
+typedef __u64  fanctl_u64;
 
 #else
 # include <stdint.h>
@@ -16,7 +18,9 @@ typedef __u32  fanctl_u32;
 typedef uint8_t  fanctl_u8;
 typedef uint16_t fanctl_u16;
 typedef int16_t  fanctl_s16;
+typedef int32_t  fanctl_s32;
 typedef uint32_t fanctl_u32;
+typedef uint64_t fanctl_u64;
 
 #endif
 
@@ -32,9 +36,65 @@ struct fanctl_status {
 	fanctl_u16 errors;         /* bitfield */
 };
 
+// kernel timestamps of a request/response pair, CLOCK_MONOTONIC ns
+struct fanctl_times {
+	fanctl_u64 tx_ns;          /* request frame handed to the tty */
+	fanctl_u64 rx_ns;          /* response frame completed in the ldisc */
+};
+
+// status together with the timing of the exchange which produced it
+struct fanctl_status_ext {
+	struct fanctl_status status;
+	struct fanctl_times  times;
+};
+
+// request priority classes used by the driver's request scheduler
+#define FANCTL_PRIO_CTRL  0 /* SET_FAN_MODE, SET_FAN_STATE, SET_THRESHOLD */
+#define FANCTL_PRIO_POLL  1 /* GET_STATUS, PING */
+#define FANCTL_PRIO_NR    2
+
+// log2 histogram of queueing delay: bucket 0 = <1us, bucket i = [2^(i-1), 2^i) us
+#define FANCTL_QSTATS_HIST_BUCKETS 20
+
+// per priority class request queue statistics
+struct fanctl_qclass_stats {
+	fanctl_u32 depth;          /* requests currently queued */
+	fanctl_u32 depth_max;      /* high watermark of depth */
+	fanctl_u64 requests;       /* requests granted the wire */
+	fanctl_u64 wait_ns_total;  /* sum of queueing delays */
+	fanctl_u64 wait_ns_max;    /* worst queueing delay */
+	fanctl_u32 wait_hist[FANCTL_QSTATS_HIST_BUCKETS]; /* last bucket: overflow */
+};
+
+struct fanctl_qstats {
+	struct fanctl_qclass_stats cls[FANCTL_PRIO_NR];
+};
+
+// link state, kept by the driver's keepalive
+#define FANCTL_LINK_UP        0 /* node answers */
+#define FANCTL_LINK_DEGRADED  1 /* recent responses missed */
+#define FANCTL_LINK_DOWN      2 /* node lost (or no ldisc attached): requests fail with ENOLINK */
+
+struct fanctl_link {
+	fanctl_u8  state;          /* FANCTL_LINK_* */
+	fanctl_u8  attached;       /* 1 when the line discipline is attached */
+	fanctl_u16 misses;         /* consecutive missed responses */
+	fanctl_u32 changes;        /* state change counter (incl. attach/detach) */
+	fanctl_u64 last_rx_ns;     /* CLOCK_MONOTONIC time of the last valid frame */
+};
+
+// node addressing (multi-drop bus), selected per open file with FANCTL_IOC_SET_ADDR
+#define FANCTL_ADDR_NONE       0x00 /* point-to-point node, unaddressed frames (default) */
+#define FANCTL_ADDR_BROADCAST  0xFF /* SET_* to all nodes, no response awaited */
+
 // ioctl cmds
 #define FANCTL_IOC_PING          _IO(FANCTL_IOC_MAGIC, 0x01)
 #define FANCTL_IOC_GET_STATUS    _IOR(FANCTL_IOC_MAGIC, 0x02, struct fanctl_status)
 #define FANCTL_IOC_SET_FAN_MODE  _IOW(FANCTL_IOC_MAGIC, 0x03, fanctl_u8)
 #define FANCTL_IOC_SET_FAN_STATE _IOW(FANCTL_IOC_MAGIC, 0x04, fanctl_u8)
 #define FANCTL_IOC_SET_THRESHOLD _IOW(FANCTL_IOC_MAGIC, 0x05, fanctl_s16)
+#define FANCTL_IOC_GET_QSTATS    _IOR(FANCTL_IOC_MAGIC, 0x06, struct fanctl_qstats)
+#define FANCTL_IOC_GET_STATUS_EXT _IOR(FANCTL_IOC_MAGIC, 0x07, struct fanctl_status_ext)
+#define FANCTL_IOC_PING_EXT      _IOR(FANCTL_IOC_MAGIC, 0x08, struct fanctl_times)
+#define FANCTL_IOC_SET_ADDR      _IOW(FANCTL_IOC_MAGIC, 0x09, fanctl_u8)
+#define FANCTL_IOC_GET_LINK      _IOR(FANCTL_IOC_MAGIC, 0x0A, struct fanctl_link)
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "fanctl_uapi.h"
+
+/*
+ * fanctld socket protocol
+ * -----------------------
+ * Local clients talk to the fanctl daemon over a SOCK_SEQPACKET Unix
+ * socket: one request or response per packet, no framing needed.
+ *
+ * A client may send several requests without waiting; responses carry
+ * the request `tag` and can come back in any order, since identical
+ * queries are coalesced and status can be answered from the cache.
+ *
+ * All fields are in host byte order (local socket only).
+ */
+
+#define FANCTLD_SOCK_PATH    "/run/fanctld.sock"
+#define FANCTLD_SOCK_ENV     "FANCTLD_SOCK"   /* overrides FANCTLD_SOCK_PATH */
+#define FANCTLD_VERSION      1
+
+// request ops
+#define FANCTLD_OP_INFO           0x00 /* transport in use, answered with fanctld_info */
+#define FANCTLD_OP_PING           0x01
+#define FANCTLD_OP_STATUS         0x02
+#define FANCTLD_OP_SET_FAN_MODE   0x03 /* arg: PROTO_FAN_MODE_* */
+#define FANCTLD_OP_SET_FAN_STATE  0x04 /* arg: PROTO_FAN_STATE_* */
+#define FANCTLD_OP_SET_THRESHOLD  0x05 /* arg: 0.01°C */
+#define FANCTLD_OP_NR             0x06
+
+// request flags
+#define FANCTLD_F_FRESH      0x01 /* STATUS: don't answer from the cache */
+
+// response flags
+#define FANCTLD_RF_CACHED    0x01 /* status served from the cache */
+#define FANCTLD_RF_COALESCED 0x02 /* shared the exchange of another request */
+
+// transport kinds (fanctld_info.kind)
+#define FANCTLD_KIND_IOCTL   0 /* /dev/fanctl */
+#define FANCTLD_KIND_SERIAL  1 /* raw tty */
+
+struct fanctld_req {
+	fanctl_u8  version;        /* FANCTLD_VERSION */
+	fanctl_u8  op;             /* FANCTLD_OP_* */
+	fanctl_u8  addr;           /* node address, FANCTL_ADDR_NONE point-to-point */
+	fanctl_u8  flags;          /* FANCTLD_F_* */
+	fanctl_s16 arg;            /* SET_* argument */
+	fanctl_u16 max_age_ms;     /* STATUS: oldest cached status accepted, 0: daemon default */
+	fanctl_u32 tag;            /* echoed in the response */
+};
+
+struct fanctld_resp {
+	fanctl_u8  version;
+	fanctl_u8  op;
+	fanctl_u8  addr;
+	fanctl_u8  flags;          /* FANCTLD_RF_* */
+	fanctl_u32 tag;            /* same offset in fanctld_info */
+	fanctl_s32 result;         /* 0 or -errno */
+	fanctl_u32 age_us;         /* STATUS: time since the response was received */
+	struct fanctl_status status; /* STATUS */
+	struct fanctl_times  times;  /* PING, STATUS: exchange that produced the answer */
+};
+
+struct fanctld_info {
+	fanctl_u8  version;
+	fanctl_u8  op;             /* FANCTLD_OP_INFO */
+	fanctl_u8  kind;           /* FANCTLD_KIND_* */
+	fanctl_u8  rsvd;
+	fanctl_u32 tag;
+	char       dev[104];       /* device path given to the daemon */
+};
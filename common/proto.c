@@ -17,10 +17,14 @@ static proto_u16	crc16_step(proto_u16 crc, proto_u8 data)
 
 proto_u16	proto_crc16(const proto_u8 *data, proto_u16 len)
 {
-	proto_u16	crc;
-	int		i;
+	return proto_crc16_update(0xFFFF, data, len);
+}
+
+/* Continue a CRC over more bytes, for data longer than one call takes */
+proto_u16	proto_crc16_update(proto_u16 crc, const proto_u8 *data, proto_u16 len)
+{
+	int	i;
 
-	crc = 0xFFFF;
 	for (i = 0; i < len; i++)
 		crc = crc16_step(crc, data[i]);
 	return crc;
@@ -28,8 +32,22 @@ proto_u16	proto_crc16(const proto_u8 *data, proto_u16 len)
 
 bool	proto_build_frame(proto_u8 cmd, proto_u8 seq, const proto_u8 *payload,
 						proto_u8 len, proto_u8 *out, proto_u16 *out_len)
+{
+	return proto_build_frame_addr(PROTO_ADDR_NONE, cmd, seq, payload, len,
+								out, out_len);
+}
+
+/*
+ * Build a frame for the given node address.
+ * PROTO_ADDR_NONE produces the unaddressed (point-to-point) format,
+ * any other address an addressed frame: SYNC1_ADDR followed by ADDR.
+ */
+bool	proto_build_frame_addr(proto_u8 addr, proto_u8 cmd, proto_u8 seq,
+							const proto_u8 *payload, proto_u8 len,
+							proto_u8 *out, proto_u16 *out_len)
 {
 	proto_u16	pos;
+	proto_u16	crc_start;
 	proto_u16	crc;
 	int		i;
 
@@ -39,13 +57,20 @@ bool	proto_build_frame(proto_u8 cmd, proto_u8 seq, const proto_u8 *payload,
 		return false;
 	pos = 0;
 	out[pos++] = PROTO_SYNC0;
-	out[pos++] = PROTO_SYNC1;
+	crc_start = 2;
+	if (addr == PROTO_ADDR_NONE)
+		out[pos++] = PROTO_SYNC1;
+	else
+	{
+		out[pos++] = PROTO_SYNC1_ADDR;
+		out[pos++] = addr;
+	}
 	out[pos++] = cmd;
 	out[pos++] = seq;
 	out[pos++] = len;
 	for (i = 0; i < len; i++)
 		out[pos++] = payload[i];
-	crc = proto_crc16(&out[2], 3 + len); // 3 bytes (cmd, seq, len) + payload length
+	crc = proto_crc16(&out[crc_start], pos - crc_start); // (addr), cmd, seq, len + payload
 	out[pos++] = crc >> 8;
 	out[pos++] = crc & 0xFF;
 	*out_len = pos;
@@ -71,12 +96,23 @@ bool	proto_rx_feed(proto_rx_t *r, proto_u8 b, proto_frame_t *out)
 		case RX_SYNC1:
 			if (b == PROTO_SYNC1)
 			{
+				r->addr = PROTO_ADDR_NONE;
 				r->st = RX_HEADER_CMD;
 				r->crc = 0xFFFF;
 			}
-			else
+			else if (b == PROTO_SYNC1_ADDR)
+			{
+				r->st = RX_HEADER_ADDR;
+				r->crc = 0xFFFF;
+			}
+			else if (b != PROTO_SYNC0) // "AA AA 55": the second AA may start the frame
 				r->st = RX_SYNC0;
 			break;
+		case RX_HEADER_ADDR:
+			r->addr = b;
+			r->crc = crc16_step(r->crc, b);
+			r->st = RX_HEADER_CMD;
+			break;
 		case RX_HEADER_CMD:
 			r->cmd = b;
 			r->crc = crc16_step(r->crc, b);
@@ -119,6 +155,7 @@ bool	proto_rx_feed(proto_rx_t *r, proto_u8 b, proto_frame_t *out)
 			r->crc_recv |= b;
 			if (r->crc == r->crc_recv)
 			{
+				out->addr = r->addr;
 				out->cmd = r->cmd;
 				out->seq = r->seq;
 				out->len = r->len;
@@ -132,3 +169,62 @@ bool	proto_rx_feed(proto_rx_t *r, proto_u8 b, proto_frame_t *out)
 	}
 	return false;
 }
+
+static void	put_be32(proto_u8 *p, proto_u32 v)
+{
+	p[0] = (proto_u8)(v >> 24);
+	p[1] = (proto_u8)(v >> 16);
+	p[2] = (proto_u8)(v >> 8);
+	p[3] = (proto_u8)v;
+}
+
+static proto_u32	get_be32(const proto_u8 *p)
+{
+	return ((proto_u32)p[0] << 24) | ((proto_u32)p[1] << 16) | ((proto_u32)p[2] << 8) | p[3];
+}
+
+/*
+ * Append the trace trailer to a response payload and flag its CMD.
+ * Returns false (frame unchanged) if the payload has no room left.
+ */
+bool	proto_trace_append(proto_frame_t *f, const proto_trace_t *t)
+{
+	proto_u8	*p;
+
+	if (!f || !t || f->len + PROTO_TRACE_LEN > PROTO_MAX_PAYLOAD)
+		return false;
+	p = &f->payload[f->len];
+	put_be32(p, t->parse_us);
+	put_be32(p + 4, t->dequeue_us);
+	put_be32(p + 8, t->handler_us);
+	put_be32(p + 12, t->send_us);
+	f->len += PROTO_TRACE_LEN;
+	f->cmd |= PROTO_CMD_F_TRACE;
+	return true;
+}
+
+/*
+ * Remove the trace trailer of a flagged response, so the frame looks
+ * like an untraced one. Returns true if a trailer was removed (`out` is
+ * optional); unflagged frames are left alone.
+ */
+bool	proto_trace_strip(proto_frame_t *f, proto_trace_t *out)
+{
+	const proto_u8	*p;
+
+	if (!f || !(f->cmd & PROTO_CMD_F_TRACE))
+		return false;
+	f->cmd &= ~PROTO_CMD_F_TRACE;
+	if (f->len < PROTO_TRACE_LEN)
+		return false;
+	f->len -= PROTO_TRACE_LEN;
+	p = &f->payload[f->len];
+	if (out)
+	{
+		out->parse_us = get_be32(p);
+		out->dequeue_us = get_be32(p + 4);
+		out->handler_us = get_be32(p + 8);
+		out->send_us = get_be32(p + 12);
+	}
+	return true;
+}
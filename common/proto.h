@@ -7,6 +7,7 @@
 typedef u8   proto_u8;
 typedef u16  proto_u16;
 typedef s16  proto_s16;
+typedef u32  proto_u32;
 
 #else
 
@@ -16,14 +17,22 @@ typedef s16  proto_s16;
 typedef uint8_t  proto_u8;
 typedef uint16_t proto_u16;
 typedef int16_t  proto_s16;
+typedef uint32_t proto_u32;
 
 #endif
 
 #define PROTO_MAX_PAYLOAD 32
+// SYNC(2) + ADDR(1, addressed frames only) + CMD/SEQ/LEN(3) + PAYLOAD + CRC16(2)
+#define PROTO_MAX_FRAME (2 + 1 + 3 + PROTO_MAX_PAYLOAD + 2)
+
+// node addresses (multi-drop)
+#define PROTO_ADDR_NONE 0x00 // unaddressed frame (point-to-point link)
+#define PROTO_ADDR_BROADCAST 0xFF // all nodes, never answered
 
 typedef enum {
 	RX_SYNC0,
 	RX_SYNC1,
+	RX_HEADER_ADDR,
 	RX_HEADER_CMD,
 	RX_HEADER_SEQ,
 	RX_HEADER_LEN,
@@ -35,6 +44,7 @@ typedef enum {
 typedef enum {
 	PROTO_SYNC0	= 0xAA,
 	PROTO_SYNC1	= 0x55,
+	PROTO_SYNC1_ADDR	= 0x5A, // SYNC1 of an addressed frame
 }	proto_sync_t;
 
 typedef enum {
@@ -48,6 +58,9 @@ typedef enum {
 	PROTO_CMD_PONG = 0x83,
 }	proto_cmd_t;
 
+// CMD flag: a request asks for a proto_trace_t trailer, a response carries one
+#define PROTO_CMD_F_TRACE 0x40
+
 typedef enum {
 	PROTO_ERR_OK = 0x00,
 	PROTO_ERR_INVALID_ARG = 0x01,
@@ -66,6 +79,7 @@ typedef enum {
 
 typedef struct {
 	proto_rx_state_t	st;
+	proto_u8		addr;
 	proto_u8		cmd;
 	proto_u8		seq;
 	proto_u8		len;
@@ -76,6 +90,7 @@ typedef struct {
 }	proto_rx_t;
 
 typedef struct {
+	proto_u8	addr; // PROTO_ADDR_NONE for unaddressed frames
 	proto_u8	cmd;
 	proto_u8	seq;
 	proto_u8	len;
@@ -90,9 +105,25 @@ typedef struct __attribute__((packed)) {
 	proto_u16	errors; // bitfield
 }	status_resp_t;
 
+// node timestamps of a traced request, µs of the node clock (wraps), big-endian on the wire
+typedef struct {
+	proto_u32	parse_us; // frame parsed (uart_read_task)
+	proto_u32	dequeue_us; // taken from the command queue (cmd_handler_task)
+	proto_u32	handler_us; // command handler started
+	proto_u32	send_us; // response handed to the UART
+}	proto_trace_t;
+
+#define PROTO_TRACE_LEN 16 // trailer size on the wire
+
 proto_u16	proto_crc16(const proto_u8 *data, proto_u16 len);
+proto_u16	proto_crc16_update(proto_u16 crc, const proto_u8 *data, proto_u16 len);
 bool		proto_build_frame(proto_u8 cmd, proto_u8 seq, const proto_u8 *payload,
 							proto_u8 len, proto_u8 *out, proto_u16 *out_len);
+bool		proto_build_frame_addr(proto_u8 addr, proto_u8 cmd, proto_u8 seq,
+							const proto_u8 *payload, proto_u8 len,
+							proto_u8 *out, proto_u16 *out_len);
 void		proto_rx_init(proto_rx_t *rx);
 bool		proto_rx_feed(proto_rx_t *rx, proto_u8 byte, proto_frame_t *out);
+bool		proto_trace_append(proto_frame_t *f, const proto_trace_t *t);
+bool		proto_trace_strip(proto_frame_t *f, proto_trace_t *out);
 
@@ -6,11 +6,69 @@
 #include <linux/completion.h>
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+#include <linux/jump_label.h>
+#include <linux/workqueue.h>
+#include <linux/bitmap.h>
+#include <linux/kref.h>
 
 #include "proto.h"
+#include "fanctl_uapi.h"
+#include "fanctl_cap.h"
+#include "fanctl_trace.h"
 
 #define N_FANCTL 27
 
+/*
+ * Max number of CTRL requests granted in a row while a POLL request
+ * is waiting. Bounds the starvation of status polls under a burst
+ * of actuation commands.
+ */
+#define FANCTL_SCHED_CTRL_BURST 8
+
+/* Consecutive missed responses after which a node is considered DOWN */
+#define FANCTL_LINK_DOWN_MISSES 3
+
+/* Request flags (fanctl_do_req) */
+#define FANCTL_REQ_PROBE	0x1 // keepalive probe, allowed while the link is DOWN
+
+/* Cached node configuration, restored when the link comes back */
+#define FANCTL_CFG_FAN_MODE	0x1
+#define FANCTL_CFG_FAN_STATE	0x2
+#define FANCTL_CFG_THRESHOLD	0x4
+
+typedef struct fanctl_node_cfg
+{
+	u8	valid; // FANCTL_CFG_* bits
+	u8	fan_mode;
+	u8	fan_state;
+	s16	threshold_x100;
+}	fanctl_node_cfg_t;
+
+/* Link state of one node address (fanctl_link.c) */
+typedef struct fanctl_node_link
+{
+	bool	known; // the node answered or timed out at least once
+	u8	state; // FANCTL_LINK_*
+	u16	misses; // consecutive missed responses
+}	fanctl_node_link_t;
+
+/**
+ * fanctl_waiter
+ * -------------
+ * A request queued for ownership of the wire (see fanctl_sched.c).
+ * Lives on the stack of the submitting context.
+ */
+typedef struct fanctl_waiter
+{
+	struct list_head	node;
+	ktime_t			enq_ts; // time of submission
+	bool			granted; // ownership handed over (or aborted)
+	int			result; // 0, or -ENODEV if aborted by detach
+}	fanctl_waiter_t;
+
 /**
  * fanctl_ctx
  * ----------
@@ -22,27 +80,71 @@
  * - the tty line discipline RX path
  * - the userspace ioctl handler
  * 
+ * Several fan nodes may share the tty (multi-drop bus); each request
+ * carries the address of its node, PROTO_ADDR_NONE on a point-to-point link.
+ *
  * The driver follows a single synchronous request-response model:
- * only single command is allowed at a time.
+ * only single command is on the wire at a time. Callers queue for the
+ * wire in two priority classes, so actuation commands (CTRL) are sent
+ * before queued status polls (POLL).
+ *
+ * The context is reference counted: the attached ldisc holds one
+ * reference, and so does every ioctl which got it from
+ * fanctl_get_active_ctx(). It is freed by the last fanctl_ctx_put(),
+ * so a request still leaving the scheduler after the ldisc was
+ * detached never touches freed memory.
  */
 typedef struct fanctl_ctx
 {
 	/* Associated TTY device */
 	struct tty_struct	*tty;
+	struct kref		ref; // ldisc + ioctls in progress
 
 	/* Protocol RX state machine */
 	proto_rx_t		rx;
 
+	/* Request scheduler (serialize requests, CTRL before POLL) */
+	spinlock_t		sched_lock; // protect the scheduler state below
+	wait_queue_head_t	sched_wq; // queued requests wait here for the wire
+	struct list_head	sched_q[FANCTL_PRIO_NR]; // queued requests per class
+	bool			wire_busy; // a request currently owns the wire
+	bool			closing; // ldisc is being detached
+	u32			ctrl_streak; // CTRL grants in a row while POLL waits
+	struct fanctl_qclass_stats	qstats[FANCTL_PRIO_NR];
+
 	/* Locks */
-	struct mutex		req_lock; // serialize ioctl requests
 	spinlock_t		resp_lock; // protect last_resp (RX context)
 	struct completion	resp_done; // wait for matching response
 
 	/* Single synchronous request-response state */
 	bool			waiting; // true when waiting for a response
+	u8			pending_addr; // node address of the pending request
 	u8			pending_cmd; // command being waited for
 	u8			pending_seq; // sequence number of pending request
 	proto_frame_t		last_resp; // last received matching response
+	ktime_t			last_resp_ts; // RX completion time of last_resp
+	proto_trace_t		last_trace; // node timestamps trailing last_resp
+	bool			last_trace_valid; // last_resp carried a trace trailer
+	ktime_t			tx_ts; // time the pending request was written to the tty
+	ktime_t			last_rx_ts; // completion time of the last valid frame (any node)
+
+	/* Link keepalive (fanctl_link.c) */
+	spinlock_t		link_lock; // protect link_state..link_down
+	u8			link_state; // FANCTL_LINK_*, of the whole bus
+	u16			link_misses; // consecutive missed responses, any node
+	ktime_t			link_rx_ts; // time of the last response/push from a node
+	fanctl_node_link_t	nodes[256]; // link state per node address
+	u16			link_known; // nodes[] entries known
+	u16			link_up; // known nodes UP
+	u16			link_down; // known nodes DOWN
+	bool			rx_resync; // reset the RX parser before the next byte
+	u8			ka_addr; // last node that answered, first candidate of the idle probe
+	u8			ka_next; // next candidate of the lost node probe (round robin)
+	struct delayed_work	ka_work; // periodic keepalive probe
+	struct work_struct	recover_work; // restore node configuration after DOWN
+	DECLARE_BITMAP(recover, 256); // nodes back from DOWN, to be restored
+	struct mutex		cfg_lock; // protect cfg
+	fanctl_node_cfg_t	cfg[256]; // last applied configuration per node address
 
 	/* RX statistics (for future extension) */
 	u32			rx_frames; // successfully parsed frames
@@ -53,14 +155,70 @@ typedef struct fanctl_ctx
 int		fanctl_set_active_ctx(fanctl_ctx_t *ctx);
 void		fanctl_clear_active_ctx(fanctl_ctx_t *ctx);
 fanctl_ctx_t	*fanctl_get_active_ctx(void);
+void		fanctl_ctx_put(fanctl_ctx_t *ctx);
+
+void		fanctl_sched_init(fanctl_ctx_t *ctx);
+int		fanctl_sched_acquire(fanctl_ctx_t *ctx, int prio);
+void		fanctl_sched_release(fanctl_ctx_t *ctx);
+void		fanctl_sched_shutdown(fanctl_ctx_t *ctx);
+void		fanctl_sched_get_stats(fanctl_ctx_t *ctx, struct fanctl_qstats *out);
+int		fanctl_req_prio(u8 req_cmd);
 
-int		fanctl_do_req_wait_resp(fanctl_ctx_t *ctx,
+int		fanctl_do_req_wait_resp(fanctl_ctx_t *ctx, u8 addr,
 			u8 req_cmd, const u8 *payload, u8 len,
 			proto_frame_t *out_resp,
+			struct fanctl_times *out_times,
 			unsigned long timeout_jiffies);
+int		fanctl_do_req(fanctl_ctx_t *ctx, u8 addr,
+			u8 req_cmd, const u8 *payload, u8 len,
+			proto_frame_t *out_resp,
+			struct fanctl_times *out_times,
+			unsigned long timeout_jiffies, unsigned int flags);
 int		fanctl_write_frame(fanctl_ctx_t *ctx, const proto_frame_t *req);
 bool		fanctl_match_resp(fanctl_ctx_t *ctx, const proto_frame_t *resp);
 
+/* Link keepalive and recovery (fanctl_link.c) */
+void		fanctl_link_init(fanctl_ctx_t *ctx);
+void		fanctl_link_start(fanctl_ctx_t *ctx);
+void		fanctl_link_stop(fanctl_ctx_t *ctx);
+void		fanctl_link_note_rx(fanctl_ctx_t *ctx, const proto_frame_t *f);
+void		fanctl_link_note_timeout(fanctl_ctx_t *ctx, u8 addr);
+u8		fanctl_link_state(fanctl_ctx_t *ctx);
+u8		fanctl_link_node_state(fanctl_ctx_t *ctx, u8 addr);
+void		fanctl_link_get(fanctl_ctx_t *ctx, struct fanctl_link *out);
+void		fanctl_link_remember_cfg(fanctl_ctx_t *ctx, u8 addr, u8 cmd,
+			const u8 *payload);
+void		fanctl_link_notify(void);
+
+/* Raw byte-stream capture (fanctl_capture.c) */
+struct dentry;
+DECLARE_STATIC_KEY_FALSE(fanctl_cap_key);
+void		__fanctl_capture(u8 dir, const u8 *data, size_t len);
+void		fanctl_capture_register(struct dentry *dir);
+void		fanctl_capture_unregister(void);
+
+static inline void	fanctl_capture(u8 dir, const u8 *data, size_t len)
+{
+	if (static_branch_unlikely(&fanctl_cap_key))
+		__fanctl_capture(dir, data, len);
+}
+
+/* Per-request latency trace (fanctl_trace.c) */
+DECLARE_STATIC_KEY_FALSE(fanctl_trace_key);
+void		__fanctl_trace(const struct fanctl_trace_rec *rec);
+bool		fanctl_trace_node(void);
+void		fanctl_trace_register(struct dentry *dir);
+void		fanctl_trace_unregister(void);
+
+static inline bool	fanctl_tracing(void)
+{
+	return static_branch_unlikely(&fanctl_trace_key);
+}
+
+void		fanctl_ctx_init(fanctl_ctx_t *ctx, struct tty_struct *tty);
+void		fanctl_rx_bytes(fanctl_ctx_t *ctx, const u8 *cp, size_t count);
+long		fanctl_decode_ack_status(const proto_frame_t *resp);
+
 int		fanctl_ldisc_register(void);
 void		fanctl_ldisc_unregister(void);
 int		fanctl_chardev_register(void);
@@ -0,0 +1,175 @@
+#include "fanctl.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+#include <linux/relay.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/atomic.h>
+
+/*
+ * Raw byte-stream capture
+ * -----------------------
+ * When enabled, every RX chunk (fanctl_receive_buf) and every TX chunk
+ * accepted by the tty (fanctl_write_frame) is copied with a timestamp
+ * into a per-CPU relay channel:
+ *
+ *   /sys/kernel/debug/fanctl/capture_enable   write 1/0 to start/stop
+ *   /sys/kernel/debug/fanctl/capture_dropped  records lost (buffers full)
+ *   /sys/kernel/debug/fanctl/capture0..N      per-CPU record streams
+ *
+ * Record format: common/fanctl_cap.h
+ *
+ * The hot paths test a static key, so a disabled capture costs a single
+ * patched-out branch. The relay channel is allocated on first enable and
+ * kept until the module is unloaded, so a capture can be read after it
+ * was stopped.
+ */
+
+#define FANCTL_CAP_SUBBUF_SIZE	(64 * 1024)
+#define FANCTL_CAP_N_SUBBUFS	8
+
+DEFINE_STATIC_KEY_FALSE(fanctl_cap_key);
+
+static DEFINE_MUTEX(g_cap_lock); // serialize enable/disable
+static struct rchan	*g_cap_chan;
+static atomic_t		g_cap_dropped = ATOMIC_INIT(0); // records lost, bumped from every CPU
+
+static struct dentry	*fanctl_cap_create_buf_file(const char *filename,
+				struct dentry *parent, umode_t mode,
+				struct rchan_buf *buf, int *is_global)
+{
+	return debugfs_create_file(filename, mode, parent, buf,
+				&relay_file_operations);
+}
+
+static int	fanctl_cap_remove_buf_file(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+	return 0;
+}
+
+static const struct rchan_callbacks	fanctl_cap_cb = {
+	.create_buf_file = fanctl_cap_create_buf_file,
+	.remove_buf_file = fanctl_cap_remove_buf_file,
+};
+
+/*
+ * Called from the RX path (deferred tty processing) and from the
+ * request path, never sleeps. Interrupts are disabled around the
+ * reservation so the per-CPU buffer cannot be switched under us.
+ */
+void	__fanctl_capture(u8 dir, const u8 *data, size_t len)
+{
+	struct fanctl_cap_rec	rec;
+	unsigned long		flags;
+	size_t			chunk;
+	u8			*p;
+
+	if (!g_cap_chan)
+		return;
+	rec.ts_ns = ktime_to_ns(ktime_get());
+	rec.magic = FANCTL_CAP_MAGIC;
+	rec.dir = dir;
+	memset(rec.rsvd, 0, sizeof(rec.rsvd));
+	while (len > 0)
+	{
+		chunk = min_t(size_t, len, FANCTL_CAP_MAX_CHUNK);
+		rec.len = (u16)chunk;
+		local_irq_save(flags);
+		p = relay_reserve(g_cap_chan, sizeof(rec) + chunk);
+		if (p)
+		{
+			memcpy(p, &rec, sizeof(rec));
+			memcpy(p + sizeof(rec), data, chunk);
+		}
+		else
+			atomic_inc(&g_cap_dropped);
+		local_irq_restore(flags);
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+static int	fanctl_cap_set_enabled(struct dentry *dir, bool enable)
+{
+	int	ret;
+
+	ret = 0;
+	mutex_lock(&g_cap_lock);
+	if (enable && !g_cap_chan)
+	{
+		g_cap_chan = relay_open("capture", dir, FANCTL_CAP_SUBBUF_SIZE,
+					FANCTL_CAP_N_SUBBUFS, &fanctl_cap_cb, NULL);
+		if (!g_cap_chan)
+			ret = -ENOMEM;
+	}
+	if (!ret && enable)
+		static_branch_enable(&fanctl_cap_key);
+	else if (!enable)
+	{
+		static_branch_disable(&fanctl_cap_key);
+		if (g_cap_chan)
+			relay_flush(g_cap_chan); // make partial sub-buffers readable
+	}
+	mutex_unlock(&g_cap_lock);
+	return ret;
+}
+
+static ssize_t	fanctl_cap_enable_read(struct file *filp, char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	char	buf[3];
+
+	buf[0] = static_key_enabled(&fanctl_cap_key) ? '1' : '0';
+	buf[1] = '\n';
+	buf[2] = '\0';
+	return simple_read_from_buffer(ubuf, count, ppos, buf, 2);
+}
+
+static ssize_t	fanctl_cap_enable_write(struct file *filp, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	bool	enable;
+	int	ret;
+
+	ret = kstrtobool_from_user(ubuf, count, &enable);
+	if (ret)
+		return ret;
+	ret = fanctl_cap_set_enabled(filp->f_path.dentry->d_parent, enable);
+	if (ret)
+		return ret;
+	return count;
+}
+
+static const struct file_operations	fanctl_cap_enable_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = fanctl_cap_enable_read,
+	.write = fanctl_cap_enable_write,
+	.llseek = default_llseek,
+};
+
+void	fanctl_capture_register(struct dentry *dir)
+{
+	if (IS_ERR_OR_NULL(dir))
+		return;
+	debugfs_create_file("capture_enable", 0600, dir, NULL,
+			&fanctl_cap_enable_fops);
+	debugfs_create_atomic_t("capture_dropped", 0400, dir, &g_cap_dropped);
+}
+
+void	fanctl_capture_unregister(void)
+{
+	mutex_lock(&g_cap_lock);
+	static_branch_disable(&fanctl_cap_key);
+	if (g_cap_chan)
+	{
+		relay_close(g_cap_chan);
+		g_cap_chan = NULL;
+	}
+	mutex_unlock(&g_cap_lock);
+}
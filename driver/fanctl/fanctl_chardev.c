@@ -6,18 +6,34 @@
 #include <linux/miscdevice.h>
 #include <linux/uaccess.h>
 #include <linux/jiffies.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/atomic.h>
 
 #include "fanctl_uapi.h"
 
 static DEFINE_MUTEX(g_ctx_lock);
 static fanctl_ctx_t *g_active_ctx;
 
+/* Link state change reporting, outlives the per-tty context */
+static DECLARE_WAIT_QUEUE_HEAD(g_link_wq);
+static atomic_t g_link_changes = ATOMIC_INIT(0);
+
+/* Per open file state of /dev/fanctl */
+typedef struct fanctl_file
+{
+	u8	addr; // node addressed by this file (FANCTL_IOC_SET_ADDR)
+	u32	link_seen; // g_link_changes when the link state was last read
+}	fanctl_file_t;
+
 static u16	fanctl_parse_be16(const u8 *p)
 {
 	return ((u16)p[0] << 8) | p[1];
 }
 
-static long	fanctl_decode_ack_status(proto_frame_t *resp)
+long	fanctl_decode_ack_status(const proto_frame_t *resp)
 {
 	u8	status;
 
@@ -35,6 +51,21 @@ static long	fanctl_decode_ack_status(proto_frame_t *resp)
 	return -EPROTO;
 }
 
+static long	fanctl_decode_status(const proto_frame_t *resp, struct fanctl_status *st)
+{
+	const u8	*p;
+
+	if (resp->cmd != PROTO_CMD_STATUS_RESP || resp->len < sizeof(status_resp_t))
+		return -EPROTO;
+	p = resp->payload;
+	st->temp_x100 = (u16)fanctl_parse_be16(p);
+	st->humidity_x100 = (u16)fanctl_parse_be16(p + 2);
+	st->fan_mode = p[4];
+	st->fan_state = p[5];
+	st->errors = (u16)fanctl_parse_be16(p + 6);
+	return 0;
+}
+
 int	fanctl_set_active_ctx(fanctl_ctx_t *ctx)
 {
 	int	ret;
@@ -57,50 +88,165 @@ void	fanctl_clear_active_ctx(fanctl_ctx_t *ctx)
 	mutex_unlock(&g_ctx_lock);
 }
 
+/* The active context with a reference held, release it with fanctl_ctx_put() */
 fanctl_ctx_t	*fanctl_get_active_ctx(void)
 {
 	fanctl_ctx_t	*ctx;
 
 	mutex_lock(&g_ctx_lock);
 	ctx = g_active_ctx;
+	if (ctx)
+		kref_get(&ctx->ref);
 	mutex_unlock(&g_ctx_lock);
 	return ctx;
 }
 
-static long	fanctl_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+/* Report a link state change (incl. attach/detach) to pollers. */
+void	fanctl_link_notify(void)
+{
+	atomic_inc(&g_link_changes);
+	wake_up_interruptible(&g_link_wq);
+}
+
+static int	fanctl_fop_open(struct inode *inode, struct file *filp)
+{
+	fanctl_file_t	*f;
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f)
+		return -ENOMEM;
+	f->addr = PROTO_ADDR_NONE;
+	f->link_seen = atomic_read(&g_link_changes);
+	filp->private_data = f;
+	return 0;
+}
+
+/*
+ * poll()/epoll(): EPOLLPRI (and EPOLLIN) when the link state changed
+ * since this file last read it with FANCTL_IOC_GET_LINK.
+ */
+static __poll_t	fanctl_fop_poll(struct file *filp, poll_table *wait)
+{
+	fanctl_file_t	*f = filp->private_data;
+
+	poll_wait(filp, &g_link_wq, wait);
+	if ((u32)atomic_read(&g_link_changes) != READ_ONCE(f->link_seen))
+		return EPOLLPRI | EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+static long	fanctl_get_link(fanctl_file_t *f, unsigned long arg)
+{
+	struct fanctl_link	link;
+	fanctl_ctx_t		*ctx;
+	u32			changes;
+
+	memset(&link, 0, sizeof(link));
+	changes = atomic_read(&g_link_changes);
+	ctx = fanctl_get_active_ctx();
+	if (ctx)
+	{
+		fanctl_link_get(ctx, &link);
+		fanctl_ctx_put(ctx);
+	}
+	else
+		link.state = FANCTL_LINK_DOWN;
+	link.changes = changes;
+	if (copy_to_user((void __user *)arg, &link, sizeof(link)))
+		return -EFAULT;
+	WRITE_ONCE(f->link_seen, changes);
+	return 0;
+}
+
+static int	fanctl_fop_release(struct inode *inode, struct file *filp)
+{
+	kfree(filp->private_data);
+	return 0;
+}
+
+/*
+ * Decode the ACK of a SET_* request (broadcasts are never answered),
+ * and remember the applied setting for link recovery.
+ */
+static long	fanctl_set_result(fanctl_ctx_t *ctx, u8 addr, u8 cmd,
+				const u8 *payload, proto_frame_t *resp)
+{
+	long	ret;
+
+	ret = 0;
+	if (addr != PROTO_ADDR_BROADCAST)
+		ret = fanctl_decode_ack_status(resp);
+	if (!ret)
+		fanctl_link_remember_cfg(ctx, addr, cmd, payload);
+	return ret;
+}
+
+/* Requests to the node of this file, with a reference on ctx held */
+static long	fanctl_ctx_ioctl(fanctl_file_t *f, fanctl_ctx_t *ctx,
+				unsigned int cmd, unsigned long arg)
 {
 	int		ret;
 	u8		payload[2];
+	u8		addr;
 	proto_frame_t	resp;
 
-	fanctl_ctx_t *ctx = fanctl_get_active_ctx();
-	if (!ctx) // when fanctl_open() is not called yet
-		return -ENODEV;
+	addr = f->addr;
+	if (addr == PROTO_ADDR_BROADCAST && (cmd == FANCTL_IOC_PING
+			|| cmd == FANCTL_IOC_PING_EXT
+			|| cmd == FANCTL_IOC_GET_STATUS
+			|| cmd == FANCTL_IOC_GET_STATUS_EXT))
+		return -EINVAL; // requests expecting a response need a single node
 	switch (cmd)
 	{
 	case FANCTL_IOC_PING:
-		return fanctl_do_req_wait_resp(ctx, PROTO_CMD_PING,
-						NULL, 0, &resp,
+		return fanctl_do_req_wait_resp(ctx, addr, PROTO_CMD_PING,
+						NULL, 0, &resp, NULL,
 						msecs_to_jiffies(1000));
 
+	case FANCTL_IOC_PING_EXT:
+		{
+			struct fanctl_times	times;
+
+			ret = fanctl_do_req_wait_resp(ctx, addr, PROTO_CMD_PING,
+							NULL, 0, &resp, &times,
+							msecs_to_jiffies(1000));
+			if (ret)
+				return ret;
+			if (copy_to_user((void __user *)arg, &times, sizeof(times)))
+				return -EFAULT;
+			return 0;
+		}
+
 	case FANCTL_IOC_GET_STATUS:
 		{
 			struct fanctl_status	st;
-			const u8		*p;
 
-			ret = fanctl_do_req_wait_resp(ctx, PROTO_CMD_STATUS_REQ,
-							NULL, 0, &resp,
+			ret = fanctl_do_req_wait_resp(ctx, addr, PROTO_CMD_STATUS_REQ,
+							NULL, 0, &resp, NULL,
+							msecs_to_jiffies(1000));
+			if (ret)
+				return ret;
+			ret = fanctl_decode_status(&resp, &st);
+			if (ret)
+				return ret;
+			if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+				return -EFAULT;
+			return 0;
+		}
+
+	case FANCTL_IOC_GET_STATUS_EXT:
+		{
+			struct fanctl_status_ext	st;
+
+			memset(&st, 0, sizeof(st));
+			ret = fanctl_do_req_wait_resp(ctx, addr, PROTO_CMD_STATUS_REQ,
+							NULL, 0, &resp, &st.times,
 							msecs_to_jiffies(1000));
 			if (ret)
 				return ret;
-			if (resp.cmd != PROTO_CMD_STATUS_RESP || resp.len < sizeof(status_resp_t))
-				return -EPROTO;
-			p = resp.payload;
-			st.temp_x100 = (u16)fanctl_parse_be16(p);
-			st.humidity_x100 = (u16)fanctl_parse_be16(p + 2);
-			st.fan_mode = p[4];
-			st.fan_state = p[5];
-			st.errors = (u16)fanctl_parse_be16(p + 6);
+			ret = fanctl_decode_status(&resp, &st.status);
+			if (ret)
+				return ret;
 			if (copy_to_user((void __user *)arg, &st, sizeof(st)))
 				return -EFAULT;
 			return 0;
@@ -113,12 +259,13 @@ static long	fanctl_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned
 			if (copy_from_user(&mode, (void __user *)arg, sizeof(mode)))
 				return -EFAULT;
 			payload[0] = mode;
-			ret = fanctl_do_req_wait_resp(ctx, PROTO_CMD_SET_FAN_MODE,
-							payload, 1, &resp,
+			ret = fanctl_do_req_wait_resp(ctx, addr, PROTO_CMD_SET_FAN_MODE,
+							payload, 1, &resp, NULL,
 							msecs_to_jiffies(1000));
 			if (ret)
 				return ret;
-			return fanctl_decode_ack_status(&resp);
+			return fanctl_set_result(ctx, addr, PROTO_CMD_SET_FAN_MODE,
+					payload, &resp);
 		}
 
 	case FANCTL_IOC_SET_FAN_STATE:
@@ -128,12 +275,13 @@ static long	fanctl_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned
 			if (copy_from_user(&state, (void __user *)arg, sizeof(state)))
 				return -EFAULT;
 			payload[0] = state;
-			ret = fanctl_do_req_wait_resp(ctx, PROTO_CMD_SET_FAN_STATE,
-							payload, 1, &resp, 
+			ret = fanctl_do_req_wait_resp(ctx, addr, PROTO_CMD_SET_FAN_STATE,
+							payload, 1, &resp, NULL,
 							msecs_to_jiffies(1000));
 			if (ret)
 				return ret;
-			return fanctl_decode_ack_status(&resp);
+			return fanctl_set_result(ctx, addr, PROTO_CMD_SET_FAN_STATE,
+					payload, &resp);
 		}
 
 	case FANCTL_IOC_SET_THRESHOLD:
@@ -144,12 +292,23 @@ static long	fanctl_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned
 				return -EFAULT;
 			payload[0] = (u8)((temp_x100 >> 8) & 0xFF);
 			payload[1] = (u8)(temp_x100 & 0xFF);
-			ret = fanctl_do_req_wait_resp(ctx, PROTO_CMD_SET_THRESHOLD,
-						payload, 2, &resp,
+			ret = fanctl_do_req_wait_resp(ctx, addr, PROTO_CMD_SET_THRESHOLD,
+						payload, 2, &resp, NULL,
 						msecs_to_jiffies(1000));
 			if (ret)
 				return ret;
-			return fanctl_decode_ack_status(&resp);
+			return fanctl_set_result(ctx, addr, PROTO_CMD_SET_THRESHOLD,
+					payload, &resp);
+		}
+
+	case FANCTL_IOC_GET_QSTATS:
+		{
+			struct fanctl_qstats	qs;
+
+			fanctl_sched_get_stats(ctx, &qs);
+			if (copy_to_user((void __user *)arg, &qs, sizeof(qs)))
+				return -EFAULT;
+			return 0;
 		}
 
 	default:
@@ -157,6 +316,31 @@ static long	fanctl_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned
 	}
 }
 
+static long	fanctl_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+	fanctl_file_t	*f = filp->private_data;
+	fanctl_ctx_t	*ctx;
+	long		ret;
+	u8		addr;
+
+	if (cmd == FANCTL_IOC_SET_ADDR) // per file, does not need the node
+	{
+		if (copy_from_user(&addr, (void __user *)arg, sizeof(addr)))
+			return -EFAULT;
+		f->addr = addr;
+		return 0;
+	}
+	if (cmd == FANCTL_IOC_GET_LINK) // also reports a detached ldisc
+		return fanctl_get_link(f, arg);
+
+	ctx = fanctl_get_active_ctx();
+	if (!ctx) // when fanctl_open() is not called yet
+		return -ENODEV;
+	ret = fanctl_ctx_ioctl(f, ctx, cmd, arg);
+	fanctl_ctx_put(ctx); // may free it, if the ldisc was detached meanwhile
+	return ret;
+}
+
 /*
  * .owner = THIS_MODULE
  * --------------------
@@ -173,6 +357,9 @@ static long	fanctl_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned
  */
 static const struct file_operations fanctl_fops = {
 	.owner = THIS_MODULE,
+	.open = fanctl_fop_open,
+	.release = fanctl_fop_release,
+	.poll = fanctl_fop_poll,
 	.unlocked_ioctl = fanctl_unlocked_ioctl,
 };
 
@@ -7,10 +7,29 @@
 #include <linux/sched.h>
 #include <linux/tty.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+
+/*
+ * Multi-drop bus arbitration
+ * --------------------------
+ * Only the host initiates transfers; a node answers within its slot or
+ * not at all. Addressed requests therefore wait at most `slot_ms` for
+ * their response, and the host leaves `bus_guard_us` of idle time after
+ * the last received frame before driving the bus again, so an RS-485
+ * transceiver on the node side has released the line.
+ */
+static unsigned int	slot_ms = 250;
+module_param(slot_ms, uint, 0644);
+MODULE_PARM_DESC(slot_ms, "response slot for addressed requests (ms)");
+
+static unsigned int	bus_guard_us = 500;
+module_param(bus_guard_us, uint, 0644);
+MODULE_PARM_DESC(bus_guard_us, "bus turnaround time before addressed requests (us)");
 
 bool	fanctl_match_resp(fanctl_ctx_t *ctx, const proto_frame_t *resp)
 {
-	if (resp->seq != ctx->pending_seq)
+	if (resp->addr != ctx->pending_addr || resp->seq != ctx->pending_seq)
 		return false;
 	if (ctx->pending_cmd == PROTO_CMD_PING && resp->cmd == PROTO_CMD_PONG)
 		return true;
@@ -28,7 +47,7 @@ bool	fanctl_match_resp(fanctl_ctx_t *ctx, const proto_frame_t *resp)
 
 int	fanctl_write_frame(fanctl_ctx_t *ctx, const proto_frame_t *req)
 {
-	u8		buf[2 + 3 + PROTO_MAX_PAYLOAD + 2];
+	u8		buf[PROTO_MAX_FRAME];
 	u16		out_len = 0;
 	int		ret;
 	int		offset = 0;
@@ -40,7 +59,8 @@ int	fanctl_write_frame(fanctl_ctx_t *ctx, const proto_frame_t *req)
 	if (!ctx->tty || !ctx->tty->ops || !ctx->tty->ops->write)
 		return -ENODEV;
 
-	if (!proto_build_frame(req->cmd, req->seq, req->payload, req->len, buf, &out_len))
+	if (!proto_build_frame_addr(req->addr, req->cmd, req->seq, req->payload,
+				req->len, buf, &out_len))
 		return -EINVAL;
 
 	deadline = jiffies + msecs_to_jiffies(1000);
@@ -64,39 +84,140 @@ int	fanctl_write_frame(fanctl_ctx_t *ctx, const proto_frame_t *req)
 			usleep_range(1000, 2000);
 			continue;
 		}
+		fanctl_capture(FANCTL_CAP_DIR_TX, buf + offset, ret);
 		offset += ret;
 	}
 	return 0;
 }
 
-int	fanctl_do_req_wait_resp(fanctl_ctx_t *ctx, u8 req_cmd, const u8 *payload,
+/* Leave the bus idle for bus_guard_us after the last frame received. */
+static void	fanctl_bus_guard(fanctl_ctx_t *ctx)
+{
+	s64	idle_us;
+	s64	guard_us;
+
+	guard_us = READ_ONCE(bus_guard_us);
+	idle_us = ktime_us_delta(ktime_get(), READ_ONCE(ctx->last_rx_ts));
+	if (idle_us < guard_us)
+		usleep_range(guard_us - idle_us, guard_us - idle_us + 100);
+}
+
+int	fanctl_do_req_wait_resp(fanctl_ctx_t *ctx, u8 addr, u8 req_cmd, const u8 *payload,
 				u8 len, proto_frame_t *out_resp,
+				struct fanctl_times *out_times,
 				unsigned long timeout_jiffies)
+{
+	return fanctl_do_req(ctx, addr, req_cmd, payload, len, out_resp,
+			out_times, timeout_jiffies, 0);
+}
+
+/* Complete and emit the trace record of a request (fanctl_trace.c) */
+static void	fanctl_trace_req(struct fanctl_trace_rec *rec, int ret)
+{
+	rec->done_ns = ktime_get_ns();
+	rec->result = ret;
+	__fanctl_trace(rec);
+}
+
+/* Requests other than keepalive probes fail fast while their node is DOWN */
+static bool	fanctl_req_nolink(fanctl_ctx_t *ctx, u8 addr, unsigned int flags)
+{
+	return !(flags & FANCTL_REQ_PROBE)
+		&& fanctl_link_node_state(ctx, addr) == FANCTL_LINK_DOWN;
+}
+
+int	fanctl_do_req(fanctl_ctx_t *ctx, u8 addr, u8 req_cmd, const u8 *payload,
+			u8 len, proto_frame_t *out_resp,
+			struct fanctl_times *out_times,
+			unsigned long timeout_jiffies, unsigned int flags)
 {
 	int		ret;
-	unsigned long	flags;
+	unsigned long	irqflags;
 	proto_frame_t	req;
+	ktime_t		rx_ts;
+	proto_trace_t	node_trace;
+	bool		node_traced;
+	struct fanctl_trace_rec	trace;
+	bool		tracing;
 
 	if (!ctx || !out_resp || len > PROTO_MAX_PAYLOAD || (len && !payload))
 		return -EINVAL;
 
-	mutex_lock(&ctx->req_lock); // ensure one request at a time
+	tracing = fanctl_tracing();
+	if (tracing)
+	{
+		memset(&trace, 0, sizeof(trace));
+		trace.submit_ns = ktime_get_ns();
+		trace.magic = FANCTL_TRACE_MAGIC;
+		trace.addr = addr;
+		trace.cmd = req_cmd;
+	}
+
+	// node lost: fail fast, without queueing for the wire
+	if (fanctl_req_nolink(ctx, addr, flags))
+	{
+		if (tracing)
+			fanctl_trace_req(&trace, -ENOLINK);
+		return -ENOLINK;
+	}
+	// ensure one request at a time, actuation commands first
+	ret = fanctl_sched_acquire(ctx, fanctl_req_prio(req_cmd));
+	if (ret)
+	{
+		if (tracing)
+			fanctl_trace_req(&trace, ret);
+		return ret;
+	}
+	// the node may have been lost while this request was queued
+	if (fanctl_req_nolink(ctx, addr, flags))
+	{
+		fanctl_sched_release(ctx);
+		if (tracing)
+			fanctl_trace_req(&trace, -ENOLINK);
+		return -ENOLINK;
+	}
+	if (tracing)
+		trace.grant_ns = ktime_get_ns();
+
+	if (addr != PROTO_ADDR_NONE)
+	{
+		fanctl_bus_guard(ctx);
+		timeout_jiffies = min(timeout_jiffies,
+				msecs_to_jiffies(READ_ONCE(slot_ms)));
+	}
 
-	ctx->waiting = true;
+	ctx->pending_addr = addr;
 	ctx->pending_cmd = req_cmd;
 	ctx->pending_seq = (u8)(ctx->pending_seq + 1);
 	reinit_completion(&ctx->resp_done);
+	ctx->waiting = addr != PROTO_ADDR_BROADCAST;
 
 	memset(&req, 0, sizeof(req));
+	req.addr = addr;
 	req.cmd = req_cmd;
 	req.seq = ctx->pending_seq;
 	req.len = len;
 	if (len)
 		memcpy(req.payload, payload, len);
+	if (tracing)
+	{
+		trace.seq = req.seq;
+		// ask the node for its timestamps, pending_cmd stays unflagged
+		if (addr != PROTO_ADDR_BROADCAST && fanctl_trace_node())
+			req.cmd |= PROTO_CMD_F_TRACE;
+	}
 
 	ret = fanctl_write_frame(ctx, &req);
 	if (ret)
 		goto out;
+	ctx->tx_ts = ktime_get();
+	if (tracing)
+		trace.tx_ns = ktime_to_ns(ctx->tx_ts);
+	if (addr == PROTO_ADDR_BROADCAST) // nodes never answer broadcasts
+	{
+		memset(out_resp, 0, sizeof(*out_resp));
+		goto out;
+	}
 
 	/*
 	 * Sleep until the RX callback(fanctl_receive_buf) wakes
@@ -104,18 +225,46 @@ int	fanctl_do_req_wait_resp(fanctl_ctx_t *ctx, u8 req_cmd, const u8 *payload,
 	 */
 	if (!wait_for_completion_timeout(&ctx->resp_done, timeout_jiffies))
 	{
+		fanctl_link_note_timeout(ctx, addr);
 		ret = -ETIMEDOUT;
 		goto out;
 	}
+	if (READ_ONCE(ctx->closing)) // woken up by fanctl_close()
+	{
+		ret = -ENODEV;
+		goto out;
+	}
 
-	spin_lock_irqsave(&ctx->resp_lock, flags);
+	spin_lock_irqsave(&ctx->resp_lock, irqflags);
 	*out_resp = ctx->last_resp;
-	spin_unlock_irqrestore(&ctx->resp_lock, flags);
+	rx_ts = ctx->last_resp_ts;
+	node_trace = ctx->last_trace;
+	node_traced = ctx->last_trace_valid;
+	spin_unlock_irqrestore(&ctx->resp_lock, irqflags);
+	if (out_times)
+	{
+		out_times->tx_ns = ktime_to_ns(ctx->tx_ts);
+		out_times->rx_ns = ktime_to_ns(rx_ts);
+	}
+	if (tracing)
+	{
+		trace.rx_ns = ktime_to_ns(rx_ts);
+		if (node_traced)
+		{
+			trace.flags |= FANCTL_TRACE_F_NODE;
+			trace.node_parse_us = node_trace.parse_us;
+			trace.node_dequeue_us = node_trace.dequeue_us;
+			trace.node_handler_us = node_trace.handler_us;
+			trace.node_send_us = node_trace.send_us;
+		}
+	}
 
 	ret = 0;
 
 out:
 	ctx->waiting = false;
-	mutex_unlock(&ctx->req_lock);
+	fanctl_sched_release(ctx);
+	if (tracing)
+		fanctl_trace_req(&trace, ret);
 	return ret;
 }
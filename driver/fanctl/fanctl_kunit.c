@@ -0,0 +1,795 @@
+#include "fanctl.h"
+
+#include <kunit/test.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
+#include <linux/moduleparam.h>
+#include <linux/version.h>
+
+/*
+ * KUnit suites
+ * ------------
+ * - fanctl_proto: framing and resync of proto_rx_feed() as built into the module
+ * - fanctl_match: response matching and ACK status decoding
+ * - fanctl_req:   request/response flow of fanctl_do_req() over an in-memory
+ *                 loopback tty (completion, timeout, stale responses, link state)
+ * - fanctl_bench: ns/byte of the parser and ns/request over the loopback tty
+ *
+ *   ./tools/testing/kunit/kunit.py run --kunitconfig=drivers/tty/fanctl
+ *
+ * The benchmarks only report their numbers unless a limit is given on the
+ * kernel command line (fanctl.bench_max_ns_byte=, fanctl.bench_max_ns_req=),
+ * in which case exceeding it fails the test.
+ */
+
+static unsigned int	bench_max_ns_byte;
+module_param(bench_max_ns_byte, uint, 0444);
+MODULE_PARM_DESC(bench_max_ns_byte, "KUnit: fail the parser benchmark above this ns/byte (0 = report only)");
+
+static unsigned int	bench_max_ns_req;
+module_param(bench_max_ns_req, uint, 0444);
+MODULE_PARM_DESC(bench_max_ns_req, "KUnit: fail the loopback benchmark above this ns/request (0 = report only)");
+
+#define FANCTL_TEST_TIMEOUT_MS	20
+
+/* Feed a buffer, return the number of frames parsed, keep the last one */
+static int	feed(proto_rx_t *rx, const u8 *buf, size_t len, proto_frame_t *out)
+{
+	int	n;
+	size_t	i;
+
+	n = 0;
+	for (i = 0; i < len; i++)
+		if (proto_rx_feed(rx, buf[i], out))
+			n++;
+	return n;
+}
+
+static u16	build(u8 addr, u8 cmd, u8 seq, const u8 *payload, u8 len, u8 *out)
+{
+	u16	out_len;
+
+	if (!proto_build_frame_addr(addr, cmd, seq, payload, len, out, &out_len))
+		return 0;
+	return out_len;
+}
+
+/* fanctl_proto ------------------------------------------------------------- */
+
+static void	proto_test_roundtrip_legacy(struct kunit *test)
+{
+	const u8	payload[] = { 0x01 };
+	u8		buf[PROTO_MAX_FRAME];
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	u16		len;
+
+	len = build(PROTO_ADDR_NONE, PROTO_CMD_SET_FAN_MODE, 7, payload, 1, buf);
+	KUNIT_ASSERT_EQ(test, len, 2 + 3 + 1 + 2);
+	KUNIT_EXPECT_EQ(test, buf[1], PROTO_SYNC1);
+	proto_rx_init(&rx);
+	KUNIT_ASSERT_EQ(test, feed(&rx, buf, len, &f), 1);
+	KUNIT_EXPECT_EQ(test, f.addr, PROTO_ADDR_NONE);
+	KUNIT_EXPECT_EQ(test, f.cmd, PROTO_CMD_SET_FAN_MODE);
+	KUNIT_EXPECT_EQ(test, f.seq, 7);
+	KUNIT_EXPECT_EQ(test, f.len, 1);
+	KUNIT_EXPECT_EQ(test, f.payload[0], 0x01);
+}
+
+static void	proto_test_roundtrip_addressed(struct kunit *test)
+{
+	const u8	payload[] = { 0x0A, 0x28 };
+	u8		buf[PROTO_MAX_FRAME];
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	u16		len;
+
+	len = build(0x12, PROTO_CMD_SET_THRESHOLD, 200, payload, 2, buf);
+	KUNIT_ASSERT_EQ(test, len, 2 + 1 + 3 + 2 + 2);
+	KUNIT_EXPECT_EQ(test, buf[1], PROTO_SYNC1_ADDR);
+	proto_rx_init(&rx);
+	KUNIT_ASSERT_EQ(test, feed(&rx, buf, len, &f), 1);
+	KUNIT_EXPECT_EQ(test, f.addr, 0x12);
+	KUNIT_EXPECT_EQ(test, f.seq, 200);
+	KUNIT_EXPECT_EQ(test, f.payload[1], 0x28);
+}
+
+static void	proto_test_max_payload(struct kunit *test)
+{
+	u8		payload[PROTO_MAX_PAYLOAD + 1];
+	u8		buf[PROTO_MAX_FRAME];
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	u16		len;
+	int		i;
+
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = (u8)(0xA0 + i);
+	KUNIT_EXPECT_EQ(test, build(1, PROTO_CMD_PING, 1, payload, PROTO_MAX_PAYLOAD + 1, buf), 0);
+	len = build(1, PROTO_CMD_PING, 1, payload, PROTO_MAX_PAYLOAD, buf);
+	KUNIT_ASSERT_EQ(test, len, PROTO_MAX_FRAME);
+	proto_rx_init(&rx);
+	KUNIT_ASSERT_EQ(test, feed(&rx, buf, len, &f), 1);
+	KUNIT_EXPECT_EQ(test, f.len, PROTO_MAX_PAYLOAD);
+	KUNIT_EXPECT_EQ(test, memcmp(f.payload, payload, PROTO_MAX_PAYLOAD), 0);
+}
+
+/* payload bytes equal to SYNC0/SYNC1 must not restart the frame */
+static void	proto_test_sync_in_payload(struct kunit *test)
+{
+	const u8	payload[] = { PROTO_SYNC0, PROTO_SYNC1, PROTO_SYNC0, PROTO_SYNC1_ADDR };
+	u8		buf[PROTO_MAX_FRAME];
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	u16		len;
+
+	len = build(PROTO_ADDR_NONE, PROTO_CMD_STATUS_RESP, 3, payload, sizeof(payload), buf);
+	proto_rx_init(&rx);
+	KUNIT_ASSERT_EQ(test, feed(&rx, buf, len, &f), 1);
+	KUNIT_EXPECT_EQ(test, memcmp(f.payload, payload, sizeof(payload)), 0);
+}
+
+static void	proto_test_crc_error(struct kunit *test)
+{
+	const u8	payload[] = { 0x01 };
+	u8		buf[PROTO_MAX_FRAME];
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	u16		len;
+
+	len = build(PROTO_ADDR_NONE, PROTO_CMD_SET_FAN_STATE, 9, payload, 1, buf);
+	proto_rx_init(&rx);
+	buf[5] ^= 0x01;
+	KUNIT_EXPECT_EQ(test, feed(&rx, buf, len, &f), 0);
+	buf[5] ^= 0x01; // the parser is back in sync for the next frame
+	KUNIT_EXPECT_EQ(test, feed(&rx, buf, len, &f), 1);
+	KUNIT_EXPECT_EQ(test, f.seq, 9);
+}
+
+/* the address is covered by the CRC */
+static void	proto_test_addr_in_crc(struct kunit *test)
+{
+	u8		buf[PROTO_MAX_FRAME];
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	u16		len;
+
+	len = build(0x03, PROTO_CMD_PONG, 1, NULL, 0, buf);
+	buf[2] = 0x04;
+	proto_rx_init(&rx);
+	KUNIT_EXPECT_EQ(test, feed(&rx, buf, len, &f), 0);
+}
+
+static void	proto_test_oversize_len(struct kunit *test)
+{
+	const u8	bad[] = { PROTO_SYNC0, PROTO_SYNC1, PROTO_CMD_PONG, 1, PROTO_MAX_PAYLOAD + 1 };
+	u8		buf[PROTO_MAX_FRAME];
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	u16		len;
+
+	proto_rx_init(&rx);
+	KUNIT_EXPECT_EQ(test, feed(&rx, bad, sizeof(bad), &f), 0);
+	KUNIT_EXPECT_EQ(test, rx.st, RX_SYNC0);
+	len = build(PROTO_ADDR_NONE, PROTO_CMD_PONG, 2, NULL, 0, buf);
+	KUNIT_EXPECT_EQ(test, feed(&rx, buf, len, &f), 1);
+}
+
+static void	proto_test_garbage_prefix(struct kunit *test)
+{
+	const u8	junk[] = { 0x00, 0xFF, PROTO_SYNC0, 0x12, PROTO_SYNC1, 0x55, 0xAA };
+	u8		buf[PROTO_MAX_FRAME];
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	u16		len;
+
+	proto_rx_init(&rx);
+	KUNIT_EXPECT_EQ(test, feed(&rx, junk, sizeof(junk), &f), 0);
+	// junk ends with SYNC0: the frame's own SYNC0 must still start it
+	len = build(PROTO_ADDR_NONE, PROTO_CMD_PONG, 5, NULL, 0, buf);
+	KUNIT_ASSERT_EQ(test, feed(&rx, buf, len, &f), 1);
+	KUNIT_EXPECT_EQ(test, f.seq, 5);
+}
+
+static void	proto_test_back_to_back(struct kunit *test)
+{
+	u8		buf[3 * PROTO_MAX_FRAME];
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	u16		len;
+
+	len = build(PROTO_ADDR_NONE, PROTO_CMD_PONG, 1, NULL, 0, buf);
+	len += build(0x20, PROTO_CMD_PONG, 2, NULL, 0, buf + len);
+	len += build(PROTO_ADDR_NONE, PROTO_CMD_PONG, 3, NULL, 0, buf + len);
+	proto_rx_init(&rx);
+	KUNIT_EXPECT_EQ(test, feed(&rx, buf, len, &f), 3);
+	KUNIT_EXPECT_EQ(test, f.seq, 3);
+}
+
+/* a traced response parses like any frame, stripping restores the plain one */
+static void	proto_test_trace_trailer(struct kunit *test)
+{
+	const proto_trace_t	t = { 0x01020304, 0x01020310, 0xFFFFFFF0, 0x00000010 };
+	u8		buf[PROTO_MAX_FRAME];
+	proto_frame_t	resp;
+	proto_frame_t	f;
+	proto_trace_t	got;
+	proto_rx_t	rx;
+	u16		len;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.cmd = PROTO_CMD_ACK;
+	resp.seq = 9;
+	resp.len = 2;
+	resp.payload[0] = PROTO_CMD_PING;
+	KUNIT_ASSERT_TRUE(test, proto_trace_append(&resp, &t));
+	KUNIT_EXPECT_EQ(test, resp.cmd, PROTO_CMD_ACK | PROTO_CMD_F_TRACE);
+	len = build(0x12, resp.cmd, resp.seq, resp.payload, resp.len, buf);
+	proto_rx_init(&rx);
+	KUNIT_ASSERT_EQ(test, feed(&rx, buf, len, &f), 1);
+	KUNIT_ASSERT_TRUE(test, proto_trace_strip(&f, &got));
+	KUNIT_EXPECT_EQ(test, f.cmd, PROTO_CMD_ACK);
+	KUNIT_EXPECT_EQ(test, f.len, 2);
+	KUNIT_EXPECT_EQ(test, f.payload[0], PROTO_CMD_PING);
+	KUNIT_EXPECT_EQ(test, got.parse_us, t.parse_us);
+	KUNIT_EXPECT_EQ(test, got.handler_us, t.handler_us);
+	KUNIT_EXPECT_EQ(test, got.send_us, t.send_us);
+	KUNIT_EXPECT_FALSE(test, proto_trace_strip(&f, NULL));
+
+	resp.len = PROTO_MAX_PAYLOAD - PROTO_TRACE_LEN + 1; // no room left
+	KUNIT_EXPECT_FALSE(test, proto_trace_append(&resp, &t));
+}
+
+static struct kunit_case	fanctl_proto_cases[] = {
+	KUNIT_CASE(proto_test_roundtrip_legacy),
+	KUNIT_CASE(proto_test_roundtrip_addressed),
+	KUNIT_CASE(proto_test_max_payload),
+	KUNIT_CASE(proto_test_sync_in_payload),
+	KUNIT_CASE(proto_test_crc_error),
+	KUNIT_CASE(proto_test_addr_in_crc),
+	KUNIT_CASE(proto_test_oversize_len),
+	KUNIT_CASE(proto_test_garbage_prefix),
+	KUNIT_CASE(proto_test_back_to_back),
+	KUNIT_CASE(proto_test_trace_trailer),
+	{}
+};
+
+static struct kunit_suite	fanctl_proto_suite = {
+	.name = "fanctl_proto",
+	.test_cases = fanctl_proto_cases,
+};
+
+/* fanctl_match ------------------------------------------------------------- */
+
+static void	set_pending(fanctl_ctx_t *ctx, u8 addr, u8 cmd, u8 seq)
+{
+	ctx->pending_addr = addr;
+	ctx->pending_cmd = cmd;
+	ctx->pending_seq = seq;
+}
+
+static proto_frame_t	resp(u8 addr, u8 cmd, u8 seq, u8 ack_cmd, u8 ack_status)
+{
+	proto_frame_t	f;
+
+	memset(&f, 0, sizeof(f));
+	f.addr = addr;
+	f.cmd = cmd;
+	f.seq = seq;
+	if (cmd == PROTO_CMD_ACK)
+	{
+		f.payload[0] = ack_cmd;
+		f.payload[1] = ack_status;
+		f.len = 2;
+	}
+	return f;
+}
+
+static void	match_test_types(struct kunit *test)
+{
+	fanctl_ctx_t	*ctx;
+	proto_frame_t	f;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx);
+	set_pending(ctx, PROTO_ADDR_NONE, PROTO_CMD_PING, 4);
+	f = resp(PROTO_ADDR_NONE, PROTO_CMD_PONG, 4, 0, 0);
+	KUNIT_EXPECT_TRUE(test, fanctl_match_resp(ctx, &f));
+	f = resp(PROTO_ADDR_NONE, PROTO_CMD_STATUS_RESP, 4, 0, 0);
+	KUNIT_EXPECT_FALSE(test, fanctl_match_resp(ctx, &f));
+
+	set_pending(ctx, PROTO_ADDR_NONE, PROTO_CMD_STATUS_REQ, 5);
+	f = resp(PROTO_ADDR_NONE, PROTO_CMD_STATUS_RESP, 5, 0, 0);
+	KUNIT_EXPECT_TRUE(test, fanctl_match_resp(ctx, &f));
+
+	set_pending(ctx, PROTO_ADDR_NONE, PROTO_CMD_SET_FAN_MODE, 6);
+	f = resp(PROTO_ADDR_NONE, PROTO_CMD_ACK, 6, PROTO_CMD_SET_FAN_MODE, PROTO_ERR_OK);
+	KUNIT_EXPECT_TRUE(test, fanctl_match_resp(ctx, &f));
+	// ACK for another command with the same SEQ
+	f = resp(PROTO_ADDR_NONE, PROTO_CMD_ACK, 6, PROTO_CMD_SET_THRESHOLD, PROTO_ERR_OK);
+	KUNIT_EXPECT_FALSE(test, fanctl_match_resp(ctx, &f));
+	// truncated ACK
+	f = resp(PROTO_ADDR_NONE, PROTO_CMD_ACK, 6, PROTO_CMD_SET_FAN_MODE, PROTO_ERR_OK);
+	f.len = 1;
+	KUNIT_EXPECT_FALSE(test, fanctl_match_resp(ctx, &f));
+}
+
+static void	match_test_seq_addr(struct kunit *test)
+{
+	fanctl_ctx_t	*ctx;
+	proto_frame_t	f;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx);
+	set_pending(ctx, 0x07, PROTO_CMD_PING, 0);
+	f = resp(0x07, PROTO_CMD_PONG, 0, 0, 0);
+	KUNIT_EXPECT_TRUE(test, fanctl_match_resp(ctx, &f));
+	f = resp(0x07, PROTO_CMD_PONG, 255, 0, 0); // stale response
+	KUNIT_EXPECT_FALSE(test, fanctl_match_resp(ctx, &f));
+	f = resp(0x08, PROTO_CMD_PONG, 0, 0, 0); // another node
+	KUNIT_EXPECT_FALSE(test, fanctl_match_resp(ctx, &f));
+	f = resp(PROTO_ADDR_NONE, PROTO_CMD_PONG, 0, 0, 0); // legacy frame
+	KUNIT_EXPECT_FALSE(test, fanctl_match_resp(ctx, &f));
+	f = resp(0x07, PROTO_CMD_PING, 0, 0, 0); // own request echoed
+	KUNIT_EXPECT_FALSE(test, fanctl_match_resp(ctx, &f));
+}
+
+static void	match_test_ack_status(struct kunit *test)
+{
+	proto_frame_t	f;
+
+	f = resp(PROTO_ADDR_NONE, PROTO_CMD_ACK, 1, PROTO_CMD_SET_FAN_STATE, PROTO_ERR_OK);
+	KUNIT_EXPECT_EQ(test, fanctl_decode_ack_status(&f), 0);
+	f.payload[1] = PROTO_ERR_INVALID_ARG;
+	KUNIT_EXPECT_EQ(test, fanctl_decode_ack_status(&f), -EOPNOTSUPP);
+	f.payload[1] = PROTO_ERR_STATE;
+	KUNIT_EXPECT_EQ(test, fanctl_decode_ack_status(&f), -EBUSY);
+	f.payload[1] = 0x7F;
+	KUNIT_EXPECT_EQ(test, fanctl_decode_ack_status(&f), -EPROTO);
+	f.len = 1;
+	KUNIT_EXPECT_EQ(test, fanctl_decode_ack_status(&f), -EPROTO);
+	f = resp(PROTO_ADDR_NONE, PROTO_CMD_PONG, 1, 0, 0);
+	KUNIT_EXPECT_EQ(test, fanctl_decode_ack_status(&f), -EPROTO);
+	KUNIT_EXPECT_EQ(test, fanctl_decode_ack_status(NULL), -EINVAL);
+}
+
+static struct kunit_case	fanctl_match_cases[] = {
+	KUNIT_CASE(match_test_types),
+	KUNIT_CASE(match_test_seq_addr),
+	KUNIT_CASE(match_test_ack_status),
+	{}
+};
+
+static struct kunit_suite	fanctl_match_suite = {
+	.name = "fanctl_match",
+	.test_cases = fanctl_match_cases,
+};
+
+/* loopback tty ------------------------------------------------------------- */
+
+/*
+ * In-memory tty standing in for the node: every frame the driver writes
+ * is parsed and answered like the firmware would, either inline from the
+ * write callback or from a work item (like flush_to_ldisc()).
+ */
+typedef enum
+{
+	FANCTL_LB_ANSWER,
+	FANCTL_LB_SILENT, // never answers
+	FANCTL_LB_STALE_FIRST, // response with the previous SEQ, then the right one
+	FANCTL_LB_WRONG_ADDR, // answers from another node address
+}	fanctl_lb_mode_t;
+
+typedef struct fanctl_lb
+{
+	struct tty_struct	tty;
+	struct tty_operations	ops;
+	fanctl_ctx_t		*ctx;
+	proto_rx_t		rx; // frames written by the driver
+	fanctl_lb_mode_t	mode;
+	bool			deferred;
+	u8			ack_status;
+	u8			out[2 * PROTO_MAX_FRAME];
+	size_t			out_len;
+	struct work_struct	work;
+	u32			requests;
+}	fanctl_lb_t;
+
+static void	fanctl_lb_work(struct work_struct *work)
+{
+	fanctl_lb_t	*lb;
+
+	lb = container_of(work, fanctl_lb_t, work);
+	fanctl_rx_bytes(lb->ctx, lb->out, lb->out_len);
+}
+
+static void	fanctl_lb_add(fanctl_lb_t *lb, const proto_frame_t *f)
+{
+	u16	len;
+
+	if (proto_build_frame_addr(f->addr, f->cmd, f->seq, f->payload, f->len,
+				lb->out + lb->out_len, &len))
+		lb->out_len += len;
+}
+
+static void	fanctl_lb_answer(fanctl_lb_t *lb, const proto_frame_t *req)
+{
+	static const u8	status[] = { 0x09, 0xD0, 0x0F, 0xA0, PROTO_FAN_MODE_AUTO,
+				PROTO_FAN_STATE_ON, 0x00, 0x00 };
+	proto_frame_t	f;
+
+	lb->requests++;
+	if (lb->mode == FANCTL_LB_SILENT || req->addr == PROTO_ADDR_BROADCAST)
+		return;
+	memset(&f, 0, sizeof(f));
+	f.addr = req->addr;
+	f.seq = req->seq;
+	if (req->cmd == PROTO_CMD_PING)
+		f.cmd = PROTO_CMD_PONG;
+	else if (req->cmd == PROTO_CMD_STATUS_REQ)
+	{
+		f.cmd = PROTO_CMD_STATUS_RESP;
+		f.len = sizeof(status);
+		memcpy(f.payload, status, sizeof(status));
+	}
+	else
+	{
+		f.cmd = PROTO_CMD_ACK;
+		f.len = 2;
+		f.payload[0] = req->cmd;
+		f.payload[1] = lb->ack_status;
+	}
+	if (lb->mode == FANCTL_LB_WRONG_ADDR)
+		f.addr++;
+	lb->out_len = 0;
+	if (lb->mode == FANCTL_LB_STALE_FIRST)
+	{
+		f.seq--;
+		fanctl_lb_add(lb, &f);
+		f.seq++;
+	}
+	fanctl_lb_add(lb, &f);
+	if (lb->deferred)
+		schedule_work(&lb->work);
+	else
+		fanctl_rx_bytes(lb->ctx, lb->out, lb->out_len);
+}
+
+/* tty_operations::write takes u8/size_t since 6.6 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+static ssize_t	fanctl_lb_write(struct tty_struct *tty, const u8 *buf, size_t count)
+#else
+static int	fanctl_lb_write(struct tty_struct *tty, const unsigned char *buf, int count)
+#endif
+{
+	fanctl_lb_t	*lb;
+	proto_frame_t	req;
+	int		i;
+
+	lb = container_of(tty, fanctl_lb_t, tty);
+	flush_work(&lb->work); // previous response fully delivered
+	for (i = 0; i < count; i++)
+		if (proto_rx_feed(&lb->rx, buf[i], &req))
+			fanctl_lb_answer(lb, &req);
+	return count;
+}
+
+static unsigned int	fanctl_lb_write_room(struct tty_struct *tty)
+{
+	return 4096;
+}
+
+static int	fanctl_lb_init(struct kunit *test)
+{
+	fanctl_lb_t	*lb;
+
+	lb = kunit_kzalloc(test, sizeof(*lb), GFP_KERNEL);
+	if (!lb)
+		return -ENOMEM;
+	lb->ctx = kunit_kzalloc(test, sizeof(*lb->ctx), GFP_KERNEL);
+	if (!lb->ctx)
+		return -ENOMEM;
+	lb->ops.write = fanctl_lb_write;
+	lb->ops.write_room = fanctl_lb_write_room;
+	lb->tty.ops = &lb->ops;
+	fanctl_ctx_init(lb->ctx, &lb->tty);
+	lb->tty.disc_data = lb->ctx;
+	proto_rx_init(&lb->rx);
+	INIT_WORK(&lb->work, fanctl_lb_work);
+	lb->mode = FANCTL_LB_ANSWER;
+	lb->ack_status = PROTO_ERR_OK;
+	test->priv = lb;
+	return 0;
+}
+
+static void	fanctl_lb_exit(struct kunit *test)
+{
+	fanctl_lb_t	*lb;
+
+	lb = test->priv;
+	fanctl_sched_shutdown(lb->ctx);
+	cancel_work_sync(&lb->work);
+	fanctl_link_stop(lb->ctx);
+}
+
+static int	lb_req(fanctl_lb_t *lb, u8 addr, u8 cmd, const u8 *payload, u8 len,
+			proto_frame_t *out, unsigned int flags)
+{
+	return fanctl_do_req(lb->ctx, addr, cmd, payload, len, out, NULL,
+			msecs_to_jiffies(FANCTL_TEST_TIMEOUT_MS), flags);
+}
+
+/* fanctl_req --------------------------------------------------------------- */
+
+static void	req_test_ping(struct kunit *test)
+{
+	fanctl_lb_t		*lb = test->priv;
+	struct fanctl_times	times;
+	proto_frame_t		out;
+	int			i;
+
+	for (i = 0; i < 2; i++)
+	{
+		lb->deferred = i;
+		KUNIT_EXPECT_EQ(test, fanctl_do_req_wait_resp(lb->ctx, PROTO_ADDR_NONE,
+				PROTO_CMD_PING, NULL, 0, &out, &times,
+				msecs_to_jiffies(FANCTL_TEST_TIMEOUT_MS)), 0);
+		KUNIT_EXPECT_EQ(test, out.cmd, PROTO_CMD_PONG);
+		KUNIT_EXPECT_EQ(test, out.seq, lb->ctx->pending_seq);
+		KUNIT_EXPECT_NE(test, times.tx_ns, 0);
+		KUNIT_EXPECT_NE(test, times.rx_ns, 0);
+	}
+	KUNIT_EXPECT_EQ(test, lb->ctx->rx_dropped, 0);
+	KUNIT_EXPECT_EQ(test, fanctl_link_state(lb->ctx), FANCTL_LINK_UP);
+}
+
+static void	req_test_status(struct kunit *test)
+{
+	fanctl_lb_t	*lb = test->priv;
+	proto_frame_t	out;
+
+	lb->deferred = true;
+	KUNIT_ASSERT_EQ(test, lb_req(lb, PROTO_ADDR_NONE, PROTO_CMD_STATUS_REQ, NULL, 0, &out, 0), 0);
+	KUNIT_EXPECT_EQ(test, out.cmd, PROTO_CMD_STATUS_RESP);
+	KUNIT_EXPECT_EQ(test, out.len, sizeof(status_resp_t));
+	KUNIT_EXPECT_EQ(test, out.payload[0], 0x09);
+}
+
+static void	req_test_ack_error(struct kunit *test)
+{
+	fanctl_lb_t	*lb = test->priv;
+	const u8	on = PROTO_FAN_STATE_ON;
+	proto_frame_t	out;
+
+	lb->ack_status = PROTO_ERR_STATE;
+	KUNIT_ASSERT_EQ(test, lb_req(lb, PROTO_ADDR_NONE, PROTO_CMD_SET_FAN_STATE, &on, 1, &out, 0), 0);
+	KUNIT_EXPECT_EQ(test, fanctl_decode_ack_status(&out), -EBUSY);
+}
+
+static void	req_test_timeout(struct kunit *test)
+{
+	fanctl_lb_t	*lb = test->priv;
+	proto_frame_t	out;
+
+	lb->mode = FANCTL_LB_SILENT;
+	KUNIT_EXPECT_EQ(test, lb_req(lb, PROTO_ADDR_NONE, PROTO_CMD_PING, NULL, 0, &out, 0), -ETIMEDOUT);
+	KUNIT_EXPECT_FALSE(test, lb->ctx->waiting);
+	KUNIT_EXPECT_EQ(test, fanctl_link_state(lb->ctx), FANCTL_LINK_DEGRADED);
+	KUNIT_EXPECT_EQ(test, lb->ctx->link_misses, 1);
+	// the next answered request brings the link back
+	lb->mode = FANCTL_LB_ANSWER;
+	KUNIT_EXPECT_EQ(test, lb_req(lb, PROTO_ADDR_NONE, PROTO_CMD_PING, NULL, 0, &out, 0), 0);
+	KUNIT_EXPECT_EQ(test, fanctl_link_state(lb->ctx), FANCTL_LINK_UP);
+}
+
+static void	req_test_stale(struct kunit *test)
+{
+	fanctl_lb_t	*lb = test->priv;
+	proto_frame_t	out;
+
+	lb->mode = FANCTL_LB_STALE_FIRST;
+	lb->deferred = true;
+	KUNIT_EXPECT_EQ(test, lb_req(lb, PROTO_ADDR_NONE, PROTO_CMD_PING, NULL, 0, &out, 0), 0);
+	KUNIT_EXPECT_EQ(test, out.seq, lb->ctx->pending_seq);
+	flush_work(&lb->work);
+	KUNIT_EXPECT_EQ(test, lb->ctx->rx_dropped, 1);
+}
+
+static void	req_test_addressed(struct kunit *test)
+{
+	fanctl_lb_t	*lb = test->priv;
+	proto_frame_t	out;
+
+	KUNIT_EXPECT_EQ(test, lb_req(lb, 0x03, PROTO_CMD_PING, NULL, 0, &out, 0), 0);
+	KUNIT_EXPECT_EQ(test, out.addr, 0x03);
+	lb->mode = FANCTL_LB_WRONG_ADDR; // another node answers
+	KUNIT_EXPECT_EQ(test, lb_req(lb, 0x03, PROTO_CMD_PING, NULL, 0, &out, 0), -ETIMEDOUT);
+	KUNIT_EXPECT_EQ(test, lb->ctx->rx_dropped, 1);
+}
+
+static void	req_test_broadcast(struct kunit *test)
+{
+	fanctl_lb_t	*lb = test->priv;
+	const u8	mode = PROTO_FAN_MODE_MANUAL;
+	proto_frame_t	out;
+
+	lb->mode = FANCTL_LB_SILENT;
+	KUNIT_EXPECT_EQ(test, lb_req(lb, PROTO_ADDR_BROADCAST, PROTO_CMD_SET_FAN_MODE,
+				&mode, 1, &out, 0), 0);
+	KUNIT_EXPECT_EQ(test, lb->requests, 1);
+	KUNIT_EXPECT_EQ(test, out.cmd, 0);
+	KUNIT_EXPECT_EQ(test, fanctl_link_state(lb->ctx), FANCTL_LINK_UP);
+}
+
+static void	req_test_link_down(struct kunit *test)
+{
+	fanctl_lb_t	*lb = test->priv;
+	proto_frame_t	out;
+	int		i;
+
+	lb->mode = FANCTL_LB_SILENT;
+	for (i = 0; i < FANCTL_LINK_DOWN_MISSES; i++)
+		KUNIT_EXPECT_EQ(test, lb_req(lb, PROTO_ADDR_NONE, PROTO_CMD_PING, NULL, 0, &out, 0),
+				-ETIMEDOUT);
+	KUNIT_EXPECT_EQ(test, fanctl_link_state(lb->ctx), FANCTL_LINK_DOWN);
+	KUNIT_EXPECT_TRUE(test, lb->ctx->rx_resync);
+	// fail fast, nothing written
+	lb->requests = 0;
+	KUNIT_EXPECT_EQ(test, lb_req(lb, PROTO_ADDR_NONE, PROTO_CMD_STATUS_REQ, NULL, 0, &out, 0),
+			-ENOLINK);
+	KUNIT_EXPECT_EQ(test, lb->requests, 0);
+	// keepalive probes still go out and bring the link back
+	lb->mode = FANCTL_LB_ANSWER;
+	KUNIT_EXPECT_EQ(test, lb_req(lb, PROTO_ADDR_NONE, PROTO_CMD_PING, NULL, 0, &out,
+				FANCTL_REQ_PROBE), 0);
+	KUNIT_EXPECT_EQ(test, fanctl_link_state(lb->ctx), FANCTL_LINK_UP);
+	KUNIT_EXPECT_EQ(test, lb->ctx->link_misses, 0);
+}
+
+static void	req_test_node_lost(struct kunit *test)
+{
+	fanctl_lb_t	*lb = test->priv;
+	const u8	mode = PROTO_FAN_MODE_AUTO;
+	proto_frame_t	out;
+	int		i;
+
+	KUNIT_EXPECT_EQ(test, lb_req(lb, 0x04, PROTO_CMD_PING, NULL, 0, &out, 0), 0);
+	lb->mode = FANCTL_LB_SILENT;
+	for (i = 0; i < FANCTL_LINK_DOWN_MISSES; i++)
+		KUNIT_EXPECT_EQ(test, lb_req(lb, 0x03, PROTO_CMD_PING, NULL, 0, &out, 0),
+				-ETIMEDOUT);
+	// only node 3 is lost, the bus is not
+	KUNIT_EXPECT_EQ(test, fanctl_link_node_state(lb->ctx, 0x03), FANCTL_LINK_DOWN);
+	KUNIT_EXPECT_EQ(test, fanctl_link_node_state(lb->ctx, 0x04), FANCTL_LINK_UP);
+	KUNIT_EXPECT_EQ(test, fanctl_link_state(lb->ctx), FANCTL_LINK_DEGRADED);
+	KUNIT_EXPECT_FALSE(test, lb->ctx->rx_resync);
+	lb->mode = FANCTL_LB_ANSWER;
+	lb->requests = 0;
+	KUNIT_EXPECT_EQ(test, lb_req(lb, 0x03, PROTO_CMD_STATUS_REQ, NULL, 0, &out, 0), -ENOLINK);
+	KUNIT_EXPECT_EQ(test, lb->requests, 0);
+	KUNIT_EXPECT_EQ(test, lb_req(lb, 0x04, PROTO_CMD_STATUS_REQ, NULL, 0, &out, 0), 0);
+	KUNIT_EXPECT_EQ(test, lb_req(lb, PROTO_ADDR_BROADCAST, PROTO_CMD_SET_FAN_MODE,
+				&mode, 1, &out, 0), 0);
+	// keepalive probes still go to node 3 and bring it back
+	KUNIT_EXPECT_EQ(test, lb_req(lb, 0x03, PROTO_CMD_PING, NULL, 0, &out,
+				FANCTL_REQ_PROBE), 0);
+	KUNIT_EXPECT_EQ(test, fanctl_link_node_state(lb->ctx, 0x03), FANCTL_LINK_UP);
+	KUNIT_EXPECT_EQ(test, fanctl_link_state(lb->ctx), FANCTL_LINK_UP);
+}
+
+static struct kunit_case	fanctl_req_cases[] = {
+	KUNIT_CASE(req_test_ping),
+	KUNIT_CASE(req_test_status),
+	KUNIT_CASE(req_test_ack_error),
+	KUNIT_CASE(req_test_timeout),
+	KUNIT_CASE(req_test_stale),
+	KUNIT_CASE(req_test_addressed),
+	KUNIT_CASE(req_test_broadcast),
+	KUNIT_CASE(req_test_link_down),
+	KUNIT_CASE(req_test_node_lost),
+	{}
+};
+
+static struct kunit_suite	fanctl_req_suite = {
+	.name = "fanctl_req",
+	.init = fanctl_lb_init,
+	.exit = fanctl_lb_exit,
+	.test_cases = fanctl_req_cases,
+};
+
+/* fanctl_bench ------------------------------------------------------------- */
+
+#define BENCH_FRAMES	256
+#define BENCH_ROUNDS	64
+#define BENCH_REQS	2000
+
+static void	bench_parser(struct kunit *test)
+{
+	proto_frame_t	f;
+	proto_rx_t	rx;
+	ktime_t		t0;
+	u64		ns;
+	u64		bytes;
+	u8		payload[8];
+	u8		*buf;
+	size_t		len;
+	int		frames;
+	int		i;
+
+	buf = kunit_kzalloc(test, BENCH_FRAMES * PROTO_MAX_FRAME, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buf);
+	len = 0;
+	for (i = 0; i < BENCH_FRAMES; i++) // status responses, half of them addressed
+	{
+		memset(payload, i, sizeof(payload));
+		len += build(i & 1 ? (u8)(1 + i % 32) : PROTO_ADDR_NONE,
+			PROTO_CMD_STATUS_RESP, (u8)i, payload, sizeof(payload), buf + len);
+	}
+	proto_rx_init(&rx);
+	frames = 0;
+	t0 = ktime_get();
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		frames += feed(&rx, buf, len, &f);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+	KUNIT_EXPECT_EQ(test, frames, BENCH_FRAMES * BENCH_ROUNDS);
+	bytes = (u64)len * BENCH_ROUNDS;
+	kunit_info(test, "proto_rx_feed: %llu bytes in %llu ns, %llu.%02llu ns/byte\n",
+		bytes, ns, div64_u64(ns, bytes), div64_u64(ns * 100, bytes) % 100);
+	if (bench_max_ns_byte)
+		KUNIT_EXPECT_LE(test, div64_u64(ns, bytes), (u64)bench_max_ns_byte);
+}
+
+static void	bench_loopback(struct kunit *test, bool deferred)
+{
+	fanctl_lb_t	*lb = test->priv;
+	proto_frame_t	out;
+	ktime_t		t0;
+	u64		ns;
+	int		fails;
+	int		i;
+
+	lb->deferred = deferred;
+	fails = 0;
+	t0 = ktime_get();
+	for (i = 0; i < BENCH_REQS; i++)
+		if (lb_req(lb, PROTO_ADDR_NONE, PROTO_CMD_STATUS_REQ, NULL, 0, &out, 0))
+			fails++;
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+	KUNIT_EXPECT_EQ(test, fails, 0);
+	kunit_info(test, "loopback (%s): %d requests, %llu ns/request\n",
+		deferred ? "deferred rx" : "inline rx", BENCH_REQS,
+		div64_u64(ns, BENCH_REQS));
+	if (bench_max_ns_req)
+		KUNIT_EXPECT_LE(test, div64_u64(ns, BENCH_REQS), (u64)bench_max_ns_req);
+}
+
+static void	bench_loopback_inline(struct kunit *test)
+{
+	bench_loopback(test, false);
+}
+
+static void	bench_loopback_deferred(struct kunit *test)
+{
+	bench_loopback(test, true);
+}
+
+static struct kunit_case	fanctl_bench_cases[] = {
+	KUNIT_CASE(bench_parser),
+	KUNIT_CASE(bench_loopback_inline),
+	KUNIT_CASE(bench_loopback_deferred),
+	{}
+};
+
+static struct kunit_suite	fanctl_bench_suite = {
+	.name = "fanctl_bench",
+	.init = fanctl_lb_init,
+	.exit = fanctl_lb_exit,
+	.test_cases = fanctl_bench_cases,
+};
+
+kunit_test_suites(&fanctl_proto_suite, &fanctl_match_suite,
+		&fanctl_req_suite, &fanctl_bench_suite);
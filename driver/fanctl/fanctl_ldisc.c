@@ -4,6 +4,34 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/termios.h>
+#include <linux/ktime.h>
+#include <linux/version.h>
+
+/* Initialize a per-tty context (also used by the KUnit loopback tty). */
+void	fanctl_ctx_init(fanctl_ctx_t *ctx, struct tty_struct *tty)
+{
+	ctx->tty = tty;
+	kref_init(&ctx->ref);
+	proto_rx_init(&ctx->rx);
+	fanctl_sched_init(ctx);
+	fanctl_link_init(ctx);
+	spin_lock_init(&ctx->resp_lock);
+	init_completion(&ctx->resp_done);
+
+	ctx->pending_seq = 0;
+	ctx->waiting = false;
+}
+
+static void	fanctl_ctx_release(struct kref *ref)
+{
+	kfree(container_of(ref, fanctl_ctx_t, ref));
+}
+
+/* Drop a reference taken by fanctl_open() or fanctl_get_active_ctx(). */
+void	fanctl_ctx_put(fanctl_ctx_t *ctx)
+{
+	kref_put(&ctx->ref, fanctl_ctx_release);
+}
 
 /* Runs when line discipline is attached. */
 static int	fanctl_open(struct tty_struct *tty)
@@ -15,14 +43,7 @@ static int	fanctl_open(struct tty_struct *tty)
 	if (!ctx)
 		return -ENOMEM;
 
-	ctx->tty = tty;
-	proto_rx_init(&ctx->rx);
-	mutex_init(&ctx->req_lock);
-	spin_lock_init(&ctx->resp_lock);
-	init_completion(&ctx->resp_done);
-
-	ctx->pending_seq = 0;
-	ctx->waiting = false;
+	fanctl_ctx_init(ctx, tty);
 	tty->disc_data = ctx;
 
 	// register active ctx - shared with the ioctl context
@@ -32,6 +53,7 @@ static int	fanctl_open(struct tty_struct *tty)
 		kfree(ctx);
 		return ret;
 	}
+	fanctl_link_start(ctx);
 	pr_info("fanctl: ldisc attached\n");
 	return 0;
 }
@@ -44,13 +66,11 @@ static void	fanctl_close(struct tty_struct *tty)
 	ctx = tty->disc_data;
 	if (!ctx)
 		return;
-	mutex_lock(&ctx->req_lock);
-	ctx->waiting = false;
-	complete_all(&ctx->resp_done); // wakeup ioctl
-	mutex_unlock(&ctx->req_lock);
-	fanctl_clear_active_ctx(ctx);
+	fanctl_clear_active_ctx(ctx); // no new ioctl can pick up ctx
+	fanctl_sched_shutdown(ctx); // abort queued ioctls, wakeup and wait for the owner
+	fanctl_link_stop(ctx); // keepalive and recovery works
 	tty->disc_data = NULL;
-	kfree(ctx);
+	fanctl_ctx_put(ctx); // freed once the last ioctl using it returns
 	pr_info("fanctl: ldisc detached\n");
 }
 
@@ -80,32 +100,45 @@ static void	fanctl_close(struct tty_struct *tty)
  *
  * This callback feeds incoming bytes into the protocol parser.
  * When a complete response frame matching the current outstanding request is detected,
- * it wakes up the sleeping ioctl handler via completion.
+ * it is stored together with its completion time (ktime_get()) and the sleeping
+ * ioctl handler is woken up via completion.
  *
  * Constraints:
  * - Must be non-blocking: do not sleep (mutex_lock, msleep, wait_for_completion, etc.)
  * - Keep work minimal (parsing + signaling only)
  */
-static int	fanctl_receive_buf(struct tty_struct *tty, const unsigned char *cp,
-		const char *fp, int count)
+void	fanctl_rx_bytes(fanctl_ctx_t *ctx, const u8 *cp, size_t count)
 {
-	fanctl_ctx_t	*ctx;
 	unsigned long	flags;
 	proto_frame_t	f;
-	int		i;
+	proto_trace_t	trace;
+	bool		traced;
+	ktime_t		ts;
+	size_t		i;
 
-	ctx = tty->disc_data;
-	if (!ctx)
-		return 0;
+	fanctl_capture(FANCTL_CAP_DIR_RX, cp, count);
+	memset(&trace, 0, sizeof(trace)); // only filled in for traced frames
+	if (READ_ONCE(ctx->rx_resync)) // link went down: drop any partial frame
+	{
+		WRITE_ONCE(ctx->rx_resync, false);
+		proto_rx_init(&ctx->rx);
+	}
 	for (i = 0; i < count; i++)
 	{
-		if (proto_rx_feed(&ctx->rx, (u8)cp[i], &f)) // parse
+		if (proto_rx_feed(&ctx->rx, cp[i], &f)) // parse
 		{
+			ts = ktime_get(); // frame completion time
+			traced = proto_trace_strip(&f, &trace); // node timestamps, if asked for
 			ctx->rx_frames++;
+			WRITE_ONCE(ctx->last_rx_ts, ts);
+			fanctl_link_note_rx(ctx, &f);
 			if (ctx->waiting && fanctl_match_resp(ctx, &f))
 			{
 				spin_lock_irqsave(&ctx->resp_lock, flags); // busy wait
 				ctx->last_resp = f;
+				ctx->last_resp_ts = ts;
+				ctx->last_trace = trace;
+				ctx->last_trace_valid = traced;
 				spin_unlock_irqrestore(&ctx->resp_lock, flags);
 				complete(&ctx->resp_done); // wakeup ioctl context
 			}
@@ -113,6 +146,23 @@ static int	fanctl_receive_buf(struct tty_struct *tty, const unsigned char *cp,
 				ctx->rx_dropped++;
 		}
 	}
+}
+
+/* receive_buf2 takes size_t counts and u8 flags since 6.6 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+static size_t	fanctl_receive_buf(struct tty_struct *tty, const u8 *cp,
+		const u8 *fp, size_t count)
+#else
+static int	fanctl_receive_buf(struct tty_struct *tty, const unsigned char *cp,
+		const char *fp, int count)
+#endif
+{
+	fanctl_ctx_t	*ctx;
+
+	ctx = tty->disc_data;
+	if (!ctx)
+		return 0;
+	fanctl_rx_bytes(ctx, cp, count);
 	return count;
 }
 
@@ -0,0 +1,385 @@
+#include "fanctl.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/jiffies.h>
+#include <linux/moduleparam.h>
+
+/*
+ * Link keepalive and recovery
+ * ---------------------------
+ * Several nodes may share the tty (multi-drop bus), so the link state is
+ * kept per node address, driven by two events:
+ *
+ * - a response (or any other node-originated frame) is received from it
+ *   -> UP
+ * - a request to it expecting a response times out
+ *   -> DEGRADED, then DOWN after FANCTL_LINK_DOWN_MISSES misses in a row
+ *
+ * A node is known once it answered or timed out. The state of the bus
+ * (FANCTL_IOC_GET_LINK) follows from the known nodes: UP when all of them
+ * are UP, DOWN when all of them are DOWN, DEGRADED otherwise. On a
+ * point-to-point link the only node is PROTO_ADDR_NONE, so both are the
+ * same.
+ *
+ * Every `keepalive_ms`, the keepalive work sends PING probes:
+ *
+ * - when no node traffic was seen for that long, to a node which is UP
+ *   (the one which answered last if it still is), or to `keepalive_addr`
+ *   while no node is known yet, so a dead link is detected even when
+ *   nobody is using it, from attach on
+ * - to one known node which is not UP, round robin, so a lost node is
+ *   noticed when it comes back
+ *
+ * While a node is DOWN, the probes to it keep going (FANCTL_REQ_PROBE)
+ * and all other requests to it fail immediately with -ENOLINK; requests
+ * to the other nodes go on. While the bus is DOWN, broadcasts fail too
+ * and the RX parser is reset, dropping any half-received frame.
+ *
+ * When a node comes back from DOWN (e.g. its ESP32 rebooted), the last
+ * configuration applied to it through the driver (fan mode, threshold,
+ * manual fan state), broadcast then addressed, is sent to it again.
+ *
+ * Every change of the bus state is reported to pollers of /dev/fanctl.
+ */
+
+#define FANCTL_KA_TIMEOUT_MS	500
+
+static unsigned int	keepalive_ms = 1000;
+module_param(keepalive_ms, uint, 0644);
+MODULE_PARM_DESC(keepalive_ms, "keepalive interval (ms), 0 = disabled");
+
+static unsigned int	keepalive_addr = PROTO_ADDR_NONE;
+module_param(keepalive_addr, uint, 0644);
+MODULE_PARM_DESC(keepalive_addr, "node probed until one is known, 0 = unaddressed (point-to-point)");
+
+u8	fanctl_link_state(fanctl_ctx_t *ctx)
+{
+	return READ_ONCE(ctx->link_state);
+}
+
+/* State of a node, the bus state for PROTO_ADDR_BROADCAST. */
+u8	fanctl_link_node_state(fanctl_ctx_t *ctx, u8 addr)
+{
+	u8	state;
+
+	if (addr == PROTO_ADDR_BROADCAST)
+		return fanctl_link_state(ctx);
+	spin_lock(&ctx->link_lock);
+	state = ctx->nodes[addr].known ? ctx->nodes[addr].state : FANCTL_LINK_UP;
+	spin_unlock(&ctx->link_lock);
+	return state;
+}
+
+void	fanctl_link_get(fanctl_ctx_t *ctx, struct fanctl_link *out)
+{
+	spin_lock(&ctx->link_lock);
+	out->state = ctx->link_state;
+	out->misses = ctx->link_misses;
+	out->last_rx_ns = ktime_to_ns(ctx->link_rx_ts);
+	spin_unlock(&ctx->link_lock);
+	out->attached = 1;
+}
+
+/* Set the state of a node and update the bus state. Called with link_lock held. */
+static void	fanctl_link_set_node(fanctl_ctx_t *ctx, u8 addr, u8 state)
+{
+	fanctl_node_link_t	*n;
+
+	n = &ctx->nodes[addr];
+	if (!n->known)
+	{
+		n->known = true;
+		n->state = FANCTL_LINK_UP;
+		ctx->link_known++;
+		ctx->link_up++;
+	}
+	if (n->state != state)
+	{
+		ctx->link_up -= n->state == FANCTL_LINK_UP;
+		ctx->link_down -= n->state == FANCTL_LINK_DOWN;
+		ctx->link_up += state == FANCTL_LINK_UP;
+		ctx->link_down += state == FANCTL_LINK_DOWN;
+		n->state = state;
+	}
+	if (ctx->link_up == ctx->link_known)
+		ctx->link_state = FANCTL_LINK_UP;
+	else if (ctx->link_down == ctx->link_known)
+		ctx->link_state = FANCTL_LINK_DOWN;
+	else
+		ctx->link_state = FANCTL_LINK_DEGRADED;
+}
+
+/*
+ * RX path: a valid frame was received. Requests echoed back on a
+ * half-duplex bus are ignored, they do not prove that a node is alive.
+ */
+void	fanctl_link_note_rx(fanctl_ctx_t *ctx, const proto_frame_t *f)
+{
+	u8	prev;
+	u8	state;
+	bool	lost;
+
+	if (!(f->cmd & 0x80)) // host -> node command
+		return;
+	if (f->addr == PROTO_ADDR_BROADCAST) // not a node address
+		return;
+	spin_lock(&ctx->link_lock);
+	prev = ctx->link_state;
+	lost = ctx->nodes[f->addr].known && ctx->nodes[f->addr].state == FANCTL_LINK_DOWN;
+	fanctl_link_set_node(ctx, f->addr, FANCTL_LINK_UP);
+	ctx->nodes[f->addr].misses = 0;
+	ctx->link_misses = 0;
+	ctx->link_rx_ts = ktime_get();
+	state = ctx->link_state;
+	spin_unlock(&ctx->link_lock);
+	WRITE_ONCE(ctx->ka_addr, f->addr);
+	if (lost)
+	{
+		if (f->addr != PROTO_ADDR_NONE)
+			pr_info("fanctl: node %u up\n", f->addr);
+		set_bit(f->addr, ctx->recover);
+		if (!READ_ONCE(ctx->closing))
+			schedule_work(&ctx->recover_work);
+	}
+	if (state == prev)
+		return;
+	if (prev == FANCTL_LINK_DOWN)
+		pr_info("fanctl: link up\n");
+	fanctl_link_notify();
+}
+
+/* A request to addr expecting a response timed out. */
+void	fanctl_link_note_timeout(fanctl_ctx_t *ctx, u8 addr)
+{
+	fanctl_node_link_t	*n;
+	u8			prev;
+	u8			state;
+	bool			was_down;
+	bool			lost;
+
+	spin_lock(&ctx->link_lock);
+	prev = ctx->link_state;
+	n = &ctx->nodes[addr];
+	was_down = n->known && n->state == FANCTL_LINK_DOWN;
+	if (n->misses < U16_MAX)
+		n->misses++;
+	fanctl_link_set_node(ctx, addr, n->misses >= FANCTL_LINK_DOWN_MISSES
+			? FANCTL_LINK_DOWN : FANCTL_LINK_DEGRADED);
+	lost = !was_down && n->state == FANCTL_LINK_DOWN;
+	if (ctx->link_misses < U16_MAX)
+		ctx->link_misses++;
+	state = ctx->link_state;
+	spin_unlock(&ctx->link_lock);
+	if (lost && addr != PROTO_ADDR_NONE)
+		pr_warn("fanctl: node %u lost\n", addr);
+	if (state == prev)
+		return;
+	if (state == FANCTL_LINK_DOWN)
+	{
+		WRITE_ONCE(ctx->rx_resync, true);
+		pr_warn("fanctl: link down\n");
+	}
+	fanctl_link_notify();
+}
+
+/* Keep the configuration applied through the driver, for recovery. */
+void	fanctl_link_remember_cfg(fanctl_ctx_t *ctx, u8 addr, u8 cmd,
+				const u8 *payload)
+{
+	u8	bit;
+	int	i;
+
+	if (cmd == PROTO_CMD_SET_FAN_MODE)
+		bit = FANCTL_CFG_FAN_MODE;
+	else if (cmd == PROTO_CMD_SET_FAN_STATE)
+		bit = FANCTL_CFG_FAN_STATE;
+	else if (cmd == PROTO_CMD_SET_THRESHOLD)
+		bit = FANCTL_CFG_THRESHOLD;
+	else
+		return;
+	mutex_lock(&ctx->cfg_lock);
+	if (addr == PROTO_ADDR_BROADCAST) // overrides what was set per node
+	{
+		for (i = 0; i < PROTO_ADDR_BROADCAST; i++)
+			ctx->cfg[i].valid &= ~bit;
+	}
+	ctx->cfg[addr].valid |= bit;
+	if (bit == FANCTL_CFG_FAN_MODE)
+		ctx->cfg[addr].fan_mode = payload[0];
+	else if (bit == FANCTL_CFG_FAN_STATE)
+		ctx->cfg[addr].fan_state = payload[0];
+	else
+		ctx->cfg[addr].threshold_x100 = (s16)((payload[0] << 8) | payload[1]);
+	mutex_unlock(&ctx->cfg_lock);
+}
+
+static int	fanctl_link_restore_one(fanctl_ctx_t *ctx, u8 addr, u8 cmd,
+				const u8 *payload, u8 len)
+{
+	proto_frame_t	resp;
+	int		ret;
+
+	ret = fanctl_do_req(ctx, addr, cmd, payload, len, &resp, NULL,
+			msecs_to_jiffies(1000), 0);
+	if (ret)
+		pr_warn("fanctl: restoring cmd 0x%02x on node %u failed: %d\n",
+			cmd, addr, ret);
+	return ret;
+}
+
+static int	fanctl_link_restore_node(fanctl_ctx_t *ctx, u8 addr,
+				const fanctl_node_cfg_t *c)
+{
+	u8	payload[2];
+	int	ret;
+
+	if (c->valid & FANCTL_CFG_FAN_MODE)
+	{
+		ret = fanctl_link_restore_one(ctx, addr, PROTO_CMD_SET_FAN_MODE,
+				&c->fan_mode, 1);
+		if (ret)
+			return ret;
+	}
+	if (c->valid & FANCTL_CFG_THRESHOLD)
+	{
+		payload[0] = (u8)((c->threshold_x100 >> 8) & 0xFF);
+		payload[1] = (u8)(c->threshold_x100 & 0xFF);
+		ret = fanctl_link_restore_one(ctx, addr, PROTO_CMD_SET_THRESHOLD,
+				payload, 2);
+		if (ret)
+			return ret;
+	}
+	// a fan state only sticks in MANUAL mode
+	if ((c->valid & FANCTL_CFG_FAN_STATE)
+		&& (!(c->valid & FANCTL_CFG_FAN_MODE)
+			|| c->fan_mode == PROTO_FAN_MODE_MANUAL))
+		return fanctl_link_restore_one(ctx, addr, PROTO_CMD_SET_FAN_STATE,
+				&c->fan_state, 1);
+	return 0;
+}
+
+static void	fanctl_link_recover_work(struct work_struct *work)
+{
+	fanctl_ctx_t		*ctx;
+	fanctl_node_cfg_t	*cfg;
+	int			addr;
+
+	ctx = container_of(work, fanctl_ctx_t, recover_work);
+	mutex_lock(&ctx->cfg_lock);
+	cfg = kmemdup(ctx->cfg, sizeof(ctx->cfg), GFP_KERNEL);
+	mutex_unlock(&ctx->cfg_lock);
+	if (!cfg)
+		return;
+	for (addr = 0; addr < PROTO_ADDR_BROADCAST; addr++)
+	{
+		if (!test_and_clear_bit(addr, ctx->recover))
+			continue;
+		// broadcast first: per node settings made later take precedence
+		if (!fanctl_link_restore_node(ctx, addr, &cfg[PROTO_ADDR_BROADCAST]))
+			fanctl_link_restore_node(ctx, addr, &cfg[addr]);
+	}
+	kfree(cfg);
+}
+
+/*
+ * First known node from `from` on, round robin, which is UP (up) or not
+ * (!up). Returns -1 if there is none. Called with link_lock held.
+ */
+static int	fanctl_link_find(fanctl_ctx_t *ctx, u8 from, bool up)
+{
+	const fanctl_node_link_t	*n;
+	int				i;
+	u8				addr;
+
+	for (i = 0; i < PROTO_ADDR_BROADCAST; i++)
+	{
+		addr = (u8)((from + i) % PROTO_ADDR_BROADCAST);
+		n = &ctx->nodes[addr];
+		if (n->known && (n->state == FANCTL_LINK_UP) == up)
+			return addr;
+	}
+	return -1;
+}
+
+static void	fanctl_link_probe(fanctl_ctx_t *ctx, u8 addr)
+{
+	proto_frame_t	resp;
+
+	// timeouts are accounted by fanctl_do_req(), responses by the RX path
+	fanctl_do_req(ctx, addr, PROTO_CMD_PING, NULL, 0, &resp, NULL,
+		msecs_to_jiffies(FANCTL_KA_TIMEOUT_MS), FANCTL_REQ_PROBE);
+}
+
+static void	fanctl_link_ka_work(struct work_struct *work)
+{
+	fanctl_ctx_t	*ctx;
+	unsigned int	interval;
+	unsigned int	first;
+	s64		idle_ms;
+	int		alive;
+	int		lost;
+
+	ctx = container_of(to_delayed_work(work), fanctl_ctx_t, ka_work);
+	if (READ_ONCE(ctx->closing))
+		return;
+	interval = READ_ONCE(keepalive_ms);
+	first = READ_ONCE(keepalive_addr);
+	if (interval)
+	{
+		spin_lock(&ctx->link_lock);
+		idle_ms = ktime_ms_delta(ktime_get(), ctx->link_rx_ts);
+		alive = -1;
+		if (idle_ms >= interval && ctx->link_known)
+			alive = fanctl_link_find(ctx, ctx->ka_addr, true);
+		else if (idle_ms >= interval && first < PROTO_ADDR_BROADCAST)
+			alive = (int)first; // no node known yet
+		lost = fanctl_link_find(ctx, ctx->ka_next, false);
+		if (lost >= 0)
+			ctx->ka_next = (u8)((lost + 1) % PROTO_ADDR_BROADCAST);
+		spin_unlock(&ctx->link_lock);
+		if (alive >= 0)
+			fanctl_link_probe(ctx, (u8)alive);
+		if (lost >= 0 && !READ_ONCE(ctx->closing))
+			fanctl_link_probe(ctx, (u8)lost);
+	}
+	if (!READ_ONCE(ctx->closing))
+		schedule_delayed_work(&ctx->ka_work,
+			msecs_to_jiffies(interval ? interval : 1000));
+}
+
+void	fanctl_link_init(fanctl_ctx_t *ctx)
+{
+	spin_lock_init(&ctx->link_lock);
+	ctx->link_state = FANCTL_LINK_UP;
+	ctx->link_misses = 0;
+	ctx->link_rx_ts = ktime_get();
+	memset(ctx->nodes, 0, sizeof(ctx->nodes));
+	ctx->link_known = 0;
+	ctx->link_up = 0;
+	ctx->link_down = 0;
+	ctx->rx_resync = false;
+	ctx->ka_addr = PROTO_ADDR_NONE;
+	ctx->ka_next = PROTO_ADDR_NONE;
+	bitmap_zero(ctx->recover, 256);
+	INIT_DELAYED_WORK(&ctx->ka_work, fanctl_link_ka_work);
+	INIT_WORK(&ctx->recover_work, fanctl_link_recover_work);
+	mutex_init(&ctx->cfg_lock);
+	memset(ctx->cfg, 0, sizeof(ctx->cfg));
+}
+
+void	fanctl_link_start(fanctl_ctx_t *ctx)
+{
+	schedule_delayed_work(&ctx->ka_work, msecs_to_jiffies(1000));
+	fanctl_link_notify(); // attached
+}
+
+/* Called after fanctl_sched_shutdown(): pending works bail out quickly. */
+void	fanctl_link_stop(fanctl_ctx_t *ctx)
+{
+	cancel_delayed_work_sync(&ctx->ka_work);
+	cancel_work_sync(&ctx->recover_work);
+	fanctl_link_notify(); // detached
+}
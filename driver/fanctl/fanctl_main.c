@@ -2,6 +2,9 @@
 
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/debugfs.h>
+
+static struct dentry	*g_debugfs_dir; // /sys/kernel/debug/fanctl
 
 static int __init fanctl_init(void)
 {
@@ -20,6 +23,10 @@ static int __init fanctl_init(void)
 		return ret;
 	}
 
+	g_debugfs_dir = debugfs_create_dir("fanctl", NULL); // optional, errors ignored
+	fanctl_capture_register(g_debugfs_dir);
+	fanctl_trace_register(g_debugfs_dir);
+
 	pr_info("fanctl: module loaded\n");
 	return 0;
 }
@@ -28,6 +35,9 @@ static void __exit fanctl_exit(void)
 {
 	fanctl_ldisc_unregister();
 	fanctl_chardev_unregister();
+	fanctl_capture_unregister();
+	fanctl_trace_unregister();
+	debugfs_remove_recursive(g_debugfs_dir);
 	pr_info("fanctl: module unloaded\n");
 }
 
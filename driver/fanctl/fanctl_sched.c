@@ -0,0 +1,223 @@
+#include "fanctl.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/sched.h>
+#include <linux/log2.h>
+
+/*
+ * Request scheduler
+ * -----------------
+ * Only one request may own the wire at a time (the node answers requests
+ * strictly in order and the driver matches a single pending response).
+ * Instead of a plain mutex, which wakes up waiters in FIFO order, callers
+ * queue in one of two priority classes:
+ *
+ * - FANCTL_PRIO_CTRL: SET_FAN_MODE / SET_FAN_STATE / SET_THRESHOLD
+ * - FANCTL_PRIO_POLL: STATUS_REQ / PING
+ *
+ * When the owner releases the wire, it is handed over to the oldest CTRL
+ * request, unless FANCTL_SCHED_CTRL_BURST CTRL requests have been granted
+ * in a row while a POLL request was waiting. In that case the oldest POLL
+ * request goes next, so polls are delayed but never starved.
+ *
+ * Ownership is handed over directly (granted flag + wake_up_all), so a
+ * newly submitted request cannot overtake queued ones.
+ */
+
+int	fanctl_req_prio(u8 req_cmd)
+{
+	switch (req_cmd)
+	{
+	case PROTO_CMD_SET_FAN_MODE:
+	case PROTO_CMD_SET_FAN_STATE:
+	case PROTO_CMD_SET_THRESHOLD:
+		return FANCTL_PRIO_CTRL;
+	default:
+		return FANCTL_PRIO_POLL;
+	}
+}
+
+void	fanctl_sched_init(fanctl_ctx_t *ctx)
+{
+	int	i;
+
+	spin_lock_init(&ctx->sched_lock);
+	init_waitqueue_head(&ctx->sched_wq);
+	for (i = 0; i < FANCTL_PRIO_NR; i++)
+		INIT_LIST_HEAD(&ctx->sched_q[i]);
+	ctx->wire_busy = false;
+	ctx->closing = false;
+	ctx->ctrl_streak = 0;
+	memset(ctx->qstats, 0, sizeof(ctx->qstats));
+}
+
+/* Account the queueing delay of a request being granted the wire. */
+static void	fanctl_sched_account(fanctl_ctx_t *ctx, int prio,
+				fanctl_waiter_t *w, ktime_t now)
+{
+	struct fanctl_qclass_stats	*qs;
+	u64				wait_ns;
+	u64				wait_us;
+	int				bucket;
+
+	qs = &ctx->qstats[prio];
+	wait_ns = ktime_to_ns(ktime_sub(now, w->enq_ts));
+	wait_us = div_u64(wait_ns, NSEC_PER_USEC);
+	bucket = wait_us ? ilog2(wait_us) + 1 : 0;
+	if (bucket >= FANCTL_QSTATS_HIST_BUCKETS)
+		bucket = FANCTL_QSTATS_HIST_BUCKETS - 1;
+	qs->requests++;
+	qs->wait_ns_total += wait_ns;
+	if (wait_ns > qs->wait_ns_max)
+		qs->wait_ns_max = wait_ns;
+	qs->wait_hist[bucket]++;
+}
+
+/*
+ * Hand the wire over to the next queued request, or mark it idle.
+ * Called with sched_lock held by the current owner.
+ */
+static void	fanctl_sched_next(fanctl_ctx_t *ctx)
+{
+	struct list_head	*ctrl_q;
+	struct list_head	*poll_q;
+	fanctl_waiter_t		*w;
+	int			prio;
+
+	ctrl_q = &ctx->sched_q[FANCTL_PRIO_CTRL];
+	poll_q = &ctx->sched_q[FANCTL_PRIO_POLL];
+	if (!list_empty(ctrl_q)
+		&& (list_empty(poll_q) || ctx->ctrl_streak < FANCTL_SCHED_CTRL_BURST))
+	{
+		prio = FANCTL_PRIO_CTRL;
+		if (list_empty(poll_q))
+			ctx->ctrl_streak = 0;
+		else
+			ctx->ctrl_streak++;
+	}
+	else if (!list_empty(poll_q))
+	{
+		prio = FANCTL_PRIO_POLL;
+		ctx->ctrl_streak = 0;
+	}
+	else
+	{
+		ctx->wire_busy = false;
+		if (ctx->closing)
+			wake_up_all(&ctx->sched_wq); // fanctl_sched_shutdown()
+		return;
+	}
+	w = list_first_entry(&ctx->sched_q[prio], fanctl_waiter_t, node);
+	list_del_init(&w->node);
+	ctx->qstats[prio].depth--;
+	fanctl_sched_account(ctx, prio, w, ktime_get());
+	w->result = 0;
+	WRITE_ONCE(w->granted, true);
+	wake_up_all(&ctx->sched_wq);
+}
+
+/*
+ * Wait until the calling request owns the wire.
+ * Returns 0 on success, -ENODEV if the ldisc is being detached,
+ * or -ERESTARTSYS if the caller was killed while queued.
+ */
+int	fanctl_sched_acquire(fanctl_ctx_t *ctx, int prio)
+{
+	fanctl_waiter_t			w;
+	struct fanctl_qclass_stats	*qs;
+	int				ret;
+
+	if (prio < 0 || prio >= FANCTL_PRIO_NR)
+		return -EINVAL;
+	INIT_LIST_HEAD(&w.node);
+	w.enq_ts = ktime_get();
+	w.granted = false;
+	w.result = 0;
+	qs = &ctx->qstats[prio];
+
+	spin_lock(&ctx->sched_lock);
+	if (ctx->closing)
+	{
+		spin_unlock(&ctx->sched_lock);
+		return -ENODEV;
+	}
+	if (!ctx->wire_busy) // queues are always empty while the wire is idle
+	{
+		ctx->wire_busy = true;
+		fanctl_sched_account(ctx, prio, &w, w.enq_ts);
+		spin_unlock(&ctx->sched_lock);
+		return 0;
+	}
+	list_add_tail(&w.node, &ctx->sched_q[prio]);
+	qs->depth++;
+	if (qs->depth > qs->depth_max)
+		qs->depth_max = qs->depth;
+	spin_unlock(&ctx->sched_lock);
+
+	ret = wait_event_killable(ctx->sched_wq, READ_ONCE(w.granted));
+	if (!ret)
+		return w.result;
+
+	spin_lock(&ctx->sched_lock);
+	if (w.granted)
+	{
+		// ownership arrived together with the signal: pass it on
+		if (!w.result)
+			fanctl_sched_next(ctx);
+	}
+	else
+	{
+		list_del(&w.node);
+		qs->depth--;
+	}
+	spin_unlock(&ctx->sched_lock);
+	return ret;
+}
+
+void	fanctl_sched_release(fanctl_ctx_t *ctx)
+{
+	spin_lock(&ctx->sched_lock);
+	fanctl_sched_next(ctx);
+	spin_unlock(&ctx->sched_lock);
+}
+
+/*
+ * Abort all queued requests with -ENODEV, refuse new ones,
+ * wake up the current owner (if any) and wait for it to release the wire.
+ * Aborted waiters and the owner may still take sched_lock after this
+ * returns: they hold a reference on ctx (fanctl_get_active_ctx()), or
+ * are works cancelled by fanctl_link_stop() before ctx is put.
+ */
+void	fanctl_sched_shutdown(fanctl_ctx_t *ctx)
+{
+	fanctl_waiter_t	*w;
+	fanctl_waiter_t	*tmp;
+	int		i;
+
+	spin_lock(&ctx->sched_lock);
+	ctx->closing = true;
+	for (i = 0; i < FANCTL_PRIO_NR; i++)
+	{
+		list_for_each_entry_safe(w, tmp, &ctx->sched_q[i], node)
+		{
+			list_del_init(&w->node);
+			w->result = -ENODEV;
+			WRITE_ONCE(w->granted, true);
+		}
+		ctx->qstats[i].depth = 0;
+	}
+	wake_up_all(&ctx->sched_wq);
+	spin_unlock(&ctx->sched_lock);
+
+	complete_all(&ctx->resp_done); // owner sees `closing` and bails out
+	wait_event(ctx->sched_wq, !READ_ONCE(ctx->wire_busy));
+}
+
+void	fanctl_sched_get_stats(fanctl_ctx_t *ctx, struct fanctl_qstats *out)
+{
+	spin_lock(&ctx->sched_lock);
+	memcpy(out->cls, ctx->qstats, sizeof(out->cls));
+	spin_unlock(&ctx->sched_lock);
+}
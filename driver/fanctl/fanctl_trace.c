@@ -0,0 +1,170 @@
+#include "fanctl.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+#include <linux/relay.h>
+#include <linux/uaccess.h>
+#include <linux/atomic.h>
+
+/*
+ * Per-request latency trace
+ * -------------------------
+ * When enabled, fanctl_do_req() writes one record per request with the
+ * time it was submitted, granted the wire, written to the tty, answered
+ * and returned:
+ *
+ *   /sys/kernel/debug/fanctl/trace_enable   0 off
+ *                                           1 host timestamps
+ *                                           2 host + node timestamps
+ *   /sys/kernel/debug/fanctl/trace_dropped  records lost (buffers full)
+ *   /sys/kernel/debug/fanctl/trace0..N      per-CPU record streams
+ *
+ * In mode 2 addressed requests carry PROTO_CMD_F_TRACE, and the node
+ * appends its parse/dequeue/handler/send times to the response
+ * (docs/protocol.md). Firmware that predates the flag does not know the
+ * flagged commands, so only use mode 2 against nodes that support it.
+ *
+ * Record format: common/fanctl_trace.h, tools: userspace/fanctl_trace
+ */
+
+#define FANCTL_TRACE_SUBBUF_SIZE	(64 * 1024)
+#define FANCTL_TRACE_N_SUBBUFS		8
+
+DEFINE_STATIC_KEY_FALSE(fanctl_trace_key);
+
+static DEFINE_MUTEX(g_trace_lock); // serialize mode changes
+static struct rchan	*g_trace_chan;
+static atomic_t		g_trace_dropped = ATOMIC_INIT(0); // records lost, bumped from every CPU
+static u8		g_trace_mode;
+
+static struct dentry	*fanctl_trace_create_buf_file(const char *filename,
+				struct dentry *parent, umode_t mode,
+				struct rchan_buf *buf, int *is_global)
+{
+	return debugfs_create_file(filename, mode, parent, buf,
+				&relay_file_operations);
+}
+
+static int	fanctl_trace_remove_buf_file(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+	return 0;
+}
+
+static const struct rchan_callbacks	fanctl_trace_cb = {
+	.create_buf_file = fanctl_trace_create_buf_file,
+	.remove_buf_file = fanctl_trace_remove_buf_file,
+};
+
+/* Called from the request path once the request returned */
+void	__fanctl_trace(const struct fanctl_trace_rec *rec)
+{
+	unsigned long	flags;
+	void		*p;
+
+	if (!g_trace_chan)
+		return;
+	local_irq_save(flags);
+	p = relay_reserve(g_trace_chan, sizeof(*rec));
+	if (p)
+		memcpy(p, rec, sizeof(*rec));
+	else
+		atomic_inc(&g_trace_dropped);
+	local_irq_restore(flags);
+}
+
+/* Whether requests should ask the node for its timestamps */
+bool	fanctl_trace_node(void)
+{
+	return READ_ONCE(g_trace_mode) >= 2;
+}
+
+static int	fanctl_trace_set_mode(struct dentry *dir, u8 mode)
+{
+	int	ret;
+
+	ret = 0;
+	mutex_lock(&g_trace_lock);
+	if (mode && !g_trace_chan)
+	{
+		g_trace_chan = relay_open("trace", dir, FANCTL_TRACE_SUBBUF_SIZE,
+					FANCTL_TRACE_N_SUBBUFS, &fanctl_trace_cb, NULL);
+		if (!g_trace_chan)
+			ret = -ENOMEM;
+	}
+	if (!ret)
+	{
+		WRITE_ONCE(g_trace_mode, mode);
+		if (mode)
+			static_branch_enable(&fanctl_trace_key);
+		else
+		{
+			static_branch_disable(&fanctl_trace_key);
+			if (g_trace_chan)
+				relay_flush(g_trace_chan); // make partial sub-buffers readable
+		}
+	}
+	mutex_unlock(&g_trace_lock);
+	return ret;
+}
+
+static ssize_t	fanctl_trace_enable_read(struct file *filp, char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	char	buf[3];
+
+	buf[0] = '0' + READ_ONCE(g_trace_mode);
+	buf[1] = '\n';
+	buf[2] = '\0';
+	return simple_read_from_buffer(ubuf, count, ppos, buf, 2);
+}
+
+static ssize_t	fanctl_trace_enable_write(struct file *filp, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	u8	mode;
+	int	ret;
+
+	ret = kstrtou8_from_user(ubuf, count, 0, &mode);
+	if (ret)
+		return ret;
+	if (mode > 2)
+		return -EINVAL;
+	ret = fanctl_trace_set_mode(filp->f_path.dentry->d_parent, mode);
+	if (ret)
+		return ret;
+	return count;
+}
+
+static const struct file_operations	fanctl_trace_enable_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = fanctl_trace_enable_read,
+	.write = fanctl_trace_enable_write,
+	.llseek = default_llseek,
+};
+
+void	fanctl_trace_register(struct dentry *dir)
+{
+	if (IS_ERR_OR_NULL(dir))
+		return;
+	debugfs_create_file("trace_enable", 0600, dir, NULL,
+			&fanctl_trace_enable_fops);
+	debugfs_create_atomic_t("trace_dropped", 0400, dir, &g_trace_dropped);
+}
+
+void	fanctl_trace_unregister(void)
+{
+	mutex_lock(&g_trace_lock);
+	WRITE_ONCE(g_trace_mode, 0);
+	static_branch_disable(&fanctl_trace_key);
+	if (g_trace_chan)
+	{
+		relay_close(g_trace_chan);
+		g_trace_chan = NULL;
+	}
+	mutex_unlock(&g_trace_lock);
+}
@@ -0,0 +1,98 @@
+/*
+ * fan_node host build
+ * -------------------
+ * Runs the firmware tasks (main/) as a Linux process for profiling:
+ * FreeRTOS and the UART driver are shimmed on pthreads and a pty,
+ * DHT22 and SG90 are mocks.
+ *
+ *   fan_node_host [-l link] [-T temp] [-H humidity] [-D drift] [-q|-v]
+ *
+ * -l   create a symlink to the UART pty (e.g. /tmp/ttyFAN0)
+ * -T   mock temperature in °C (default 25)
+ * -H   mock humidity in % (default 40)
+ * -D   temperature drift in °C per second (default 0)
+ * -q   only log errors (handlers log every request otherwise)
+ * -v   debug logs (UART hexdumps)
+ *
+ * On SIGINT/SIGTERM the request latency (last request byte read ->
+ * response written) and the CPU time of each task are printed.
+ */
+
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "host.h"
+
+void	app_main(void);
+
+static void	print_profile(void)
+{
+	host_task_cpu_t		cpu[HOST_MAX_TASKS];
+	host_uart_stats_t	st;
+	uint64_t		req_cpu_ns;
+	size_t			n;
+	size_t			i;
+
+	host_uart_stats(&st);
+	fprintf(stderr, "\nrequests: %llu\n", (unsigned long long)st.requests);
+	if (st.requests)
+		fprintf(stderr, "latency us: min %.1f avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+			st.lat_ns_min / 1e3, st.lat_ns_total / 1e3 / st.requests,
+			st.lat_ns_p50 / 1e3, st.lat_ns_p99 / 1e3, st.lat_ns_max / 1e3);
+	req_cpu_ns = 0;
+	n = host_task_cpu(cpu, HOST_MAX_TASKS);
+	for (i = 0; i < n; i++)
+	{
+		fprintf(stderr, "cpu %-18s %10.3f ms\n", cpu[i].name, cpu[i].cpu_ns / 1e6);
+		if (!strcmp(cpu[i].name, "uart_read_task") || !strcmp(cpu[i].name, "cmd_handler_task"))
+			req_cpu_ns += cpu[i].cpu_ns;
+	}
+	if (st.requests)
+		fprintf(stderr, "cpu per request (uart_read + cmd_handler): %.2f us\n",
+			req_cpu_ns / 1e3 / st.requests);
+	fprintf(stderr, "servo moves: %u\n", host_sg90_moves());
+}
+
+int	main(int argc, char **argv)
+{
+	sigset_t	set;
+	float		temp;
+	float		humid;
+	float		drift;
+	int		sig;
+	int		opt;
+
+	temp = 25.0f;
+	humid = 40.0f;
+	drift = 0.0f;
+	while ((opt = getopt(argc, argv, "l:T:H:D:qvh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'l': host_uart_set_link(optarg); break;
+			case 'T': temp = strtof(optarg, NULL); break;
+			case 'H': humid = strtof(optarg, NULL); break;
+			case 'D': drift = strtof(optarg, NULL); break;
+			case 'q': g_esp_log_level = ESP_LOG_ERROR; break;
+			case 'v': g_esp_log_level = ESP_LOG_DEBUG; break;
+			default:
+				fprintf(stderr, "Usage: %s [-l link] [-T temp] [-H humidity] [-D drift] [-q|-v]\n",
+					argv[0]);
+				return 1;
+		}
+	}
+	host_dht_set(temp, humid, drift);
+	// tasks inherit the blocked mask, the signals are only taken here
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	app_main();
+	sigwait(&set, &sig);
+	print_profile();
+	host_uart_close();
+	return 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * DHT22 mock (host build)
+ * Replaces main/dht22.c: no GPIO bit-banging, readings follow a linear
+ * drift from the configured start values.
+ */
+
+#include "freertos/FreeRTOS.h"
+
+#include "dht22.h"
+#include "host.h"
+
+static float	g_temp = 25.0f;
+static float	g_humid = 40.0f;
+static float	g_drift; // °C per second
+static uint64_t	g_t0_ns;
+
+void	host_dht_set(float temp, float humid, float drift_per_s)
+{
+	g_temp = temp;
+	g_humid = humid;
+	g_drift = drift_per_s;
+}
+
+void	dht_gpio_init(void)
+{
+	g_t0_ns = host_now_ns();
+}
+
+bool	dht_read(float *out_temp, float *out_humid)
+{
+	float	t_s;
+
+	t_s = (float)(host_now_ns() - g_t0_ns) / 1e9f;
+	*out_temp = g_temp + g_drift * t_s;
+	*out_humid = g_humid;
+	return true;
+}
@@ -0,0 +1,26 @@
+/*
+ * SG90 mock (host build)
+ * Replaces main/sg90.c: counts the servo moves instead of driving LEDC.
+ */
+
+#include <stdatomic.h>
+
+#include "sg90.h"
+#include "host.h"
+
+static atomic_uint	g_moves;
+
+void	sg90_init(void)
+{
+}
+
+void	sg90_set_angle(uint16_t degree)
+{
+	(void)degree;
+	atomic_fetch_add(&g_moves, 1);
+}
+
+uint32_t	host_sg90_moves(void)
+{
+	return atomic_load(&g_moves);
+}
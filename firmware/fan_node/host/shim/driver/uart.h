@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * UART driver subset backed by a pseudo-terminal (host build)
+ * The pty is opened by uart_driver_install(), its slave side is what
+ * the host tools talk to.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+typedef int	uart_port_t;
+
+#define UART_NUM_0	0
+#define UART_NUM_1	1
+#define UART_NUM_2	2
+
+#define UART_PIN_NO_CHANGE	(-1)
+
+typedef enum { UART_DATA_5_BITS, UART_DATA_6_BITS, UART_DATA_7_BITS, UART_DATA_8_BITS }	uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE, UART_PARITY_EVEN, UART_PARITY_ODD }	uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1, UART_STOP_BITS_1_5, UART_STOP_BITS_2 }	uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE, UART_HW_FLOWCTRL_RTS, UART_HW_FLOWCTRL_CTS, UART_HW_FLOWCTRL_CTS_RTS }	uart_hw_flowcontrol_t;
+typedef enum { UART_MODE_UART, UART_MODE_RS485_HALF_DUPLEX }	uart_mode_t;
+
+typedef struct {
+	int			baud_rate;
+	uart_word_length_t	data_bits;
+	uart_parity_t		parity;
+	uart_stop_bits_t	stop_bits;
+	uart_hw_flowcontrol_t	flow_ctrl;
+}	uart_config_t;
+
+esp_err_t	uart_param_config(uart_port_t port, const uart_config_t *cfg);
+esp_err_t	uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+esp_err_t	uart_driver_install(uart_port_t port, int rx_buf_size, int tx_buf_size,
+				int queue_size, QueueHandle_t *queue, int intr_flags);
+esp_err_t	uart_set_mode(uart_port_t port, uart_mode_t mode);
+int		uart_read_bytes(uart_port_t port, void *buf, uint32_t len, TickType_t ticks);
+int		uart_write_bytes(uart_port_t port, const void *src, size_t size);
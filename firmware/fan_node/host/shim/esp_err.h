@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int	esp_err_t;
+
+#define ESP_OK		0
+#define ESP_FAIL	-1
+
+#define ESP_ERROR_CHECK(x) do {							\
+		esp_err_t	__err = (x);					\
+		if (__err != ESP_OK) {						\
+			fprintf(stderr, "ESP_ERROR_CHECK failed: %d at %s:%d\n",\
+				__err, __FILE__, __LINE__);			\
+			abort();						\
+		}								\
+	} while (0)
@@ -0,0 +1,47 @@
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "esp_log.h"
+#include "host.h"
+
+esp_log_level_t	g_esp_log_level = ESP_LOG_INFO;
+
+static const char	g_level_chr[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+
+void	esp_log_write(esp_log_level_t level, const char *tag, const char *fmt, ...)
+{
+	va_list	ap;
+
+	if (level > g_esp_log_level)
+		return;
+	flockfile(stderr);
+	fprintf(stderr, "%c (%llu) %s: ", g_level_chr[level],
+		(unsigned long long)(host_now_ns() / 1000000), tag);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	funlockfile(stderr);
+}
+
+void	esp_log_buffer_hexdump(const char *tag, const void *buf, size_t len,
+				esp_log_level_t level)
+{
+	const uint8_t	*p;
+	size_t		i;
+
+	if (level > g_esp_log_level)
+		return;
+	p = buf;
+	flockfile(stderr);
+	for (i = 0; i < len; i++)
+	{
+		if (i % 16 == 0)
+			fprintf(stderr, "%s%c (%llu) %s: 0x%04zx  ", i ? "\n" : "",
+				g_level_chr[level],
+				(unsigned long long)(host_now_ns() / 1000000), tag, i);
+		fprintf(stderr, "%02x ", p[i]);
+	}
+	fputc('\n', stderr);
+	funlockfile(stderr);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * ESP-IDF logging on stderr
+ * Same line format as the target ("I (1234) TAG: message"),
+ * the level is set with -v/-q of the host binary.
+ */
+typedef enum {
+	ESP_LOG_NONE,
+	ESP_LOG_ERROR,
+	ESP_LOG_WARN,
+	ESP_LOG_INFO,
+	ESP_LOG_DEBUG,
+	ESP_LOG_VERBOSE,
+}	esp_log_level_t;
+
+extern esp_log_level_t	g_esp_log_level;
+
+void	esp_log_write(esp_log_level_t level, const char *tag, const char *fmt, ...)
+		__attribute__((format(printf, 3, 4)));
+void	esp_log_buffer_hexdump(const char *tag, const void *buf, size_t len,
+				esp_log_level_t level);
+
+#define ESP_LOGE(tag, fmt, ...) esp_log_write(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) esp_log_write(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) esp_log_write(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) esp_log_write(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) esp_log_write(ESP_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buf, len, level) \
+	esp_log_buffer_hexdump(tag, buf, len, level)
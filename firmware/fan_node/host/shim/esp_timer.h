@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "host.h"
+
+/* µs since start, like the target's since boot */
+static inline int64_t	esp_timer_get_time(void)
+{
+	return (int64_t)(host_now_ns() / 1000);
+}
@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "host.h"
+
+struct host_task {
+	pthread_t	thread;
+	TaskFunction_t	fn;
+	void		*arg;
+	const char	*name;
+};
+
+struct host_queue {
+	pthread_mutex_t	lock;
+	pthread_cond_t	not_empty;
+	pthread_cond_t	not_full;
+	uint8_t		*buf;
+	UBaseType_t	len;
+	UBaseType_t	item_size;
+	UBaseType_t	head;
+	UBaseType_t	count;
+};
+
+struct host_sem {
+	pthread_mutex_t	lock;
+};
+
+static struct host_task	g_tasks[HOST_MAX_TASKS];
+static size_t		g_n_tasks;
+static pthread_mutex_t	g_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t	host_now_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Absolute CLOCK_MONOTONIC deadline `ticks` from now (for the *_timedwait calls). */
+static struct timespec	deadline_after(TickType_t ticks)
+{
+	struct timespec	ts;
+	uint64_t	ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ns = (uint64_t)ts.tv_nsec + (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ);
+	ts.tv_sec += ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	return ts;
+}
+
+static void	*task_entry(void *arg)
+{
+	struct host_task	*t;
+
+	t = arg;
+	pthread_setname_np(pthread_self(), t->name);
+	t->fn(t->arg);
+	return NULL;
+}
+
+BaseType_t	xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+				void *arg, UBaseType_t prio, TaskHandle_t *out)
+{
+	struct host_task	*t;
+
+	(void)stack_depth;
+	(void)prio;
+	pthread_mutex_lock(&g_tasks_lock);
+	if (g_n_tasks == HOST_MAX_TASKS)
+	{
+		pthread_mutex_unlock(&g_tasks_lock);
+		return pdFAIL;
+	}
+	t = &g_tasks[g_n_tasks];
+	t->fn = fn;
+	t->arg = arg;
+	t->name = name;
+	if (pthread_create(&t->thread, NULL, task_entry, t) != 0)
+	{
+		pthread_mutex_unlock(&g_tasks_lock);
+		return pdFAIL;
+	}
+	g_n_tasks++;
+	pthread_mutex_unlock(&g_tasks_lock);
+	if (out)
+		*out = t;
+	return pdPASS;
+}
+
+void	vTaskDelay(TickType_t ticks)
+{
+	struct timespec	ts;
+
+	ts = deadline_after(ticks);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+TickType_t	xTaskGetTickCount(void)
+{
+	return (TickType_t)(host_now_ns() / (1000000000ULL / configTICK_RATE_HZ));
+}
+
+/* CPU time consumed so far by each task thread. */
+size_t	host_task_cpu(host_task_cpu_t *out, size_t max)
+{
+	struct timespec	ts;
+	clockid_t	cid;
+	size_t		i;
+	size_t		n;
+
+	n = 0;
+	pthread_mutex_lock(&g_tasks_lock);
+	for (i = 0; i < g_n_tasks && n < max; i++)
+	{
+		if (pthread_getcpuclockid(g_tasks[i].thread, &cid) != 0
+			|| clock_gettime(cid, &ts) != 0)
+			continue;
+		out[n].name = g_tasks[i].name;
+		out[n].cpu_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+		n++;
+	}
+	pthread_mutex_unlock(&g_tasks_lock);
+	return n;
+}
+
+static void	cond_init_mono(pthread_cond_t *cond)
+{
+	pthread_condattr_t	attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/* Wait on `cond` for at most `ticks` (portMAX_DELAY: forever), lock held. */
+static bool	cond_wait_ticks(pthread_cond_t *cond, pthread_mutex_t *lock,
+				const struct timespec *deadline, TickType_t ticks)
+{
+	if (ticks == 0)
+		return false;
+	if (ticks == portMAX_DELAY)
+		return pthread_cond_wait(cond, lock) == 0;
+	return pthread_cond_timedwait(cond, lock, deadline) == 0;
+}
+
+QueueHandle_t	xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+	struct host_queue	*q;
+
+	q = calloc(1, sizeof(*q));
+	if (!q)
+		return NULL;
+	q->buf = calloc(len, item_size);
+	if (!q->buf)
+	{
+		free(q);
+		return NULL;
+	}
+	q->len = len;
+	q->item_size = item_size;
+	pthread_mutex_init(&q->lock, NULL);
+	cond_init_mono(&q->not_empty);
+	cond_init_mono(&q->not_full);
+	return q;
+}
+
+BaseType_t	xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+	struct timespec	deadline;
+
+	deadline = deadline_after(ticks);
+	pthread_mutex_lock(&q->lock);
+	while (q->count == q->len)
+	{
+		if (!cond_wait_ticks(&q->not_full, &q->lock, &deadline, ticks))
+		{
+			pthread_mutex_unlock(&q->lock);
+			return pdFALSE;
+		}
+	}
+	memcpy(q->buf + ((q->head + q->count) % q->len) * q->item_size, item, q->item_size);
+	q->count++;
+	pthread_cond_signal(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+	return pdTRUE;
+}
+
+BaseType_t	xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+	struct timespec	deadline;
+
+	deadline = deadline_after(ticks);
+	pthread_mutex_lock(&q->lock);
+	while (q->count == 0)
+	{
+		if (!cond_wait_ticks(&q->not_empty, &q->lock, &deadline, ticks))
+		{
+			pthread_mutex_unlock(&q->lock);
+			return pdFALSE;
+		}
+	}
+	memcpy(item, q->buf + q->head * q->item_size, q->item_size);
+	q->head = (q->head + 1) % q->len;
+	q->count--;
+	pthread_cond_signal(&q->not_full);
+	pthread_mutex_unlock(&q->lock);
+	return pdTRUE;
+}
+
+SemaphoreHandle_t	xSemaphoreCreateMutex(void)
+{
+	struct host_sem	*sem;
+
+	sem = calloc(1, sizeof(*sem));
+	if (!sem)
+		return NULL;
+	pthread_mutex_init(&sem->lock, NULL);
+	return sem;
+}
+
+BaseType_t	xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+	struct timespec	deadline;
+
+	if (ticks == portMAX_DELAY)
+		return pthread_mutex_lock(&sem->lock) == 0 ? pdTRUE : pdFALSE;
+	deadline = deadline_after(ticks);
+	return pthread_mutex_clocklock(&sem->lock, CLOCK_MONOTONIC, &deadline) == 0
+		? pdTRUE : pdFALSE;
+}
+
+BaseType_t	xSemaphoreGive(SemaphoreHandle_t sem)
+{
+	return pthread_mutex_unlock(&sem->lock) == 0 ? pdTRUE : pdFALSE;
+}
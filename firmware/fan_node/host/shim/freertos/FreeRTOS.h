@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+ * FreeRTOS API subset on POSIX threads
+ * ------------------------------------
+ * Only what firmware/fan_node/main uses. One tick is one millisecond,
+ * tasks are detached pthreads, priorities and stack sizes are ignored
+ * (the host scheduler decides).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_err.h"
+#include "freertos/portmacro.h"
+
+#define configTICK_RATE_HZ	1000
+
+#define pdFALSE		((BaseType_t)0)
+#define pdTRUE		((BaseType_t)1)
+#define pdPASS		pdTRUE
+#define pdFAIL		pdFALSE
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef long		BaseType_t;
+typedef unsigned long	UBaseType_t;
+typedef uint32_t	TickType_t;
+
+#define portMAX_DELAY	((TickType_t)0xFFFFFFFFUL)
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue	*QueueHandle_t;
+
+QueueHandle_t	xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+BaseType_t	xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks);
+BaseType_t	xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks);
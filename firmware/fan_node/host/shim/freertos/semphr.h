@@ -0,0 +1,9 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_sem	*SemaphoreHandle_t;
+
+SemaphoreHandle_t	xSemaphoreCreateMutex(void);
+BaseType_t		xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t		xSemaphoreGive(SemaphoreHandle_t sem);
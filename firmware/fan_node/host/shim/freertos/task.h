@@ -0,0 +1,11 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void	(*TaskFunction_t)(void *);
+typedef struct host_task	*TaskHandle_t;
+
+BaseType_t	xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+				void *arg, UBaseType_t prio, TaskHandle_t *out);
+void		vTaskDelay(TickType_t ticks);
+TickType_t	xTaskGetTickCount(void);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Host build hooks
+ * Used by host_main.c to configure the shims and collect the profile.
+ */
+
+#define HOST_MAX_TASKS	8
+
+typedef struct {
+	const char	*name;
+	uint64_t	cpu_ns;
+}	host_task_cpu_t;
+
+typedef struct {
+	uint64_t	requests; // responses matched to a request
+	uint64_t	lat_ns_total;
+	uint64_t	lat_ns_min;
+	uint64_t	lat_ns_max;
+	uint64_t	lat_ns_p50;
+	uint64_t	lat_ns_p99;
+}	host_uart_stats_t;
+
+uint64_t	host_now_ns(void);
+
+size_t		host_task_cpu(host_task_cpu_t *out, size_t max);
+
+void		host_uart_set_link(const char *path);
+void		host_uart_close(void);
+void		host_uart_stats(host_uart_stats_t *out);
+
+// mocks
+void		host_dht_set(float temp, float humid, float drift_per_s);
+uint32_t	host_sg90_moves(void);
@@ -0,0 +1,9 @@
+#pragma once
+
+/*
+ * Host build configuration (replaces the generated sdkconfig.h)
+ * Override with `make NODE_ADDR=<n>`.
+ */
+#ifndef CONFIG_FAN_NODE_ADDR
+# define CONFIG_FAN_NODE_ADDR 0
+#endif
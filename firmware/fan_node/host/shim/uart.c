@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <termios.h>
+#include <pthread.h>
+
+#include "driver/uart.h"
+#include "proto.h"
+#include "host.h"
+
+/*
+ * pty-backed UART
+ * ---------------
+ * uart_read_bytes() keeps the ESP-IDF semantics: it returns once `len`
+ * bytes were read or `ticks` expired, whichever comes first.
+ *
+ * Both directions are also tapped with a protocol parser so every
+ * response can be matched (by SEQ) to the request that caused it:
+ * latency = response written - last request byte read.
+ */
+
+#define LAT_SAMPLES_MAX	(1 << 20)
+
+static int		g_master = -1;
+static const char	*g_link_path;
+
+static pthread_mutex_t	g_tap_lock = PTHREAD_MUTEX_INITIALIZER;
+static proto_rx_t	g_tap_rx;
+static proto_rx_t	g_tap_tx;
+static uint64_t		g_req_ns[256]; // request arrival by SEQ, 0: none
+static uint64_t		*g_lat;
+static size_t		g_n_lat;
+
+void	host_uart_set_link(const char *path)
+{
+	g_link_path = path;
+}
+
+void	host_uart_close(void)
+{
+	if (g_link_path)
+		unlink(g_link_path);
+}
+
+esp_err_t	uart_param_config(uart_port_t port, const uart_config_t *cfg)
+{
+	(void)port;
+	(void)cfg;
+	return ESP_OK;
+}
+
+esp_err_t	uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+	(void)port;
+	(void)tx;
+	(void)rx;
+	(void)rts;
+	(void)cts;
+	return ESP_OK;
+}
+
+esp_err_t	uart_set_mode(uart_port_t port, uart_mode_t mode)
+{
+	(void)port;
+	(void)mode;
+	return ESP_OK;
+}
+
+esp_err_t	uart_driver_install(uart_port_t port, int rx_buf_size, int tx_buf_size,
+				int queue_size, QueueHandle_t *queue, int intr_flags)
+{
+	struct termios	tio;
+	const char	*slave;
+	int		slave_fd;
+
+	(void)port;
+	(void)rx_buf_size;
+	(void)tx_buf_size;
+	(void)queue_size;
+	(void)queue;
+	(void)intr_flags;
+	g_master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (g_master < 0 || grantpt(g_master) < 0 || unlockpt(g_master) < 0)
+		return ESP_FAIL;
+	slave = ptsname(g_master);
+	if (!slave)
+		return ESP_FAIL;
+	// held open for the whole run: keeps raw mode and avoids EIO on the master
+	slave_fd = open(slave, O_RDWR | O_NOCTTY);
+	if (slave_fd < 0)
+		return ESP_FAIL;
+	if (tcgetattr(slave_fd, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		cfsetspeed(&tio, B115200);
+		tcsetattr(slave_fd, TCSANOW, &tio);
+	}
+	if (g_link_path)
+	{
+		unlink(g_link_path);
+		if (symlink(slave, g_link_path) < 0)
+			return ESP_FAIL;
+	}
+	fcntl(g_master, F_SETFL, fcntl(g_master, F_GETFL) | O_NONBLOCK);
+	proto_rx_init(&g_tap_rx);
+	proto_rx_init(&g_tap_tx);
+	g_lat = calloc(LAT_SAMPLES_MAX, sizeof(*g_lat));
+	fprintf(stderr, "UART on %s\n", g_link_path ? g_link_path : slave);
+	return ESP_OK;
+}
+
+static void	tap_rx(const uint8_t *buf, size_t len, uint64_t now)
+{
+	proto_frame_t	f;
+	size_t		i;
+
+	pthread_mutex_lock(&g_tap_lock);
+	for (i = 0; i < len; i++)
+		if (proto_rx_feed(&g_tap_rx, buf[i], &f) && f.addr != PROTO_ADDR_BROADCAST)
+			g_req_ns[f.seq] = now;
+	pthread_mutex_unlock(&g_tap_lock);
+}
+
+static void	tap_tx(const uint8_t *buf, size_t len, uint64_t now)
+{
+	proto_frame_t	f;
+	size_t		i;
+
+	pthread_mutex_lock(&g_tap_lock);
+	for (i = 0; i < len; i++)
+	{
+		if (!proto_rx_feed(&g_tap_tx, buf[i], &f) || !g_req_ns[f.seq])
+			continue;
+		if (g_lat && g_n_lat < LAT_SAMPLES_MAX)
+			g_lat[g_n_lat++] = now - g_req_ns[f.seq];
+		g_req_ns[f.seq] = 0;
+	}
+	pthread_mutex_unlock(&g_tap_lock);
+}
+
+int	uart_read_bytes(uart_port_t port, void *buf, uint32_t len, TickType_t ticks)
+{
+	struct pollfd	pfd;
+	uint64_t	deadline;
+	uint64_t	now;
+	uint32_t	got;
+	ssize_t		n;
+	int		timeout_ms;
+
+	(void)port;
+	if (g_master < 0)
+		return -1;
+	deadline = host_now_ns() + (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ);
+	got = 0;
+	pfd.fd = g_master;
+	pfd.events = POLLIN;
+	while (got < len)
+	{
+		n = read(g_master, (uint8_t *)buf + got, len - got);
+		if (n > 0)
+		{
+			tap_rx((uint8_t *)buf + got, (size_t)n, host_now_ns());
+			got += (uint32_t)n;
+			continue;
+		}
+		if (n < 0 && errno != EAGAIN && errno != EIO)
+			return -1;
+		now = host_now_ns();
+		if (now >= deadline)
+			break;
+		timeout_ms = (int)((deadline - now + 999999) / 1000000);
+		if (poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR)
+			return -1;
+	}
+	return (int)got;
+}
+
+int	uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+	ssize_t	n;
+
+	(void)port;
+	if (g_master < 0)
+		return -1;
+	n = write(g_master, src, size);
+	if (n > 0)
+		tap_tx(src, (size_t)n, host_now_ns());
+	return (int)n;
+}
+
+static int	cmp_u64(const void *a, const void *b)
+{
+	uint64_t	x;
+	uint64_t	y;
+
+	x = *(const uint64_t *)a;
+	y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+void	host_uart_stats(host_uart_stats_t *out)
+{
+	size_t	i;
+
+	memset(out, 0, sizeof(*out));
+	pthread_mutex_lock(&g_tap_lock);
+	if (g_n_lat > 0)
+	{
+		qsort(g_lat, g_n_lat, sizeof(*g_lat), cmp_u64);
+		out->requests = g_n_lat;
+		for (i = 0; i < g_n_lat; i++)
+			out->lat_ns_total += g_lat[i];
+		out->lat_ns_min = g_lat[0];
+		out->lat_ns_max = g_lat[g_n_lat - 1];
+		out->lat_ns_p50 = g_lat[g_n_lat / 2];
+		out->lat_ns_p99 = g_lat[(g_n_lat * 99) / 100];
+	}
+	pthread_mutex_unlock(&g_tap_lock);
+}
@@ -16,6 +16,7 @@ static void	send_ack(proto_frame_t *req, const uint8_t status)
 	proto_frame_t	resp;
 
 	resp.cmd = PROTO_CMD_ACK;
+	resp.addr = req->addr;
 	resp.seq = req->seq;
 	resp.payload[0] = req->cmd;
 	resp.payload[1] = status;
@@ -51,6 +52,7 @@ void	handle_status_req(proto_frame_t *req)
 	printf("   errors: 0x%04X\n\n", status.errors);
 	
 	resp.cmd = PROTO_CMD_STATUS_RESP;
+	resp.addr = req->addr;
 	resp.seq = req->seq;
 	resp.len = sizeof(status);
 	memcpy(resp.payload, &status, sizeof(status));
@@ -143,6 +145,7 @@ void	handle_ping(proto_frame_t *req)
 	proto_frame_t	resp;
 
 	resp.cmd = PROTO_CMD_PONG;
+	resp.addr = req->addr;
 	resp.seq = req->seq;
 	resp.len = 0;
 	if (!comm_send_frame(&resp))
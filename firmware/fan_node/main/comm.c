@@ -1,7 +1,18 @@
+#include "esp_timer.h"
+
 #include "comm.h"
 
 static const char	*TAG = "COMM";
 
+/*
+ * Request tracing
+ * A request with PROTO_CMD_F_TRACE gets the node timestamps appended to
+ * its response (proto_trace_t). Responses are only sent by
+ * cmd_handler_task, one request at a time, so one trace is enough.
+ */
+static bool				g_trace_on;
+static proto_trace_t	g_trace;
+
 void	comm_init(void)
 {
 	uart_config_t	uart_config = {
@@ -12,23 +23,76 @@ void	comm_init(void)
 		.flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
 	};
 	ESP_ERROR_CHECK(uart_param_config(COMM_UART, &uart_config));
+#ifdef COMM_RS485_DE_PIN
+	// RTS drives the transceiver's DE/RE pin in RS-485 half-duplex mode
+	ESP_ERROR_CHECK(uart_set_pin(COMM_UART,
+				COMM_TX_PIN,
+				COMM_RX_PIN,
+				COMM_RS485_DE_PIN,
+				UART_PIN_NO_CHANGE));
+#else
 	ESP_ERROR_CHECK(uart_set_pin(COMM_UART,
 				COMM_TX_PIN,
 				COMM_RX_PIN,
 				UART_PIN_NO_CHANGE,
 				UART_PIN_NO_CHANGE));
+#endif
 	ESP_ERROR_CHECK(uart_driver_install(COMM_UART, 2048, 0, 0, NULL, 0));
+#ifdef COMM_RS485_DE_PIN
+	ESP_ERROR_CHECK(uart_set_mode(COMM_UART, UART_MODE_RS485_HALF_DUPLEX));
+#endif
+	ESP_LOGI(TAG, "node address: %d", COMM_NODE_ADDR);
+}
+
+/*
+ * Multi-drop filter
+ * - point-to-point node (COMM_NODE_ADDR == PROTO_ADDR_NONE):
+ *   unaddressed and broadcast frames
+ * - addressed node: frames addressed to this node and broadcast frames
+ */
+bool	comm_frame_is_for_me(const proto_frame_t *frame)
+{
+	if (frame->addr == PROTO_ADDR_BROADCAST)
+		return true;
+	return frame->addr == COMM_NODE_ADDR;
+}
+
+/* Start the trace of a dequeued request, strips PROTO_CMD_F_TRACE from it */
+void	comm_trace_begin(proto_frame_t *req, uint32_t parse_us)
+{
+	g_trace_on = (req->cmd & PROTO_CMD_F_TRACE) != 0;
+	req->cmd &= ~PROTO_CMD_F_TRACE;
+	g_trace.parse_us = parse_us;
+	g_trace.dequeue_us = (uint32_t)esp_timer_get_time();
+	g_trace.handler_us = g_trace.dequeue_us;
+	g_trace.send_us = 0;
+}
+
+void	comm_trace_handler(void)
+{
+	g_trace.handler_us = (uint32_t)esp_timer_get_time();
 }
 
 bool	comm_send_frame(const proto_frame_t *frame)
 {
-	uint8_t		buf[2 + 3 + PROTO_MAX_PAYLOAD + 2]; // SYNC(2) + CMD/SEQ/LEN(3) + PAYLOAD + CRC16(2)
-	uint16_t	out_len;
-	uint16_t	written_len;
+	uint8_t			buf[PROTO_MAX_FRAME];
+	proto_frame_t	traced;
+	uint16_t		out_len;
+	uint16_t		written_len;
 
 	if (!frame || frame->len > PROTO_MAX_PAYLOAD)
 		return false;
-	if (!proto_build_frame(frame->cmd, frame->seq, frame->payload,
+	if (frame->addr == PROTO_ADDR_BROADCAST) // broadcast requests are never answered
+		return true;
+	if (g_trace_on)
+	{
+		g_trace_on = false;
+		traced = *frame;
+		g_trace.send_us = (uint32_t)esp_timer_get_time();
+		if (proto_trace_append(&traced, &g_trace))
+			frame = &traced;
+	}
+	if (!proto_build_frame_addr(frame->addr, frame->cmd, frame->seq, frame->payload,
 							frame->len, buf, &out_len))
 	{
 		ESP_LOGE(TAG, "Failed to build frame (cmd=0x%02X)", frame->cmd);
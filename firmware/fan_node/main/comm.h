@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "sdkconfig.h"
 #include "driver/uart.h"
 
 #include "proto.h"
@@ -11,5 +12,15 @@
 #define COMM_TX_PIN 16
 #define COMM_RX_PIN 17
 
+// multi-drop address of this node (Kconfig), PROTO_ADDR_NONE when point-to-point
+#define COMM_NODE_ADDR CONFIG_FAN_NODE_ADDR
+
+#ifdef CONFIG_FAN_NODE_RS485
+# define COMM_RS485_DE_PIN CONFIG_FAN_NODE_RS485_DE_PIN
+#endif
+
 void	comm_init(void);
 bool	comm_send_frame(const proto_frame_t *frame);
+bool	comm_frame_is_for_me(const proto_frame_t *frame);
+void	comm_trace_begin(proto_frame_t *req, uint32_t parse_us);
+void	comm_trace_handler(void);
@@ -13,7 +13,7 @@ void app_main(void)
 
 	ESP_LOGI("MAIN", "app_main start");
 
-	g_cmd_queue = xQueueCreate(8, sizeof(proto_frame_t));
+	g_cmd_queue = xQueueCreate(8, sizeof(cmd_msg_t));
 	if (!g_cmd_queue)
 	{
 		ESP_LOGE("MAIN", "Failed to create cmd queue");
@@ -25,4 +25,10 @@ void	sys_state_set_fan_state(proto_fan_state_t state);
 void	sys_state_set_fan_mode(proto_fan_mode_t mode);
 void	sys_state_set_threshold(float t);
 
+// element of g_cmd_queue
+typedef struct {
+	proto_frame_t	frame;
+	uint32_t		parse_us; // esp_timer_get_time() when the frame was parsed
+}	cmd_msg_t;
+
 extern QueueHandle_t	g_cmd_queue;
@@ -1,4 +1,5 @@
 #include "driver/uart.h"
+#include "esp_timer.h"
 
 #include "sys_state.h"
 #include "sg90.h"
@@ -12,6 +13,7 @@ void	sensor_task(void *arg)
 	float	t;
 	float	h;
 
+	(void)arg;
 	vTaskDelay(pdMS_TO_TICKS(3000));
 	dht_gpio_init();
 	while (1)
@@ -38,6 +40,7 @@ void	fan_control_task(void *arg)
 {
 	sys_state_t	state;
 
+	(void)arg;
 	sg90_init();
 	while (1)
 	{
@@ -74,8 +77,9 @@ void	uart_read_task(void *arg)
 	uint8_t			rx_buf[128];
 	int				read_len;
 	proto_rx_t		rx;
-	proto_frame_t	frame;
+	cmd_msg_t		msg;
 
+	(void)arg;
 	comm_init();
 	proto_rx_init(&rx);
 	while (1)
@@ -87,9 +91,12 @@ void	uart_read_task(void *arg)
 			ESP_LOG_BUFFER_HEXDUMP("UART", rx_buf, read_len, ESP_LOG_DEBUG);
 			for (int i = 0; i < read_len; i++)
 			{
-				if (proto_rx_feed(&rx, rx_buf[i], &frame)) {
-					if (xQueueSend(g_cmd_queue, &frame, pdMS_TO_TICKS(50)) != pdTRUE)
-						ESP_LOGE("UART", "Queue full, drop cmd 0x%02X", frame.cmd);
+				if (proto_rx_feed(&rx, rx_buf[i], &msg.frame)) {
+					if (!comm_frame_is_for_me(&msg.frame)) // another node on the bus
+						continue;
+					msg.parse_us = (uint32_t)esp_timer_get_time();
+					if (xQueueSend(g_cmd_queue, &msg, pdMS_TO_TICKS(50)) != pdTRUE)
+						ESP_LOGE("UART", "Queue full, drop cmd 0x%02X", msg.frame.cmd);
 				}
 			}
 		}
@@ -98,36 +105,45 @@ void	uart_read_task(void *arg)
 
 void	cmd_handler_task(void *arg)
 {
-	proto_frame_t	req;
+	cmd_msg_t		msg;
+	proto_frame_t	*req;
 
+	(void)arg;
+	req = &msg.frame;
 	while (1)
 	{
-		if (xQueueReceive(g_cmd_queue, &req, portMAX_DELAY) == pdTRUE)
+		if (xQueueReceive(g_cmd_queue, &msg, portMAX_DELAY) == pdTRUE)
 		{
-			switch (req.cmd)
+			comm_trace_begin(req, msg.parse_us);
+			switch (req->cmd)
 			{
 				case PROTO_CMD_STATUS_REQ:
 					ESP_LOGI("CMD", "CMD received: STATUS_REQ");
-					handle_status_req(&req);
+					comm_trace_handler();
+					handle_status_req(req);
 					break;
 				case PROTO_CMD_SET_FAN_MODE:
 					ESP_LOGI("CMD", "CMD received: SET_FAN_MODE");
-					handle_set_fan_mode(&req);
+					comm_trace_handler();
+					handle_set_fan_mode(req);
 					break;
 				case PROTO_CMD_SET_FAN_STATE:
 					ESP_LOGI("CMD", "CMD received: SET_FAN_STATE");
-					handle_set_fan_state(&req);
+					comm_trace_handler();
+					handle_set_fan_state(req);
 					break;
 				case PROTO_CMD_SET_THRESHOLD:
 					ESP_LOGI("CMD", "CMD received: SET_THRESHOLD");
-					handle_set_threshold(&req);
+					comm_trace_handler();
+					handle_set_threshold(req);
 					break;
 				case PROTO_CMD_PING:
 					ESP_LOGI("CMD", "CMD received: PING");
-					handle_ping(&req);
+					comm_trace_handler();
+					handle_ping(req);
 					break;
 				default:
-					ESP_LOGW("CMD", "Unknown CMD 0x%02X", req.cmd);
+					ESP_LOGW("CMD", "Unknown CMD 0x%02X", req->cmd);
 					break;
 			}
 		}
@@ -0,0 +1 @@
+#include "../../userspace/fanctl_load/hist.c"
@@ -0,0 +1,556 @@
+/*
+ * fanmodel
+ * --------
+ * Offline capacity model of a fanctl link (see model.h): predicts
+ * throughput, queueing delay and RTT percentiles for a node count,
+ * polling rate, command mix and baud rate without hardware.
+ *
+ *   fanmodel [-b baud] [-n nodes] [-c workers | -r rate | -M hz] [-e] [-m mix]
+ *            [-U] [-H host_us] [-J jitter_us] [-F handle_us] [-W window_ms] [-I]
+ *            [-g guard_us] [-S slot_ms] [-P pipeline] [-t seconds] [-w warmup_s]
+ *            [-s seed] [-x param=v1,v2,...] [-K fanctl_load.json]... [-j] [-v]
+ *
+ * -b   baud rate, 8N1, 0 = no wire time, e.g. a pty (default 115200)
+ * -n   addressed nodes on a multi-drop bus, 0 = point-to-point (default 0)
+ * -c   closed loop: concurrent callers (default 1)
+ * -r   open loop: total request rate, round robin over the nodes
+ * -M   open loop: polling rate per node (-r = nodes * hz)
+ * -e   exponential inter-arrival times instead of a fixed period
+ * -m   command mix, as fanctl_load (default status=1)
+ * -U   requests take no wire time (fansim paces its replies only)
+ * -H   host overhead per request in µs: syscall, ldisc, wakeup (default 0)
+ * -J   mean of an exponentially distributed extra host time in µs (default 0)
+ * -F   firmware handling time per request in µs (default 0)
+ * -W   uart_read_bytes() timeout of uart_read_task in ms, 0 = frames are
+ *      handed over as soon as they are complete (default 100)
+ * -I   the timeout restarts with every received chunk (instead of per call)
+ * -g   bus_guard_us (default 500), -S slot_ms (default 250)
+ * -P   requests in flight to different nodes (driver: 1), what-if only
+ * -t   simulated seconds (default 60), -w warmup seconds (default 0)
+ * -x   sweep one parameter: baud, nodes, hz, rate, workers, window, pipeline
+ * -K   calibrate -H/-J against fanctl_load -j output: the first file fits
+ *      p50 and p99, further files are compared with the fitted model
+ * -j   JSON output
+ * -v   print frame sizes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "model.h"
+
+#define MAX_SWEEP	64
+#define MAX_CALIB	16
+#define CALIB_ROUNDS	8
+
+static const char	*g_cmd_names[MODEL_CMD_NR] = {
+	[MODEL_CMD_STATUS]	= "status",
+	[MODEL_CMD_PING]	= "ping",
+	[MODEL_CMD_THRESHOLD]	= "threshold",
+	[MODEL_CMD_AUTO]	= "auto",
+};
+
+static const double	g_pcts[] = { 50, 90, 99, 99.9 };
+
+/* "status=8,ping=1" -> weights */
+static bool	parse_mix(model_cfg_t *cfg, const char *spec)
+{
+	char		name[16];
+	unsigned	w;
+	unsigned	sum;
+	int		n;
+	int		i;
+
+	memset(cfg->weights, 0, sizeof(cfg->weights));
+	sum = 0;
+	while (*spec)
+	{
+		if (sscanf(spec, "%15[a-z]=%u%n", name, &w, &n) != 2)
+			return false;
+		for (i = 0; i < MODEL_CMD_NR; i++)
+			if (!strcmp(name, g_cmd_names[i]))
+				break;
+		if (i == MODEL_CMD_NR)
+			return false;
+		cfg->weights[i] = w;
+		sum += w;
+		spec += n;
+		if (*spec == ',')
+			spec++;
+		else if (*spec)
+			return false;
+	}
+	return sum > 0;
+}
+
+static double	ms(uint64_t ns)
+{
+	return (double)ns / 1e6;
+}
+
+/* ------------------------------------------------------------------------ */
+
+typedef enum {
+	SWEEP_NONE,
+	SWEEP_BAUD,
+	SWEEP_NODES,
+	SWEEP_HZ,
+	SWEEP_RATE,
+	SWEEP_WORKERS,
+	SWEEP_WINDOW,
+	SWEEP_PIPELINE,
+}	sweep_t;
+
+static const char	*g_sweep_names[] = {
+	[SWEEP_BAUD]		= "baud",
+	[SWEEP_NODES]		= "nodes",
+	[SWEEP_HZ]		= "hz",
+	[SWEEP_RATE]		= "rate",
+	[SWEEP_WORKERS]		= "workers",
+	[SWEEP_WINDOW]		= "window",
+	[SWEEP_PIPELINE]	= "pipeline",
+};
+
+static bool	parse_sweep(const char *spec, sweep_t *param, double *vals, int *n_vals)
+{
+	const char	*p;
+	char		*end;
+	size_t		len;
+	int		i;
+
+	p = strchr(spec, '=');
+	if (!p)
+		return false;
+	len = (size_t)(p - spec);
+	*param = SWEEP_NONE;
+	for (i = SWEEP_BAUD; i <= SWEEP_PIPELINE; i++)
+		if (strlen(g_sweep_names[i]) == len && !strncmp(spec, g_sweep_names[i], len))
+			*param = (sweep_t)i;
+	if (*param == SWEEP_NONE)
+		return false;
+	*n_vals = 0;
+	p++;
+	while (*p && *n_vals < MAX_SWEEP)
+	{
+		vals[*n_vals] = strtod(p, &end);
+		if (end == p)
+			return false;
+		(*n_vals)++;
+		p = *end == ',' ? end + 1 : end;
+		if (*end && *end != ',')
+			return false;
+	}
+	return *n_vals > 0;
+}
+
+/* per-node rate follows the node count unless -r was given */
+static void	apply_sweep(model_cfg_t *cfg, sweep_t param, double v, double hz)
+{
+	switch (param)
+	{
+		case SWEEP_BAUD: cfg->baud = (uint32_t)v; break;
+		case SWEEP_NODES: cfg->nodes = (int)v; break;
+		case SWEEP_HZ: hz = v; break;
+		case SWEEP_RATE: cfg->rate = v; break;
+		case SWEEP_WORKERS: cfg->workers = (int)v; cfg->rate = 0; break;
+		case SWEEP_WINDOW: cfg->window_ns = (int64_t)(v * 1e6); break;
+		case SWEEP_PIPELINE: cfg->pipeline = (int)v; break;
+		default: break;
+	}
+	if (hz > 0)
+		cfg->rate = hz * (cfg->nodes ? cfg->nodes : 1);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void	print_frames(const model_cfg_t *cfg)
+{
+	int	i;
+
+	printf("frame bytes (req/resp, %s):", cfg->nodes ? "addressed" : "point-to-point");
+	for (i = 0; i < MODEL_CMD_NR; i++)
+		printf(" %s %u/%u", g_cmd_names[i], model_req_bytes(cfg, (model_cmd_t)i),
+			model_resp_bytes(cfg, (model_cmd_t)i));
+	printf(", %.1f µs/byte\n", cfg->baud ? 1e7 / cfg->baud : 0.0);
+}
+
+static void	print_text(const model_cfg_t *cfg, const model_result_t *r)
+{
+	char	label[16];
+	size_t	i;
+
+	printf("link: %u baud, %d %s, window %.0f ms (%s), pipeline %d\n", cfg->baud,
+		cfg->nodes ? cfg->nodes : 1, cfg->nodes ? "addressed nodes" : "point-to-point node",
+		(double)cfg->window_ns / 1e6, cfg->rx_mode == MODEL_RX_IDLE ? "idle" : "per call",
+		cfg->pipeline);
+	if (cfg->rate > 0)
+		printf("load: %.1f req/s offered (%s)\n", cfg->rate, cfg->poisson ? "poisson" : "fixed");
+	else
+		printf("load: %d closed-loop callers\n", cfg->workers);
+	printf("throughput %.1f req/s, bus busy %.1f %%, timeouts %llu, dropped %llu\n",
+		(double)r->completed / r->elapsed_s, r->bus_util * 100,
+		(unsigned long long)r->timeouts, (unsigned long long)r->dropped);
+	if (!r->rtt.count)
+		return;
+	printf("%-10s", "ms");
+	for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+	{
+		snprintf(label, sizeof(label), "p%g", g_pcts[i]);
+		printf(" %10s", label);
+	}
+	printf("\n%-10s", "wait");
+	for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+		printf(" %10.3f", ms(hist_percentile(&r->wait, g_pcts[i])));
+	if (r->wait_ctrl.count)
+	{
+		printf("\n%-10s", "wait ctrl");
+		for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+			printf(" %10.3f", ms(hist_percentile(&r->wait_ctrl, g_pcts[i])));
+	}
+	printf("\n%-10s", "rtt");
+	for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+		printf(" %10.3f", ms(hist_percentile(&r->rtt, g_pcts[i])));
+	printf("\n");
+}
+
+static void	print_row_header(sweep_t param)
+{
+	printf("%10s %10s %10s %6s %9s %9s %9s %9s %8s\n", g_sweep_names[param], "offered/s",
+		"done/s", "bus%", "wait_p50", "wait_p99", "rtt_p50", "rtt_p99", "timeouts");
+}
+
+static void	print_row(double v, const model_cfg_t *cfg, const model_result_t *r)
+{
+	double	offered;
+
+	offered = (double)r->offered / r->elapsed_s;
+	printf("%10g %10.1f %10.1f %6.1f %9.3f %9.3f %9.3f %9.3f %8llu%s\n", v, offered,
+		(double)r->completed / r->elapsed_s, r->bus_util * 100,
+		ms(hist_percentile(&r->wait, 50)), ms(hist_percentile(&r->wait, 99)),
+		ms(hist_percentile(&r->rtt, 50)), ms(hist_percentile(&r->rtt, 99)),
+		(unsigned long long)r->timeouts,
+		cfg->rate > 0 && (double)r->completed / r->elapsed_s < 0.98 * offered ? "  overload" : "");
+}
+
+static void	print_json(const model_cfg_t *cfg, const model_result_t *r)
+{
+	size_t	i;
+	int	c;
+
+	printf("{\"baud\":%u,\"nodes\":%d,\"workers\":%d,\"rate\":%g,\"poisson\":%s,"
+		"\"host_us\":%.1f,\"jitter_us\":%.1f,\"handle_us\":%.1f,\"window_ms\":%g,\"rx_mode\":\"%s\","
+		"\"pipeline\":%d,\"mix\":{", cfg->baud, cfg->nodes, cfg->rate > 0 ? 0 : cfg->workers,
+		cfg->rate, cfg->poisson ? "true" : "false", (double)cfg->host_ns / 1e3,
+		(double)cfg->host_jitter_ns / 1e3,
+		(double)cfg->handle_ns / 1e3, (double)cfg->window_ns / 1e6,
+		cfg->rx_mode == MODEL_RX_IDLE ? "idle" : "call", cfg->pipeline);
+	for (c = 0; c < MODEL_CMD_NR; c++)
+		printf("%s\"%s\":%u", c ? "," : "", g_cmd_names[c], cfg->weights[c]);
+	printf("},\"offered_per_s\":%.3f,\"ops_per_s\":%.3f,\"bus_util\":%.4f,"
+		"\"timeouts\":%llu,\"dropped\":%llu", (double)r->offered / r->elapsed_s,
+		(double)r->completed / r->elapsed_s, r->bus_util,
+		(unsigned long long)r->timeouts, (unsigned long long)r->dropped);
+	printf(",\"wait_ns\":{");
+	for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+		printf("%s\"p%g\":%llu", i ? "," : "", g_pcts[i],
+			(unsigned long long)hist_percentile(&r->wait, g_pcts[i]));
+	printf("},\"rtt_ns\":{");
+	for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+		printf("%s\"p%g\":%llu", i ? "," : "", g_pcts[i],
+			(unsigned long long)hist_percentile(&r->rtt, g_pcts[i]));
+	printf("}}");
+}
+
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+	const char	*path;
+	int		workers;
+	double		rate;
+	unsigned	weights[MODEL_CMD_NR];
+	double		ops;
+	double		pct[4]; // g_pcts, ns
+}	calib_t;
+
+static bool	json_num(const char *buf, const char *end, const char *key, double *out)
+{
+	char		pat[32];
+	const char	*p;
+
+	snprintf(pat, sizeof(pat), "\"%s\":", key);
+	p = strstr(buf, pat);
+	if (!p || (end && p >= end))
+		return false;
+	*out = strtod(p + strlen(pat), NULL);
+	return true;
+}
+
+/* The few fields of a fanctl_load -j report the model needs */
+static bool	load_calib(const char *path, calib_t *c)
+{
+	static char	buf[1 << 16];
+	const char	*mix;
+	const char	*lat;
+	char		key[16];
+	size_t		n;
+	double		v;
+	FILE		*f;
+	size_t		i;
+	int		k;
+
+	f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[n] = '\0';
+	memset(c, 0, sizeof(*c));
+	c->path = path;
+	mix = strstr(buf, "\"mix\":{");
+	lat = strstr(buf, "\"latency_ns\":{");
+	if (!mix || !lat || !json_num(buf, NULL, "workers", &v))
+		goto bad;
+	c->workers = (int)v;
+	if (!json_num(buf, NULL, "rate", &c->rate) || !json_num(buf, NULL, "ops_per_s", &c->ops))
+		goto bad;
+	for (k = 0; k < MODEL_CMD_NR; k++)
+		if (json_num(mix, strchr(mix, '}'), g_cmd_names[k], &v))
+			c->weights[k] = (unsigned)v;
+	for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+	{
+		snprintf(key, sizeof(key), "p%g", g_pcts[i]);
+		if (!json_num(lat, NULL, key, &c->pct[i]))
+			goto bad;
+	}
+	return true;
+bad:
+	fprintf(stderr, "%s: not a fanctl_load -j report\n", path);
+	return false;
+}
+
+static void	calib_cfg(model_cfg_t *cfg, const calib_t *c)
+{
+	memcpy(cfg->weights, c->weights, sizeof(cfg->weights));
+	cfg->workers = c->workers;
+	cfg->rate = c->rate;
+}
+
+/*
+ * Fit the host time so the model's p50 and p99 match the first report
+ * (for an exponential tail p99 - p50 = 3.9 * mean), then print measured
+ * vs. modelled for all of them.
+ */
+static int	calibrate(model_cfg_t cfg, const calib_t *c, int n, bool json)
+{
+	model_result_t	*r;
+	double		d50;
+	double		d99;
+	size_t		i;
+	int		k;
+
+	r = malloc(sizeof(*r));
+	if (!r)
+		return 1;
+	calib_cfg(&cfg, &c[0]);
+	cfg.host_ns = 1000;
+	cfg.host_jitter_ns = 0;
+	for (k = 0; k < CALIB_ROUNDS; k++)
+	{
+		if (!model_run(&cfg, r) || !r->rtt.count)
+		{
+			fprintf(stderr, "model run failed\n");
+			free(r);
+			return 1;
+		}
+		d50 = c[0].pct[0] - (double)hist_percentile(&r->rtt, 50);
+		d99 = c[0].pct[2] - (double)hist_percentile(&r->rtt, 99) - d50;
+		if (d50 > -1000 && d50 < 1000 && d99 > -1000 && d99 < 1000)
+			break;
+		cfg.host_jitter_ns += (int64_t)(d99 / 3.9);
+		if (cfg.host_jitter_ns < 0)
+			cfg.host_jitter_ns = 0;
+		cfg.host_ns += (int64_t)(d50 - 0.69 * d99 / 3.9); // exponential median
+		if (cfg.host_ns < 1000)
+			cfg.host_ns = 1000;
+	}
+	if (json)
+		printf("{\"host_us\":%.1f,\"jitter_us\":%.1f,\"runs\":[", (double)cfg.host_ns / 1e3,
+			(double)cfg.host_jitter_ns / 1e3);
+	else
+		printf("fitted: -H %.0f -J %.0f\n%-24s %10s %10s %10s %10s %10s\n",
+			(double)cfg.host_ns / 1e3, (double)cfg.host_jitter_ns / 1e3,
+			"report (measured/model)", "ops/s", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms");
+	for (k = 0; k < n; k++)
+	{
+		calib_cfg(&cfg, &c[k]);
+		if (!model_run(&cfg, r))
+			continue;
+		if (json)
+		{
+			printf("%s{\"report\":\"%s\",\"measured\":{\"ops_per_s\":%.3f", k ? "," : "",
+				c[k].path, c[k].ops);
+			for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+				printf(",\"p%g\":%.0f", g_pcts[i], c[k].pct[i]);
+			printf("},\"model\":");
+			print_json(&cfg, r);
+			printf("}");
+			continue;
+		}
+		printf("%-24.24s %10.1f", c[k].path, c[k].ops);
+		for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+			printf(" %10.3f", c[k].pct[i] / 1e6);
+		printf("\n%-24s %10.1f", "", (double)r->completed / r->elapsed_s);
+		for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+			printf(" %10.3f", ms(hist_percentile(&r->rtt, g_pcts[i])));
+		printf("\n");
+	}
+	if (json)
+		printf("]}\n");
+	free(r);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void	usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-b baud] [-n nodes] [-c workers | -r rate | -M hz] [-e] [-m mix]\n"
+			"       [-U] [-H host_us] [-J jitter_us] [-F handle_us] [-W window_ms] [-I]\n"
+			"       [-g guard_us] [-S slot_ms] [-P pipeline] [-t seconds] [-w warmup_s]\n"
+			"       [-s seed] [-x param=v1,v2,...] [-K fanctl_load.json]... [-j] [-v]\n"
+			"sweep params: baud, nodes, hz, rate, workers, window, pipeline\n", prog);
+}
+
+int	main(int argc, char **argv)
+{
+	static calib_t	calib[MAX_CALIB];
+	static double	vals[MAX_SWEEP];
+	model_result_t	*res;
+	model_cfg_t	cfg;
+	model_cfg_t	run;
+	sweep_t		param;
+	double		hz;
+	bool		json;
+	bool		verbose;
+	int		n_calib;
+	int		n_vals;
+	int		opt;
+	int		i;
+
+	model_cfg_default(&cfg);
+	param = SWEEP_NONE;
+	hz = 0;
+	json = false;
+	verbose = false;
+	n_calib = 0;
+	n_vals = 0;
+	while ((opt = getopt(argc, argv, "b:Un:c:r:M:em:H:J:F:W:Ig:S:P:t:w:s:x:K:jvh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b': cfg.baud = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'n': cfg.nodes = atoi(optarg); break;
+			case 'c': cfg.workers = atoi(optarg); break;
+			case 'r': cfg.rate = atof(optarg); break;
+			case 'M': hz = atof(optarg); break;
+			case 'e': cfg.poisson = true; break;
+			case 'U': cfg.unpaced_req = true; break;
+			case 'H': cfg.host_ns = (int64_t)(atof(optarg) * 1e3); break;
+			case 'J': cfg.host_jitter_ns = (int64_t)(atof(optarg) * 1e3); break;
+			case 'F': cfg.handle_ns = (int64_t)(atof(optarg) * 1e3); break;
+			case 'W': cfg.window_ns = (int64_t)(atof(optarg) * 1e6); break;
+			case 'I': cfg.rx_mode = MODEL_RX_IDLE; break;
+			case 'g': cfg.guard_ns = (int64_t)(atof(optarg) * 1e3); break;
+			case 'S': cfg.slot_ns = (int64_t)(atof(optarg) * 1e6); break;
+			case 'P': cfg.pipeline = atoi(optarg); break;
+			case 't': cfg.duration_ns = (int64_t)(atof(optarg) * 1e9); break;
+			case 'w': cfg.warmup_ns = (int64_t)(atof(optarg) * 1e9); break;
+			case 's': cfg.seed = strtoull(optarg, NULL, 0); break;
+			case 'j': json = true; break;
+			case 'v': verbose = true; break;
+			case 'm':
+				if (!parse_mix(&cfg, optarg))
+				{
+					fprintf(stderr, "Invalid mix: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'x':
+				if (!parse_sweep(optarg, &param, vals, &n_vals))
+				{
+					fprintf(stderr, "Invalid sweep: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'K':
+				if (n_calib == MAX_CALIB || !load_calib(optarg, &calib[n_calib++]))
+					return 1;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (cfg.nodes < 0 || cfg.nodes > MODEL_MAX_NODES || cfg.workers < 1
+		|| cfg.workers > MODEL_MAX_WORKERS || cfg.duration_ns <= 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if (verbose)
+		print_frames(&cfg);
+	if (n_calib)
+		return calibrate(cfg, calib, n_calib, json);
+	res = malloc(sizeof(*res));
+	if (!res)
+		return 1;
+	if (param == SWEEP_NONE)
+	{
+		apply_sweep(&cfg, SWEEP_NONE, 0, hz);
+		if (!model_run(&cfg, res))
+		{
+			fprintf(stderr, "Invalid model configuration\n");
+			free(res);
+			return 1;
+		}
+		if (json)
+		{
+			print_json(&cfg, res);
+			printf("\n");
+		}
+		else
+			print_text(&cfg, res);
+		free(res);
+		return 0;
+	}
+	if (json)
+		printf("[");
+	else
+		print_row_header(param);
+	for (i = 0; i < n_vals; i++)
+	{
+		run = cfg;
+		apply_sweep(&run, param, vals[i], hz);
+		if (!model_run(&run, res))
+		{
+			fprintf(stderr, "Invalid model configuration (%s=%g)\n", g_sweep_names[param], vals[i]);
+			continue;
+		}
+		if (json)
+		{
+			printf("%s", i ? "," : "");
+			print_json(&run, res);
+		}
+		else
+			print_row(vals[i], &run, res);
+	}
+	if (json)
+		printf("]\n");
+	free(res);
+	return 0;
+}
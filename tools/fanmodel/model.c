@@ -0,0 +1,743 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "model.h"
+
+/*
+ * Event loop
+ * ----------
+ * A binary heap of timestamped events, ties broken by insertion order so
+ * events scheduled for the same instant run FIFO. Requests live in a
+ * growable pool indexed by int; queues are intrusive singly linked lists.
+ */
+
+#define NS_PER_S	1000000000LL
+#define DRAIN_NS	(10 * NS_PER_S) // max. simulated time after the end to drain
+
+typedef enum {
+	EV_ARRIVAL, // fixed-rate source
+	EV_TX, // owner starts writing its frame
+	EV_BUS_DONE, // last byte of the current transmission
+	EV_WINDOW, // uart_read_bytes() returns on a node
+	EV_HANDLED, // cmd_handler_task done on a node
+	EV_DONE, // ioctl returns
+	EV_TIMEOUT,
+}	ev_type_t;
+
+typedef struct {
+	int64_t		t;
+	uint64_t	order;
+	ev_type_t	type;
+	int		a;
+	uint32_t	gen;
+}	event_t;
+
+typedef struct {
+	model_cmd_t	cmd;
+	int		prio; // 0: CTRL, 1: POLL
+	int		node;
+	int		worker; // -1: fixed-rate source
+	int		next; // queue link
+	int64_t		t_submit;
+	int64_t		t_grant;
+	int64_t		t_tx;
+	uint32_t	gen; // bumped when the request completes or times out
+	bool		in_flight;
+}	req_t;
+
+typedef struct {
+	int		req;
+	uint32_t	gen; // req->gen when sent, stale once it differs
+	model_cmd_t	cmd;
+}	ref_t;
+
+typedef struct {
+	bool	from_host;
+	ref_t	ref;
+	int	node; // sender (node -> host)
+	int	bytes;
+}	xfer_t;
+
+typedef struct {
+	int	head;
+	int	tail;
+	int	len;
+}	rq_t;
+
+typedef struct {
+	// uart_read_task
+	int64_t		call_start;
+	int		rx_bytes; // received during the current call
+	ref_t		rx_frames[MODEL_UART_RX_BUF]; // complete frames not yet returned
+	int		n_rx_frames;
+	uint32_t	window_gen;
+	bool		window_armed;
+	// cmd_handler_task
+	ref_t		cmdq[MODEL_CMD_QUEUE_LEN];
+	int		cmdq_head;
+	int		cmdq_len;
+	bool		handler_busy;
+	ref_t		handling;
+	// driver: one request per node in flight
+	bool		busy;
+}	node_t;
+
+typedef struct {
+	const model_cfg_t	*cfg;
+	model_result_t		*res;
+	uint64_t		rng;
+	// event heap
+	event_t			*heap;
+	size_t			heap_len;
+	size_t			heap_cap;
+	uint64_t		order;
+	int64_t			now;
+	// request pool
+	req_t			*reqs;
+	int			n_reqs;
+	int			free_head;
+	// driver
+	rq_t			q[2];
+	int			owners;
+	int			ctrl_streak;
+	int64_t			last_rx_end; // bus_guard_us reference
+	// wire
+	xfer_t			*bus_q;
+	size_t			bus_head;
+	size_t			bus_len;
+	size_t			bus_cap;
+	bool			bus_busy;
+	xfer_t			bus_cur;
+	int64_t			bus_start;
+	int64_t			byte_ns;
+	// nodes, load
+	node_t			nodes[MODEL_MAX_NODES];
+	int			n_nodes;
+	int			rr; // round-robin target
+	unsigned		weight_sum;
+	int64_t			t_rec; // recording window
+	int64_t			t_end;
+	bool			stopping;
+}	sim_t;
+
+static uint64_t	rng_next(sim_t *s)
+{
+	s->rng ^= s->rng << 13;
+	s->rng ^= s->rng >> 7;
+	s->rng ^= s->rng << 17;
+	return s->rng;
+}
+
+static double	rng_unit(sim_t *s)
+{
+	return (double)(rng_next(s) >> 11) / (double)(1ULL << 53);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static bool	ev_push(sim_t *s, int64_t t, ev_type_t type, int a, uint32_t gen)
+{
+	event_t	ev;
+	event_t	*grown;
+	size_t	i;
+	size_t	p;
+
+	if (s->heap_len == s->heap_cap)
+	{
+		s->heap_cap = s->heap_cap ? s->heap_cap * 2 : 1024;
+		grown = realloc(s->heap, s->heap_cap * sizeof(*s->heap));
+		if (!grown)
+			return false;
+		s->heap = grown;
+	}
+	ev.t = t;
+	ev.order = s->order++;
+	ev.type = type;
+	ev.a = a;
+	ev.gen = gen;
+	i = s->heap_len++;
+	while (i > 0)
+	{
+		p = (i - 1) / 2;
+		if (s->heap[p].t < ev.t || (s->heap[p].t == ev.t && s->heap[p].order < ev.order))
+			break;
+		s->heap[i] = s->heap[p];
+		i = p;
+	}
+	s->heap[i] = ev;
+	return true;
+}
+
+static bool	ev_before(const event_t *a, const event_t *b)
+{
+	return a->t < b->t || (a->t == b->t && a->order < b->order);
+}
+
+static event_t	ev_pop(sim_t *s)
+{
+	event_t	top;
+	event_t	last;
+	size_t	i;
+	size_t	c;
+
+	top = s->heap[0];
+	last = s->heap[--s->heap_len];
+	i = 0;
+	while ((c = 2 * i + 1) < s->heap_len)
+	{
+		if (c + 1 < s->heap_len && ev_before(&s->heap[c + 1], &s->heap[c]))
+			c++;
+		if (!ev_before(&s->heap[c], &last))
+			break;
+		s->heap[i] = s->heap[c];
+		i = c;
+	}
+	s->heap[i] = last;
+	return top;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static uint8_t	cmd_code(model_cmd_t cmd, uint8_t *resp_cmd, uint8_t *req_len, uint8_t *resp_len)
+{
+	switch (cmd)
+	{
+		case MODEL_CMD_STATUS:
+			*req_len = 0;
+			*resp_cmd = PROTO_CMD_STATUS_RESP;
+			*resp_len = sizeof(status_resp_t);
+			return PROTO_CMD_STATUS_REQ;
+		case MODEL_CMD_PING:
+			*req_len = 0;
+			*resp_cmd = PROTO_CMD_PONG;
+			*resp_len = 0;
+			return PROTO_CMD_PING;
+		case MODEL_CMD_THRESHOLD:
+			*req_len = 2;
+			*resp_cmd = PROTO_CMD_ACK;
+			*resp_len = 2;
+			return PROTO_CMD_SET_THRESHOLD;
+		case MODEL_CMD_AUTO:
+		default:
+			*req_len = 1;
+			*resp_cmd = PROTO_CMD_ACK;
+			*resp_len = 2;
+			return PROTO_CMD_SET_FAN_MODE;
+	}
+}
+
+/* On-wire size, as built by proto_build_frame_addr() */
+static uint16_t	frame_bytes(const model_cfg_t *cfg, model_cmd_t cmd, bool resp)
+{
+	uint8_t		buf[PROTO_MAX_FRAME];
+	uint8_t		payload[PROTO_MAX_PAYLOAD];
+	uint8_t		resp_cmd;
+	uint8_t		req_len;
+	uint8_t		resp_len;
+	uint8_t		c;
+	uint16_t	len;
+
+	memset(payload, 0, sizeof(payload));
+	c = cmd_code(cmd, &resp_cmd, &req_len, &resp_len);
+	if (!proto_build_frame_addr(cfg->nodes ? 1 : PROTO_ADDR_NONE, resp ? resp_cmd : c, 0,
+					payload, resp ? resp_len : req_len, buf, &len))
+		return 0;
+	return len;
+}
+
+uint16_t	model_req_bytes(const model_cfg_t *cfg, model_cmd_t cmd)
+{
+	return frame_bytes(cfg, cmd, false);
+}
+
+uint16_t	model_resp_bytes(const model_cfg_t *cfg, model_cmd_t cmd)
+{
+	return frame_bytes(cfg, cmd, true);
+}
+
+/* Half of the host time is spent before the write, half after the response */
+static int64_t	host_half(sim_t *s)
+{
+	int64_t	t;
+
+	t = s->cfg->host_ns / 2;
+	if (s->cfg->host_jitter_ns > 0)
+		t += (int64_t)(-log(1.0 - rng_unit(s)) * (double)s->cfg->host_jitter_ns / 2);
+	return t;
+}
+
+static bool	recording(const sim_t *s, const req_t *r)
+{
+	return r->t_submit >= s->t_rec && r->t_submit < s->t_end;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void	bus_start_next(sim_t *s);
+
+static bool	bus_send(sim_t *s, const xfer_t *x)
+{
+	xfer_t	*grown;
+	size_t	i;
+
+	if (s->bus_len == s->bus_cap)
+	{
+		grown = malloc((s->bus_cap ? s->bus_cap * 2 : 64) * sizeof(*grown));
+		if (!grown)
+			return false;
+		for (i = 0; i < s->bus_len; i++)
+			grown[i] = s->bus_q[(s->bus_head + i) % s->bus_cap];
+		free(s->bus_q);
+		s->bus_q = grown;
+		s->bus_head = 0;
+		s->bus_cap = s->bus_cap ? s->bus_cap * 2 : 64;
+	}
+	s->bus_q[(s->bus_head + s->bus_len++) % s->bus_cap] = *x;
+	if (!s->bus_busy)
+		bus_start_next(s);
+	return true;
+}
+
+static void	bus_start_next(sim_t *s)
+{
+	if (!s->bus_len)
+	{
+		s->bus_busy = false;
+		return;
+	}
+	s->bus_cur = s->bus_q[s->bus_head];
+	s->bus_head = (s->bus_head + 1) % s->bus_cap;
+	s->bus_len--;
+	s->bus_busy = true;
+	s->bus_start = s->now;
+	if (s->bus_cur.from_host && s->cfg->unpaced_req)
+		ev_push(s, s->now, EV_BUS_DONE, 0, 0);
+	else
+		ev_push(s, s->now + s->bus_cur.bytes * s->byte_ns, EV_BUS_DONE, 0, 0);
+}
+
+/* Busy time inside the recording window */
+static void	bus_account(sim_t *s, int64_t from, int64_t to)
+{
+	if (from < s->t_rec)
+		from = s->t_rec;
+	if (to > s->t_end)
+		to = s->t_end;
+	if (to > from)
+		s->res->bus_util += (double)(to - from);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void	sched_next(sim_t *s);
+
+static void	submit(sim_t *s, model_cmd_t cmd, int worker)
+{
+	req_t	*r;
+	req_t	*grown;
+	int	id;
+	int	cap;
+	int	prio;
+
+	if (s->free_head < 0)
+	{
+		cap = s->n_reqs ? s->n_reqs * 2 : 256;
+		grown = realloc(s->reqs, (size_t)cap * sizeof(*grown));
+		if (!grown)
+			return;
+		s->reqs = grown;
+		for (id = cap - 1; id >= s->n_reqs; id--)
+		{
+			s->reqs[id].next = s->free_head;
+			s->free_head = id;
+		}
+		s->n_reqs = cap;
+	}
+	id = s->free_head;
+	r = &s->reqs[id];
+	s->free_head = r->next;
+	prio = cmd == MODEL_CMD_THRESHOLD || cmd == MODEL_CMD_AUTO ? 0 : 1; // fanctl_req_prio()
+	r->cmd = cmd;
+	r->prio = prio;
+	r->node = s->rr++ % s->n_nodes;
+	r->worker = worker;
+	r->next = -1;
+	r->t_submit = s->now;
+	r->gen++;
+	r->in_flight = false;
+	if (recording(s, r))
+		s->res->offered++;
+	if (s->q[prio].len)
+		s->reqs[s->q[prio].tail].next = id;
+	else
+		s->q[prio].head = id;
+	s->q[prio].tail = id;
+	s->q[prio].len++;
+	sched_next(s);
+}
+
+static model_cmd_t	pick_cmd(sim_t *s)
+{
+	unsigned	r;
+	int		i;
+
+	r = (unsigned)(rng_next(s) % s->weight_sum);
+	for (i = 0; i < MODEL_CMD_NR - 1; i++)
+	{
+		if (r < s->cfg->weights[i])
+			break;
+		r -= s->cfg->weights[i];
+	}
+	return (model_cmd_t)i;
+}
+
+/* Oldest queued request of `prio` whose node is idle, unlinked from the queue */
+static int	dequeue(sim_t *s, int prio)
+{
+	rq_t	*q;
+	int	prev;
+	int	id;
+
+	q = &s->q[prio];
+	prev = -1;
+	for (id = q->head; id >= 0; prev = id, id = s->reqs[id].next)
+	{
+		if (s->nodes[s->reqs[id].node].busy)
+			continue;
+		if (prev < 0)
+			q->head = s->reqs[id].next;
+		else
+			s->reqs[prev].next = s->reqs[id].next;
+		if (q->tail == id)
+			q->tail = prev;
+		q->len--;
+		return id;
+	}
+	return -1;
+}
+
+/* fanctl_sched_next(), generalized to `pipeline` owners */
+static void	sched_next(sim_t *s)
+{
+	req_t	*r;
+	int64_t	t;
+	int	id;
+
+	while (s->owners < s->cfg->pipeline)
+	{
+		id = -1;
+		if (s->q[0].len && (!s->q[1].len || s->ctrl_streak < MODEL_SCHED_CTRL_BURST))
+		{
+			id = dequeue(s, 0);
+			if (id >= 0)
+				s->ctrl_streak = s->q[1].len ? s->ctrl_streak + 1 : 0;
+		}
+		if (id < 0 && s->q[1].len)
+		{
+			id = dequeue(s, 1);
+			if (id >= 0)
+				s->ctrl_streak = 0;
+		}
+		if (id < 0)
+			return;
+		r = &s->reqs[id];
+		r->t_grant = s->now;
+		r->in_flight = true;
+		s->nodes[r->node].busy = true;
+		s->owners++;
+		if (recording(s, r))
+		{
+			hist_record(&s->res->wait, (uint64_t)(r->t_grant - r->t_submit));
+			if (r->prio == 0)
+				hist_record(&s->res->wait_ctrl, (uint64_t)(r->t_grant - r->t_submit));
+		}
+		t = s->now + host_half(s);
+		if (s->cfg->nodes && t < s->last_rx_end + s->cfg->guard_ns)
+			t = s->last_rx_end + s->cfg->guard_ns;
+		ev_push(s, t, EV_TX, id, r->gen);
+	}
+}
+
+static void	finish(sim_t *s, int id, bool timeout)
+{
+	req_t	*r;
+	int	worker;
+
+	r = &s->reqs[id];
+	if (recording(s, r))
+	{
+		if (timeout)
+			s->res->timeouts++;
+		else
+		{
+			s->res->completed++;
+			s->res->per_cmd[r->cmd]++;
+			hist_record(&s->res->rtt, (uint64_t)(s->now - r->t_submit));
+		}
+	}
+	worker = r->worker;
+	s->nodes[r->node].busy = false;
+	r->in_flight = false;
+	r->gen++;
+	r->next = s->free_head;
+	s->free_head = id;
+	s->owners--;
+	sched_next(s);
+	if (worker >= 0 && !s->stopping)
+		submit(s, pick_cmd(s), worker);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void	node_handle_next(sim_t *s, int node)
+{
+	node_t	*n;
+
+	n = &s->nodes[node];
+	if (n->handler_busy || !n->cmdq_len)
+		return;
+	n->handler_busy = true;
+	n->handling = n->cmdq[n->cmdq_head];
+	n->cmdq_head = (n->cmdq_head + 1) % MODEL_CMD_QUEUE_LEN;
+	n->cmdq_len--;
+	ev_push(s, s->now + s->cfg->handle_ns, EV_HANDLED, node, 0);
+}
+
+/* uart_read_bytes() returned: parsed frames go to g_cmd_queue */
+static void	node_deliver(sim_t *s, int node)
+{
+	node_t	*n;
+	int	i;
+
+	n = &s->nodes[node];
+	for (i = 0; i < n->n_rx_frames; i++)
+	{
+		if (n->cmdq_len == MODEL_CMD_QUEUE_LEN)
+		{
+			s->res->dropped++; // xQueueSend() timed out, the host will time out
+			continue;
+		}
+		n->cmdq[(n->cmdq_head + n->cmdq_len++) % MODEL_CMD_QUEUE_LEN] = n->rx_frames[i];
+	}
+	n->n_rx_frames = 0;
+	n->rx_bytes = 0;
+	n->call_start = s->now;
+	n->window_armed = false;
+	n->window_gen++;
+	node_handle_next(s, node);
+}
+
+/*
+ * `bytes` arrived on a node's UART, completing a request for this node
+ * when `ref` is set. Frames are handed to cmd_handler_task when the
+ * pending uart_read_bytes() call returns.
+ */
+static void	node_rx(sim_t *s, int node, int bytes, const ref_t *ref)
+{
+	const model_cfg_t	*cfg;
+	node_t			*n;
+	int64_t			end;
+
+	cfg = s->cfg;
+	n = &s->nodes[node];
+	if (cfg->rx_mode == MODEL_RX_TOTAL && cfg->window_ns && !n->window_armed
+		&& s->now >= n->call_start + cfg->window_ns)
+	{
+		// calls that returned empty since the last one with data
+		n->call_start += (s->now - n->call_start) / cfg->window_ns * cfg->window_ns;
+		n->rx_bytes = 0;
+	}
+	n->rx_bytes += bytes;
+	if (ref && n->n_rx_frames < MODEL_UART_RX_BUF)
+		n->rx_frames[n->n_rx_frames++] = *ref;
+	if (!cfg->window_ns || n->rx_bytes >= MODEL_UART_RX_BUF)
+	{
+		node_deliver(s, node);
+		return;
+	}
+	if (cfg->rx_mode == MODEL_RX_IDLE)
+		end = s->now + cfg->window_ns; // every chunk restarts the wait
+	else if (!n->window_armed && n->n_rx_frames)
+		end = n->call_start + cfg->window_ns;
+	else
+		return; // armed already, or nothing to hand over
+	n->window_armed = true;
+	ev_push(s, end, EV_WINDOW, node, ++n->window_gen);
+}
+
+static void	on_window(sim_t *s, int node, uint32_t gen)
+{
+	node_t	*n;
+
+	n = &s->nodes[node];
+	if (gen != n->window_gen)
+		return;
+	if (s->cfg->rx_mode == MODEL_RX_IDLE && !n->n_rx_frames)
+	{
+		// bytes for other nodes only: the call goes on
+		n->window_armed = false;
+		return;
+	}
+	node_deliver(s, node);
+}
+
+static void	on_handled(sim_t *s, int node)
+{
+	node_t	*n;
+	xfer_t	x;
+
+	n = &s->nodes[node];
+	x.from_host = false;
+	x.ref = n->handling;
+	x.node = node;
+	x.bytes = model_resp_bytes(s->cfg, x.ref.cmd);
+	n->handler_busy = false;
+	bus_send(s, &x); // sent even if the host gave up on the request
+	node_handle_next(s, node);
+}
+
+static void	on_tx(sim_t *s, int id, uint32_t gen)
+{
+	req_t	*r;
+	xfer_t	x;
+
+	r = &s->reqs[id];
+	if (gen != r->gen)
+		return;
+	r->t_tx = s->now;
+	x.from_host = true;
+	x.ref.req = id;
+	x.ref.gen = r->gen;
+	x.ref.cmd = r->cmd;
+	x.node = r->node;
+	x.bytes = model_req_bytes(s->cfg, r->cmd);
+	bus_send(s, &x);
+	ev_push(s, s->now + (s->cfg->nodes ? s->cfg->slot_ns : s->cfg->timeout_ns),
+		EV_TIMEOUT, id, r->gen);
+}
+
+static void	on_bus_done(sim_t *s)
+{
+	xfer_t	x;
+	req_t	*r;
+	int	i;
+
+	x = s->bus_cur;
+	bus_account(s, s->bus_start, s->now);
+	// every node on the line sees every byte, except its own in half duplex
+	for (i = 0; i < s->n_nodes; i++)
+	{
+		if (!x.from_host && i == x.node)
+			continue;
+		node_rx(s, i, x.bytes, x.from_host && x.node == i ? &x.ref : NULL);
+	}
+	if (!x.from_host)
+	{
+		s->last_rx_end = s->now;
+		r = &s->reqs[x.ref.req];
+		// late responses of timed-out requests are dropped by the matcher
+		if (r->gen == x.ref.gen && r->in_flight)
+			ev_push(s, s->now + host_half(s), EV_DONE, x.ref.req, r->gen);
+	}
+	bus_start_next(s);
+}
+
+static void	on_arrival(sim_t *s)
+{
+	double	gap;
+
+	if (s->stopping)
+		return;
+	submit(s, pick_cmd(s), -1);
+	gap = 1.0 / s->cfg->rate;
+	if (s->cfg->poisson)
+		gap *= -log(1.0 - rng_unit(s));
+	ev_push(s, s->now + (int64_t)(gap * NS_PER_S), EV_ARRIVAL, 0, 0);
+}
+
+/* ------------------------------------------------------------------------ */
+
+void	model_cfg_default(model_cfg_t *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->baud = 115200;
+	cfg->workers = 1;
+	cfg->weights[MODEL_CMD_STATUS] = 1;
+	cfg->window_ns = 100000000; // pdMS_TO_TICKS(100) in uart_read_task
+	cfg->rx_mode = MODEL_RX_TOTAL;
+	cfg->guard_ns = 500000;
+	cfg->slot_ns = 250000000;
+	cfg->timeout_ns = NS_PER_S;
+	cfg->pipeline = 1;
+	cfg->duration_ns = 60 * NS_PER_S;
+	cfg->seed = 1;
+}
+
+bool	model_run(const model_cfg_t *cfg, model_result_t *res)
+{
+	sim_t	s;
+	event_t	ev;
+	int	i;
+
+	memset(res, 0, sizeof(*res));
+	hist_init(&res->rtt);
+	hist_init(&res->wait);
+	hist_init(&res->wait_ctrl);
+	memset(&s, 0, sizeof(s));
+	s.cfg = cfg;
+	s.res = res;
+	s.rng = cfg->seed ? cfg->seed : 1;
+	s.free_head = -1;
+	s.n_nodes = cfg->nodes ? cfg->nodes : 1;
+	if (s.n_nodes > MODEL_MAX_NODES || cfg->pipeline < 1)
+		return false;
+	if (!cfg->baud && cfg->host_ns <= 0 && cfg->handle_ns <= 0 && cfg->window_ns <= 0)
+		return false; // requests would take no time at all
+	for (i = 0; i < MODEL_CMD_NR; i++)
+		s.weight_sum += cfg->weights[i];
+	if (!s.weight_sum)
+		return false;
+	s.byte_ns = cfg->baud ? 10LL * NS_PER_S / cfg->baud : 0; // 8N1
+	s.t_rec = cfg->warmup_ns;
+	s.t_end = cfg->warmup_ns + cfg->duration_ns;
+	s.last_rx_end = -cfg->guard_ns;
+	for (i = 0; i < s.n_nodes; i++) // uart_read_task loops are not aligned
+		s.nodes[i].call_start = -(int64_t)(rng_unit(&s) * (double)cfg->window_ns);
+	if (cfg->rate > 0)
+		ev_push(&s, 0, EV_ARRIVAL, 0, 0);
+	else
+		for (i = 0; i < cfg->workers && i < MODEL_MAX_WORKERS; i++)
+			submit(&s, pick_cmd(&s), i);
+	while (s.heap_len)
+	{
+		ev = ev_pop(&s);
+		s.now = ev.t;
+		if (!s.stopping && s.now >= s.t_end)
+			s.stopping = true; // no new requests, drain what was submitted
+		if (s.now >= s.t_end + DRAIN_NS)
+			break;
+		switch (ev.type)
+		{
+			case EV_ARRIVAL: on_arrival(&s); break;
+			case EV_TX: on_tx(&s, ev.a, ev.gen); break;
+			case EV_BUS_DONE: on_bus_done(&s); break;
+			case EV_WINDOW: on_window(&s, ev.a, ev.gen); break;
+			case EV_HANDLED: on_handled(&s, ev.a); break;
+			case EV_DONE:
+				if (s.reqs[ev.a].gen == ev.gen)
+					finish(&s, ev.a, false);
+				break;
+			case EV_TIMEOUT:
+				if (s.reqs[ev.a].gen == ev.gen && s.reqs[ev.a].in_flight)
+					finish(&s, ev.a, true);
+				break;
+		}
+	}
+	res->elapsed_s = (double)cfg->duration_ns / NS_PER_S;
+	res->bus_util /= (double)cfg->duration_ns;
+	free(s.heap);
+	free(s.reqs);
+	free(s.bus_q);
+	return true;
+}
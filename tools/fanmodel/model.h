@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "proto.h"
+#include "hist.h"
+
+/*
+ * Discrete-event model of one fanctl link
+ * ---------------------------------------
+ * host:   requests from a closed loop (workers) or a fixed-rate source,
+ *         the driver's wire ownership (one request at a time, CTRL before
+ *         POLL with FANCTL_SCHED_CTRL_BURST), fixed host overhead,
+ *         bus_guard_us before addressed requests, slot_ms / 1 s timeouts
+ * wire:   one half-duplex line, frame sizes from proto_build_frame_addr(),
+ *         10 bits per byte
+ * node:   uart_read_task windows (uart_read_bytes: 128 bytes or W ms),
+ *         cmd_handler_task FIFO with a fixed handling time per command
+ *
+ * All times are in ns of simulated time.
+ */
+
+#define MODEL_MAX_NODES		64
+#define MODEL_MAX_WORKERS	64
+#define MODEL_SCHED_CTRL_BURST	8 // FANCTL_SCHED_CTRL_BURST
+#define MODEL_UART_RX_BUF	128 // uart_read_task rx_buf
+#define MODEL_CMD_QUEUE_LEN	8 // g_cmd_queue depth
+
+typedef enum {
+	MODEL_CMD_STATUS,
+	MODEL_CMD_PING,
+	MODEL_CMD_THRESHOLD,
+	MODEL_CMD_AUTO,
+	MODEL_CMD_NR,
+}	model_cmd_t;
+
+typedef enum {
+	MODEL_RX_TOTAL, // uart_read_bytes timeout counted from the call
+	MODEL_RX_IDLE, // timeout restarted by every received chunk
+}	model_rx_mode_t;
+
+typedef struct {
+	uint32_t	baud; // 0: no wire time (pty)
+	bool		unpaced_req; // requests take no wire time (fansim)
+	int		nodes; // 0: one point-to-point node
+	int		workers; // closed loop, used when rate == 0
+	double		rate; // total requests/s, round robin over nodes
+	bool		poisson; // exponential instead of fixed inter-arrival
+	unsigned	weights[MODEL_CMD_NR];
+	int64_t		host_ns; // syscall + ldisc + wakeup per request
+	int64_t		host_jitter_ns; // mean of an exponential extra host time
+	int64_t		handle_ns; // cmd_handler_task per request
+	int64_t		window_ns; // uart_read_bytes timeout, 0: immediate
+	model_rx_mode_t	rx_mode;
+	int64_t		guard_ns; // bus_guard_us
+	int64_t		slot_ns; // slot_ms, addressed requests
+	int64_t		timeout_ns; // point-to-point requests
+	int		pipeline; // requests in flight (driver: 1)
+	int64_t		duration_ns;
+	int64_t		warmup_ns;
+	uint64_t	seed;
+}	model_cfg_t;
+
+typedef struct {
+	uint64_t	offered;
+	uint64_t	completed;
+	uint64_t	timeouts;
+	uint64_t	dropped; // node command queue full
+	uint64_t	per_cmd[MODEL_CMD_NR];
+	double		elapsed_s;
+	double		bus_util; // fraction of time the line carries bytes
+	hist_t		rtt; // submit -> ioctl return
+	hist_t		wait; // submit -> wire granted
+	hist_t		wait_ctrl;
+}	model_result_t;
+
+void		model_cfg_default(model_cfg_t *cfg);
+uint16_t	model_req_bytes(const model_cfg_t *cfg, model_cmd_t cmd);
+uint16_t	model_resp_bytes(const model_cfg_t *cfg, model_cmd_t cmd);
+bool		model_run(const model_cfg_t *cfg, model_result_t *res);
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capfile.h"
+
+static bool	cap_add(cap_t *c, uint64_t ts_ns, uint8_t dir, const uint8_t *data, size_t len)
+{
+	cap_chunk_t	*chunks;
+	uint8_t		*buf;
+	size_t		n;
+
+	if (c->n == c->cap)
+	{
+		n = c->cap ? c->cap * 2 : 1024;
+		chunks = realloc(c->chunks, n * sizeof(*chunks));
+		if (!chunks)
+			return false;
+		c->chunks = chunks;
+		c->cap = n;
+	}
+	if (c->bytes + len > c->data_cap)
+	{
+		n = c->data_cap ? c->data_cap : 64 * 1024;
+		while (n < c->bytes + len)
+			n *= 2;
+		buf = realloc(c->data, n);
+		if (!buf)
+			return false;
+		c->data = buf;
+		c->data_cap = n;
+	}
+	memcpy(c->data + c->bytes, data, len);
+	c->chunks[c->n].ts_ns = ts_ns;
+	c->chunks[c->n].off = c->bytes;
+	c->chunks[c->n].len = (uint16_t)len;
+	c->chunks[c->n].dir = dir;
+	c->n++;
+	c->bytes += len;
+	return true;
+}
+
+static bool	cap_load_raw(cap_t *c, FILE *f)
+{
+	uint8_t	buf[FANCTL_CAP_MAX_CHUNK];
+	size_t	n;
+
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		if (!cap_add(c, 0, FANCTL_CAP_DIR_RX, buf, n))
+			return false;
+	return !ferror(f);
+}
+
+static bool	cap_load_records(cap_t *c, FILE *f, const char *path)
+{
+	struct fanctl_cap_rec	rec;
+	uint8_t			buf[FANCTL_CAP_MAX_CHUNK];
+	long			pos;
+
+	for (;;)
+	{
+		pos = ftell(f);
+		if (fread(&rec, sizeof(rec), 1, f) != 1)
+			break;
+		if (rec.magic != FANCTL_CAP_MAGIC || rec.len > FANCTL_CAP_MAX_CHUNK
+			|| rec.dir > FANCTL_CAP_DIR_TX)
+		{
+			fprintf(stderr, "%s: bad record at offset %ld\n", path, pos);
+			return false;
+		}
+		if (fread(buf, 1, rec.len, f) != rec.len)
+		{
+			fprintf(stderr, "%s: truncated record at offset %ld\n", path, pos);
+			return false;
+		}
+		if (!cap_add(c, rec.ts_ns, rec.dir, buf, rec.len))
+			return false;
+	}
+	return !ferror(f);
+}
+
+bool	cap_load(cap_t *c, const char *path, bool raw)
+{
+	FILE	*f;
+	bool	ok;
+
+	f = fopen(path, "rb");
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+	ok = raw ? cap_load_raw(c, f) : cap_load_records(c, f, path);
+	if (!ok && ferror(f))
+		perror(path);
+	fclose(f);
+	return ok;
+}
+
+static int	cmp_chunk(const void *a, const void *b)
+{
+	const cap_chunk_t	*ca;
+	const cap_chunk_t	*cb;
+
+	ca = a;
+	cb = b;
+	if (ca->ts_ns != cb->ts_ns)
+		return ca->ts_ns < cb->ts_ns ? -1 : 1;
+	return ca->off < cb->off ? -1 : ca->off > cb->off; // file order on equal timestamps
+}
+
+/* Merge per-CPU streams (and several files) in time order */
+void	cap_sort(cap_t *c)
+{
+	qsort(c->chunks, c->n, sizeof(*c->chunks), cmp_chunk);
+}
+
+void	cap_free(cap_t *c)
+{
+	free(c->chunks);
+	free(c->data);
+	memset(c, 0, sizeof(*c));
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fanctl_cap.h"
+
+/*
+ * In-memory capture
+ * -----------------
+ * Chunks of one or more capture files (common/fanctl_cap.h), merged by
+ * timestamp, with their bytes in one contiguous buffer. A raw byte dump
+ * (e.g. a terminal log of a node booting) loads as a single RX chunk.
+ */
+
+typedef struct {
+	uint64_t	ts_ns;
+	size_t		off; // into cap_t.data
+	uint16_t	len;
+	uint8_t		dir; // FANCTL_CAP_DIR_*
+}	cap_chunk_t;
+
+typedef struct {
+	cap_chunk_t	*chunks;
+	size_t		n;
+	size_t		cap;
+	uint8_t		*data;
+	size_t		bytes;
+	size_t		data_cap;
+}	cap_t;
+
+bool	cap_load(cap_t *c, const char *path, bool raw);
+void	cap_sort(cap_t *c);
+void	cap_free(cap_t *c);
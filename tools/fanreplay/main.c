@@ -0,0 +1,414 @@
+/*
+ * fanreplay
+ * ---------
+ * Replays recorded UART byte streams through the frame parser, to turn
+ * real traffic (including noise such as a node's boot log) into parser
+ * benchmarks.
+ *
+ *   fanreplay [-p parser|all] [-d rx|tx|all] [-R] [-i iterations]
+ *             [-T] [-x speed] [-j] [-v] [-l] capture...
+ *
+ * Captures come from the driver (cat /sys/kernel/debug/fanctl/capture[0-9]*)
+ * or from `fanctl -w` (userspace/fanctl_serial), format common/fanctl_cap.h.
+ * Several files are merged by timestamp; RX and TX are parsed as two
+ * separate streams.
+ *
+ * -p   parser to benchmark, see -l (default bytewise)
+ * -d   only replay one direction (default both)
+ * -R   the files are raw byte dumps, replayed as RX
+ * -i   iterations over the capture (default: as many as fit in ~1 s)
+ * -T   feed chunks at their recorded times instead of back to back
+ * -x   speed factor for -T (default 1)
+ * -j   JSON output
+ * -v   print every decoded frame
+ * -l   list parsers
+ *
+ * Exits with 1 if a parser finds a different number of frames than
+ * proto_rx_feed().
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "capfile.h"
+#include "parser.h"
+
+#define AUTO_ITER_NS	1000000000LL
+
+static const char	*g_dir_names[2] = {
+	[FANCTL_CAP_DIR_RX] = "rx",
+	[FANCTL_CAP_DIR_TX] = "tx",
+};
+
+typedef struct {
+	const parser_t	*parser;
+	uint64_t	iterations;
+	uint64_t	bytes;
+	uint64_t	frames;
+	int64_t		elapsed_ns; // parsing only
+	int64_t		wall_ns; // -T: whole replay
+	int64_t		max_chunk_ns; // -T: slowest chunk
+	int64_t		max_lag_ns; // -T: latest chunk vs its recorded time
+}	bench_t;
+
+static int64_t	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void	sleep_until(int64_t t_ns)
+{
+	struct timespec	ts;
+
+	ts.tv_sec = t_ns / 1000000000LL;
+	ts.tv_nsec = t_ns % 1000000000LL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static void	print_frame(const proto_frame_t *f, void *arg)
+{
+	const cap_chunk_t	*c;
+	int			i;
+
+	c = arg;
+	printf("%llu.%09llu %s addr %02X cmd %02X seq %3u len %2u:",
+		(unsigned long long)(c->ts_ns / 1000000000ULL),
+		(unsigned long long)(c->ts_ns % 1000000000ULL),
+		g_dir_names[c->dir], f->addr, f->cmd, f->seq, f->len);
+	for (i = 0; i < f->len; i++)
+		printf(" %02X", f->payload[i]);
+	printf("\n");
+}
+
+/* Reference pass: decoder statistics per direction */
+static void	run_stats(const cap_t *cap, unsigned dir_mask, bool verbose, stats_ctx_t st[2])
+{
+	const cap_chunk_t	*c;
+	size_t			i;
+
+	stats_init(&st[0]);
+	stats_init(&st[1]);
+	for (i = 0; i < cap->n; i++)
+	{
+		c = &cap->chunks[i];
+		if (!(dir_mask & (1u << c->dir)))
+			continue;
+		stats_feed(&st[c->dir], cap->data + c->off, c->len,
+			verbose ? print_frame : NULL, (void *)c);
+	}
+	stats_finish(&st[0]);
+	stats_finish(&st[1]);
+}
+
+static uint64_t	replay_once(const parser_t *p, void *ctx[2], const cap_t *cap,
+			unsigned dir_mask, proto_frame_t *last)
+{
+	const cap_chunk_t	*c;
+	uint64_t		frames;
+	size_t			i;
+
+	p->init(ctx[0]);
+	p->init(ctx[1]);
+	frames = 0;
+	for (i = 0; i < cap->n; i++)
+	{
+		c = &cap->chunks[i];
+		if (dir_mask & (1u << c->dir))
+			frames += p->feed(ctx[c->dir], cap->data + c->off, c->len, last);
+	}
+	return frames;
+}
+
+/* Back to back, `iterations` times over the whole capture (0: ~1 s) */
+static void	bench_max(bench_t *b, void *ctx[2], const cap_t *cap, unsigned dir_mask,
+			uint64_t iterations, uint64_t bytes)
+{
+	proto_frame_t	last;
+	uint64_t	frames;
+	uint64_t	i;
+	int64_t		t0;
+
+	if (!iterations)
+	{
+		t0 = mono_ns();
+		replay_once(b->parser, ctx, cap, dir_mask, &last); // also warms the caches
+		iterations = (uint64_t)(AUTO_ITER_NS / (mono_ns() - t0 + 1)) + 1;
+	}
+	frames = 0;
+	t0 = mono_ns();
+	for (i = 0; i < iterations; i++)
+		frames += replay_once(b->parser, ctx, cap, dir_mask, &last);
+	b->elapsed_ns = mono_ns() - t0;
+	b->iterations = iterations;
+	b->bytes = bytes * iterations;
+	b->frames = frames;
+}
+
+/* Once, each chunk at its recorded time (scaled by `speed`) */
+static void	bench_timed(bench_t *b, void *ctx[2], const cap_t *cap, unsigned dir_mask,
+			double speed)
+{
+	const cap_chunk_t	*c;
+	proto_frame_t		last;
+	int64_t			start;
+	int64_t			due;
+	int64_t			t0;
+	int64_t			t1;
+	size_t			i;
+
+	b->parser->init(ctx[0]);
+	b->parser->init(ctx[1]);
+	b->iterations = 1;
+	start = mono_ns();
+	for (i = 0; i < cap->n; i++)
+	{
+		c = &cap->chunks[i];
+		if (!(dir_mask & (1u << c->dir)))
+			continue;
+		due = start + (int64_t)((c->ts_ns - cap->chunks[0].ts_ns) / speed);
+		sleep_until(due);
+		t0 = mono_ns();
+		b->frames += b->parser->feed(ctx[c->dir], cap->data + c->off, c->len, &last);
+		t1 = mono_ns();
+		b->bytes += c->len;
+		b->elapsed_ns += t1 - t0;
+		if (t1 - t0 > b->max_chunk_ns)
+			b->max_chunk_ns = t1 - t0;
+		if (t0 - due > b->max_lag_ns)
+			b->max_lag_ns = t0 - due;
+	}
+	b->wall_ns = mono_ns() - start;
+}
+
+static void	print_text(const cap_t *cap, int files, const stats_ctx_t st[2], unsigned dir_mask,
+			const bench_t *bench, int nbench, bool timed)
+{
+	const parse_stats_t	*s;
+	double			span;
+	int			d;
+	int			i;
+
+	span = cap->n ? (cap->chunks[cap->n - 1].ts_ns - cap->chunks[0].ts_ns) / 1e9 : 0;
+	printf("capture: %d file(s), %zu chunks, %zu bytes, %.3f s\n\n", files, cap->n, cap->bytes, span);
+	printf("%-6s %10s %8s %8s %8s %8s %8s %10s\n",
+		"stream", "bytes", "frames", "crc_err", "len_err", "resyncs", "max_gap", "skipped");
+	for (d = 0; d < 2; d++)
+	{
+		if (!(dir_mask & (1u << d)))
+			continue;
+		s = &st[d].st;
+		printf("%-6s %10llu %8llu %8llu %8llu %8llu %8llu %10llu\n", g_dir_names[d],
+			(unsigned long long)s->bytes, (unsigned long long)s->frames,
+			(unsigned long long)s->crc_errors, (unsigned long long)s->len_errors,
+			(unsigned long long)s->resyncs, (unsigned long long)s->max_gap,
+			(unsigned long long)(s->bytes - s->frame_bytes));
+	}
+	printf("\n%-10s %8s %10s %10s %12s", "parser", "iters", "ns/byte", "MB/s", "frames/s");
+	if (timed)
+		printf(" %12s %12s", "max_chunk_us", "max_lag_us");
+	printf("\n");
+	for (i = 0; i < nbench; i++)
+	{
+		const bench_t	*b = &bench[i];
+
+		printf("%-10s %8llu %10.2f %10.1f %12.0f", b->parser->name,
+			(unsigned long long)b->iterations,
+			b->bytes ? (double)b->elapsed_ns / b->bytes : 0.0,
+			b->elapsed_ns ? b->bytes * 1e3 / b->elapsed_ns : 0.0,
+			b->elapsed_ns ? b->frames * 1e9 / (timed ? b->wall_ns : b->elapsed_ns) : 0.0);
+		if (timed)
+			printf(" %12.1f %12.1f", b->max_chunk_ns / 1e3, b->max_lag_ns / 1e3);
+		printf("\n");
+	}
+}
+
+static void	print_json(const cap_t *cap, int files, const stats_ctx_t st[2], unsigned dir_mask,
+			const bench_t *bench, int nbench, bool timed)
+{
+	const parse_stats_t	*s;
+	const char		*sep;
+	int			d;
+	int			i;
+
+	printf("{\"files\":%d,\"chunks\":%zu,\"bytes\":%zu,\"mode\":\"%s\",\"streams\":{",
+		files, cap->n, cap->bytes, timed ? "timed" : "max");
+	sep = "";
+	for (d = 0; d < 2; d++)
+	{
+		if (!(dir_mask & (1u << d)))
+			continue;
+		s = &st[d].st;
+		printf("%s\"%s\":{\"bytes\":%llu,\"frames\":%llu,\"crc_errors\":%llu,"
+			"\"len_errors\":%llu,\"resyncs\":%llu,\"max_gap\":%llu,\"skipped\":%llu}",
+			sep, g_dir_names[d], (unsigned long long)s->bytes, (unsigned long long)s->frames,
+			(unsigned long long)s->crc_errors, (unsigned long long)s->len_errors,
+			(unsigned long long)s->resyncs, (unsigned long long)s->max_gap,
+			(unsigned long long)(s->bytes - s->frame_bytes));
+		sep = ",";
+	}
+	printf("},\"parsers\":[");
+	for (i = 0; i < nbench; i++)
+	{
+		const bench_t	*b = &bench[i];
+
+		printf("%s{\"name\":\"%s\",\"iterations\":%llu,\"bytes\":%llu,\"frames\":%llu,"
+			"\"elapsed_ns\":%lld,\"ns_per_byte\":%.3f,\"frames_per_s\":%.1f",
+			i ? "," : "", b->parser->name, (unsigned long long)b->iterations,
+			(unsigned long long)b->bytes, (unsigned long long)b->frames,
+			(long long)b->elapsed_ns,
+			b->bytes ? (double)b->elapsed_ns / b->bytes : 0.0,
+			b->elapsed_ns ? b->frames * 1e9 / (timed ? b->wall_ns : b->elapsed_ns) : 0.0);
+		if (timed)
+			printf(",\"max_chunk_ns\":%lld,\"max_lag_ns\":%lld",
+				(long long)b->max_chunk_ns, (long long)b->max_lag_ns);
+		printf("}");
+	}
+	printf("]}\n");
+}
+
+static void	usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-p parser|all] [-d rx|tx|all] [-R] [-i iterations]\n"
+		"       [-T] [-x speed] [-j] [-v] [-l] capture...\n", prog);
+}
+
+int	main(int argc, char **argv)
+{
+	bench_t		bench[16];
+	stats_ctx_t	st[2];
+	cap_t		cap;
+	const parser_t	*p;
+	const char	*parser_name;
+	void		*ctx[2];
+	uint64_t	iterations;
+	uint64_t	bytes;
+	uint64_t	ref_frames;
+	unsigned	dir_mask;
+	double		speed;
+	bool		raw;
+	bool		timed;
+	bool		json;
+	bool		verbose;
+	int		nbench;
+	int		ret;
+	int		opt;
+	int		i;
+
+	parser_name = "bytewise";
+	dir_mask = 3;
+	iterations = 0;
+	speed = 1.0;
+	raw = false;
+	timed = false;
+	json = false;
+	verbose = false;
+	while ((opt = getopt(argc, argv, "p:d:Ri:Tx:jvlh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'p': parser_name = optarg; break;
+			case 'd':
+				if (!strcmp(optarg, "rx"))
+					dir_mask = 1u << FANCTL_CAP_DIR_RX;
+				else if (!strcmp(optarg, "tx"))
+					dir_mask = 1u << FANCTL_CAP_DIR_TX;
+				else if (!strcmp(optarg, "all"))
+					dir_mask = 3;
+				else
+				{
+					usage(argv[0]);
+					return 2;
+				}
+				break;
+			case 'R': raw = true; break;
+			case 'i': iterations = strtoull(optarg, NULL, 0); break;
+			case 'T': timed = true; break;
+			case 'x': speed = atof(optarg); break;
+			case 'j': json = true; break;
+			case 'v': verbose = true; break;
+			case 'l':
+				for (p = g_parsers; p->name; p++)
+					printf("%-10s %s\n", p->name, p->desc);
+				return 0;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	if (optind == argc || speed <= 0)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+	if (strcmp(parser_name, "all") && !parser_find(parser_name))
+	{
+		fprintf(stderr, "unknown parser %s (-l lists them)\n", parser_name);
+		return 2;
+	}
+
+	memset(&cap, 0, sizeof(cap));
+	for (i = optind; i < argc; i++)
+	{
+		if (!cap_load(&cap, argv[i], raw))
+		{
+			cap_free(&cap);
+			return 1;
+		}
+	}
+	cap_sort(&cap);
+
+	run_stats(&cap, dir_mask, verbose, st);
+	bytes = st[0].st.bytes + st[1].st.bytes;
+	ref_frames = st[0].st.frames + st[1].st.frames;
+
+	ret = 0;
+	nbench = 0;
+	memset(bench, 0, sizeof(bench));
+	for (p = g_parsers; p->name && nbench < (int)(sizeof(bench) / sizeof(bench[0])); p++)
+	{
+		if (strcmp(parser_name, "all") && strcmp(parser_name, p->name))
+			continue;
+		ctx[0] = malloc(p->ctx_size);
+		ctx[1] = malloc(p->ctx_size);
+		if (!ctx[0] || !ctx[1])
+		{
+			perror("malloc");
+			free(ctx[0]);
+			free(ctx[1]);
+			cap_free(&cap);
+			return 1;
+		}
+		bench[nbench].parser = p;
+		if (timed)
+			bench_timed(&bench[nbench], ctx, &cap, dir_mask, speed);
+		else
+			bench_max(&bench[nbench], ctx, &cap, dir_mask, iterations, bytes);
+		if (bench[nbench].frames != ref_frames * bench[nbench].iterations)
+		{
+			fprintf(stderr, "%s: %llu frames, proto_rx_feed() found %llu\n", p->name,
+				(unsigned long long)bench[nbench].frames,
+				(unsigned long long)(ref_frames * bench[nbench].iterations));
+			ret = 1;
+		}
+		free(ctx[0]);
+		free(ctx[1]);
+		nbench++;
+	}
+
+	if (json)
+		print_json(&cap, argc - optind, st, dir_mask, bench, nbench, timed);
+	else
+		print_text(&cap, argc - optind, st, dir_mask, bench, nbench, timed);
+	cap_free(&cap);
+	return ret;
+}
@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include "parser.h"
+
+/* proto_rx_feed(), one byte at a time: what the driver and firmware run */
+static void	bytewise_init(void *ctx)
+{
+	proto_rx_init(ctx);
+}
+
+static size_t	bytewise_feed(void *ctx, const uint8_t *buf, size_t len, proto_frame_t *last)
+{
+	size_t	frames;
+	size_t	i;
+
+	frames = 0;
+	for (i = 0; i < len; i++)
+		if (proto_rx_feed(ctx, buf[i], last))
+			frames++;
+	return frames;
+}
+
+const parser_t	g_parsers[] = {
+	{ "bytewise", "proto_rx_feed() per byte", sizeof(proto_rx_t), bytewise_init, bytewise_feed },
+	{ NULL, NULL, 0, NULL, NULL },
+};
+
+const parser_t	*parser_find(const char *name)
+{
+	const parser_t	*p;
+
+	for (p = g_parsers; p->name; p++)
+		if (!strcmp(p->name, name))
+			return p;
+	return NULL;
+}
+
+void	stats_init(stats_ctx_t *s)
+{
+	memset(s, 0, sizeof(*s));
+	proto_rx_init(&s->rx);
+}
+
+static void	stats_gap(stats_ctx_t *s, uint64_t start)
+{
+	if (start <= s->last_end)
+		return;
+	s->st.resyncs++;
+	if (start - s->last_end > s->st.max_gap)
+		s->st.max_gap = start - s->last_end;
+}
+
+/*
+ * Same parser, watching its state: a frame that reaches the last CRC
+ * byte without being returned failed its CRC, a LEN byte that sends the
+ * parser back to SYNC0 was out of range. Whatever lies between two
+ * valid frames was skipped.
+ */
+void	stats_feed(stats_ctx_t *s, const uint8_t *buf, size_t len,
+		void (*on_frame)(const proto_frame_t *f, void *arg), void *arg)
+{
+	proto_rx_state_t	st;
+	proto_frame_t		f;
+	uint64_t		size;
+	size_t			i;
+
+	for (i = 0; i < len; i++)
+	{
+		st = s->rx.st;
+		s->st.bytes++;
+		if (proto_rx_feed(&s->rx, buf[i], &f))
+		{
+			size = 2 + (f.addr != PROTO_ADDR_NONE) + 3 + f.len + 2;
+			stats_gap(s, s->st.bytes - size);
+			s->st.frames++;
+			s->st.frame_bytes += size;
+			s->last_end = s->st.bytes;
+			if (on_frame)
+				on_frame(&f, arg);
+		}
+		else if (st == RX_CRC_LO)
+			s->st.crc_errors++;
+		else if (st == RX_HEADER_LEN && s->rx.st == RX_SYNC0)
+			s->st.len_errors++;
+	}
+}
+
+/* Account for trailing bytes that never became a frame */
+void	stats_finish(stats_ctx_t *s)
+{
+	stats_gap(s, s->st.bytes);
+	s->last_end = s->st.bytes;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "proto.h"
+
+/*
+ * Parsers under test
+ * ------------------
+ * A parser consumes a byte chunk and reports how many frames completed
+ * in it. Add an entry to g_parsers[] to benchmark another implementation
+ * (e.g. a bulk parser scanning a whole chunk at once) on the same
+ * captures; its frame count is checked against proto_rx_feed().
+ */
+
+typedef struct {
+	const char	*name;
+	const char	*desc;
+	size_t		ctx_size;
+	void		(*init)(void *ctx);
+	size_t		(*feed)(void *ctx, const uint8_t *buf, size_t len, proto_frame_t *last);
+}	parser_t;
+
+extern const parser_t	g_parsers[];
+
+const parser_t	*parser_find(const char *name);
+
+/* Decoder statistics of one byte stream, from proto_rx_feed() */
+typedef struct {
+	uint64_t	bytes;
+	uint64_t	frames;
+	uint64_t	frame_bytes; // bytes that belong to a valid frame
+	uint64_t	crc_errors; // complete frames with a wrong CRC
+	uint64_t	len_errors; // LEN above PROTO_MAX_PAYLOAD
+	uint64_t	resyncs; // runs of bytes skipped between valid frames
+	uint64_t	max_gap; // longest such run
+}	parse_stats_t;
+
+typedef struct {
+	proto_rx_t	rx;
+	parse_stats_t	st;
+	uint64_t	last_end; // stream offset after the last valid frame
+}	stats_ctx_t;
+
+void	stats_init(stats_ctx_t *s);
+void	stats_feed(stats_ctx_t *s, const uint8_t *buf, size_t len,
+		void (*on_frame)(const proto_frame_t *f, void *arg), void *arg);
+void	stats_finish(stats_ctx_t *s);
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "curve.h"
+
+bool	curve_parse(const char *spec, curve_t *out)
+{
+	char	kind[8];
+	int	n;
+
+	memset(out, 0, sizeof(*out));
+	n = sscanf(spec, "%7[a-z]:%lf:%lf:%lf", kind, &out->a, &out->b, &out->c);
+	if (n == 2 && !strcmp(kind, "const"))
+		out->kind = CURVE_CONST;
+	else if (n == 4 && !strcmp(kind, "sine") && out->c > 0)
+		out->kind = CURVE_SINE;
+	else if (n == 4 && !strcmp(kind, "ramp") && out->c > 0)
+		out->kind = CURVE_RAMP;
+	else if (n == 4 && !strcmp(kind, "step"))
+		out->kind = CURVE_STEP;
+	else
+		return false;
+	return true;
+}
+
+float	curve_temp(const curve_t *curve, double t_s)
+{
+	switch (curve->kind)
+	{
+		case CURVE_SINE:
+			return (float)(curve->a + curve->b * sin(2.0 * M_PI * t_s / curve->c));
+		case CURVE_RAMP:
+			if (t_s >= curve->c)
+				return (float)curve->b;
+			return (float)(curve->a + (curve->b - curve->a) * t_s / curve->c);
+		case CURVE_STEP:
+			return (float)(t_s < curve->c ? curve->a : curve->b);
+		case CURVE_CONST:
+		default:
+			return (float)curve->a;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * Synthetic temperature curves (°C over seconds since start)
+ *
+ *   const:<t>                   constant
+ *   sine:<mean>:<amp>:<period>  mean + amp * sin(2*pi*t/period)
+ *   ramp:<from>:<to>:<dur>      linear from -> to over dur seconds, then hold
+ *   step:<from>:<to>:<at>       from, then to after `at` seconds
+ */
+typedef enum {
+	CURVE_CONST,
+	CURVE_SINE,
+	CURVE_RAMP,
+	CURVE_STEP,
+}	curve_kind_t;
+
+typedef struct {
+	curve_kind_t	kind;
+	double		a;
+	double		b;
+	double		c;
+}	curve_t;
+
+bool	curve_parse(const char *spec, curve_t *out);
+float	curve_temp(const curve_t *curve, double t_s);
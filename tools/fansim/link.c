@@ -0,0 +1,157 @@
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "link.h"
+
+void	link_init(link_t *link, uint32_t baud, double p_loss, double p_corrupt, uint64_t seed)
+{
+	memset(link, 0, sizeof(*link));
+	link->baud = baud;
+	link->byte_ns = baud ? 10LL * 1000000000LL / baud : 0;
+	link->p_loss = p_loss;
+	link->p_corrupt = p_corrupt;
+	link->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+/* xorshift64*, reproducible with -s */
+double	link_rand(link_t *link)
+{
+	link->rng ^= link->rng >> 12;
+	link->rng ^= link->rng << 25;
+	link->rng ^= link->rng >> 27;
+	return (double)((link->rng * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+}
+
+/*
+ * Apply the fault model to one byte.
+ * Returns false when the byte is lost.
+ */
+static bool	link_inject(link_t *link, uint8_t *byte, uint64_t *dropped, uint64_t *corrupted)
+{
+	if (link->p_loss > 0 && link_rand(link) < link->p_loss)
+	{
+		(*dropped)++;
+		return false;
+	}
+	if (link->p_corrupt > 0 && link_rand(link) < link->p_corrupt)
+	{
+		*byte ^= (uint8_t)(1 + (int)(link_rand(link) * 255)); // never a no-op
+		(*corrupted)++;
+	}
+	return true;
+}
+
+bool	link_rx_byte(link_t *link, uint8_t *byte)
+{
+	link->stats.rx_bytes++;
+	return link_inject(link, byte, &link->stats.rx_dropped, &link->stats.rx_corrupted);
+}
+
+bool	link_queue(link_t *link, const uint8_t *data, size_t len, int64_t due_ns)
+{
+	link_frame_t	*f;
+
+	if (link->txq_len == LINK_TXQ_LEN || len > sizeof(f->data))
+	{
+		link->stats.txq_overflow++;
+		return false;
+	}
+	f = &link->txq[link->txq_len++];
+	memcpy(f->data, data, len);
+	f->len = len;
+	f->due_ns = due_ns;
+	return true;
+}
+
+static void	link_pop(link_t *link)
+{
+	link->txq_len--;
+	memmove(&link->txq[0], &link->txq[1], link->txq_len * sizeof(link->txq[0]));
+	link->tx_active = false;
+	link->tx_off = 0;
+	link->stats.tx_frames++;
+}
+
+/*
+ * Push every byte that has fully crossed the wire by `now_ns`.
+ * A frame starts when it is due and the previous one has left, frames
+ * are sent in queue order (the node serializes its replies).
+ * Bytes the pty doesn't accept (full, or no reader: EAGAIN/EIO) are
+ * lost like on a real wire, and counted in tx_dropped.
+ * Returns -1 on a write error other than EAGAIN or EIO.
+ */
+int	link_flush(link_t *link, int fd, int64_t now_ns)
+{
+	link_frame_t	*f;
+	uint8_t		out[PROTO_MAX_FRAME];
+	size_t		n_due;
+	size_t		n_out;
+	size_t		i;
+	ssize_t		w;
+
+	while (link->txq_len > 0)
+	{
+		f = &link->txq[0];
+		if (!link->tx_active)
+		{
+			if (f->due_ns > now_ns)
+				return 0;
+			link->tx_start_ns = f->due_ns > link->wire_free_ns ? f->due_ns : link->wire_free_ns;
+			link->tx_active = true;
+		}
+		if (link->byte_ns == 0)
+			n_due = f->len;
+		else if (now_ns < link->tx_start_ns)
+			return 0;
+		else
+		{
+			n_due = (size_t)((now_ns - link->tx_start_ns) / link->byte_ns);
+			if (n_due > f->len)
+				n_due = f->len;
+		}
+		if (n_due <= link->tx_off)
+			return 0;
+		n_out = 0;
+		for (i = link->tx_off; i < n_due; i++)
+		{
+			out[n_out] = f->data[i];
+			if (link_inject(link, &out[n_out], &link->stats.tx_dropped, &link->stats.tx_corrupted))
+				n_out++;
+		}
+		if (n_out > 0)
+		{
+			w = write(fd, out, n_out);
+			if (w < 0 && errno != EAGAIN && errno != EIO)
+				return -1;
+			// these bytes left the wire: what the pty didn't take is lost
+			if (w < (ssize_t)n_out)
+				link->stats.tx_dropped += n_out - (size_t)(w < 0 ? 0 : w);
+		}
+		link->stats.tx_bytes += n_due - link->tx_off;
+		link->tx_off = n_due;
+		if (link->tx_off < f->len)
+			return 0;
+		link->wire_free_ns = link->tx_start_ns + (int64_t)f->len * link->byte_ns;
+		link_pop(link);
+	}
+	return 0;
+}
+
+/* Earliest time link_flush() has something to do, -1 if idle. */
+int64_t	link_next_deadline(const link_t *link)
+{
+	int64_t	start;
+
+	if (link->txq_len == 0)
+		return -1;
+	if (link->tx_active)
+		start = link->tx_start_ns;
+	else
+	{
+		start = link->txq[0].due_ns;
+		if (start < link->wire_free_ns)
+			start = link->wire_free_ns;
+	}
+	return start + (int64_t)(link->tx_off + 1) * link->byte_ns;
+}
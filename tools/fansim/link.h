@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "proto.h"
+
+/*
+ * Simulated wire
+ * --------------
+ * Responses are queued with the time they leave the node and are written
+ * to the pty byte by byte at the configured baud rate (10 bits per byte,
+ * 8N1), one frame at a time, like a shared half-duplex bus.
+ * Both directions go through the fault injector (per-byte loss and
+ * corruption probabilities).
+ */
+
+#define LINK_TXQ_LEN	32
+
+typedef struct {
+	uint8_t		data[PROTO_MAX_FRAME];
+	size_t		len;
+	int64_t		due_ns; // earliest time the first byte may leave
+}	link_frame_t;
+
+typedef struct {
+	uint64_t	rx_bytes;
+	uint64_t	rx_dropped;
+	uint64_t	rx_corrupted;
+	uint64_t	tx_frames;
+	uint64_t	tx_bytes;
+	uint64_t	tx_dropped;
+	uint64_t	tx_corrupted;
+	uint64_t	txq_overflow;
+}	link_stats_t;
+
+typedef struct {
+	uint32_t	baud; // 0: no pacing
+	int64_t		byte_ns;
+	double		p_loss;
+	double		p_corrupt;
+	uint64_t	rng;
+	link_frame_t	txq[LINK_TXQ_LEN];
+	size_t		txq_len;
+	bool		tx_active; // txq[0] is on the wire
+	size_t		tx_off; // bytes of txq[0] already on the wire
+	int64_t		tx_start_ns; // when txq[0] started
+	int64_t		wire_free_ns; // when the last frame fully left
+	link_stats_t	stats;
+}	link_t;
+
+void	link_init(link_t *link, uint32_t baud, double p_loss, double p_corrupt, uint64_t seed);
+bool	link_rx_byte(link_t *link, uint8_t *byte);
+bool	link_queue(link_t *link, const uint8_t *data, size_t len, int64_t due_ns);
+int	link_flush(link_t *link, int fd, int64_t now_ns);
+int64_t	link_next_deadline(const link_t *link);
+double	link_rand(link_t *link);
@@ -0,0 +1,378 @@
+/*
+ * fansim
+ * ------
+ * Fan node simulator on a pseudo-terminal.
+ * Speaks the wire protocol (common/proto.h) on the slave side of a pty,
+ * so fanctl_serial, ldattach + the fanctl driver and proto_test.py can
+ * be exercised without an ESP32.
+ *
+ *   fansim [-l link] [-a addrs] [-b baud] [-d delay_us] [-j jitter_us]
+ *          [-L loss] [-C corrupt] [-T curve] [-s seed] [-v]
+ *
+ * -l   create a symlink to the slave pty (e.g. /tmp/ttyFAN0)
+ * -a   simulate addressed nodes on a shared bus ("1,2,5-8"),
+ *      default: one point-to-point node
+ * -b   wire baud rate for reply pacing, 0 disables (default 115200)
+ * -d   per-request processing time in µs (default 1000)
+ * -j   extra uniformly distributed jitter in µs (default 0)
+ * -L   per-byte loss probability, both directions (default 0)
+ * -C   per-byte corruption probability, both directions (default 0)
+ * -T   temperature curve, see curve.h (default const:25)
+ * -s   PRNG seed for jitter and fault injection
+ * -v   log every frame to stderr
+ *
+ * Counters are printed on SIGINT/SIGTERM.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+
+#include "proto.h"
+#include "node.h"
+#include "curve.h"
+#include "link.h"
+
+#define SENSOR_PERIOD_NS	2100000000LL // dht22_task
+#define FAN_CTRL_PERIOD_NS	1000000000LL // fan_control_task
+#define MAX_NODES		(PROTO_ADDR_BROADCAST)
+
+typedef struct {
+	sim_node_t	nodes[MAX_NODES];
+	size_t		n_nodes;
+	link_t		link;
+	curve_t		curve;
+	int64_t		delay_ns;
+	int64_t		jitter_ns;
+	int64_t		t0_ns;
+	bool		verbose;
+	uint64_t	rx_frames;
+	uint64_t	broadcasts;
+}	sim_t;
+
+static volatile sig_atomic_t	g_stop;
+
+static void	on_signal(int sig)
+{
+	(void)sig;
+	g_stop = 1;
+}
+
+static int64_t	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* "1,2,5-8" -> node list */
+static bool	parse_addrs(sim_t *sim, const char *spec)
+{
+	const char	*p;
+	char		*end;
+	long		lo;
+	long		hi;
+	long		a;
+
+	p = spec;
+	while (*p)
+	{
+		lo = strtol(p, &end, 0);
+		if (end == p)
+			return false;
+		hi = lo;
+		if (*end == '-')
+		{
+			p = end + 1;
+			hi = strtol(p, &end, 0);
+			if (end == p)
+				return false;
+		}
+		if (lo < 1 || hi >= PROTO_ADDR_BROADCAST || lo > hi)
+			return false;
+		for (a = lo; a <= hi && sim->n_nodes < MAX_NODES; a++)
+			node_init(&sim->nodes[sim->n_nodes++], (uint8_t)a);
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return false;
+		p = end;
+	}
+	return sim->n_nodes > 0;
+}
+
+static int	open_pty(const char *link_path)
+{
+	struct termios	tio;
+	const char	*slave;
+	int		master;
+	int		slave_fd;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+	{
+		perror("posix_openpt");
+		return -1;
+	}
+	slave = ptsname(master);
+	if (!slave)
+	{
+		perror("ptsname");
+		return -1;
+	}
+	// Keep one slave fd open: the master reads EIO while no slave is open,
+	// and raw mode set here survives clients coming and going.
+	slave_fd = open(slave, O_RDWR | O_NOCTTY);
+	if (slave_fd < 0)
+	{
+		perror("open slave");
+		return -1;
+	}
+	if (tcgetattr(slave_fd, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		cfsetspeed(&tio, B115200);
+		tcsetattr(slave_fd, TCSANOW, &tio);
+	}
+	if (link_path)
+	{
+		unlink(link_path);
+		if (symlink(slave, link_path) < 0)
+		{
+			perror("symlink");
+			return -1;
+		}
+	}
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+	printf("%s\n", link_path ? link_path : slave);
+	fflush(stdout);
+	return master;
+}
+
+static void	sim_frame(sim_t *sim, const proto_frame_t *req, int64_t now_ns)
+{
+	proto_frame_t	plain;
+	proto_frame_t	resp;
+	proto_trace_t	trace;
+	sim_node_t	*node;
+	uint8_t		buf[PROTO_MAX_FRAME];
+	proto_u16	len;
+	int64_t		start_ns;
+	int64_t		due_ns;
+	size_t		i;
+
+	sim->rx_frames++;
+	if (req->addr == PROTO_ADDR_BROADCAST)
+		sim->broadcasts++;
+	if (sim->verbose)
+		fprintf(stderr, "rx addr=0x%02X cmd=0x%02X seq=%u len=%u\n",
+			req->addr, req->cmd, req->seq, req->len);
+	plain = *req;
+	plain.cmd &= ~PROTO_CMD_F_TRACE;
+	for (i = 0; i < sim->n_nodes; i++)
+	{
+		node = &sim->nodes[i];
+		if (!node_accepts(node, req))
+			continue;
+		// cmd_handler_task handles one request at a time
+		start_ns = node->busy_until_ns > now_ns ? node->busy_until_ns : now_ns;
+		due_ns = start_ns + sim->delay_ns;
+		if (sim->jitter_ns > 0)
+			due_ns += (int64_t)(link_rand(&sim->link) * (double)sim->jitter_ns);
+		node->busy_until_ns = due_ns;
+		memset(&resp, 0, sizeof(resp));
+		if (!node_handle(node, &plain, &resp))
+			continue;
+		if (req->cmd & PROTO_CMD_F_TRACE) // same points as the firmware, simulated clock
+		{
+			trace.parse_us = (uint32_t)(now_ns / 1000);
+			trace.dequeue_us = (uint32_t)(start_ns / 1000);
+			trace.handler_us = trace.dequeue_us;
+			trace.send_us = (uint32_t)(due_ns / 1000);
+			proto_trace_append(&resp, &trace);
+		}
+		if (!proto_build_frame_addr(resp.addr, resp.cmd, resp.seq, resp.payload,
+						resp.len, buf, &len))
+			continue;
+		link_queue(&sim->link, buf, len, due_ns);
+	}
+}
+
+static void	sim_tick(sim_t *sim, int64_t now_ns, int64_t *next_sensor, int64_t *next_fan)
+{
+	double	t_s;
+	size_t	i;
+
+	if (now_ns >= *next_sensor)
+	{
+		t_s = (double)(now_ns - sim->t0_ns) / 1e9;
+		for (i = 0; i < sim->n_nodes; i++)
+		{
+			sim->nodes[i].temperature = curve_temp(&sim->curve, t_s);
+			sim->nodes[i].humidity = curve_temp(&(curve_t){CURVE_SINE, 40, 5, 600}, t_s);
+		}
+		*next_sensor += SENSOR_PERIOD_NS;
+	}
+	if (now_ns >= *next_fan)
+	{
+		for (i = 0; i < sim->n_nodes; i++)
+			node_fan_control(&sim->nodes[i]);
+		*next_fan += FAN_CTRL_PERIOD_NS;
+	}
+}
+
+static void	print_stats(const sim_t *sim)
+{
+	const link_stats_t	*s;
+	size_t			i;
+
+	s = &sim->link.stats;
+	fprintf(stderr, "rx: %llu bytes, %llu frames (%llu broadcast), %llu dropped, %llu corrupted\n",
+		(unsigned long long)s->rx_bytes, (unsigned long long)sim->rx_frames,
+		(unsigned long long)sim->broadcasts, (unsigned long long)s->rx_dropped,
+		(unsigned long long)s->rx_corrupted);
+	fprintf(stderr, "tx: %llu bytes, %llu frames, %llu dropped, %llu corrupted, %llu queue overflow\n",
+		(unsigned long long)s->tx_bytes, (unsigned long long)s->tx_frames,
+		(unsigned long long)s->tx_dropped, (unsigned long long)s->tx_corrupted,
+		(unsigned long long)s->txq_overflow);
+	for (i = 0; i < sim->n_nodes; i++)
+		fprintf(stderr, "node 0x%02X: %u requests\n", sim->nodes[i].addr,
+			sim->nodes[i].handled);
+}
+
+static void	usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-l link] [-a addrs] [-b baud] [-d delay_us] [-j jitter_us]\n"
+			"       [-L loss] [-C corrupt] [-T curve] [-s seed] [-v]\n"
+			"curve: const:<t> | sine:<mean>:<amp>:<period_s> | ramp:<from>:<to>:<dur_s>"
+			" | step:<from>:<to>:<at_s>\n", prog);
+}
+
+int	main(int argc, char **argv)
+{
+	static sim_t	sim;
+	struct pollfd	pfd;
+	struct timespec	ts;
+	proto_frame_t	frame;
+	proto_rx_t	rx;
+	const char	*link_path;
+	uint8_t		buf[256];
+	uint32_t	baud;
+	double		p_loss;
+	double		p_corrupt;
+	uint64_t	seed;
+	int64_t		now;
+	int64_t		next_sensor;
+	int64_t		next_fan;
+	int64_t		deadline;
+	int64_t		d;
+	ssize_t		n;
+	ssize_t		i;
+	int		master;
+	int		opt;
+
+	link_path = NULL;
+	baud = 115200;
+	p_loss = 0;
+	p_corrupt = 0;
+	seed = 0;
+	sim.delay_ns = 1000000;
+	curve_parse("const:25", &sim.curve);
+	while ((opt = getopt(argc, argv, "l:a:b:d:j:L:C:T:s:vh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'l': link_path = optarg; break;
+			case 'b': baud = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'd': sim.delay_ns = (int64_t)(atof(optarg) * 1000); break;
+			case 'j': sim.jitter_ns = (int64_t)(atof(optarg) * 1000); break;
+			case 'L': p_loss = atof(optarg); break;
+			case 'C': p_corrupt = atof(optarg); break;
+			case 's': seed = strtoull(optarg, NULL, 0); break;
+			case 'v': sim.verbose = true; break;
+			case 'a':
+				if (!parse_addrs(&sim, optarg))
+				{
+					fprintf(stderr, "Invalid address list: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'T':
+				if (!curve_parse(optarg, &sim.curve))
+				{
+					fprintf(stderr, "Invalid curve: %s\n", optarg);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (sim.n_nodes == 0)
+		node_init(&sim.nodes[sim.n_nodes++], PROTO_ADDR_NONE);
+	link_init(&sim.link, baud, p_loss, p_corrupt, seed);
+	master = open_pty(link_path);
+	if (master < 0)
+		return 1;
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	proto_rx_init(&rx);
+	sim.t0_ns = mono_ns();
+	next_sensor = sim.t0_ns;
+	next_fan = sim.t0_ns;
+	pfd.fd = master;
+	pfd.events = POLLIN;
+	while (!g_stop)
+	{
+		now = mono_ns();
+		sim_tick(&sim, now, &next_sensor, &next_fan);
+		if (link_flush(&sim.link, master, now) < 0)
+		{
+			perror("write");
+			break;
+		}
+		deadline = next_sensor < next_fan ? next_sensor : next_fan;
+		d = link_next_deadline(&sim.link);
+		if (d >= 0 && d < deadline)
+			deadline = d;
+		d = deadline - mono_ns();
+		if (d < 0)
+			d = 0;
+		ts.tv_sec = d / 1000000000LL;
+		ts.tv_nsec = d % 1000000000LL;
+		if (ppoll(&pfd, 1, &ts, NULL) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("ppoll");
+			break;
+		}
+		if (!(pfd.revents & POLLIN))
+			continue;
+		n = read(master, buf, sizeof(buf));
+		if (n <= 0)
+			continue;
+		now = mono_ns();
+		for (i = 0; i < n; i++)
+		{
+			if (!link_rx_byte(&sim.link, &buf[i]))
+				continue;
+			if (proto_rx_feed(&rx, buf[i], &frame))
+				sim_frame(&sim, &frame, now);
+		}
+	}
+	print_stats(&sim);
+	if (link_path)
+		unlink(link_path);
+	return 0;
+}
@@ -0,0 +1,162 @@
+#include <string.h>
+
+#include "node.h"
+
+#define BE16(x) ((uint16_t)((((uint16_t)(x)) >> 8) | (((uint16_t)(x)) << 8)))
+
+void	node_init(sim_node_t *node, uint8_t addr)
+{
+	memset(node, 0, sizeof(*node));
+	node->addr = addr;
+	node->fan_state = PROTO_FAN_STATE_OFF;
+	node->fan_mode = PROTO_FAN_MODE_AUTO;
+	node->temp_threshold = 20.0f;
+	node->humidity = 40.0f;
+}
+
+/* Same filter as comm_frame_is_for_me() in the firmware. */
+bool	node_accepts(const sim_node_t *node, const proto_frame_t *req)
+{
+	if (req->addr == PROTO_ADDR_BROADCAST)
+		return true;
+	return req->addr == node->addr;
+}
+
+static void	make_ack(const proto_frame_t *req, uint8_t status, proto_frame_t *resp)
+{
+	resp->addr = req->addr;
+	resp->cmd = PROTO_CMD_ACK;
+	resp->seq = req->seq;
+	resp->payload[0] = req->cmd;
+	resp->payload[1] = status;
+	resp->len = 2;
+}
+
+static void	handle_status_req(sim_node_t *node, const proto_frame_t *req, proto_frame_t *resp)
+{
+	status_resp_t	status;
+
+	status.temp_x100 = BE16((int16_t)(node->temperature * 100.0f));
+	status.humidity_x100 = BE16((uint16_t)(node->humidity * 100.0f));
+	status.fan_mode = node->fan_mode;
+	status.fan_state = node->fan_state;
+	status.errors = BE16(node->errors);
+	resp->addr = req->addr;
+	resp->cmd = PROTO_CMD_STATUS_RESP;
+	resp->seq = req->seq;
+	resp->len = sizeof(status);
+	memcpy(resp->payload, &status, sizeof(status));
+}
+
+static void	handle_set_fan_mode(sim_node_t *node, const proto_frame_t *req, proto_frame_t *resp)
+{
+	uint8_t	mode;
+
+	if (req->len != 1)
+	{
+		make_ack(req, PROTO_ERR_INVALID_ARG, resp);
+		return;
+	}
+	mode = req->payload[0];
+	if (mode != PROTO_FAN_MODE_AUTO && mode != PROTO_FAN_MODE_MANUAL)
+	{
+		make_ack(req, PROTO_ERR_INVALID_ARG, resp);
+		return;
+	}
+	node->fan_mode = mode;
+	make_ack(req, PROTO_ERR_OK, resp);
+}
+
+static void	handle_set_fan_state(sim_node_t *node, const proto_frame_t *req, proto_frame_t *resp)
+{
+	uint8_t	fan_state;
+
+	if (req->len != 1)
+	{
+		make_ack(req, PROTO_ERR_INVALID_ARG, resp);
+		return;
+	}
+	fan_state = req->payload[0];
+	if (fan_state != PROTO_FAN_STATE_ON && fan_state != PROTO_FAN_STATE_OFF)
+	{
+		make_ack(req, PROTO_ERR_INVALID_ARG, resp);
+		return;
+	}
+	if (node->fan_mode == PROTO_FAN_MODE_AUTO)
+	{
+		make_ack(req, PROTO_ERR_STATE, resp);
+		return;
+	}
+	node->fan_state = fan_state;
+	make_ack(req, PROTO_ERR_OK, resp);
+}
+
+static void	handle_set_threshold(sim_node_t *node, const proto_frame_t *req, proto_frame_t *resp)
+{
+	int16_t	temp_x100;
+	float	temp;
+
+	if (req->len != 2)
+	{
+		make_ack(req, PROTO_ERR_INVALID_ARG, resp);
+		return;
+	}
+	temp_x100 = (int16_t)((req->payload[0] << 8) | req->payload[1]);
+	temp = (float)temp_x100 / 100;
+	if (temp > 80.0f || temp < -40.0f)
+	{
+		make_ack(req, PROTO_ERR_INVALID_ARG, resp);
+		return;
+	}
+	node->temp_threshold = temp;
+	make_ack(req, PROTO_ERR_OK, resp);
+}
+
+static void	handle_ping(const proto_frame_t *req, proto_frame_t *resp)
+{
+	resp->addr = req->addr;
+	resp->cmd = PROTO_CMD_PONG;
+	resp->seq = req->seq;
+	resp->len = 0;
+}
+
+/*
+ * cmd_handler_task equivalent.
+ * Returns true when `resp` has to be sent (never for broadcasts).
+ */
+bool	node_handle(sim_node_t *node, const proto_frame_t *req, proto_frame_t *resp)
+{
+	switch (req->cmd)
+	{
+		case PROTO_CMD_STATUS_REQ:
+			handle_status_req(node, req, resp);
+			break;
+		case PROTO_CMD_SET_FAN_MODE:
+			handle_set_fan_mode(node, req, resp);
+			break;
+		case PROTO_CMD_SET_FAN_STATE:
+			handle_set_fan_state(node, req, resp);
+			break;
+		case PROTO_CMD_SET_THRESHOLD:
+			handle_set_threshold(node, req, resp);
+			break;
+		case PROTO_CMD_PING:
+			handle_ping(req, resp);
+			break;
+		default:
+			return false;
+	}
+	node->handled++;
+	return req->addr != PROTO_ADDR_BROADCAST;
+}
+
+/* fan_control_task equivalent, called once per second. */
+void	node_fan_control(sim_node_t *node)
+{
+	if (node->fan_mode != PROTO_FAN_MODE_AUTO)
+		return;
+	if (node->temperature >= node->temp_threshold)
+		node->fan_state = PROTO_FAN_STATE_ON;
+	else
+		node->fan_state = PROTO_FAN_STATE_OFF;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "proto.h"
+
+/*
+ * Simulated fan node
+ * Mirrors the firmware's sys_state_t and command handlers
+ * (firmware/fan_node/main/cmd_handler.c, task.c).
+ */
+typedef struct {
+	uint8_t			addr; // PROTO_ADDR_NONE: point-to-point node
+	float			temperature;
+	float			humidity;
+	proto_fan_state_t	fan_state;
+	proto_fan_mode_t	fan_mode;
+	float			temp_threshold;
+	uint16_t		errors;
+	int64_t			busy_until_ns; // cmd_handler_task busy until (CLOCK_MONOTONIC)
+	uint32_t		handled; // requests handled
+}	sim_node_t;
+
+void	node_init(sim_node_t *node, uint8_t addr);
+bool	node_accepts(const sim_node_t *node, const proto_frame_t *req);
+bool	node_handle(sim_node_t *node, const proto_frame_t *req, proto_frame_t *resp);
+void	node_fan_control(sim_node_t *node);
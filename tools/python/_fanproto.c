@@ -0,0 +1,287 @@
+/*
+ * _fanproto
+ * ---------
+ * CPython extension over common/proto.c, the native path of fanproto.py:
+ *
+ *   crc16(data, init=0xFFFF) -> int
+ *   build_frame(cmd, seq, payload=b"", addr=0) -> bytes
+ *   parse(data) -> [Frame, ...]
+ *   Parser().feed(data) -> [Frame, ...]    state kept across calls
+ *
+ * `data` is any buffer-protocol object (bytes, bytearray, memoryview,
+ * mmap), read in place. Frames are (addr, cmd, seq, payload) struct
+ * sequences, so they index and unpack like fanproto.Frame. The parser is
+ * proto_rx_feed(), the one the driver, the firmware and fansim use.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include "proto.h"
+
+#define NOGIL_MIN	65536 // release the GIL for CRCs over this many bytes
+
+static PyTypeObject	*g_frame_type;
+
+/* Frames ------------------------------------------------------------------- */
+
+static PyStructSequence_Field	g_frame_fields[] = {
+	{ "addr", "node address, 0 for unaddressed frames" },
+	{ "cmd", "command byte" },
+	{ "seq", "sequence number" },
+	{ "payload", "payload bytes" },
+	{ NULL, NULL },
+};
+
+static PyStructSequence_Desc	g_frame_desc = {
+	"_fanproto.Frame",
+	"A received frame",
+	g_frame_fields,
+	4,
+};
+
+static PyObject	*frame_new(const proto_frame_t *f)
+{
+	PyObject	*obj;
+	PyObject	*payload;
+
+	payload = PyBytes_FromStringAndSize((const char *)f->payload, f->len);
+	if (!payload)
+		return NULL;
+	obj = PyStructSequence_New(g_frame_type);
+	if (!obj)
+	{
+		Py_DECREF(payload);
+		return NULL;
+	}
+	// small ints are cached, these can't fail
+	PyStructSequence_SET_ITEM(obj, 0, PyLong_FromLong(f->addr));
+	PyStructSequence_SET_ITEM(obj, 1, PyLong_FromLong(f->cmd));
+	PyStructSequence_SET_ITEM(obj, 2, PyLong_FromLong(f->seq));
+	PyStructSequence_SET_ITEM(obj, 3, payload);
+	return obj;
+}
+
+/*
+ * Feed a whole buffer to rx. Returns a new list of frames, NULL with an
+ * exception set on failure. A frame whose CRC doesn't match is counted.
+ */
+static PyObject	*feed(proto_rx_t *rx, const Py_buffer *buf, unsigned long long *crc_errors)
+{
+	const proto_u8	*p;
+	proto_frame_t	f;
+	PyObject	*list;
+	PyObject	*frame;
+	Py_ssize_t	i;
+	bool		last;
+
+	list = PyList_New(0);
+	if (!list)
+		return NULL;
+	p = buf->buf;
+	for (i = 0; i < buf->len; i++)
+	{
+		last = rx->st == RX_CRC_LO;
+		if (!proto_rx_feed(rx, p[i], &f))
+		{
+			*crc_errors += last;
+			continue;
+		}
+		frame = frame_new(&f);
+		if (!frame || PyList_Append(list, frame) < 0)
+		{
+			Py_XDECREF(frame);
+			Py_DECREF(list);
+			return NULL;
+		}
+		Py_DECREF(frame);
+	}
+	return list;
+}
+
+/* Parser ------------------------------------------------------------------- */
+
+typedef struct {
+	PyObject_HEAD
+	proto_rx_t		rx;
+	unsigned long long	crc_errors;
+}	parser_t;
+
+static int	parser_init(parser_t *self, PyObject *args, PyObject *kwds)
+{
+	static char	*kwlist[] = { NULL };
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, ":Parser", kwlist))
+		return -1;
+	proto_rx_init(&self->rx);
+	self->crc_errors = 0;
+	return 0;
+}
+
+static PyObject	*parser_feed(parser_t *self, PyObject *arg)
+{
+	Py_buffer	buf;
+	PyObject	*list;
+
+	if (PyObject_GetBuffer(arg, &buf, PyBUF_SIMPLE) < 0)
+		return NULL;
+	list = feed(&self->rx, &buf, &self->crc_errors);
+	PyBuffer_Release(&buf);
+	return list;
+}
+
+static PyObject	*parser_reset(parser_t *self, PyObject *Py_UNUSED(ignored))
+{
+	proto_rx_init(&self->rx);
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef	g_parser_methods[] = {
+	{ "feed", (PyCFunction)parser_feed, METH_O,
+		"feed(data) -> list of the frames completed by data" },
+	{ "reset", (PyCFunction)parser_reset, METH_NOARGS,
+		"reset() -> drop a partly received frame" },
+	{ NULL, NULL, 0, NULL },
+};
+
+static PyMemberDef	g_parser_members[] = {
+	{ "crc_errors", T_ULONGLONG, offsetof(parser_t, crc_errors), READONLY,
+		"frames dropped because their CRC didn't match" },
+	{ NULL, 0, 0, 0, NULL },
+};
+
+static PyTypeObject	g_parser_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "_fanproto.Parser",
+	.tp_doc = "Streaming frame parser (proto_rx_feed)",
+	.tp_basicsize = sizeof(parser_t),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_new = PyType_GenericNew,
+	.tp_init = (initproc)parser_init,
+	.tp_methods = g_parser_methods,
+	.tp_members = g_parser_members,
+};
+
+/* Functions ---------------------------------------------------------------- */
+
+static proto_u16	crc_buf(proto_u16 crc, const proto_u8 *p, Py_ssize_t len)
+{
+	proto_u16	chunk;
+
+	while (len > 0)
+	{
+		chunk = len > 0xFFFF ? 0xFFFF : (proto_u16)len;
+		crc = proto_crc16_update(crc, p, chunk);
+		p += chunk;
+		len -= chunk;
+	}
+	return crc;
+}
+
+static PyObject	*py_crc16(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	static char	*kwlist[] = { "data", "init", NULL };
+	Py_buffer	buf;
+	unsigned int	init;
+	proto_u16	crc;
+
+	(void)self;
+	init = 0xFFFF;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|I:crc16", kwlist, &buf, &init))
+		return NULL;
+	if (buf.len < NOGIL_MIN)
+		crc = crc_buf((proto_u16)init, buf.buf, buf.len);
+	else
+	{
+		Py_BEGIN_ALLOW_THREADS
+		crc = crc_buf((proto_u16)init, buf.buf, buf.len);
+		Py_END_ALLOW_THREADS
+	}
+	PyBuffer_Release(&buf);
+	return PyLong_FromLong(crc);
+}
+
+static PyObject	*py_build_frame(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	static char	*kwlist[] = { "cmd", "seq", "payload", "addr", NULL };
+	proto_u8	out[PROTO_MAX_FRAME];
+	proto_u16	out_len;
+	Py_buffer	payload;
+	unsigned char	cmd;
+	unsigned char	seq;
+	unsigned char	addr;
+	bool		ok;
+
+	(void)self;
+	addr = PROTO_ADDR_NONE;
+	memset(&payload, 0, sizeof(payload));
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "BB|y*B:build_frame", kwlist, &cmd, &seq,
+			&payload, &addr))
+		return NULL;
+	ok = payload.len <= PROTO_MAX_PAYLOAD && proto_build_frame_addr(addr, cmd, seq,
+		payload.buf, (proto_u8)payload.len, out, &out_len);
+	if (payload.obj)
+		PyBuffer_Release(&payload);
+	if (!ok)
+		return PyErr_Format(PyExc_ValueError, "payload longer than %d bytes", PROTO_MAX_PAYLOAD);
+	return PyBytes_FromStringAndSize((const char *)out, out_len);
+}
+
+static PyObject	*py_parse(PyObject *self, PyObject *arg)
+{
+	unsigned long long	crc_errors;
+	proto_rx_t		rx;
+	Py_buffer		buf;
+	PyObject		*list;
+
+	(void)self;
+	if (PyObject_GetBuffer(arg, &buf, PyBUF_SIMPLE) < 0)
+		return NULL;
+	proto_rx_init(&rx);
+	crc_errors = 0;
+	list = feed(&rx, &buf, &crc_errors);
+	PyBuffer_Release(&buf);
+	return list;
+}
+
+static PyMethodDef	g_methods[] = {
+	{ "crc16", (PyCFunction)(void (*)(void))py_crc16, METH_VARARGS | METH_KEYWORDS,
+		"crc16(data, init=0xFFFF) -> CRC-16/CCITT-FALSE of data" },
+	{ "build_frame", (PyCFunction)(void (*)(void))py_build_frame, METH_VARARGS | METH_KEYWORDS,
+		"build_frame(cmd, seq, payload=b\"\", addr=0) -> frame bytes" },
+	{ "parse", py_parse, METH_O,
+		"parse(data) -> list of the frames in data" },
+	{ NULL, NULL, 0, NULL },
+};
+
+static struct PyModuleDef	g_module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "_fanproto",
+	.m_doc = "Native frame codec over common/proto.c",
+	.m_size = -1,
+	.m_methods = g_methods,
+};
+
+PyMODINIT_FUNC	PyInit__fanproto(void)
+{
+	PyObject	*m;
+
+	if (PyType_Ready(&g_parser_type) < 0)
+		return NULL;
+	g_frame_type = PyStructSequence_NewType(&g_frame_desc);
+	if (!g_frame_type)
+		return NULL;
+	m = PyModule_Create(&g_module);
+	if (!m)
+		return NULL;
+	Py_INCREF(&g_parser_type);
+	Py_INCREF(g_frame_type);
+	if (PyModule_AddObject(m, "Parser", (PyObject *)&g_parser_type) < 0
+		|| PyModule_AddObject(m, "Frame", (PyObject *)g_frame_type) < 0)
+	{
+		Py_DECREF(m);
+		return NULL;
+	}
+	return m;
+}
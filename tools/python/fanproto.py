@@ -0,0 +1,221 @@
+"""
+fanproto.py
+
+Wire protocol helpers shared by the Python tools (common/proto.h):
+    - CRC-16/CCITT-FALSE
+    - Frame building, unaddressed and addressed
+    - Streaming frame parser, same states as proto_rx_feed()
+    - Reader for raw captures (common/fanctl_cap.h)
+
+crc16, build_frame, parse and Parser use the _fanproto C extension
+(common/proto.c) when it is built, and the pure Python code below
+otherwise. Build it with `make` in this directory; set FANPROTO_PURE=1
+to use the Python code anyway. Both return the same frames.
+"""
+
+import mmap
+import os
+import struct
+from collections import namedtuple
+
+SYNC0 = 0xAA
+SYNC1 = 0x55
+SYNC1_ADDR = 0x5A
+
+PROTO_MAX_PAYLOAD = 32
+
+PROTO_ADDR_NONE      = 0x00
+PROTO_ADDR_BROADCAST = 0xFF
+
+PROTO_CMD_STATUS_REQ    = 0x01
+PROTO_CMD_SET_FAN_MODE  = 0x02
+PROTO_CMD_SET_FAN_STATE = 0x03
+PROTO_CMD_SET_THRESHOLD = 0x04
+PROTO_CMD_PING          = 0x05
+
+PROTO_CMD_STATUS_RESP   = 0x81
+PROTO_CMD_ACK           = 0x82
+PROTO_CMD_PONG          = 0x83
+
+PROTO_CMD_F_TRACE = 0x40
+
+PROTO_ERR_OK          = 0x00
+PROTO_ERR_INVALID_ARG = 0x01
+PROTO_ERR_STATE       = 0x02
+
+PROTO_FAN_MODE_AUTO   = 0x00
+PROTO_FAN_MODE_MANUAL = 0x01
+
+PROTO_FAN_STATE_OFF   = 0x00
+PROTO_FAN_STATE_ON    = 0x01
+
+FANCTL_CAP_MAGIC  = 0xFC5A
+FANCTL_CAP_DIR_RX = 0
+FANCTL_CAP_DIR_TX = 1
+
+Frame = namedtuple("Frame", "addr cmd seq payload")
+
+def crc16_ccitt_false(data: bytes, init = 0xFFFF) -> int:
+    poly = 0x1021
+    crc = init
+    for b in data:
+        crc ^= (b << 8)
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) & 0xFFFF) ^ poly
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+def build_frame_py(cmd: int, seq: int, payload: bytes = b"", addr: int = PROTO_ADDR_NONE) -> bytes:
+    if len(payload) > PROTO_MAX_PAYLOAD:
+        raise ValueError(f"payload longer than {PROTO_MAX_PAYLOAD} bytes")
+    if addr == PROTO_ADDR_NONE:
+        head = bytes([SYNC0, SYNC1])
+        body = bytes([cmd & 0xFF, seq & 0xFF, len(payload)]) + bytes(payload)
+    else:
+        head = bytes([SYNC0, SYNC1_ADDR])
+        body = bytes([addr & 0xFF, cmd & 0xFF, seq & 0xFF, len(payload)]) + bytes(payload)
+    crc = crc16_ccitt_false(body)
+    return head + body + bytes([(crc >> 8) & 0xFF, crc & 0xFF])
+
+class ProtoRx:
+    RX_SYNC0 = 0
+    RX_SYNC1 = 1
+    RX_HEADER_ADDR = 2
+    RX_HEADER_CMD = 3
+    RX_HEADER_SEQ = 4
+    RX_HEADER_LEN = 5
+    RX_PAYLOAD = 6
+    RX_CRC_HI = 7
+    RX_CRC_LO = 8
+
+    def __init__(self):
+        self.crc_errors = 0
+        self.reset()
+
+    def reset(self):
+        self.state = self.RX_SYNC0
+        self.addr = PROTO_ADDR_NONE
+        self.cmd = 0
+        self.seq = 0
+        self.len = 0
+        self.payload = bytearray()
+        self.crc = 0xFFFF
+        self.crc_recv = 0
+
+    def feed_byte(self, b: int):
+        if self.state == self.RX_SYNC0:
+            if b == SYNC0:
+                self.state = self.RX_SYNC1
+
+        elif self.state == self.RX_SYNC1:
+            if b == SYNC1:
+                self.addr = PROTO_ADDR_NONE
+                self.state = self.RX_HEADER_CMD
+                self.crc = 0xFFFF
+            elif b == SYNC1_ADDR:
+                self.state = self.RX_HEADER_ADDR
+                self.crc = 0xFFFF
+            elif b != SYNC0: # "AA AA 55": the second AA may start the frame
+                self.state = self.RX_SYNC0
+
+        elif self.state == self.RX_HEADER_ADDR:
+            self.addr = b
+            self.crc = crc16_ccitt_false(bytes([b]), init=self.crc)
+            self.state = self.RX_HEADER_CMD
+
+        elif self.state == self.RX_HEADER_CMD:
+            self.cmd = b
+            self.crc = crc16_ccitt_false(bytes([b]), init=self.crc)
+            self.state = self.RX_HEADER_SEQ
+
+        elif self.state == self.RX_HEADER_SEQ:
+            self.seq = b
+            self.crc = crc16_ccitt_false(bytes([b]), init=self.crc)
+            self.state = self.RX_HEADER_LEN
+
+        elif self.state == self.RX_HEADER_LEN:
+            self.len = b
+            if self.len > PROTO_MAX_PAYLOAD:
+                self.reset()
+                return None
+            self.crc = crc16_ccitt_false(bytes([b]), init=self.crc)
+            self.payload = bytearray()
+            if self.len == 0:
+                self.state = self.RX_CRC_HI
+            else:
+                self.state = self.RX_PAYLOAD
+
+        elif self.state == self.RX_PAYLOAD:
+            self.payload.append(b)
+            self.crc = crc16_ccitt_false(bytes([b]), init=self.crc)
+            if len(self.payload) == self.len:
+                self.state = self.RX_CRC_HI
+
+        elif self.state == self.RX_CRC_HI:
+            self.crc_recv = b << 8
+            self.state = self.RX_CRC_LO
+
+        elif self.state == self.RX_CRC_LO:
+            self.crc_recv |= b
+            if self.crc == self.crc_recv:
+                frame = Frame(self.addr, self.cmd, self.seq, bytes(self.payload))
+                self.reset()
+                return frame
+            self.crc_errors += 1
+            self.reset()
+
+        return None
+
+    def feed(self, data) -> list:
+        frames = []
+        for b in bytes(data):
+            f = self.feed_byte(b)
+            if f is not None:
+                frames.append(f)
+        return frames
+
+def parse_py(data) -> list:
+    return ProtoRx().feed(data)
+
+def read_capture(path):
+    """Yield (ts_ns, dir, data) per record. data is a memoryview into the
+    mapped file, valid until the next record: parse it, don't keep it."""
+    hdr = struct.Struct("=QHHB3x")
+    with open(path, "rb") as fp:
+        if os.fstat(fp.fileno()).st_size == 0:
+            return
+        with mmap.mmap(fp.fileno(), 0, access=mmap.ACCESS_READ) as m:
+            view = memoryview(m)
+            pos = 0
+            try:
+                while pos + hdr.size <= len(view):
+                    ts_ns, magic, length, direction = hdr.unpack_from(view, pos)
+                    if magic != FANCTL_CAP_MAGIC:
+                        raise ValueError(f"{path}: bad record at offset {pos}")
+                    pos += hdr.size
+                    yield ts_ns, direction, view[pos:pos + length]
+                    pos += length
+            finally:
+                view.release()
+
+try:
+    if os.environ.get("FANPROTO_PURE"):
+        raise ImportError
+    import _fanproto
+except ImportError:
+    _fanproto = None
+
+NATIVE = _fanproto is not None
+
+if NATIVE:
+    crc16 = _fanproto.crc16
+    build_frame = _fanproto.build_frame
+    parse = _fanproto.parse
+    Parser = _fanproto.Parser
+else:
+    crc16 = crc16_ccitt_false
+    build_frame = build_frame_py
+    parse = parse_py
+    Parser = ProtoRx
@@ -0,0 +1,131 @@
+"""
+metrics_check.py
+
+Parse a Prometheus text page as written by fanctld (-M textfile or the
+-m metrics socket) and check it the way a scraper would:
+    - every sample line is `name{labels} value`, with valid names,
+      escaped label values and a float value
+    - every sample belongs to a family declared by # HELP and # TYPE
+      before it, counters end in _total
+    - histogram buckets are cumulative, end with le="+Inf", and +Inf
+      equals _count
+
+Usage:
+    metrics_check.py [-m socket] [file]
+
+Reads the file, the socket (one page per connection) or stdin. Exit
+status is 1 when the page is invalid.
+"""
+
+import argparse
+import math
+import re
+import socket
+import sys
+
+NAME = r"[a-zA-Z_:][a-zA-Z0-9_:]*"
+LABEL = r'[a-zA-Z_][a-zA-Z0-9_]*="(?:[^"\\\n]|\\[\\"n])*"'
+SAMPLE = re.compile(rf"^({NAME})(?:\{{((?:{LABEL})(?:,{LABEL})*)?\}})? (\S+)$")
+LABELS = re.compile(rf'([a-zA-Z_][a-zA-Z0-9_]*)="((?:[^"\\\n]|\\[\\"n])*)"')
+TYPES = ("counter", "gauge", "histogram", "summary", "untyped")
+
+def family_of(name: str, types: dict):
+    if name in types:
+        return name
+    for suffix in ("_bucket", "_sum", "_count"):
+        if name.endswith(suffix) and types.get(name[:-len(suffix)]) == "histogram":
+            return name[:-len(suffix)]
+    return None
+
+def check(text: str) -> list:
+    errors = []
+    types = {}
+    helps = set()
+    buckets = {} # (family, labels without le) -> [(le, value)]
+    counts = {}
+    for no, line in enumerate(text.splitlines(), 1):
+        if not line:
+            continue
+        if line.startswith("#"):
+            parts = line.split(None, 3)
+            if len(parts) >= 3 and parts[1] == "HELP":
+                helps.add(parts[2])
+            elif len(parts) == 4 and parts[1] == "TYPE":
+                if parts[3] not in TYPES:
+                    errors.append(f"{no}: unknown type '{parts[3]}'")
+                if parts[2] in types:
+                    errors.append(f"{no}: {parts[2]} declared twice")
+                types[parts[2]] = parts[3]
+            continue
+        m = SAMPLE.match(line)
+        if not m:
+            errors.append(f"{no}: not a sample: {line}")
+            continue
+        name, labels, value = m.group(1), LABELS.findall(m.group(2) or ""), m.group(3)
+        try:
+            v = float(value)
+        except ValueError:
+            errors.append(f"{no}: bad value '{value}'")
+            continue
+        fam = family_of(name, types)
+        if fam is None:
+            errors.append(f"{no}: {name} has no # TYPE")
+            continue
+        if fam not in helps:
+            errors.append(f"{no}: {fam} has no # HELP")
+        if types[fam] == "counter" and not name.endswith("_total"):
+            errors.append(f"{no}: counter {name} doesn't end in _total")
+        if types[fam] != "histogram":
+            continue
+        key = (fam, tuple(l for l in labels if l[0] != "le"))
+        if name.endswith("_bucket"):
+            le = [l[1] for l in labels if l[0] == "le"]
+            if not le:
+                errors.append(f"{no}: {name} without le")
+                continue
+            buckets.setdefault(key, []).append((float(le[0]), v, no))
+        elif name.endswith("_count"):
+            counts[key] = v
+    for key, bs in buckets.items():
+        if bs[-1][0] != math.inf:
+            errors.append(f"{bs[-1][2]}: {key[0]} buckets don't end with +Inf")
+        for (le0, v0, _), (le1, v1, no) in zip(bs, bs[1:]):
+            if le1 <= le0 or v1 < v0:
+                errors.append(f"{no}: {key[0]} buckets not cumulative")
+        if key in counts and bs[-1][1] != counts[key]:
+            errors.append(f"{bs[-1][2]}: {key[0]} +Inf bucket != _count")
+    return errors
+
+def read_socket(path: str) -> str:
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+        s.connect(path)
+        chunks = []
+        while True:
+            data = s.recv(65536)
+            if not data:
+                break
+            chunks.append(data)
+    return b"".join(chunks).decode()
+
+def main():
+    ap = argparse.ArgumentParser(description="check a fanctld metrics page")
+    ap.add_argument("-m", help="fanctld metrics socket")
+    ap.add_argument("file", nargs="?", help="textfile (default stdin)")
+    args = ap.parse_args()
+
+    if args.m:
+        text = read_socket(args.m)
+    elif args.file:
+        with open(args.file) as fp:
+            text = fp.read()
+    else:
+        text = sys.stdin.read()
+    errors = check(text)
+    for e in errors:
+        print(e, file=sys.stderr)
+    samples = sum(1 for l in text.splitlines() if l and not l.startswith("#"))
+    print(f"{samples} samples, {len(errors)} errors")
+    sys.exit(1 if errors else 0)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,114 @@
+"""
+proto_bench.py
+
+Compare the pure Python and the native (_fanproto) frame codecs on a
+large capture:
+    - parse: every RX chunk of the capture through one streaming parser
+    - crc:   CRC-16 over the whole RX stream
+
+Usage:
+    proto_bench.py [-n MiB] [-s seed] [capture]
+
+The capture is a raw byte-stream capture (common/fanctl_cap.h), as
+written by `fanctl_serial -c` or the driver's debugfs relay. Without
+one, -n MiB (default 2) of node traffic is generated: status responses,
+ACKs and PONGs, addressed and not, some traced, with 1% corrupted frames
+and noise between frames. Both codecs must return the same frames.
+"""
+
+import argparse
+import random
+import sys
+import time
+
+import fanproto
+
+CHUNK = 1024 # FANCTL_CAP_MAX_CHUNK
+
+def synth(size: int, seed: int) -> list:
+    rnd = random.Random(seed)
+    stream = bytearray()
+    seq = 0
+    while len(stream) < size:
+        addr = rnd.choice((fanproto.PROTO_ADDR_NONE, rnd.randint(1, 32)))
+        kind = rnd.random()
+        if kind < 0.6:
+            cmd = fanproto.PROTO_CMD_STATUS_RESP
+            payload = rnd.randint(2000, 3500).to_bytes(2, "big") + rnd.randint(3000, 6000).to_bytes(2, "big") \
+                + bytes([rnd.randint(0, 1), rnd.randint(0, 1), 0, 0])
+        elif kind < 0.9:
+            cmd = fanproto.PROTO_CMD_ACK
+            payload = bytes([rnd.choice((fanproto.PROTO_CMD_SET_FAN_MODE, fanproto.PROTO_CMD_SET_FAN_STATE)),
+                rnd.choice((fanproto.PROTO_ERR_OK, fanproto.PROTO_ERR_STATE))])
+        else:
+            cmd = fanproto.PROTO_CMD_PONG
+            payload = b""
+        if rnd.random() < 0.1:
+            cmd |= fanproto.PROTO_CMD_F_TRACE
+            payload += rnd.randbytes(16)
+        frame = bytearray(fanproto.build_frame_py(cmd, seq, payload, addr))
+        if rnd.random() < 0.01:
+            frame[rnd.randrange(2, len(frame))] ^= 1 << rnd.randrange(8)
+        stream += frame
+        if rnd.random() < 0.05:
+            stream += rnd.randbytes(rnd.randint(1, 8))
+        seq = (seq + 1) & 0xFF
+    return [bytes(stream[i:i + CHUNK]) for i in range(0, len(stream), CHUNK)]
+
+def load(path: str) -> list:
+    chunks = []
+    for _, direction, data in fanproto.read_capture(path):
+        if direction == fanproto.FANCTL_CAP_DIR_RX:
+            chunks.append(bytes(data))
+        data.release()
+    return chunks
+
+def run_parse(parser, chunks: list) -> tuple:
+    frames = []
+    t0 = time.perf_counter()
+    for c in chunks:
+        frames += parser.feed(c)
+    return time.perf_counter() - t0, frames
+
+def run_crc(crc16, stream) -> tuple:
+    t0 = time.perf_counter()
+    crc = crc16(stream)
+    return time.perf_counter() - t0, crc
+
+def main():
+    ap = argparse.ArgumentParser(description="Python vs native frame codec benchmark")
+    ap.add_argument("-n", type=float, default=2.0, help="MiB of generated traffic without a capture")
+    ap.add_argument("-s", type=int, default=1, help="seed of the generated traffic")
+    ap.add_argument("capture", nargs="?", help="raw capture (common/fanctl_cap.h)")
+    args = ap.parse_args()
+
+    if not fanproto.NATIVE:
+        print("_fanproto is not built (make), or FANPROTO_PURE is set", file=sys.stderr)
+        sys.exit(1)
+    chunks = load(args.capture) if args.capture else synth(int(args.n * 1024 * 1024), args.s)
+    stream = b"".join(chunks)
+    mib = len(stream) / (1024 * 1024)
+
+    py_rx = fanproto.ProtoRx()
+    nat_rx = fanproto._fanproto.Parser()
+    py_parse_s, py_frames = run_parse(py_rx, chunks)
+    nat_parse_s, nat_frames = run_parse(nat_rx, chunks)
+    py_crc_s, py_crc = run_crc(fanproto.crc16_ccitt_false, stream)
+    nat_crc_s, nat_crc = run_crc(fanproto._fanproto.crc16, memoryview(stream))
+
+    if [tuple(f) for f in py_frames] != [tuple(f) for f in nat_frames] or py_rx.crc_errors != nat_rx.crc_errors:
+        print("frames differ between the Python and native parsers", file=sys.stderr)
+        sys.exit(1)
+    if py_crc != nat_crc:
+        print(f"CRC differs: 0x{py_crc:04X} vs 0x{nat_crc:04X}", file=sys.stderr)
+        sys.exit(1)
+
+    print(f"{args.capture or 'generated'}: {mib:.2f} MiB in {len(chunks)} chunks, "
+        f"{len(nat_frames)} frames, {nat_rx.crc_errors} bad CRC")
+    print(f"{'':8} {'parse_MiB/s':>12} {'frames/s':>12} {'crc_MiB/s':>12}")
+    for name, ps, cs in (("python", py_parse_s, py_crc_s), ("native", nat_parse_s, nat_crc_s)):
+        print(f"{name:8} {mib / ps:12.2f} {len(nat_frames) / ps:12.0f} {mib / cs:12.2f}")
+    print(f"{'speedup':8} {py_parse_s / nat_parse_s:11.0f}x {'':12} {py_crc_s / nat_crc_s:11.0f}x")
+
+if __name__ == "__main__":
+    main()
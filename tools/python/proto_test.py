@@ -11,133 +11,75 @@ interface and exercises the custom UART binary protocol:
     - State validation (AUTO / MANUAL mode, threshold logic)
 
 Used during early development and debugging.
+
+Usage:
+    proto_test.py PORT
+        Run the validation sequence once, step by step, with pauses to
+        watch the fan.
+    proto_test.py --soak [-a ADDRS] [-p DEPTH] [-L DEPTH] [-n CYCLES | -t SECONDS] PORT...
+        Run the sequence over and over against every node at once (asyncio,
+        non-blocking tty/pty I/O), with up to DEPTH requests in flight per
+        node, and report per-node throughput and latency percentiles. For
+        soak and scale tests against fansim or a rack of nodes.
 """
 
+import argparse
+import asyncio
+import collections
+import os
 import sys
+import termios
 import time
 import struct
-import serial
-
-SYNC0 = 0xAA
-SYNC1 = 0x55
-
-PROTO_CMD_STATUS_REQ    = 0x01
-PROTO_CMD_SET_FAN_MODE  = 0x02
-PROTO_CMD_SET_FAN_STATE = 0x03
-PROTO_CMD_SET_THRESHOLD = 0x04
-PROTO_CMD_PING          = 0x05
-
-PROTO_CMD_STATUS_RESP   = 0x81
-PROTO_CMD_ACK           = 0x82
-PROTO_CMD_PONG          = 0x83
-
-PROTO_ERR_OK          = 0x00
-PROTO_ERR_INVALID_ARG = 0x01
-PROTO_ERR_STATE       = 0x02
-
-PROTO_FAN_MODE_AUTO   = 0x00
-PROTO_FAN_MODE_MANUAL = 0x01
-
-PROTO_FAN_STATE_OFF   = 0x00
-PROTO_FAN_STATE_ON    = 0x01
-
-def crc16_ccitt_false(data: bytes, init = 0xFFFF) -> int:
-    poly = 0x1021
-    crc = init
-    for b in data:
-        crc ^= (b << 8)
-        for _ in range(8):
-            if crc & 0x8000:
-                crc = ((crc << 1) & 0xFFFF) ^ poly
-            else:
-                crc = (crc << 1) & 0xFFFF
-    return crc
-
-class ProtoRx:
-    RX_SYNC0 = 0
-    RX_SYNC1 = 1
-    RX_HEADER_CMD = 2
-    RX_HEADER_SEQ = 3
-    RX_HEADER_LEN = 4
-    RX_PAYLOAD = 5
-    RX_CRC_HI = 6
-    RX_CRC_LO = 7
-    
-    def __init__(self):
-        self.state = self.RX_SYNC0
-        self.cmd = 0
-        self.seq = 0
-        self.len = 0
-        self.payload = bytearray()
-        self.crc = 0xFFFF
-        self.crc_recv = 0
-
-    def reset(self):
-        self.__init__()
-
-    def feed_byte(self, b: int):
-        if self.state == self.RX_SYNC0:
-            if b == SYNC0:
-                self.state = self.RX_SYNC1
-
-        elif self.state == self.RX_SYNC1:
-            if b == SYNC1:
-                self.state = self.RX_HEADER_CMD
-                self.crc = 0xFFFF
-            else:
-                self.state = self.RX_SYNC0
-        
-        elif self.state == self.RX_HEADER_CMD:
-            self.cmd = b
-            self.crc = crc16_ccitt_false(bytes([b]), init=self.crc) 
-            self.state = self.RX_HEADER_SEQ
-
-        elif self.state == self.RX_HEADER_SEQ:
-            self.seq = b
-            self.crc = crc16_ccitt_false(bytes([b]), init=self.crc)
-            self.state = self.RX_HEADER_LEN
-
-        elif self.state == self.RX_HEADER_LEN:
-            self.len = b
-            if self.len > 32:
-                self.reset()
-                return None
-            self.crc = crc16_ccitt_false(bytes([b]), init=self.crc)
-            if self.len == 0:
-                self.state = self.RX_CRC_HI
-            else:
-                self.payload = bytearray()
-                self.state = self.RX_PAYLOAD
-
-        elif self.state == self.RX_PAYLOAD:
-            self.payload.append(b)
-            self.crc = crc16_ccitt_false(bytes([b]), init=self.crc)
-            if len(self.payload) == self.len:
-                self.state = self.RX_CRC_HI
-
-        elif self.state == self.RX_CRC_HI:
-            self.crc_recv = b << 8
-            self.state = self.RX_CRC_LO
-
-        elif self.state == self.RX_CRC_LO:
-            self.crc_recv |= b
-            if self.crc == self.crc_recv:
-                frame = {"cmd": self.cmd, "seq": self.seq, "len": self.len, "payload": bytes(self.payload)}
-                self.reset()
-                return frame
-            print("Frame received but CRC does not match.")
-            self.reset() 
-
-        return None
-
-def test(ser: serial.Serial, test_cmd: int, seq: int, payload: bytes, expected_cmd=None):
-    header = bytes([test_cmd & 0xFF, seq & 0xFF, len(payload) & 0xFF])
-    crc = crc16_ccitt_false(header + payload)
-    frame = bytes([SYNC0, SYNC1, test_cmd & 0xFF, seq & 0xFF, len(payload) & 0xFF]) + payload + bytes([(crc >> 8) & 0xFF, crc & 0xFF])
+import tty
+from typing import NamedTuple
+
+try:
+    import serial # pyserial, for the interactive run only
+except ImportError:
+    serial = None
+
+from fanproto import *
+
+class Step(NamedTuple):
+    name: str
+    cmd: int
+    payload: bytes
+    resp: int
+    status: int # expected ACK status, None for PONG / STATUS_RESP
+    pause: float # seconds, interactive run only
+    desc: str
+
+# The validation sequence. It starts and ends in AUTO, so it can be repeated.
+SEQUENCE = (
+    Step("PONG", PROTO_CMD_PING, b"", PROTO_CMD_PONG, None, 1,
+        "Testing PING ..."),
+    Step("STATUS_RESP", PROTO_CMD_STATUS_REQ, b"", PROTO_CMD_STATUS_RESP, None, 1,
+        "Testing STATUS_REQ ..."),
+    Step("ACK", PROTO_CMD_SET_FAN_STATE, bytes([PROTO_FAN_STATE_ON]), PROTO_CMD_ACK, PROTO_ERR_STATE, 3,
+        "Testing SET_FAN_STATE to ON ... This should not work - the fan must remain OFF)."),
+    Step("ACK", PROTO_CMD_SET_FAN_MODE, bytes([PROTO_FAN_MODE_MANUAL]), PROTO_CMD_ACK, PROTO_ERR_OK, 1,
+        "Testing SET_FAN_MODE to MANUAL ..."),
+    Step("ACK", PROTO_CMD_SET_FAN_STATE, bytes([PROTO_FAN_STATE_ON]), PROTO_CMD_ACK, PROTO_ERR_OK, 5,
+        "Testing SET_FAN_STATE to ON ..."),
+    Step("ACK", PROTO_CMD_SET_FAN_STATE, bytes([PROTO_FAN_STATE_OFF]), PROTO_CMD_ACK, PROTO_ERR_OK, 2,
+        "Testing SET_FAN_STATE to OFF ... The fan will stop."),
+    Step("ACK", PROTO_CMD_SET_FAN_MODE, bytes([PROTO_FAN_MODE_AUTO]), PROTO_CMD_ACK, PROTO_ERR_OK, 2,
+        "Testing SET_FAN_MODE to AUTO ..."),
+    Step("ACK", PROTO_CMD_SET_THRESHOLD, (400).to_bytes(2, byteorder="big", signed=True), PROTO_CMD_ACK,
+        PROTO_ERR_OK, 5, "Testing SET_THRESHOLD to 4°C ... The fan will be ON if it is room temperature."),
+    Step("ACK", PROTO_CMD_SET_THRESHOLD, (3000).to_bytes(2, byteorder="big", signed=True), PROTO_CMD_ACK,
+        PROTO_ERR_OK, 3, "Testing SET_THRESHOLD to 30°C ... The fan will be OFF."),
+    Step("STATUS_RESP", PROTO_CMD_STATUS_REQ, b"", PROTO_CMD_STATUS_RESP, None, 0,
+        "Testing STATUS_REQ ..."),
+)
+
+def test(ser: "serial.Serial", test_cmd: int, seq: int, payload: bytes, expected_cmd=None):
+    frame = build_frame(test_cmd & 0xFF, seq & 0xFF, payload)
     ser.write(frame)
     ser.flush()
     
-    rx = ProtoRx()
+    rx = Parser()
     t0 = time.time()
     
     timeout = 2.0
@@ -145,12 +87,14 @@ def test(ser: serial.Serial, test_cmd: int, seq: int, payload: bytes, expected_c
         data = ser.read(64)
         if not data:
             continue
-        for b in data:
-            f = rx.feed_byte(b)
-            if f is not None:
-                print(f"<<< RX cmd=0x{f['cmd']:02X}, seq={f['seq']}, len={f['len']}")
-                if expected_cmd == f["cmd"]:
-                    return f
+        crc_errors = rx.crc_errors
+        frames = rx.feed(data)
+        if rx.crc_errors != crc_errors:
+            print("Frame received but CRC does not match.")
+        for f in frames:
+            print(f"<<< RX cmd=0x{f.cmd:02X}, seq={f.seq}, len={len(f.payload)}")
+            if expected_cmd == f.cmd:
+                return f
     raise TimeoutError("No expected response within timeout")
 
 def decode_status_resp(payload):
@@ -188,104 +132,272 @@ def decode_ack(payload, expected_status=None):
     else:
         print(" (UNKNOWN)")
 
-def main():
-    if len(sys.argv) != 2:
-        print("Usage: {sys.argv[0]} /dev/cu.usbserial-XX")
+def run_interactive(port: str):
+    if serial is None:
+        print("The interactive run needs pyserial (pip install pyserial).")
         sys.exit(1)
-
-    port = sys.argv[1]
     ser = serial.Serial(port, 115200, timeout=0.1)
 
     try:
-        # 1) PING -> PONG
-        seq = 1
-        print(f"\n[seq: {seq}] Testing PING ...")
-        f = test(ser, PROTO_CMD_PING, seq, b"", PROTO_CMD_PONG)
-        print("Got PONG")
-        time.sleep(1)
-
-        # 2) STATUS_REQ -> STATUS_RESP
-        seq += 1
-        print(f"\n[seq: {seq}] Testing STATUS_REQ ...")
-        f = test(ser, PROTO_CMD_STATUS_REQ, seq, b"", PROTO_CMD_STATUS_RESP)
-        print("Got STATUS_RESP")
-        decode_status_resp(f["payload"])
-        time.sleep(1)
-
-        # 3) SET_FAN_STATE (ON) -> ACK
-        seq += 1
-        print(f"\n[seq: {seq}] Testing SET_FAN_STATE to ON ... This should not work - the fan must remain OFF).")
-        f = test(ser, PROTO_CMD_SET_FAN_STATE, seq, bytes([PROTO_FAN_STATE_ON]), PROTO_CMD_ACK)
-        print("Got ACK")
-        decode_ack(f["payload"])
-        time.sleep(3)
-
-        # 3) SET_FAN_MODE (MANUAL) -> ACK
-        seq += 1
-        print(f"\n[seq: {seq}] Testing SET_FAN_MODE to MANUAL ...")
-        f = test(ser, PROTO_CMD_SET_FAN_MODE, seq, bytes([PROTO_FAN_MODE_MANUAL]), PROTO_CMD_ACK)
-        print("Got ACK")
-        decode_ack(f["payload"])
-        time.sleep(1)
-
-        # 4) SET_FAN_STATE (ON) -> ACK
-        seq += 1
-        print(f"\n[seq: {seq}] Testing SET_FAN_STATE to ON ...")
-        f = test(ser, PROTO_CMD_SET_FAN_STATE, seq, bytes([PROTO_FAN_STATE_ON]), PROTO_CMD_ACK)
-        print("Got ACK")
-        decode_ack(f["payload"])
-        time.sleep(5)
-
-        # 5) SET_FAN_STATE (OFF) -> ACK
-        seq += 1
-        print(f"\n[seq: {seq}] Testing SET_FAN_STATE to OFF ... The fan will stop.")
-        f = test(ser, PROTO_CMD_SET_FAN_STATE, seq, bytes([PROTO_FAN_STATE_OFF]), PROTO_CMD_ACK)
-        print("Got ACK")
-        decode_ack(f["payload"])
-        time.sleep(2)
-
-        # 6) SET_FAN_MODE (AUTO) -> ACK
-        seq += 1
-        print(f"\n[seq: {seq}] Testing SET_FAN_MODE to AUTO ...")
-        f = test(ser, PROTO_CMD_SET_FAN_MODE, seq, bytes([PROTO_FAN_MODE_AUTO]), PROTO_CMD_ACK)
-        print("Got ACK")
-        decode_ack(f["payload"])
-        time.sleep(2)
-
-        # 7) SET_THRESHOLD (4°C) -> ACK
-        seq += 1
-        print(f"\n[seq: {seq}] Testing SET_THRESHOLD to 4°C ... The fan will be ON if it is room temperature.")
-        temp_c = 4.0
-        temp_x100 = int(temp_c * 100)
-        payload = temp_x100.to_bytes(2, byteorder="big", signed=True)
-        f = test(ser, PROTO_CMD_SET_THRESHOLD, seq, payload, PROTO_CMD_ACK)
-        print("Got ACK")
-        decode_ack(f["payload"])
-        time.sleep(5)
-
-        # 8) SET_THRESHOLD (30°C) -> ACK
-        seq += 1
-        print(f"\n[seq: {seq}] Testing SET_THRESHOLD to 30°C ... The fan will be OFF.")
-        temp_c = 30.0
-        temp_x100 = int(temp_c * 100)
-        payload = temp_x100.to_bytes(2, byteorder="big", signed=True)
-        f = test(ser, PROTO_CMD_SET_THRESHOLD, seq, payload, PROTO_CMD_ACK)
-        print("Got ACK")
-        decode_ack(f["payload"])
-        time.sleep(3)
-
-        # 9) STATUS_REQ -> STATUS_RESP
-        seq += 1
-        print(f"\n[seq: {seq}] Testing STATUS_REQ ...")
-        f = test(ser, PROTO_CMD_STATUS_REQ, seq, b"", PROTO_CMD_STATUS_RESP)
-        print("Got STATUS_RESP")
-        decode_status_resp(f["payload"])
+        for seq, step in enumerate(SEQUENCE, start=1):
+            print(f"\n[seq: {seq}] {step.desc}")
+            f = test(ser, step.cmd, seq, step.payload, step.resp)
+            print(f"Got {step.name}")
+            if step.resp == PROTO_CMD_STATUS_RESP:
+                decode_status_resp(f.payload)
+            elif step.resp == PROTO_CMD_ACK:
+                decode_ack(f.payload)
+            time.sleep(step.pause)
 
         print("\nTest successful.")
 
     except TimeoutError as e:
         print("Test failed: Error:", e)
 
+# Soak mode ------------------------------------------------------------------
+
+class AsyncLink:
+    """
+    One raw tty or pty, non-blocking, driven by the event loop. Requests
+    are matched to responses by SEQ, address and response type, as in
+    sclient, so many can be in flight on one link.
+    """
+
+    def __init__(self, path: str, depth: int):
+        self.path = path
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        tty.setraw(self.fd)
+        attrs = termios.tcgetattr(self.fd)
+        attrs[2] = (attrs[2] & ~(termios.CSTOPB | termios.PARENB | termios.CRTSCTS)) | termios.CLOCAL | termios.CREAD
+        attrs[4] = attrs[5] = termios.B115200
+        termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+        self.loop = asyncio.get_running_loop()
+        self.parser = Parser()
+        self.slots = asyncio.Semaphore(min(depth, 255)) # one SEQ stays free
+        self.inflight = {} # seq -> (addr, cmd, future)
+        self.next_seq = 0
+        self.txbuf = bytearray()
+        self.stale = 0
+        self.error = None
+        self.loop.add_reader(self.fd, self._on_read)
+
+    def close(self):
+        self.loop.remove_reader(self.fd)
+        self.loop.remove_writer(self.fd)
+        os.close(self.fd)
+
+    def _fail(self, err: Exception):
+        self.error = err
+        self.loop.remove_reader(self.fd)
+        self.loop.remove_writer(self.fd)
+        for _, _, fut in self.inflight.values():
+            if not fut.done():
+                fut.set_exception(err)
+
+    @staticmethod
+    def _matches(cmd: int, f) -> bool:
+        if cmd == PROTO_CMD_PING:
+            return f.cmd == PROTO_CMD_PONG
+        if cmd == PROTO_CMD_STATUS_REQ:
+            return f.cmd == PROTO_CMD_STATUS_RESP
+        return f.cmd == PROTO_CMD_ACK and len(f.payload) >= 1 and f.payload[0] == cmd
+
+    def _on_read(self):
+        try:
+            data = os.read(self.fd, 4096)
+        except BlockingIOError:
+            return
+        except OSError as e:
+            self._fail(e)
+            return
+        if not data:
+            self._fail(EOFError(f"{self.path}: closed"))
+            return
+        for f in self.parser.feed(data):
+            entry = self.inflight.get(f.seq)
+            if entry and entry[0] == f.addr and self._matches(entry[1], f) and not entry[2].done():
+                entry[2].set_result(f)
+            else:
+                self.stale += 1 # late reply to a timed-out request, or noise
+
+    def _flush(self):
+        try:
+            n = os.write(self.fd, self.txbuf)
+        except BlockingIOError:
+            n = 0
+        except OSError as e:
+            self._fail(e)
+            return
+        del self.txbuf[:n]
+        if self.txbuf:
+            self.loop.add_writer(self.fd, self._flush)
+        else:
+            self.loop.remove_writer(self.fd)
+
+    async def request(self, addr: int, cmd: int, payload: bytes, timeout: float):
+        async with self.slots:
+            if self.error:
+                raise self.error
+            while self.next_seq in self.inflight:
+                self.next_seq = (self.next_seq + 1) & 0xFF
+            seq = self.next_seq
+            self.next_seq = (seq + 1) & 0xFF
+            fut = self.loop.create_future()
+            self.inflight[seq] = (addr, cmd, fut)
+            try:
+                pending = bool(self.txbuf)
+                self.txbuf += build_frame(cmd, seq, payload, addr)
+                if not pending:
+                    self._flush()
+                return await asyncio.wait_for(fut, timeout)
+            finally:
+                del self.inflight[seq]
+
+class NodeStats:
+    def __init__(self, name: str):
+        self.name = name
+        self.ok = 0
+        self.timeouts = 0
+        self.bad = 0 # wrong response or ACK status
+        self.errors = 0 # link failed
+        self.lat = [] # seconds, completed requests
+        self.last_bad = ""
+
+    def total(self) -> int:
+        return self.ok + self.timeouts + self.bad + self.errors
+
+def percentile(sorted_lat: list, p: float) -> float:
+    if not sorted_lat:
+        return float("nan")
+    return sorted_lat[min(len(sorted_lat) - 1, int(p / 100 * len(sorted_lat)))]
+
+async def soak_step(link: AsyncLink, addr: int, step: Step, timeout: float, st: NodeStats):
+    t0 = time.perf_counter()
+    try:
+        f = await link.request(addr, step.cmd, step.payload, timeout)
+    except asyncio.TimeoutError:
+        st.timeouts += 1
+        return
+    except (OSError, EOFError):
+        st.errors += 1
+        return
+    st.lat.append(time.perf_counter() - t0)
+    if step.status is not None and (len(f.payload) < 2 or f.payload[1] != step.status):
+        st.bad += 1
+        st.last_bad = f"cmd 0x{step.cmd:02X}: ACK status 0x{f.payload[1] if len(f.payload) > 1 else 0xFF:02X}, expected 0x{step.status:02X}"
+    elif step.resp == PROTO_CMD_STATUS_RESP and len(f.payload) != 8:
+        st.bad += 1
+        st.last_bad = f"STATUS_RESP of {len(f.payload)} bytes"
+    else:
+        st.ok += 1
+
+async def soak_node(link: AsyncLink, addr: int, args, st: NodeStats, end: float):
+    """
+    Send the sequence in order, keeping up to args.depth requests of
+    this node in flight. The node handles its requests in arrival order,
+    so the state checks hold while pipelining; a timeout can break them
+    for the rest of that cycle.
+    """
+    window = asyncio.Semaphore(args.depth)
+    tasks = set()
+
+    async def one(step):
+        try:
+            await soak_step(link, addr, step, args.timeout / 1000, st)
+        finally:
+            window.release()
+
+    cycle = 0
+    while (args.cycles and cycle < args.cycles) or (not args.cycles and time.monotonic() < end):
+        for step in SEQUENCE:
+            await window.acquire()
+            t = asyncio.create_task(one(step))
+            tasks.add(t)
+            t.add_done_callback(tasks.discard)
+        cycle += 1
+    if tasks:
+        await asyncio.gather(*tasks)
+
+async def soak_progress(stats: list, t0: float):
+    while True:
+        await asyncio.sleep(10)
+        done = sum(st.total() for st in stats)
+        failed = sum(st.total() - st.ok for st in stats)
+        print(f"{time.monotonic() - t0:7.0f} s  {done} requests, {failed} failed", file=sys.stderr)
+
+def parse_addrs(spec: str) -> list:
+    addrs = []
+    for part in spec.split(","):
+        lo, _, hi = part.partition("-")
+        lo = int(lo, 0)
+        hi = int(hi, 0) if hi else lo
+        if not 0 <= lo <= hi < PROTO_ADDR_BROADCAST:
+            raise argparse.ArgumentTypeError(f"invalid address range '{part}'")
+        addrs += [a for a in range(lo, hi + 1) if a not in addrs]
+    return addrs
+
+async def run_soak(args) -> int:
+    links = [AsyncLink(p, args.link_depth) for p in args.ports]
+    stats = []
+    jobs = []
+    t0 = time.monotonic()
+    end = t0 + (args.seconds or 0)
+    for link in links:
+        for addr in args.addrs:
+            st = NodeStats(f"{link.path}:{addr}" if addr != PROTO_ADDR_NONE else link.path)
+            stats.append(st)
+            jobs.append(soak_node(link, addr, args, st, end))
+    progress = asyncio.create_task(soak_progress(stats, t0))
+    await asyncio.gather(*jobs)
+    progress.cancel()
+    elapsed = time.monotonic() - t0
+    for link in links:
+        link.close()
+
+    print(f"{'NODE':24} {'REQS':>8} {'OK':>8} {'TIMEOUT':>8} {'BAD':>6} {'REQ/S':>8} "
+        f"{'P50_MS':>8} {'P90_MS':>8} {'P99_MS':>8} {'MAX_MS':>8}")
+    lat_all = []
+    for st in stats:
+        lat = sorted(st.lat)
+        lat_all += lat
+        print(f"{st.name:24} {st.total():8} {st.ok:8} {st.timeouts:8} {st.bad + st.errors:6} "
+            f"{st.total() / elapsed:8.1f} {percentile(lat, 50) * 1e3:8.2f} {percentile(lat, 90) * 1e3:8.2f} "
+            f"{percentile(lat, 99) * 1e3:8.2f} {(lat[-1] if lat else float('nan')) * 1e3:8.2f}"
+            + (f"  {st.last_bad}" if st.last_bad else ""))
+    lat_all.sort()
+    total = sum(st.total() for st in stats)
+    failed = sum(st.total() - st.ok for st in stats)
+    print(f"{total} requests to {len(stats)} nodes in {elapsed:.1f} s ({total / elapsed:.0f}/s), {failed} failed, "
+        f"p50 {percentile(lat_all, 50) * 1e3:.2f} ms, p99 {percentile(lat_all, 99) * 1e3:.2f} ms, "
+        f"{sum(l.stale for l in links)} stale responses", file=sys.stderr)
+    return 1 if failed else 0
+
+def main():
+    if len(sys.argv) == 2 and not sys.argv[1].startswith("-"):
+        run_interactive(sys.argv[1])
+        return
+
+    ap = argparse.ArgumentParser(description="Fan node protocol validation")
+    ap.add_argument("--soak", action="store_true", help="run the sequence concurrently against every node")
+    ap.add_argument("-a", dest="addrs", type=parse_addrs, default=[PROTO_ADDR_NONE],
+        help="node addresses on each port, e.g. 1-8,12; 0 is unaddressed (default 0)")
+    ap.add_argument("-p", dest="depth", type=int, default=4, help="requests in flight per node (default 4)")
+    ap.add_argument("-L", dest="link_depth", type=int, default=255,
+        help="requests in flight per port (default 255); 1 on a half-duplex RS-485 bus")
+    ap.add_argument("-n", dest="cycles", type=int, default=0, help="sequences per node (default 10)")
+    ap.add_argument("-t", dest="seconds", type=float, default=0, help="run for this long instead of -n")
+    ap.add_argument("--timeout", type=int, default=1000, help="request timeout in ms (default 1000)")
+    ap.add_argument("ports", nargs="+")
+    args = ap.parse_args()
+    if not args.soak:
+        ap.error("more than one port or options need --soak")
+    if args.depth < 1 or args.link_depth < 1:
+        ap.error("depths start at 1")
+    if not args.seconds and not args.cycles:
+        args.cycles = 10
+    sys.exit(asyncio.run(run_soak(args)))
+
 
 if __name__ == "__main__":
     main()
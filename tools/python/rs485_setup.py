@@ -0,0 +1,65 @@
+"""
+rs485_setup.py
+
+Configure the RS-485 mode of a host serial port for a multi-drop fan node bus.
+
+The kernel serial driver then drives the transceiver direction through RTS:
+RTS is asserted while a request is being sent and released afterwards, so
+the nodes can answer on the same pair. This works while the fanctl line
+discipline is attached, as TIOCSRS485 is handled by the serial driver.
+
+Only UARTs whose kernel driver supports RS-485 mode accept the setting
+(e.g. most SoC UARTs, 8250 with RS-485 support); for USB adapters with
+automatic direction control nothing needs to be configured.
+"""
+
+import fcntl
+import os
+import struct
+import sys
+
+TIOCGRS485 = 0x542E
+TIOCSRS485 = 0x542F
+
+SER_RS485_ENABLED        = 1 << 0
+SER_RS485_RTS_ON_SEND    = 1 << 1
+SER_RS485_RTS_AFTER_SEND = 1 << 2
+SER_RS485_RX_DURING_TX   = 1 << 4
+
+# struct serial_rs485: flags, delay_rts_before_send, delay_rts_after_send, padding[5]
+SERIAL_RS485_FMT = "=8I"
+
+def get_rs485(fd):
+    buf = fcntl.ioctl(fd, TIOCGRS485, bytes(struct.calcsize(SERIAL_RS485_FMT)))
+    return struct.unpack(SERIAL_RS485_FMT, buf)
+
+def set_rs485(fd, enable, delay_before_ms=0, delay_after_ms=0):
+    flags = 0
+    if enable:
+        flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND
+    buf = struct.pack(SERIAL_RS485_FMT, flags, delay_before_ms, delay_after_ms, 0, 0, 0, 0, 0)
+    fcntl.ioctl(fd, TIOCSRS485, buf)
+
+def main():
+    if len(sys.argv) < 3 or sys.argv[2] not in ("on", "off", "show"):
+        print(f"Usage: {sys.argv[0]} /dev/ttyXXX <on|off|show> [delay_before_ms delay_after_ms]")
+        sys.exit(1)
+
+    port = sys.argv[1]
+    action = sys.argv[2]
+    delays = [int(x) for x in sys.argv[3:5]]
+    fd = os.open(port, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+    try:
+        if action != "show":
+            set_rs485(fd, action == "on", *delays)
+        flags, before, after = get_rs485(fd)[:3]
+        print(f"{port}: rs485={'on' if flags & SER_RS485_ENABLED else 'off'} "
+              f"flags=0x{flags:x} delay_rts_before_send={before}ms delay_rts_after_send={after}ms")
+    except OSError as e:
+        print(f"{port}: RS-485 mode not supported by the serial driver: {e}")
+        sys.exit(1)
+    finally:
+        os.close(fd)
+
+if __name__ == "__main__":
+    main()
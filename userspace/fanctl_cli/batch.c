@@ -0,0 +1,463 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "proto.h"
+#include "fanctld_proto.h"
+#include "client.h"
+#include "libfanctl.h"
+#include "batch.h"
+
+struct batch {
+	batch_rec_t	*recs;
+	uint32_t	n;
+	uint32_t	cap;
+	const char	*name;
+	const batch_ops_t *ops; // during batch_run()
+	unsigned	depth;
+	unsigned	inflight;
+	uint32_t	*retry; // stack of records to send again
+	uint32_t	nretry;
+	unsigned	retried;
+	uint64_t	start_ns;
+	uint64_t	end_ns;
+};
+
+static const char	*g_op_names[FANCTLD_OP_NR] = {
+	[FANCTLD_OP_PING]		= "ping",
+	[FANCTLD_OP_STATUS]		= "status",
+	[FANCTLD_OP_SET_FAN_MODE]	= "mode",
+	[FANCTLD_OP_SET_FAN_STATE]	= "state",
+	[FANCTLD_OP_SET_THRESHOLD]	= "threshold",
+};
+
+static uint64_t	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+const char	*batch_op_name(uint8_t op)
+{
+	if (op == BATCH_OP_SLEEP)
+		return "sleep";
+	if (op == BATCH_OP_SYNC)
+		return "sync";
+	if (op < FANCTLD_OP_NR && g_op_names[op])
+		return g_op_names[op];
+	return "?";
+}
+
+/* Script ------------------------------------------------------------------- */
+
+static bool	parse_line(char *line, batch_rec_t *r)
+{
+	char	*word;
+	char	*arg;
+	char	*end;
+	char	*save;
+	float	temp;
+	long	ms;
+
+	word = strtok_r(line, " \t\r\n", &save);
+	arg = strtok_r(NULL, " \t\r\n", &save);
+	if (strtok_r(NULL, " \t\r\n", &save))
+		return false;
+	r->arg = 0;
+	if (!strcmp(word, "ping") || !strcmp(word, "status") || !strcmp(word, "sync"))
+	{
+		r->op = word[0] == 'p' ? FANCTLD_OP_PING
+			: word[1] == 't' ? FANCTLD_OP_STATUS : BATCH_OP_SYNC;
+		return !arg;
+	}
+	if (!strcmp(word, "auto") || !strcmp(word, "manual"))
+	{
+		r->op = FANCTLD_OP_SET_FAN_MODE;
+		r->arg = word[0] == 'a' ? PROTO_FAN_MODE_AUTO : PROTO_FAN_MODE_MANUAL;
+		return !arg;
+	}
+	if (!strcmp(word, "on") || !strcmp(word, "off"))
+	{
+		r->op = FANCTLD_OP_SET_FAN_STATE;
+		r->arg = word[1] == 'n' ? PROTO_FAN_STATE_ON : PROTO_FAN_STATE_OFF;
+		return !arg;
+	}
+	if (!arg)
+		return false;
+	if (!strcmp(word, "threshold"))
+	{
+		errno = 0;
+		temp = strtof(arg, &end);
+		if (end == arg || *end || errno == ERANGE || temp < -40.0f || temp > 80.0f)
+			return false;
+		r->op = FANCTLD_OP_SET_THRESHOLD;
+		r->arg = (int16_t)(temp * 100.0f);
+		return true;
+	}
+	if (!strcmp(word, "sleep"))
+	{
+		ms = strtol(arg, &end, 10);
+		if (end == arg || *end || ms < 0 || ms > INT16_MAX)
+			return false;
+		r->op = BATCH_OP_SLEEP;
+		r->arg = (int16_t)ms;
+		return true;
+	}
+	return false;
+}
+
+batch_t	*batch_load(FILE *in, const char *name)
+{
+	batch_rec_t	*grown;
+	batch_t		*b;
+	char		*line;
+	char		*p;
+	size_t		cap;
+	int		lineno;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return NULL;
+	b->name = name;
+	line = NULL;
+	cap = 0;
+	lineno = 0;
+	while (getline(&line, &cap, in) >= 0)
+	{
+		lineno++;
+		p = strchr(line, '#');
+		if (p)
+			*p = '\0';
+		p = line + strspn(line, " \t\r\n");
+		if (!*p)
+			continue;
+		if (b->n == b->cap)
+		{
+			b->cap = b->cap ? b->cap * 2 : 64;
+			grown = realloc(b->recs, b->cap * sizeof(*b->recs));
+			if (!grown)
+				goto fail;
+			b->recs = grown;
+		}
+		memset(&b->recs[b->n], 0, sizeof(b->recs[b->n]));
+		b->recs[b->n].line = lineno;
+		b->recs[b->n].idx = b->n;
+		if (!parse_line(p, &b->recs[b->n]))
+		{
+			fprintf(stderr, "%s:%d: bad command\n", name, lineno);
+			goto fail;
+		}
+		b->n++;
+	}
+	free(line);
+	b->retry = calloc(b->n ? b->n : 1, sizeof(*b->retry));
+	if (!b->retry)
+	{
+		batch_free(b);
+		return NULL;
+	}
+	return b;
+fail:
+	free(line);
+	batch_free(b);
+	return NULL;
+}
+
+void	batch_free(batch_t *b)
+{
+	if (!b)
+		return;
+	free(b->recs);
+	free(b->retry);
+	free(b);
+}
+
+batch_rec_t	*batch_rec(batch_t *b, uint32_t idx)
+{
+	return idx < b->n ? &b->recs[idx] : NULL;
+}
+
+/* Run ---------------------------------------------------------------------- */
+
+void	batch_done(batch_t *b, batch_rec_t *r, int result, const struct fanctl_status *st)
+{
+	if (!r->busy)
+		return; // duplicate or late answer
+	r->busy = false;
+	b->inflight--;
+	// a SET_* is only sent again if that can't reorder it with later ones
+	if (result == -ETIMEDOUT && b->ops && r->tries <= b->ops->retries
+		&& (r->op < FANCTLD_OP_SET_FAN_MODE || b->depth == 1))
+	{
+		b->retry[b->nretry++] = r->idx;
+		b->retried++;
+		return;
+	}
+	r->done = true;
+	r->result = result;
+	r->done_ns = mono_ns();
+	if (st && !result)
+		r->status = *st;
+}
+
+static void	submit(batch_t *b, batch_rec_t *r)
+{
+	int	ret;
+
+	if (!r->tries)
+		r->submit_ns = mono_ns();
+	r->tries++;
+	r->busy = true;
+	b->inflight++;
+	ret = b->ops->submit(b->ops->ctx, b, r);
+	if (ret < 0)
+		batch_done(b, r, ret, NULL);
+}
+
+static bool	is_barrier(const batch_rec_t *r)
+{
+	return r->op == BATCH_OP_SLEEP || r->op == BATCH_OP_SYNC;
+}
+
+static void	fail_rest(batch_t *b, uint32_t from, int err)
+{
+	uint32_t	i;
+
+	b->nretry = 0;
+	for (i = from; i < b->n; i++)
+	{
+		if (b->recs[i].done)
+			continue;
+		if (b->recs[i].busy)
+			b->inflight--;
+		b->recs[i].busy = false;
+		b->recs[i].done = true;
+		b->recs[i].result = err;
+		b->recs[i].done_ns = mono_ns();
+	}
+}
+
+/*
+ * Send commands until `depth` are in flight or a barrier is reached,
+ * print finished ones in script order, wait, repeat. Returns the number
+ * of failed commands, or -errno when the backend failed.
+ */
+int	batch_run(batch_t *b, const batch_ops_t *ops)
+{
+	struct timespec	ts;
+	batch_rec_t	*r;
+	uint32_t	next;
+	uint32_t	printed;
+	int		failed;
+	int		err;
+
+	b->ops = ops;
+	b->depth = ops->depth ? ops->depth : 1;
+	b->start_ns = mono_ns();
+	next = 0;
+	printed = 0;
+	failed = 0;
+	err = 0;
+	while (printed < b->n)
+	{
+		while (b->nretry && b->inflight < b->depth)
+			submit(b, &b->recs[b->retry[--b->nretry]]);
+		while (next < b->n && b->inflight < b->depth && !b->nretry
+			&& !is_barrier(&b->recs[next]))
+			submit(b, &b->recs[next++]);
+		while (printed < next && b->recs[printed].done)
+		{
+			r = &b->recs[printed++];
+			if (is_barrier(r))
+				continue; // only left behind by fail_rest()
+			if (r->result)
+				failed++;
+			ops->print(ops->ctx, r);
+		}
+		if (printed == next && next < b->n && is_barrier(&b->recs[next]))
+		{
+			r = &b->recs[next++];
+			if (r->op == BATCH_OP_SLEEP)
+			{
+				ts.tv_sec = r->arg / 1000;
+				ts.tv_nsec = (long)(r->arg % 1000) * 1000000L;
+				while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+					;
+			}
+			r->done = true;
+			printed++;
+			continue;
+		}
+		if (!b->inflight || printed == b->n)
+			continue;
+		err = ops->wait(ops->ctx, b);
+		if (err < 0)
+		{
+			fprintf(stderr, "%s: %s, giving up\n", b->name, strerror(-err));
+			fail_rest(b, printed, err);
+			next = b->n;
+		}
+	}
+	b->end_ns = mono_ns();
+	b->ops = NULL;
+	return err < 0 ? err : failed;
+}
+
+void	batch_summary(const batch_t *b, FILE *out)
+{
+	const batch_rec_t	*r;
+	uint64_t		sum[FANCTLD_OP_NR];
+	uint64_t		max[FANCTLD_OP_NR];
+	unsigned		cnt[FANCTLD_OP_NR];
+	unsigned		fail[FANCTLD_OP_NR];
+	unsigned		total;
+	unsigned		failed;
+	uint64_t		lat;
+	double			wall_s;
+	uint32_t		i;
+	int			op;
+
+	memset(sum, 0, sizeof(sum));
+	memset(max, 0, sizeof(max));
+	memset(cnt, 0, sizeof(cnt));
+	memset(fail, 0, sizeof(fail));
+	total = 0;
+	failed = 0;
+	for (i = 0; i < b->n; i++)
+	{
+		r = &b->recs[i];
+		if (is_barrier(r) || !r->done)
+			continue;
+		lat = r->done_ns - r->submit_ns;
+		cnt[r->op]++;
+		sum[r->op] += lat;
+		if (lat > max[r->op])
+			max[r->op] = lat;
+		if (r->result)
+			fail[r->op]++;
+		total++;
+		failed += r->result != 0;
+	}
+	wall_s = (double)(b->end_ns - b->start_ns) / 1e9;
+	fprintf(out, "%s: %u commands (%u failed, %u retried) in %.1f ms, %.1f cmd/s, depth %u\n",
+		b->name, total, failed, b->retried, wall_s * 1e3,
+		wall_s > 0 ? total / wall_s : 0.0, b->depth);
+	fprintf(out, "  %-10s %6s %6s %10s %10s\n", "op", "n", "fail", "mean ms", "max ms");
+	for (op = 0; op < FANCTLD_OP_NR; op++)
+	{
+		if (!cnt[op])
+			continue;
+		fprintf(out, "  %-10s %6u %6u %10.3f %10.3f\n", batch_op_name((uint8_t)op),
+			cnt[op], fail[op], (double)sum[op] / cnt[op] / 1e6, (double)max[op] / 1e6);
+	}
+}
+
+/* libfanctl backend, on the device or a tty -------------------------------- */
+
+typedef struct {
+	fanctl_req_t	req;
+	batch_t		*b;
+	batch_rec_t	*r;
+}	batch_req_t;
+
+static void	fanctl_done(fanctl_req_t *req)
+{
+	batch_req_t	*br;
+
+	br = req->user;
+	batch_done(br->b, br->r, req->result, &req->status);
+	free(br);
+}
+
+static int	fanctl_submit_rec(void *ctx, batch_t *b, batch_rec_t *r)
+{
+	batch_fanctl_t	*f;
+	batch_req_t	*br;
+	int		ret;
+
+	f = ctx;
+	br = calloc(1, sizeof(*br));
+	if (!br)
+		return -ENOMEM;
+	br->req.op = r->op;
+	br->req.addr = f->addr;
+	br->req.arg = r->arg;
+	br->req.cb = fanctl_done;
+	br->req.user = br;
+	br->b = b;
+	br->r = r;
+	ret = fanctl_submit(f->h, &br->req);
+	if (ret < 0)
+		free(br);
+	return ret;
+}
+
+static int	fanctl_wait(void *ctx, batch_t *b)
+{
+	int	ret;
+
+	(void)b;
+	ret = fanctl_run(((batch_fanctl_t *)ctx)->h, -1);
+	return ret < 0 ? ret : 0;
+}
+
+void	batch_fanctl_ops(batch_ops_t *ops, batch_fanctl_t *f)
+{
+	memset(ops, 0, sizeof(*ops));
+	ops->ctx = f;
+	ops->depth = 1;
+	ops->submit = fanctl_submit_rec;
+	ops->wait = fanctl_wait;
+}
+
+/* fanctld backend, pipelined by tag ---------------------------------------- */
+
+static int	daemon_submit(void *ctx, batch_t *b, batch_rec_t *r)
+{
+	batch_daemon_t		*d;
+	struct fanctld_req	req;
+
+	(void)b;
+	d = ctx;
+	memset(&req, 0, sizeof(req));
+	req.version = FANCTLD_VERSION;
+	req.op = r->op;
+	req.addr = d->addr;
+	req.arg = r->arg;
+	req.tag = r->idx;
+	return fanctld_send(d->fd, &req) < 0 ? -errno : 0;
+}
+
+static int	daemon_wait(void *ctx, batch_t *b)
+{
+	batch_daemon_t		*d;
+	struct fanctld_resp	resp;
+	batch_rec_t		*r;
+	int			timeout_ms;
+	ssize_t			n;
+
+	d = ctx;
+	timeout_ms = FANCTLD_CALL_TIMEOUT_MS;
+	for (;;) // everything already queued on the socket
+	{
+		n = fanctld_recv(d->fd, &resp, sizeof(resp), timeout_ms);
+		if (n < 0)
+			return timeout_ms && errno ? -errno : 0;
+		r = batch_rec(b, resp.tag);
+		if ((size_t)n == sizeof(resp) && r && r->op == resp.op)
+			batch_done(b, r, resp.result, &resp.status);
+		timeout_ms = 0;
+	}
+}
+
+void	batch_daemon_ops(batch_ops_t *ops, batch_daemon_t *d)
+{
+	memset(ops, 0, sizeof(*ops));
+	ops->ctx = d;
+	ops->depth = 8;
+	ops->submit = daemon_submit;
+	ops->wait = daemon_wait;
+}
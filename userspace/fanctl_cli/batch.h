@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fanctl_uapi.h"
+#include "libfanctl.h"
+
+/*
+ * Batch scripts
+ * -------------
+ * One command per line, the CLIs' words:
+ *
+ *   ping | status | auto | manual | on | off | threshold <tempC>
+ *   sleep <ms>     wait for the commands before it, then pause
+ *   sync           wait for the commands before it
+ *
+ * '#' starts a comment. Commands between barriers are pipelined up to
+ * the backend's depth; results are printed in script order and a timing
+ * summary goes to stderr. Shared by both CLIs: batch_fanctl_ops() runs
+ * the script on a libfanctl handle (device or tty), batch_daemon_ops()
+ * through fanctld.
+ */
+
+#define BATCH_OP_SLEEP	0xF0
+#define BATCH_OP_SYNC	0xF1
+
+typedef struct batch	batch_t;
+
+typedef struct {
+	uint8_t			op; // FANCTLD_OP_* or BATCH_OP_*
+	int16_t			arg; // SET_* argument, sleep: ms
+	int			line;
+	uint32_t		idx;
+	unsigned		tries;
+	bool			busy; // in flight
+	bool			done;
+	int			result; // 0 or -errno
+	struct fanctl_status	status; // STATUS only
+	uint64_t		submit_ns; // first try
+	uint64_t		done_ns;
+}	batch_rec_t;
+
+typedef struct {
+	void		*ctx;
+	unsigned	depth; // commands in flight, >= 1
+	unsigned	retries; // extra tries after -ETIMEDOUT
+	// start r; completes it through batch_done(), possibly right away
+	int		(*submit)(void *ctx, batch_t *b, batch_rec_t *r);
+	// wait for completions; < 0 fails everything in flight
+	int		(*wait)(void *ctx, batch_t *b);
+	void		(*print)(void *ctx, const batch_rec_t *r);
+}	batch_ops_t;
+
+typedef struct {
+	int		fd;
+	uint8_t		addr;
+}	batch_daemon_t;
+
+typedef struct {
+	fanctl_t	*h;
+	uint8_t		addr;
+}	batch_fanctl_t;
+
+batch_t		*batch_load(FILE *in, const char *name);
+void		batch_free(batch_t *b);
+batch_rec_t	*batch_rec(batch_t *b, uint32_t idx);
+void		batch_done(batch_t *b, batch_rec_t *r, int result,
+			const struct fanctl_status *st);
+int		batch_run(batch_t *b, const batch_ops_t *ops);
+void		batch_summary(const batch_t *b, FILE *out);
+void		batch_daemon_ops(batch_ops_t *ops, batch_daemon_t *d);
+void		batch_fanctl_ops(batch_ops_t *ops, batch_fanctl_t *f);
+const char	*batch_op_name(uint8_t op);
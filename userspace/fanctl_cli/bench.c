@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/utsname.h>
+
+#include "proto.h"
+#include "hist.h"
+#include "util.h"
+#include "bench.h"
+
+#define BENCH_MAX_DEPTH	64
+
+typedef struct {
+	hist_t		hist; // answered requests, ns
+	uint64_t	nacks;
+	uint64_t	errors; // not answered
+	uint64_t	elapsed_ns;
+}	bench_res_t;
+
+/* One in-flight slot on the driver: a thread with its own open file */
+typedef struct {
+	pthread_t	thread;
+	fanctl_t	*h;
+	uint8_t		op;
+	int16_t		arg;
+	uint8_t		addr;
+	uint64_t	count;
+	uint64_t	start_ns;
+	uint64_t	period_ns; // 0: back to back
+	bench_res_t	res;
+}	bench_lane_t;
+
+/* Requests in flight on a tty handle */
+typedef struct {
+	bench_res_t	*res;
+	unsigned	inflight;
+	uint64_t	done;
+}	bench_tty_t;
+
+static const double	g_pcts[] = { 50.0, 90.0, 99.0 };
+
+static uint64_t	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Option parsing ----------------------------------------------------------- */
+
+static bool	parse_ops(const char *str, unsigned *ops)
+{
+	static const char	*names[FANCTL_OP_NR] = {
+		[FANCTL_OP_PING]		= "ping",
+		[FANCTL_OP_STATUS]		= "status",
+		[FANCTL_OP_SET_FAN_MODE]	= "mode",
+		[FANCTL_OP_SET_FAN_STATE]	= "state",
+		[FANCTL_OP_SET_THRESHOLD]	= "threshold",
+	};
+	const char		*p;
+	size_t			len;
+	unsigned		op;
+
+	*ops = 0;
+	p = str;
+	while (*p)
+	{
+		len = strcspn(p, ",");
+		for (op = FANCTL_OP_PING; op < FANCTL_OP_NR; op++)
+		{
+			if (strlen(names[op]) == len && !strncmp(p, names[op], len))
+				break;
+		}
+		if (op == FANCTL_OP_NR)
+			return false;
+		*ops |= 1u << op;
+		p += len;
+		if (*p == ',')
+			p++;
+	}
+	return *ops != 0;
+}
+
+bool	bench_parse_args(int argc, char **argv, bench_cfg_t *cfg)
+{
+	char	*end;
+	double	v;
+	float	temp;
+	int	err;
+	int	i;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->count = 1000;
+	cfg->depth = 1;
+	cfg->ops = 1u << FANCTL_OP_PING | 1u << FANCTL_OP_STATUS
+		| 1u << FANCTL_OP_SET_FAN_MODE | 1u << FANCTL_OP_SET_FAN_STATE;
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-j"))
+			cfg->json = true;
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+		{
+			if (!parse_ops(argv[++i], &cfg->ops))
+				return false;
+		}
+		else if (!strcmp(argv[i], "-T") && i + 1 < argc)
+		{
+			temp = parse_temp_str(argv[++i], &err);
+			if (err != PARSE_TEMP_ERR_OK)
+				return false;
+			cfg->threshold = (int16_t)(temp * 100.0f);
+			cfg->ops |= 1u << FANCTL_OP_SET_THRESHOLD;
+		}
+		else if ((!strcmp(argv[i], "-n") || !strcmp(argv[i], "-r")
+			|| !strcmp(argv[i], "-c")) && i + 1 < argc)
+		{
+			v = strtod(argv[i + 1], &end);
+			if (end == argv[i + 1] || *end || v < (argv[i][1] == 'r' ? 0 : 1))
+				return false;
+			if (argv[i][1] == 'n')
+				cfg->count = (uint64_t)v;
+			else if (argv[i][1] == 'r')
+				cfg->rate = v;
+			else if (v > BENCH_MAX_DEPTH)
+				return false;
+			else
+				cfg->depth = (unsigned)v;
+			i++;
+		}
+		else
+			return false;
+	}
+	if ((cfg->ops & 1u << FANCTL_OP_SET_THRESHOLD) && !cfg->threshold)
+	{
+		fprintf(stderr, "bench: threshold needs -T tempC\n");
+		return false;
+	}
+	return true;
+}
+
+/* Runs --------------------------------------------------------------------- */
+
+/* ACKs with an error are full exchanges too */
+static void	bench_record(bench_res_t *res, int result, uint64_t ns)
+{
+	if (result && result != -EOPNOTSUPP && result != -EBUSY)
+	{
+		res->errors++;
+		return;
+	}
+	if (result)
+		res->nacks++;
+	hist_record(&res->hist, ns);
+}
+
+static void	tty_done(fanctl_req_t *r)
+{
+	bench_tty_t	*t;
+
+	t = r->user;
+	bench_record(t->res, r->result, r->times.rx_ns - r->times.tx_ns);
+	t->inflight--;
+	t->done++;
+}
+
+/* Pipelined on the handle, timed by the library from write to RX */
+static int	bench_tty(fanctl_t *h, const bench_cfg_t *cfg, uint8_t op, int16_t arg,
+			bench_res_t *res)
+{
+	fanctl_req_t	*slots;
+	bench_tty_t	t;
+	uint64_t	issued;
+	uint64_t	period;
+	uint64_t	next;
+	uint64_t	now;
+	unsigned	i;
+	int		timeout;
+	int		ret;
+
+	slots = calloc(cfg->depth, sizeof(*slots));
+	if (!slots)
+		return -ENOMEM;
+	for (i = 0; i < cfg->depth; i++)
+		slots[i].done = true;
+	memset(&t, 0, sizeof(t));
+	t.res = res;
+	period = cfg->rate > 0 ? (uint64_t)(1e9 / cfg->rate) : 0;
+	issued = 0;
+	ret = 0;
+	next = mono_ns();
+	res->elapsed_ns = next;
+	while (t.done < cfg->count && ret >= 0)
+	{
+		now = mono_ns();
+		for (i = 0; i < cfg->depth && issued < cfg->count; i++)
+		{
+			if (!slots[i].done)
+				continue;
+			if (period && next > now)
+				break;
+			memset(&slots[i], 0, sizeof(slots[i]));
+			slots[i].op = op;
+			slots[i].addr = cfg->addr;
+			slots[i].arg = arg;
+			slots[i].cb = tty_done;
+			slots[i].user = &t;
+			issued++;
+			next += period;
+			ret = fanctl_submit(h, &slots[i]);
+			if (ret == 0)
+			{
+				t.inflight++;
+				continue;
+			}
+			slots[i].done = true;
+			bench_record(res, ret, 0);
+			t.done++;
+			ret = 0;
+		}
+		if (t.done >= cfg->count)
+			break;
+		timeout = -1;
+		if (period && issued < cfg->count && t.inflight < cfg->depth)
+			timeout = next > now ? (int)((next - now + 999999) / 1000000) : 0;
+		ret = fanctl_run(h, timeout);
+	}
+	res->elapsed_ns = mono_ns() - res->elapsed_ns;
+	free(slots);
+	return ret < 0 ? ret : 0;
+}
+
+static void	*lane_main(void *arg)
+{
+	struct timespec	ts;
+	bench_lane_t	*l;
+	fanctl_req_t	r;
+	uint64_t	next;
+	uint64_t	t0;
+	uint64_t	i;
+	int		ret;
+
+	l = arg;
+	next = l->start_ns;
+	for (i = 0; i < l->count; i++)
+	{
+		if (l->period_ns)
+		{
+			ts.tv_sec = (time_t)(next / 1000000000ULL);
+			ts.tv_nsec = (long)(next % 1000000000ULL);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+				;
+			next += l->period_ns;
+		}
+		memset(&r, 0, sizeof(r));
+		r.op = l->op;
+		r.addr = l->addr;
+		r.arg = l->arg;
+		t0 = mono_ns();
+		ret = fanctl_do(l->h, &r);
+		bench_record(&l->res, ret, mono_ns() - t0);
+	}
+	return NULL;
+}
+
+/* One thread per slot, each timing its own blocking ioctl() calls */
+static int	bench_dev(bench_lane_t *lanes, const bench_cfg_t *cfg, uint8_t op, int16_t arg,
+			bench_res_t *res)
+{
+	bench_lane_t	*l;
+	uint64_t	start;
+	uint64_t	period;
+	unsigned	started;
+	unsigned	i;
+	int		ret;
+
+	period = cfg->rate > 0 ? (uint64_t)(1e9 * cfg->depth / cfg->rate) : 0;
+	start = mono_ns();
+	ret = 0;
+	for (started = 0; started < cfg->depth; started++)
+	{
+		l = &lanes[started];
+		l->op = op;
+		l->arg = arg;
+		l->addr = cfg->addr;
+		l->count = cfg->count / cfg->depth + (started < cfg->count % cfg->depth);
+		l->period_ns = period;
+		l->start_ns = start + period / cfg->depth * started; // spread over a period
+		hist_init(&l->res.hist);
+		l->res.nacks = 0;
+		l->res.errors = 0;
+		ret = -pthread_create(&l->thread, NULL, lane_main, l);
+		if (ret < 0)
+			break;
+	}
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(lanes[i].thread, NULL);
+		hist_merge(&res->hist, &lanes[i].res.hist);
+		res->nacks += lanes[i].res.nacks;
+		res->errors += lanes[i].res.errors;
+	}
+	res->elapsed_ns = mono_ns() - start;
+	return ret;
+}
+
+/* Output ------------------------------------------------------------------- */
+
+static unsigned	tty_baud(fanctl_t *h)
+{
+	struct termios	tio;
+
+	if (fanctl_kind(h) != FANCTL_TR_SERIAL || tcgetattr(fanctl_dev_fd(h), &tio) < 0)
+		return 0;
+	switch (cfgetospeed(&tio))
+	{
+		case B9600:
+			return 9600;
+		case B19200:
+			return 19200;
+		case B38400:
+			return 38400;
+		case B57600:
+			return 57600;
+		case B115200:
+			return 115200;
+		case B230400:
+			return 230400;
+		case B460800:
+			return 460800;
+		case B921600:
+			return 921600;
+	}
+	return 0;
+}
+
+static double	ops_per_s(const bench_res_t *r)
+{
+	return r->elapsed_ns ? (double)r->hist.count * 1e9 / (double)r->elapsed_ns : 0.0;
+}
+
+static void	print_text(fanctl_t *h, const bench_cfg_t *cfg, const bench_res_t *res)
+{
+	const bench_res_t	*r;
+	unsigned		baud;
+	unsigned		op;
+	size_t			i;
+
+	baud = tty_baud(h);
+	printf("bench: %s %s", fanctl_kind(h) == FANCTL_TR_SERIAL ? "tty" : "driver", fanctl_dev(h));
+	if (baud)
+		printf(", %u baud", baud);
+	if (cfg->addr != FANCTL_ADDR_NONE)
+		printf(", addr %u", cfg->addr);
+	printf(", concurrency %u, ", cfg->depth);
+	if (cfg->rate > 0)
+		printf("%g req/s\n", cfg->rate);
+	else
+		printf("back to back\n");
+	printf("%-14s %8s %6s %6s %9s %9s %9s %9s %9s %10s\n", "op", "count", "nack", "err",
+		"min_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms", "ops/s");
+	for (op = FANCTL_OP_PING; op < FANCTL_OP_NR; op++)
+	{
+		if (!(cfg->ops & 1u << op))
+			continue;
+		r = &res[op];
+		printf("%-14s %8llu %6llu %6llu", fanctl_op_name((uint8_t)op),
+			(unsigned long long)r->hist.count, (unsigned long long)r->nacks,
+			(unsigned long long)r->errors);
+		if (!r->hist.count)
+		{
+			printf(" %9s %9s %9s %9s %9s %10s\n", "-", "-", "-", "-", "-", "-");
+			continue;
+		}
+		printf(" %9.3f", (double)r->hist.min / 1e6);
+		for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+			printf(" %9.3f", (double)hist_percentile(&r->hist, g_pcts[i]) / 1e6);
+		printf(" %9.3f %10.1f\n", (double)r->hist.max / 1e6, ops_per_s(r));
+	}
+}
+
+static void	print_json(fanctl_t *h, const bench_cfg_t *cfg, const bench_res_t *res)
+{
+	const bench_res_t	*r;
+	struct utsname		un;
+	const char		*sep;
+	unsigned		op;
+	size_t			i;
+
+	uname(&un);
+	printf("{\"host\":\"%s\",\"kernel\":\"%s\",\"backend\":\"%s\",\"device\":\"%s\","
+		"\"baud\":%u,\"addr\":%u,\"concurrency\":%u,\"rate\":%g,\"count\":%llu,\"ops\":{",
+		un.nodename, un.release, fanctl_kind(h) == FANCTL_TR_SERIAL ? "serial" : "ioctl",
+		fanctl_dev(h), tty_baud(h), cfg->addr, cfg->depth, cfg->rate,
+		(unsigned long long)cfg->count);
+	sep = "";
+	for (op = FANCTL_OP_PING; op < FANCTL_OP_NR; op++)
+	{
+		if (!(cfg->ops & 1u << op))
+			continue;
+		r = &res[op];
+		printf("%s\"%s\":{\"ok\":%llu,\"nack\":%llu,\"errors\":%llu,\"elapsed_ns\":%llu,"
+			"\"ops_per_s\":%.3f,\"latency_ns\":{\"min\":%llu,\"max\":%llu",
+			sep, fanctl_op_name((uint8_t)op), (unsigned long long)(r->hist.count - r->nacks),
+			(unsigned long long)r->nacks, (unsigned long long)r->errors,
+			(unsigned long long)r->elapsed_ns, ops_per_s(r),
+			(unsigned long long)(r->hist.count ? r->hist.min : 0),
+			(unsigned long long)r->hist.max);
+		for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+			printf(",\"p%g\":%llu", g_pcts[i],
+				(unsigned long long)hist_percentile(&r->hist, g_pcts[i]));
+		printf("}}");
+		sep = ",";
+	}
+	printf("}}\n");
+}
+
+int	bench_run(fanctl_t *h, const bench_cfg_t *cfg)
+{
+	struct fanctl_status	st;
+	bench_lane_t		*lanes;
+	bench_res_t		*res;
+	uint64_t		failed;
+	unsigned		op;
+	unsigned		i;
+	int16_t			arg;
+	int			ret;
+
+	memset(&st, 0, sizeof(st));
+	if (cfg->ops & (1u << FANCTL_OP_SET_FAN_MODE | 1u << FANCTL_OP_SET_FAN_STATE))
+	{
+		ret = fanctl_call(h, FANCTL_OP_STATUS, cfg->addr, 0, &st, NULL);
+		if (ret < 0)
+		{
+			fprintf(stderr, "bench: reading mode and state: %s\n", strerror(-ret));
+			return ret;
+		}
+	}
+	res = calloc(FANCTL_OP_NR, sizeof(*res));
+	lanes = NULL;
+	if (res && fanctl_kind(h) == FANCTL_TR_IOCTL)
+		lanes = calloc(cfg->depth, sizeof(*lanes));
+	if (!res || (fanctl_kind(h) == FANCTL_TR_IOCTL && !lanes))
+	{
+		free(res);
+		return -ENOMEM;
+	}
+	ret = 0;
+	for (i = 0; lanes && i < cfg->depth && ret == 0; i++)
+	{
+		lanes[i].h = i ? fanctl_open(fanctl_dev(h), FANCTL_TR_IOCTL) : h;
+		if (!lanes[i].h)
+		{
+			ret = -errno;
+			perror(fanctl_dev(h));
+		}
+	}
+	for (op = FANCTL_OP_PING; op < FANCTL_OP_NR && ret == 0; op++)
+	{
+		if (!(cfg->ops & 1u << op))
+			continue;
+		arg = 0;
+		if (op == FANCTL_OP_SET_FAN_MODE)
+			arg = st.fan_mode;
+		else if (op == FANCTL_OP_SET_FAN_STATE)
+			arg = st.fan_state;
+		else if (op == FANCTL_OP_SET_THRESHOLD)
+			arg = cfg->threshold;
+		hist_init(&res[op].hist);
+		if (lanes)
+			ret = bench_dev(lanes, cfg, (uint8_t)op, arg, &res[op]);
+		else
+			ret = bench_tty(h, cfg, (uint8_t)op, arg, &res[op]);
+	}
+	for (i = 1; lanes && i < cfg->depth; i++)
+		fanctl_close(lanes[i].h);
+	free(lanes);
+	if (ret == 0)
+	{
+		if (cfg->json)
+			print_json(h, cfg, res);
+		else
+			print_text(h, cfg, res);
+	}
+	failed = 0;
+	for (op = 0; op < FANCTL_OP_NR; op++)
+		failed += res[op].errors;
+	free(res);
+	if (ret < 0)
+	{
+		fprintf(stderr, "bench: %s\n", strerror(-ret));
+		return ret;
+	}
+	return failed > INT32_MAX ? INT32_MAX : (int)failed;
+}
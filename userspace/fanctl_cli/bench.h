@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "libfanctl.h"
+
+/*
+ * Bench mode
+ * ----------
+ * Issues `count` requests of each selected type, back to back or at a
+ * fixed total rate, with up to `depth` in flight, then prints min, p50,
+ * p90, p99, max and ops/s per type (text, or one JSON object with -j).
+ * Shared by both CLIs and always run on a libfanctl handle, never
+ * through fanctld, whose queue and cache would be measured instead:
+ *  - on a tty, requests are pipelined on the handle and each is timed
+ *    from the write of its frame to the completion of the response
+ *    frame (req->times)
+ *  - on the driver, every in-flight slot is a thread with its own open
+ *    file, and a request is timed around the whole ioctl() call
+ * SET_FAN_MODE / SET_FAN_STATE write back the mode and state read just
+ * before, so the node is left as it was. SET_THRESHOLD has no readback
+ * and only runs with -T. A rejected SET_* (ACK with an error) is still
+ * a full exchange: it is timed and counted as `nack`, not as an error.
+ */
+
+typedef struct {
+	uint64_t	count; // requests per type
+	double		rate; // total requests/s, 0: back to back
+	unsigned	depth; // in flight, >= 1
+	unsigned	ops; // 1 << FANCTL_OP_*
+	int16_t		threshold; // 0.01°C, SET_THRESHOLD only
+	bool		json;
+	uint8_t		addr;
+}	bench_cfg_t;
+
+bool	bench_parse_args(int argc, char **argv, bench_cfg_t *cfg);
+int	bench_run(fanctl_t *h, const bench_cfg_t *cfg); // requests not answered, or -errno
+
+#define BENCH_USAGE	"bench [-n count] [-r rate] [-c concurrency] [-o ping,status,mode,state,threshold] [-T tempC] [-j]"
@@ -0,0 +1 @@
+#include "../fanstore/rollup.c"
@@ -0,0 +1 @@
+#include "../fanstore/store.c"
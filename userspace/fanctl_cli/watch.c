@@ -0,0 +1,573 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "fanctld_proto.h"
+#include "client.h"
+#include "store.h"
+#include "watch.h"
+
+struct watch {
+	const watch_cfg_t	*cfg;
+	char			buf[WATCH_OUT_BUF];
+	size_t			off; // first unwritten byte
+	size_t			len; // unwritten bytes
+	uint64_t		started; // samples the backend took
+	uint64_t		done; // status records
+	uint64_t		errors;
+	uint64_t		missed; // ticks without a sample
+	uint64_t		dropped; // records that didn't fit in buf
+	store_t			*st; // -S
+	bool			out_err;
+};
+
+static volatile sig_atomic_t	g_stop;
+
+static void	on_signal(int sig)
+{
+	(void)sig;
+	g_stop = 1;
+}
+
+/* Option parsing ----------------------------------------------------------- */
+
+bool	watch_parse_args(int argc, char **argv, watch_cfg_t *cfg)
+{
+	char	*end;
+	long	v;
+	int	i;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->interval_ms = 1000;
+	cfg->fmt = WATCH_FMT_CSV;
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-B"))
+			cfg->block = true;
+		else if (!strcmp(argv[i], "-S") && i + 1 < argc)
+			cfg->store = argv[++i];
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+		{
+			i++;
+			if (!strcmp(argv[i], "csv"))
+				cfg->fmt = WATCH_FMT_CSV;
+			else if (!strcmp(argv[i], "json"))
+				cfg->fmt = WATCH_FMT_NDJSON;
+			else if (!strcmp(argv[i], "bin"))
+				cfg->fmt = WATCH_FMT_BIN;
+			else
+				return false;
+		}
+		else if ((!strcmp(argv[i], "-i") || !strcmp(argv[i], "-n")) && i + 1 < argc)
+		{
+			v = strtol(argv[i + 1], &end, 10);
+			if (end == argv[i + 1] || *end || v < (argv[i][1] == 'i' ? 1 : 0))
+				return false;
+			if (argv[i][1] == 'i')
+				cfg->interval_ms = (unsigned)v;
+			else
+				cfg->count = (uint64_t)v;
+			i++;
+		}
+		else
+			return false;
+	}
+	return true;
+}
+
+/* Formatting, into a caller's buffer, no stdio ----------------------------- */
+
+static char	*put_str(char *p, const char *s)
+{
+	while (*s)
+		*p++ = *s++;
+	return p;
+}
+
+static char	*put_u64(char *p, uint64_t v)
+{
+	char	tmp[20];
+	int	n;
+
+	n = 0;
+	do
+	{
+		tmp[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while (v);
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+static char	*put_i64(char *p, int64_t v)
+{
+	if (v < 0)
+	{
+		*p++ = '-';
+		return put_u64(p, (uint64_t)-(v + 1) + 1);
+	}
+	return put_u64(p, (uint64_t)v);
+}
+
+/* x100 fixed point as "-12.34" */
+static char	*put_x100(char *p, int32_t v)
+{
+	uint32_t	a;
+
+	if (v < 0)
+		*p++ = '-';
+	a = v < 0 ? (uint32_t)-(int64_t)v : (uint32_t)v;
+	p = put_u64(p, a / 100);
+	*p++ = '.';
+	*p++ = (char)('0' + a / 10 % 10);
+	*p++ = (char)('0' + a % 10);
+	return p;
+}
+
+static const char	*link_name(uint8_t state)
+{
+	if (state == FANCTL_LINK_UP)
+		return "UP";
+	if (state == FANCTL_LINK_DEGRADED)
+		return "DEGRADED";
+	return "DOWN";
+}
+
+static const char	g_csv_header[] = "ts_ns,sample,kind,addr,result,temp_c,humidity_pct,"
+	"fan_mode,fan_state,errors,rtt_us,link\n";
+
+static size_t	fmt_csv(char *line, const struct watch_rec *r)
+{
+	char	*p;
+
+	p = put_u64(line, r->ts_ns);
+	*p++ = ',';
+	p = put_u64(p, r->sample);
+	p = put_str(p, r->kind == WATCH_KIND_LINK ? ",link," : ",status,");
+	p = put_u64(p, r->addr);
+	*p++ = ',';
+	p = put_i64(p, r->result);
+	*p++ = ',';
+	if (r->kind == WATCH_KIND_STATUS && !r->result)
+	{
+		p = put_x100(p, r->temp_x100);
+		*p++ = ',';
+		p = put_x100(p, r->humidity_x100);
+		*p++ = ',';
+		p = put_u64(p, r->fan_mode);
+		*p++ = ',';
+		p = put_u64(p, r->fan_state);
+		*p++ = ',';
+		p = put_u64(p, r->errors);
+	}
+	else
+		p = put_str(p, ",,,,");
+	*p++ = ',';
+	if (r->rtt_us)
+		p = put_u64(p, r->rtt_us);
+	*p++ = ',';
+	if (r->kind == WATCH_KIND_LINK)
+		p = put_str(p, link_name(r->link));
+	*p++ = '\n';
+	return (size_t)(p - line);
+}
+
+static size_t	fmt_ndjson(char *line, const struct watch_rec *r)
+{
+	char	*p;
+
+	p = put_str(line, "{\"ts_ns\":");
+	p = put_u64(p, r->ts_ns);
+	if (r->kind == WATCH_KIND_LINK)
+	{
+		p = put_str(p, ",\"kind\":\"link\",\"addr\":");
+		p = put_u64(p, r->addr);
+		p = put_str(p, ",\"link\":\"");
+		p = put_str(p, link_name(r->link));
+		p = put_str(p, "\"}\n");
+		return (size_t)(p - line);
+	}
+	p = put_str(p, ",\"sample\":");
+	p = put_u64(p, r->sample);
+	p = put_str(p, ",\"kind\":\"status\",\"addr\":");
+	p = put_u64(p, r->addr);
+	p = put_str(p, ",\"result\":");
+	p = put_i64(p, r->result);
+	if (!r->result)
+	{
+		p = put_str(p, ",\"temp_c\":");
+		p = put_x100(p, r->temp_x100);
+		p = put_str(p, ",\"humidity_pct\":");
+		p = put_x100(p, r->humidity_x100);
+		p = put_str(p, ",\"fan_mode\":");
+		p = put_u64(p, r->fan_mode);
+		p = put_str(p, ",\"fan_state\":");
+		p = put_u64(p, r->fan_state);
+		p = put_str(p, ",\"errors\":");
+		p = put_u64(p, r->errors);
+	}
+	if (r->rtt_us)
+	{
+		p = put_str(p, ",\"rtt_us\":");
+		p = put_u64(p, r->rtt_us);
+	}
+	p = put_str(p, "}\n");
+	return (size_t)(p - line);
+}
+
+/* Output buffer ------------------------------------------------------------ */
+
+/* Write at most PIPE_BUF bytes: never blocks on a pipe that polled writable */
+static int	flush_some(watch_t *w)
+{
+	ssize_t	n;
+
+	if (!w->len)
+		return 0;
+	n = write(STDOUT_FILENO, w->buf + w->off, w->len < PIPE_BUF ? w->len : PIPE_BUF);
+	if (n < 0)
+	{
+		if (errno == EINTR || errno == EAGAIN)
+			return 0;
+		if (errno != EPIPE)
+			perror("write");
+		w->out_err = true;
+		return -1;
+	}
+	w->off += (size_t)n;
+	w->len -= (size_t)n;
+	if (!w->len)
+		w->off = 0;
+	return 0;
+}
+
+static void	enqueue(watch_t *w, const void *data, size_t n)
+{
+	struct pollfd	pfd;
+
+	while (w->cfg->block && !w->out_err && sizeof(w->buf) - w->len < n)
+	{
+		pfd.fd = STDOUT_FILENO;
+		pfd.events = POLLOUT;
+		if (poll(&pfd, 1, -1) > 0)
+			flush_some(w);
+		else if (g_stop)
+			break;
+	}
+	if (w->out_err || sizeof(w->buf) - w->len < n)
+	{
+		w->dropped++;
+		return;
+	}
+	if (w->off + w->len + n > sizeof(w->buf))
+	{
+		memmove(w->buf, w->buf + w->off, w->len);
+		w->off = 0;
+	}
+	memcpy(w->buf + w->off + w->len, data, n);
+	w->len += n;
+}
+
+void	watch_status_rec(struct watch_rec *r, uint32_t sample, int result,
+		const struct fanctl_status *st, uint32_t rtt_us)
+{
+	memset(r, 0, sizeof(*r));
+	r->kind = WATCH_KIND_STATUS;
+	r->sample = sample;
+	r->result = result;
+	r->rtt_us = rtt_us;
+	if (result || !st)
+		return;
+	r->temp_x100 = st->temp_x100;
+	r->humidity_x100 = st->humidity_x100;
+	r->fan_mode = st->fan_mode;
+	r->fan_state = st->fan_state;
+	r->errors = st->errors;
+}
+
+static void	store_rec(watch_t *w, const struct watch_rec *r)
+{
+	store_sample_t	s;
+	int		ret;
+
+	memset(&s, 0, sizeof(s));
+	s.ts_ms = (int64_t)(r->ts_ns / 1000000);
+	s.result = r->result;
+	s.temp_x100 = r->temp_x100;
+	s.humidity_x100 = r->humidity_x100;
+	s.fan_mode = r->fan_mode;
+	s.fan_state = r->fan_state;
+	s.errors = r->errors;
+	s.rtt_us = r->rtt_us;
+	ret = store_append(w->st, &s);
+	if (ret < 0)
+	{
+		fprintf(stderr, "watch: %s: %s\n", w->cfg->store, strerror(-ret));
+		w->out_err = true;
+	}
+}
+
+void	watch_record(watch_t *w, struct watch_rec *r)
+{
+	struct timespec	ts;
+	char		line[320];
+	size_t		n;
+
+	r->magic = WATCH_MAGIC;
+	r->addr = w->cfg->addr;
+	if (!r->ts_ns)
+	{
+		clock_gettime(CLOCK_REALTIME, &ts);
+		r->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+	}
+	if (r->kind == WATCH_KIND_STATUS)
+	{
+		w->done++;
+		if (r->result)
+			w->errors++;
+	}
+	if (w->st)
+	{
+		if (r->kind == WATCH_KIND_STATUS)
+			store_rec(w, r);
+		return;
+	}
+	if (w->cfg->fmt == WATCH_FMT_BIN)
+	{
+		enqueue(w, r, sizeof(*r));
+		return;
+	}
+	n = w->cfg->fmt == WATCH_FMT_CSV ? fmt_csv(line, r) : fmt_ndjson(line, r);
+	enqueue(w, line, n);
+}
+
+/* Loop --------------------------------------------------------------------- */
+
+int	watch_run(const watch_cfg_t *cfg, const watch_ops_t *ops)
+{
+	struct itimerspec	its;
+	struct sigaction	sa;
+	struct pollfd		pfd[3];
+	uint64_t		ticks;
+	uint64_t		exp;
+	watch_t			*w;
+	int			tfd;
+	int			ret;
+
+	w = calloc(1, sizeof(*w)); // the only allocation, buffer included
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (!w || tfd < 0)
+	{
+		perror("watch");
+		free(w);
+		return -1;
+	}
+	w->cfg = cfg;
+	ret = cfg->store ? store_open(&w->st, cfg->store, cfg->addr) : 0;
+	if (ret < 0)
+	{
+		fprintf(stderr, "watch: %s: %s\n", cfg->store, ret == -EBUSY ? "already has a writer"
+			: ret == -EXDEV ? "history of another node" : strerror(-ret));
+		close(tfd);
+		free(w);
+		return -1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal; // no SA_RESTART: poll() returns
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN); // a closed pipe shows up as EPIPE
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_nsec = 1; // first sample right away
+	its.it_interval.tv_sec = cfg->interval_ms / 1000;
+	its.it_interval.tv_nsec = (long)(cfg->interval_ms % 1000) * 1000000L;
+	timerfd_settime(tfd, 0, &its, NULL);
+	if (cfg->fmt == WATCH_FMT_CSV && !w->st)
+		enqueue(w, g_csv_header, sizeof(g_csv_header) - 1);
+
+	ticks = 0;
+	ret = 0;
+	// -n counts ticks; after the last one, wait for samples in flight
+	while (!g_stop && !w->out_err
+		&& (!cfg->count || ticks < cfg->count || w->done < w->started))
+	{
+		pfd[0].fd = tfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = ops->fd;
+		pfd[1].events = ops->events;
+		pfd[2].fd = w->len ? STDOUT_FILENO : -1;
+		pfd[2].events = POLLOUT;
+		if (poll(pfd, 3, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			ret = -1;
+			break;
+		}
+		if ((pfd[2].revents & (POLLOUT | POLLERR | POLLHUP)) && flush_some(w) < 0)
+			break;
+		if (pfd[1].revents && ops->ready(ops->ctx, w, pfd[1].revents) < 0)
+		{
+			ret = -1;
+			break;
+		}
+		if (!(pfd[0].revents & POLLIN) || read(tfd, &exp, sizeof(exp)) != sizeof(exp))
+			continue;
+		if (cfg->count && ticks >= cfg->count)
+			continue; // last samples still in flight
+		w->missed += exp - 1; // the backend took longer than the interval
+		ticks += exp;
+		ret = ops->tick(ops->ctx, w, (uint32_t)ticks);
+		if (ret < 0)
+			break;
+		if (ret > 0)
+			w->missed++; // previous sample still in flight
+		else
+			w->started++;
+		ret = 0;
+	}
+	while (w->len && !w->out_err) // drain what was already sampled
+		if (flush_some(w) < 0)
+			break;
+	fprintf(stderr, "watch: %llu samples (%llu failed), %llu missed ticks, "
+		"%llu dropped records\n", (unsigned long long)w->done,
+		(unsigned long long)w->errors, (unsigned long long)w->missed,
+		(unsigned long long)w->dropped);
+	store_close(w->st);
+	close(tfd);
+	free(w);
+	return ret;
+}
+
+/* libfanctl backend -------------------------------------------------------- */
+
+static void	fanctl_done(fanctl_req_t *req)
+{
+	watch_fanctl_t		*f;
+	struct watch_rec	r;
+
+	f = req->user;
+	f->busy = false;
+	watch_status_rec(&r, f->sample, req->result, &req->status,
+		!req->result && req->times.rx_ns > req->times.tx_ns
+		? (uint32_t)((req->times.rx_ns - req->times.tx_ns) / 1000) : 0);
+	watch_record(f->w, &r);
+}
+
+static int	fanctl_tick(void *ctx, watch_t *w, uint32_t sample)
+{
+	watch_fanctl_t	*f;
+	int		ret;
+
+	f = ctx;
+	if (f->busy)
+		return 1;
+	memset(&f->req, 0, sizeof(f->req));
+	f->req.op = FANCTL_OP_STATUS;
+	f->req.addr = w->cfg->addr;
+	f->req.cb = fanctl_done;
+	f->req.user = f;
+	f->w = w;
+	f->sample = sample;
+	ret = fanctl_submit(f->h, &f->req);
+	if (ret < 0)
+		return ret;
+	f->busy = true;
+	return 0;
+}
+
+static int	fanctl_ready(void *ctx, watch_t *w, short revents)
+{
+	int	ret;
+
+	(void)w;
+	(void)revents;
+	ret = fanctl_run(((watch_fanctl_t *)ctx)->h, 0);
+	return ret < 0 ? ret : 0;
+}
+
+void	watch_fanctl_ops(watch_ops_t *ops, watch_fanctl_t *f)
+{
+	memset(ops, 0, sizeof(*ops));
+	f->busy = false;
+	ops->ctx = f;
+	ops->fd = fanctl_fd(f->h);
+	ops->events = POLLIN;
+	ops->tick = fanctl_tick;
+	ops->ready = fanctl_ready;
+}
+
+/* fanctld backend ---------------------------------------------------------- */
+
+static int	daemon_tick(void *ctx, watch_t *w, uint32_t sample)
+{
+	watch_daemon_t		*d;
+	struct fanctld_req	req;
+
+	d = ctx;
+	if (d->busy)
+		return 1;
+	memset(&req, 0, sizeof(req));
+	req.version = FANCTLD_VERSION;
+	req.op = FANCTLD_OP_STATUS;
+	req.addr = w->cfg->addr;
+	// a cached status is fine if it is from this half of the interval
+	req.max_age_ms = (uint16_t)(w->cfg->interval_ms / 2 > 0xFFFF ? 0xFFFF
+			: w->cfg->interval_ms / 2 ? w->cfg->interval_ms / 2 : 1);
+	req.tag = sample;
+	if (fanctld_send(d->fd, &req) < 0)
+	{
+		perror("fanctld");
+		return -1;
+	}
+	d->busy = true;
+	return 0;
+}
+
+static int	daemon_ready(void *ctx, watch_t *w, short revents)
+{
+	watch_daemon_t		*d;
+	struct fanctld_resp	resp;
+	struct watch_rec	r;
+	ssize_t			n;
+
+	(void)revents;
+	d = ctx;
+	n = fanctld_recv(d->fd, &resp, sizeof(resp), 0);
+	if (n < 0)
+	{
+		if (errno == ETIMEDOUT)
+			return 0;
+		perror("fanctld");
+		return -1;
+	}
+	if ((size_t)n != sizeof(resp) || resp.op != FANCTLD_OP_STATUS)
+		return 0;
+	d->busy = false;
+	watch_status_rec(&r, resp.tag, resp.result, &resp.status,
+		resp.times.rx_ns > resp.times.tx_ns
+		? (uint32_t)((resp.times.rx_ns - resp.times.tx_ns) / 1000) : 0);
+	watch_record(w, &r);
+	return 0;
+}
+
+void	watch_daemon_ops(watch_ops_t *ops, watch_daemon_t *d)
+{
+	memset(ops, 0, sizeof(*ops));
+	d->busy = false;
+	ops->ctx = d;
+	ops->fd = d->fd;
+	ops->events = POLLIN;
+	ops->tick = daemon_tick;
+	ops->ready = daemon_ready;
+}
+
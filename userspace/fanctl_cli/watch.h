@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fanctl_uapi.h"
+#include "libfanctl.h"
+
+/*
+ * Watch mode
+ * ----------
+ * Samples the node on a timerfd schedule and writes one record per
+ * sample to stdout, as CSV (with a header line), NDJSON or fixed-size
+ * binary struct watch_rec. Shared by both CLIs, which provide the
+ * sampling backend: watch_fanctl_ops() samples a libfanctl handle,
+ * watch_daemon_ops() goes through fanctld.
+ *
+ * Records are formatted into a preallocated output buffer without
+ * allocating, and written out when stdout is writable, at most PIPE_BUF
+ * bytes at a time so a pipe never blocks. When the consumer falls
+ * behind and the buffer is full, records are dropped (default) or the
+ * loop blocks until it drains (-B). `sample` counts timer ticks, so
+ * dropped records, late ticks and failed samples all leave gaps or
+ * error rows that a collector can see.
+ *
+ * With -S dir, watch is the collector of a fanstore history instead:
+ * status records are appended to the store in `dir` (see store.h) and
+ * nothing is written to stdout. Link events aren't stored.
+ */
+
+#define WATCH_MAGIC		0xFC57
+#define WATCH_OUT_BUF		65536
+
+enum {
+	WATCH_KIND_STATUS	= 0,
+	WATCH_KIND_LINK		= 1, // link state change pushed by the driver
+};
+
+typedef enum {
+	WATCH_FMT_CSV,
+	WATCH_FMT_NDJSON,
+	WATCH_FMT_BIN,
+}	watch_fmt_t;
+
+/* Binary record, host byte order */
+struct watch_rec {
+	uint16_t	magic; // WATCH_MAGIC
+	uint8_t		kind; // WATCH_KIND_*
+	uint8_t		addr;
+	uint32_t	sample; // timer tick, 0 for link events
+	uint64_t	ts_ns; // CLOCK_REALTIME
+	int32_t		result; // 0 or -errno
+	uint32_t	rtt_us; // 0 when unknown
+	int16_t		temp_x100;
+	uint16_t	humidity_x100;
+	uint8_t		fan_mode;
+	uint8_t		fan_state;
+	uint16_t	errors; // link misses for WATCH_KIND_LINK
+	uint8_t		link; // FANCTL_LINK_*, WATCH_KIND_LINK only
+	uint8_t		rsvd[7];
+};
+
+_Static_assert(sizeof(struct watch_rec) == 40, "watch_rec is a file format");
+
+typedef struct watch	watch_t;
+
+typedef struct {
+	void	*ctx;
+	int	fd; // polled for `events` besides the timer, -1: none
+	short	events;
+	// timer tick: start a sample, finished now or later with watch_record()
+	int	(*tick)(void *ctx, watch_t *w, uint32_t sample);
+	// fd is ready; < 0 stops the watch
+	int	(*ready)(void *ctx, watch_t *w, short revents);
+}	watch_ops_t;
+
+typedef struct {
+	unsigned	interval_ms;
+	uint64_t	count; // samples, 0: until SIGINT/SIGTERM
+	watch_fmt_t	fmt;
+	bool		block; // block on a slow consumer instead of dropping
+	const char	*store; // fanstore directory, NULL: stdout
+	uint8_t		addr;
+}	watch_cfg_t;
+
+typedef struct {
+	int	fd; // fanctld connection
+	bool	busy;
+}	watch_daemon_t;
+
+typedef struct {
+	fanctl_t	*h;
+	fanctl_req_t	req; // the sample in flight
+	bool		busy;
+	watch_t		*w;
+	uint32_t	sample;
+}	watch_fanctl_t;
+
+bool	watch_parse_args(int argc, char **argv, watch_cfg_t *cfg);
+void	watch_record(watch_t *w, struct watch_rec *r);
+void	watch_status_rec(struct watch_rec *r, uint32_t sample, int result,
+		const struct fanctl_status *st, uint32_t rtt_us);
+int	watch_run(const watch_cfg_t *cfg, const watch_ops_t *ops);
+void	watch_daemon_ops(watch_ops_t *ops, watch_daemon_t *d);
+void	watch_fanctl_ops(watch_ops_t *ops, watch_fanctl_t *f);
+
+#define WATCH_USAGE	"watch [-i interval_ms] [-n count] [-f csv|json|bin] [-B] [-S store_dir]"
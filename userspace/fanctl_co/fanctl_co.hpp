@@ -0,0 +1,1035 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "proto.h"
+#include "fanctl_uapi.h"
+
+/*
+ * fanctl_co: coroutine client for the raw tty
+ * -------------------------------------------
+ * Header-only C++20 layer over common/proto.h, for controllers that
+ * drive many nodes from one thread instead of one blocking call per
+ * thread:
+ *  - crc16() and its table are constexpr, checked at compile time
+ *  - frames are built into fixed buffers and parsed in bulk; a parsed
+ *    frame is a frame_view, a std::span into the port's RX buffer
+ *  - a request is an awaitable living in the awaiting coroutine's
+ *    frame: sending one allocates nothing
+ *  - one executor per thread: an epoll loop doing the ports' I/O and
+ *    the request deadlines, and resuming the coroutine whose request
+ *    completed
+ *
+ *   fanctl::task<void>	poll(fanctl::node n)
+ *   {
+ *   	fanctl::reply	r = co_await n.status();
+ *   	...
+ *   }
+ *
+ *   fanctl::executor	ex;
+ *   fanctl::port	tty(ex);
+ *   tty.open("/dev/ttyFAN0");
+ *   tty.set_depth(8);
+ *   for (uint8_t a = 1; a <= 200; a++)
+ *   	ex.spawn(poll(fanctl::node(tty, a)));
+ *   ex.run();
+ *
+ * Same wire semantics as sclient (fanctl_serial/sclient.h): responses
+ * are matched by SEQ, address and type, up to `depth` requests are on
+ * the wire per port and the others wait in submission order. Keep depth
+ * 1 on a half-duplex RS-485 bus. Results are 0 or -errno as in
+ * libfanctl. Not thread-safe; ports and nodes must outlive the tasks
+ * using them.
+ */
+
+namespace fanctl
+{
+
+inline constexpr int		DEFAULT_TIMEOUT_MS = 1000;
+inline constexpr unsigned	MAX_INFLIGHT = 255; // one SEQ stays free so a stale reply can't match
+inline constexpr size_t		RX_BUF = 4096;
+inline constexpr size_t		TX_BUF = 4096;
+
+inline uint64_t	mono_ns()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* CRC ---------------------------------------------------------------------- */
+
+// CRC-16/CCITT-FALSE, as proto_crc16(), one table lookup per byte
+constexpr std::array<uint16_t, 256>	make_crc_table()
+{
+	std::array<uint16_t, 256>	t{};
+	uint16_t			crc;
+
+	for (unsigned i = 0; i < 256; i++)
+	{
+		crc = (uint16_t)(i << 8);
+		for (int b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		t[i] = crc;
+	}
+	return t;
+}
+
+inline constexpr std::array<uint16_t, 256>	crc_table = make_crc_table();
+
+constexpr uint16_t	crc16(std::span<const uint8_t> data, uint16_t crc = 0xFFFF)
+{
+	for (uint8_t b : data)
+		crc = (uint16_t)((crc << 8) ^ crc_table[((crc >> 8) ^ b) & 0xFF]);
+	return crc;
+}
+
+static_assert(crc16(std::array<uint8_t, 9>{ '1', '2', '3', '4', '5', '6', '7', '8', '9' }) == 0x29B1,
+	"CRC-16/CCITT-FALSE check value");
+
+/* Frames ------------------------------------------------------------------- */
+
+/*
+ * Same bytes as proto_build_frame_addr(). Returns the frame length, 0
+ * if the payload is too long.
+ */
+constexpr size_t	build_frame(std::span<uint8_t, PROTO_MAX_FRAME> out, uint8_t addr, uint8_t cmd,
+				uint8_t seq, std::span<const uint8_t> payload)
+{
+	size_t		pos;
+	uint16_t	crc;
+
+	if (payload.size() > PROTO_MAX_PAYLOAD)
+		return 0;
+	pos = 0;
+	out[pos++] = PROTO_SYNC0;
+	if (addr == PROTO_ADDR_NONE)
+		out[pos++] = PROTO_SYNC1;
+	else
+	{
+		out[pos++] = PROTO_SYNC1_ADDR;
+		out[pos++] = addr;
+	}
+	out[pos++] = cmd;
+	out[pos++] = seq;
+	out[pos++] = (uint8_t)payload.size();
+	for (uint8_t b : payload)
+		out[pos++] = b;
+	crc = crc16(std::span<const uint8_t>(out).subspan(2, pos - 2)); // (addr), cmd, seq, len + payload
+	out[pos++] = (uint8_t)(crc >> 8);
+	out[pos++] = (uint8_t)crc;
+	return pos;
+}
+
+/* A whole frame, valid while the bytes it views are */
+class frame_view
+{
+public:
+	constexpr frame_view() = default;
+	constexpr explicit frame_view(std::span<const uint8_t> bytes) : m_bytes(bytes) {}
+
+	constexpr bool	empty() const { return m_bytes.empty(); }
+	constexpr std::span<const uint8_t>	bytes() const { return m_bytes; }
+	constexpr uint8_t	addr() const { return hdr() == 3 ? m_bytes[2] : PROTO_ADDR_NONE; }
+	constexpr uint8_t	cmd() const { return m_bytes[hdr()] & ~PROTO_CMD_F_TRACE; }
+	constexpr bool	traced() const { return m_bytes[hdr()] & PROTO_CMD_F_TRACE; }
+	constexpr uint8_t	seq() const { return m_bytes[hdr() + 1]; }
+
+	// payload without the trace trailer, if any
+	constexpr std::span<const uint8_t>	payload() const
+	{
+		size_t	len;
+
+		len = m_bytes[hdr() + 2];
+		if (traced() && len >= PROTO_TRACE_LEN)
+			len -= PROTO_TRACE_LEN;
+		return m_bytes.subspan(hdr() + 3, len);
+	}
+
+private:
+	constexpr size_t	hdr() const { return m_bytes[1] == PROTO_SYNC1_ADDR ? 3 : 2; }
+
+	std::span<const uint8_t>	m_bytes;
+};
+
+/*
+ * Find the first valid frame in buf. *used is set to the bytes the
+ * caller can drop: up to the end of the frame, or, with no frame, up
+ * to the first byte that may still start one. A bad length or CRC only
+ * skips its SYNC0, so a frame starting inside a corrupted one is found
+ * (proto_rx_feed() resumes after the bad frame instead).
+ */
+constexpr frame_view	scan_frame(std::span<const uint8_t> buf, size_t *used)
+{
+	size_t		i;
+	size_t		hdr;
+	size_t		total;
+	uint16_t	crc;
+
+	i = 0;
+	while (i < buf.size())
+	{
+		if (buf[i] != PROTO_SYNC0)
+		{
+			i++;
+			continue;
+		}
+		if (i + 1 >= buf.size())
+			break;
+		if (buf[i + 1] != PROTO_SYNC1 && buf[i + 1] != PROTO_SYNC1_ADDR)
+		{
+			i++;
+			continue;
+		}
+		hdr = buf[i + 1] == PROTO_SYNC1_ADDR ? 3 : 2;
+		if (i + hdr + 3 > buf.size())
+			break;
+		if (buf[i + hdr + 2] > PROTO_MAX_PAYLOAD)
+		{
+			i++;
+			continue;
+		}
+		total = hdr + 3 + buf[i + hdr + 2] + 2;
+		if (i + total > buf.size())
+			break;
+		crc = crc16(buf.subspan(i + 2, total - 4));
+		if (crc != ((buf[i + total - 2] << 8) | buf[i + total - 1]))
+		{
+			i++;
+			continue;
+		}
+		*used = i + total;
+		return frame_view(buf.subspan(i, total));
+	}
+	*used = i;
+	return frame_view();
+}
+
+/* Round trip through both, at compile time */
+static_assert([] {
+	std::array<uint8_t, PROTO_MAX_FRAME>	f{};
+	std::array<uint8_t, 2>			arg{ 0x09, 0xC4 };
+	size_t					len;
+	size_t					used;
+	frame_view				v;
+
+	len = build_frame(f, 7, PROTO_CMD_SET_THRESHOLD, 42, arg);
+	v = scan_frame(std::span<const uint8_t>(f).first(len), &used);
+	return used == len && v.addr() == 7 && v.cmd() == PROTO_CMD_SET_THRESHOLD && v.seq() == 42
+		&& v.payload().size() == 2 && v.payload()[1] == 0xC4;
+}(), "build_frame/scan_frame round trip");
+
+/* Executor ----------------------------------------------------------------- */
+
+class executor;
+
+namespace detail
+{
+
+/* Deadline, in the executor's list sorted by deadline */
+struct timer
+{
+	uint64_t	deadline_ns = 0;
+	timer		*prev = nullptr;
+	timer		*next = nullptr;
+	bool		armed = false;
+	void		(*fire)(timer *t) = nullptr;
+	void		*ctx = nullptr;
+};
+
+struct io_source
+{
+	virtual void	on_io(uint32_t events) = 0;
+
+protected:
+	~io_source() = default;
+};
+
+}
+
+template <typename T = void> class task;
+
+class executor : private detail::io_source
+{
+public:
+	executor()
+	{
+		struct epoll_event	ev{};
+
+		m_ep = epoll_create1(EPOLL_CLOEXEC);
+		m_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		ev.events = EPOLLIN;
+		ev.data.ptr = static_cast<detail::io_source *>(this);
+		if (m_ep >= 0 && m_tfd >= 0)
+			epoll_ctl(m_ep, EPOLL_CTL_ADD, m_tfd, &ev);
+	}
+
+	~executor()
+	{
+		if (m_tfd >= 0)
+			::close(m_tfd);
+		if (m_ep >= 0)
+			::close(m_ep);
+	}
+
+	executor(const executor &) = delete;
+	executor	&operator=(const executor &) = delete;
+
+	bool	ok() const { return m_ep >= 0 && m_tfd >= 0; }
+	int	fd() const { return m_ep; } // readable when there is work, to nest in another loop
+	unsigned	tasks() const { return m_tasks; }
+
+	// all 0 or -errno
+	int	add(int fd, uint32_t events, detail::io_source *src) { return ctl(EPOLL_CTL_ADD, fd, events, src); }
+	int	modify(int fd, uint32_t events, detail::io_source *src) { return ctl(EPOLL_CTL_MOD, fd, events, src); }
+	void	remove(int fd) { epoll_ctl(m_ep, EPOLL_CTL_DEL, fd, nullptr); }
+
+	// start a task now; it runs until its first suspension and owns itself after
+	void	spawn(task<void> t);
+	void	task_done() { m_tasks--; }
+
+	// dispatch what is ready, waiting up to timeout_ms (-1: forever); events handled or -errno
+	int	run_once(int timeout_ms)
+	{
+		struct epoll_event	evs[64];
+		int			n;
+
+		n = epoll_wait(m_ep, evs, 64, timeout_ms);
+		if (n < 0)
+			return errno == EINTR ? 0 : -errno;
+		for (int i = 0; i < n; i++)
+			static_cast<detail::io_source *>(evs[i].data.ptr)->on_io(evs[i].events);
+		return n;
+	}
+
+	// until every spawned task is done, or stop()
+	int	run()
+	{
+		int	ret;
+
+		m_stop = false;
+		while (m_tasks && !m_stop)
+		{
+			ret = run_once(-1);
+			if (ret < 0)
+				return ret;
+		}
+		return 0;
+	}
+
+	void	stop() { m_stop = true; }
+
+	void	add_timer(detail::timer *t)
+	{
+		detail::timer	*at;
+
+		// deadlines mostly come in order: search from the latest
+		at = m_tail;
+		while (at && at->deadline_ns > t->deadline_ns)
+			at = at->prev;
+		t->prev = at;
+		t->next = at ? at->next : m_head;
+		if (t->next)
+			t->next->prev = t;
+		else
+			m_tail = t;
+		if (at)
+			at->next = t;
+		else
+			m_head = t;
+		t->armed = true;
+		if (m_head == t)
+			arm();
+	}
+
+	void	cancel_timer(detail::timer *t)
+	{
+		if (!t->armed)
+			return;
+		if (t->prev)
+			t->prev->next = t->next;
+		else
+			m_head = t->next;
+		if (t->next)
+			t->next->prev = t->prev;
+		else
+			m_tail = t->prev;
+		t->prev = t->next = nullptr;
+		t->armed = false;
+	}
+
+	class sleep_op
+	{
+	public:
+		sleep_op(executor &ex, int ms) : m_ex(ex)
+		{
+			m_timer.deadline_ns = mono_ns() + (uint64_t)ms * 1000000ULL;
+			m_timer.ctx = this;
+			m_timer.fire = [](detail::timer *t) {
+				static_cast<sleep_op *>(t->ctx)->m_waiter.resume();
+			};
+		}
+		sleep_op(const sleep_op &) = delete;
+
+		bool	await_ready() const noexcept { return false; }
+		void	await_suspend(std::coroutine_handle<> h)
+		{
+			m_waiter = h;
+			m_ex.add_timer(&m_timer);
+		}
+		void	await_resume() const noexcept {}
+
+	private:
+		executor		&m_ex;
+		detail::timer		m_timer;
+		std::coroutine_handle<>	m_waiter;
+	};
+
+	sleep_op	sleep(int ms) { return sleep_op(*this, ms); }
+
+private:
+	int	ctl(int op, int fd, uint32_t events, detail::io_source *src)
+	{
+		struct epoll_event	ev{};
+
+		ev.events = events;
+		ev.data.ptr = src;
+		return epoll_ctl(m_ep, op, fd, &ev) < 0 ? -errno : 0;
+	}
+
+	void	arm()
+	{
+		struct itimerspec	its{};
+
+		if (m_head)
+		{
+			its.it_value.tv_sec = (time_t)(m_head->deadline_ns / 1000000000ULL);
+			its.it_value.tv_nsec = (long)(m_head->deadline_ns % 1000000000ULL);
+			if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+				its.it_value.tv_nsec = 1; // zero would disarm
+		}
+		timerfd_settime(m_tfd, TFD_TIMER_ABSTIME, &its, nullptr);
+	}
+
+	// timerfd: fire what is due, each popped before it runs
+	void	on_io(uint32_t) override
+	{
+		uint64_t	expirations;
+		uint64_t	now;
+		detail::timer	*t;
+
+		if (read(m_tfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+			return;
+		now = mono_ns();
+		while (m_head && m_head->deadline_ns <= now)
+		{
+			t = m_head;
+			cancel_timer(t);
+			t->fire(t);
+		}
+		arm();
+	}
+
+	int		m_ep = -1;
+	int		m_tfd = -1;
+	unsigned	m_tasks = 0;
+	bool		m_stop = false;
+	detail::timer	*m_head = nullptr;
+	detail::timer	*m_tail = nullptr;
+};
+
+/* Tasks -------------------------------------------------------------------- */
+
+namespace detail
+{
+
+struct promise_base
+{
+	std::coroutine_handle<>	continuation;
+	executor		*owner = nullptr; // spawned: destroys itself when done
+
+	std::suspend_always	initial_suspend() noexcept { return {}; }
+	void			unhandled_exception() noexcept { std::terminate(); }
+};
+
+struct final_awaiter
+{
+	bool	await_ready() const noexcept { return false; }
+	void	await_resume() const noexcept {}
+
+	template <typename P>
+	std::coroutine_handle<>	await_suspend(std::coroutine_handle<P> h) noexcept
+	{
+		promise_base	&p = h.promise();
+		executor	*owner;
+
+		if (p.continuation)
+			return p.continuation;
+		owner = p.owner;
+		if (owner)
+		{
+			h.destroy();
+			owner->task_done();
+		}
+		return std::noop_coroutine();
+	}
+};
+
+template <typename T>
+struct promise_value
+{
+	std::optional<T>	value;
+
+	void	return_value(T v) { value = std::move(v); }
+	T	take() { return std::move(*value); }
+};
+
+template <>
+struct promise_value<void>
+{
+	void	return_void() {}
+	void	take() {}
+};
+
+}
+
+/* Lazy coroutine: starts when awaited or spawned */
+template <typename T>
+class task
+{
+public:
+	struct promise_type : detail::promise_base, detail::promise_value<T>
+	{
+		task			get_return_object() { return task(handle::from_promise(*this)); }
+		detail::final_awaiter	final_suspend() noexcept { return {}; }
+	};
+
+	using handle = std::coroutine_handle<promise_type>;
+
+	task(task &&o) noexcept : m_h(std::exchange(o.m_h, nullptr)) {}
+	task(const task &) = delete;
+	task	&operator=(const task &) = delete;
+	~task()
+	{
+		if (m_h)
+			m_h.destroy();
+	}
+
+	bool	await_ready() const noexcept { return false; }
+	std::coroutine_handle<>	await_suspend(std::coroutine_handle<> caller) noexcept
+	{
+		m_h.promise().continuation = caller;
+		return m_h;
+	}
+	T	await_resume() { return m_h.promise().take(); }
+
+	handle	release() { return std::exchange(m_h, nullptr); }
+
+private:
+	explicit task(handle h) : m_h(h) {}
+
+	handle	m_h;
+};
+
+inline void	executor::spawn(task<void> t)
+{
+	task<void>::handle	h;
+
+	h = t.release();
+	h.promise().owner = this;
+	m_tasks++;
+	h.resume();
+}
+
+/* Requests ----------------------------------------------------------------- */
+
+struct reply
+{
+	int			result; // 0, -ETIMEDOUT, -EOPNOTSUPP, -EBUSY, -EPROTO, -EIO, -ECANCELED
+	struct fanctl_status	status; // STATUS only
+	uint64_t		rtt_ns; // from queueing the frame to parsing the response
+};
+
+struct port_stats
+{
+	uint64_t	submitted;
+	uint64_t	completed;
+	uint64_t	timeouts;
+	uint64_t	stale; // responses with no matching request
+	uint64_t	waited; // requests queued behind `depth` others
+	uint64_t	rx_bytes;
+	uint64_t	rx_frames;
+	uint64_t	tx_bytes;
+	unsigned	max_inflight;
+};
+
+class port;
+
+/* One request; awaiting it sends it. Not copyable: the port points at it. */
+class request
+{
+public:
+	request(port &p, uint8_t addr, uint8_t cmd, std::span<const uint8_t> payload, int timeout_ms)
+		: m_port(p), m_addr(addr), m_cmd(cmd), m_len((uint8_t)payload.size()), m_timeout_ms(timeout_ms)
+	{
+		if (!payload.empty())
+			std::memcpy(m_payload.data(), payload.data(), payload.size());
+		m_timer.ctx = this;
+	}
+	request(const request &) = delete;
+	request	&operator=(const request &) = delete;
+
+	bool	await_ready() const noexcept { return false; }
+	bool	await_suspend(std::coroutine_handle<> h); // false: completed already
+	reply	await_resume() const noexcept { return m_reply; }
+
+private:
+	friend class port;
+
+	port					&m_port;
+	uint8_t					m_addr;
+	uint8_t					m_cmd;
+	uint8_t					m_len;
+	uint8_t					m_seq = 0;
+	int					m_timeout_ms;
+	std::array<uint8_t, PROTO_MAX_PAYLOAD>	m_payload;
+	std::coroutine_handle<>			m_waiter;
+	request					*m_next = nullptr; // wait queue
+	uint64_t				m_tx_ns = 0;
+	detail::timer				m_timer;
+	reply					m_reply{};
+};
+
+/* Raw tty (or pty) carrying frames to the nodes behind it */
+class port : private detail::io_source
+{
+public:
+	explicit port(executor &ex) : m_ex(ex) { m_inflight.fill(nullptr); }
+	~port() { close(); }
+
+	port(const port &) = delete;
+	port	&operator=(const port &) = delete;
+
+	// raw 8N1 at 115200 like serial_open(); 0 or -errno
+	int	open(const char *path)
+	{
+		struct termios	tio;
+		int		fd;
+		int		ret;
+
+		fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0)
+			return -errno;
+		if (tcgetattr(fd, &tio) == 0)
+		{
+			cfmakeraw(&tio);
+			tio.c_cflag |= CLOCAL | CREAD;
+			tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS | CSIZE);
+			tio.c_cflag |= CS8;
+			cfsetispeed(&tio, B115200);
+			cfsetospeed(&tio, B115200);
+			tcsetattr(fd, TCSANOW, &tio);
+			tcflush(fd, TCIOFLUSH);
+		}
+		ret = attach(fd);
+		if (ret < 0)
+		{
+			::close(fd);
+			return ret;
+		}
+		m_owned = true;
+		return 0;
+	}
+
+	// an open non-blocking fd, not owned; 0 or -errno
+	int	attach(int fd)
+	{
+		int	ret;
+
+		close();
+		ret = m_ex.add(fd, EPOLLIN, this);
+		if (ret < 0)
+			return ret;
+		m_fd = fd;
+		m_owned = false;
+		m_events = EPOLLIN;
+		return 0;
+	}
+
+	// pending requests complete with -ECANCELED
+	void	close()
+	{
+		if (m_fd >= 0)
+			fail(-ECANCELED);
+	}
+
+	int		fd() const { return m_fd; }
+	unsigned	inflight() const { return m_count; }
+	const port_stats	&stats() const { return m_st; }
+
+	// requests on the wire, 1..MAX_INFLIGHT (default 1)
+	void	set_depth(unsigned depth)
+	{
+		m_depth = depth < 1 ? 1 : depth > MAX_INFLIGHT ? MAX_INFLIGHT : depth;
+	}
+
+	void	set_timeout(int ms) { m_timeout_ms = ms; }
+
+private:
+	friend class request;
+
+	static bool	matches(uint8_t req_cmd, const frame_view &f)
+	{
+		switch (req_cmd)
+		{
+			case PROTO_CMD_PING:
+				return f.cmd() == PROTO_CMD_PONG;
+			case PROTO_CMD_STATUS_REQ:
+				return f.cmd() == PROTO_CMD_STATUS_RESP;
+			default:
+				return f.cmd() == PROTO_CMD_ACK && f.payload().size() >= 1 && f.payload()[0] == req_cmd;
+		}
+	}
+
+	// same as sclient_decode()
+	static int	decode(const frame_view &f, struct fanctl_status *st)
+	{
+		std::span<const uint8_t>	p = f.payload();
+
+		if (f.cmd() == PROTO_CMD_PONG)
+			return 0;
+		if (f.cmd() == PROTO_CMD_STATUS_RESP)
+		{
+			if (p.size() < sizeof(status_resp_t))
+				return -EPROTO;
+			st->temp_x100 = (int16_t)((p[0] << 8) | p[1]);
+			st->humidity_x100 = (uint16_t)((p[2] << 8) | p[3]);
+			st->fan_mode = p[4];
+			st->fan_state = p[5];
+			st->errors = (uint16_t)((p[6] << 8) | p[7]);
+			return 0;
+		}
+		if (p.size() < 2)
+			return -EPROTO;
+		if (p[1] == PROTO_ERR_OK)
+			return 0;
+		if (p[1] == PROTO_ERR_INVALID_ARG)
+			return -EOPNOTSUPP;
+		if (p[1] == PROTO_ERR_STATE)
+			return -EBUSY;
+		return -EPROTO;
+	}
+
+	// false if r completed without waiting
+	bool	submit(request *r)
+	{
+		if (m_fd < 0)
+		{
+			r->m_reply.result = -EIO;
+			return false;
+		}
+		m_st.submitted++;
+		if (r->m_addr == PROTO_ADDR_BROADCAST) // never answered
+		{
+			r->m_reply.result = TX_BUF - m_tx_len < PROTO_MAX_FRAME ? -ENOBUFS : 0;
+			if (!r->m_reply.result)
+			{
+				queue_frame(r, 0);
+				m_st.completed++;
+				flush();
+			}
+			return false;
+		}
+		if (m_wait_head || !can_start())
+		{
+			m_st.waited++;
+			if (m_wait_tail)
+				m_wait_tail->m_next = r;
+			else
+				m_wait_head = r;
+			m_wait_tail = r;
+			return true;
+		}
+		start(r);
+		flush();
+		return true;
+	}
+
+	bool	can_start() const
+	{
+		return m_count < m_depth && TX_BUF - m_tx_len >= PROTO_MAX_FRAME;
+	}
+
+	void	queue_frame(request *r, uint8_t seq)
+	{
+		std::span<uint8_t, PROTO_MAX_FRAME>	out(&m_tx[m_tx_len], PROTO_MAX_FRAME);
+
+		if (m_tx_head && TX_BUF - m_tx_len < PROTO_MAX_FRAME)
+		{
+			std::memmove(m_tx.data(), &m_tx[m_tx_head], m_tx_len - m_tx_head);
+			m_tx_len -= m_tx_head;
+			m_tx_head = 0;
+			out = std::span<uint8_t, PROTO_MAX_FRAME>(&m_tx[m_tx_len], PROTO_MAX_FRAME);
+		}
+		m_tx_len += build_frame(out, r->m_addr, r->m_cmd, seq,
+				std::span<const uint8_t>(r->m_payload).first(r->m_len));
+		r->m_tx_ns = mono_ns();
+	}
+
+	void	start(request *r)
+	{
+		int	ms;
+
+		while (m_inflight[m_next_seq]) // at most MAX_INFLIGHT in use
+			m_next_seq++;
+		r->m_seq = m_next_seq++;
+		m_inflight[r->m_seq] = r;
+		if (++m_count > m_st.max_inflight)
+			m_st.max_inflight = m_count;
+		queue_frame(r, r->m_seq);
+		ms = r->m_timeout_ms > 0 ? r->m_timeout_ms : m_timeout_ms;
+		r->m_timer.deadline_ns = r->m_tx_ns + (uint64_t)ms * 1000000ULL;
+		r->m_timer.fire = [](detail::timer *t) {
+			request	*r = static_cast<request *>(t->ctx);
+
+			r->m_port.m_st.timeouts++;
+			r->m_port.complete(r, -ETIMEDOUT, nullptr);
+		};
+		m_ex.add_timer(&r->m_timer);
+	}
+
+	// start waiting requests while there is room
+	void	pump()
+	{
+		request	*r;
+
+		while (m_wait_head && can_start())
+		{
+			r = m_wait_head;
+			m_wait_head = r->m_next;
+			if (!m_wait_head)
+				m_wait_tail = nullptr;
+			r->m_next = nullptr;
+			start(r);
+		}
+		flush();
+	}
+
+	void	complete(request *r, int result, const frame_view *f)
+	{
+		m_inflight[r->m_seq] = nullptr;
+		m_count--;
+		m_st.completed++;
+		m_ex.cancel_timer(&r->m_timer);
+		r->m_reply.result = result;
+		r->m_reply.rtt_ns = mono_ns() - r->m_tx_ns;
+		if (!result && f)
+			r->m_reply.result = decode(*f, &r->m_reply.status);
+		if (m_fd >= 0)
+			pump(); // keep the wire busy before running the caller
+		r->m_waiter.resume();
+	}
+
+	void	fail_all(int result)
+	{
+		request	*r;
+
+		for (unsigned seq = 0; seq < m_inflight.size(); seq++)
+		{
+			if (m_inflight[seq])
+				complete(m_inflight[seq], result, nullptr);
+		}
+		while (m_wait_head)
+		{
+			r = m_wait_head;
+			m_wait_head = r->m_next;
+			if (!m_wait_head)
+				m_wait_tail = nullptr;
+			r->m_reply.result = result;
+			m_st.completed++;
+			r->m_waiter.resume();
+		}
+	}
+
+	void	fail(int result)
+	{
+		m_ex.remove(m_fd);
+		if (m_owned)
+			::close(m_fd);
+		m_fd = -1;
+		m_events = 0;
+		m_rx_len = 0;
+		m_tx_head = m_tx_len = 0;
+		fail_all(result);
+	}
+
+	void	flush()
+	{
+		ssize_t		n;
+		uint32_t	events;
+
+		while (m_fd >= 0 && m_tx_head < m_tx_len)
+		{
+			n = write(m_fd, &m_tx[m_tx_head], m_tx_len - m_tx_head);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0 && errno == EAGAIN)
+				break;
+			if (n <= 0)
+			{
+				fail(-EIO);
+				return;
+			}
+			m_tx_head += (size_t)n;
+			m_st.tx_bytes += (uint64_t)n;
+		}
+		if (m_fd < 0)
+			return;
+		if (m_tx_head == m_tx_len)
+			m_tx_head = m_tx_len = 0;
+		events = m_tx_len ? EPOLLIN | EPOLLOUT : EPOLLIN;
+		if (events != m_events && m_ex.modify(m_fd, events, this) == 0)
+			m_events = events;
+	}
+
+	void	dispatch(const frame_view &f)
+	{
+		request	*r;
+
+		m_st.rx_frames++;
+		r = m_inflight[f.seq()];
+		if (!r || r->m_addr != f.addr() || !matches(r->m_cmd, f))
+		{
+			m_st.stale++; // late reply to a timed-out request, or noise
+			return;
+		}
+		complete(r, 0, &f);
+	}
+
+	void	on_io(uint32_t events) override
+	{
+		frame_view	f;
+		ssize_t		n;
+		size_t		pos;
+		size_t		used;
+
+		if (events & EPOLLOUT)
+			flush();
+		while (m_fd >= 0 && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+		{
+			n = read(m_fd, &m_rx[m_rx_len], RX_BUF - m_rx_len);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0 && errno == EAGAIN)
+				break;
+			if (n <= 0)
+			{
+				fail(-EIO);
+				return;
+			}
+			m_st.rx_bytes += (uint64_t)n;
+			m_rx_len += (size_t)n;
+			// parse in place; a continuation may close the port
+			pos = 0;
+			while (m_fd >= 0)
+			{
+				f = scan_frame(std::span<const uint8_t>(m_rx).subspan(pos, m_rx_len - pos), &used);
+				pos += used;
+				if (f.empty())
+					break;
+				dispatch(f);
+			}
+			if (m_fd < 0)
+				return;
+			std::memmove(m_rx.data(), &m_rx[pos], m_rx_len - pos);
+			m_rx_len -= pos;
+		}
+	}
+
+	executor				&m_ex;
+	int					m_fd = -1;
+	bool					m_owned = false;
+	uint32_t				m_events = 0;
+	unsigned				m_depth = 1;
+	int					m_timeout_ms = DEFAULT_TIMEOUT_MS;
+	std::array<request *, 256>		m_inflight;
+	unsigned				m_count = 0;
+	uint8_t					m_next_seq = 0;
+	request					*m_wait_head = nullptr;
+	request					*m_wait_tail = nullptr;
+	std::array<uint8_t, RX_BUF>		m_rx;
+	size_t					m_rx_len = 0;
+	std::array<uint8_t, TX_BUF>		m_tx;
+	size_t					m_tx_head = 0;
+	size_t					m_tx_len = 0;
+	port_stats				m_st{};
+};
+
+inline bool	request::await_suspend(std::coroutine_handle<> h)
+{
+	m_waiter = h;
+	return m_port.submit(this);
+}
+
+/* Nodes -------------------------------------------------------------------- */
+
+/* One address on a port; cheap to copy. timeout_ms 0: the port's. */
+class node
+{
+public:
+	node(port &p, uint8_t addr = PROTO_ADDR_NONE) : m_port(&p), m_addr(addr) {}
+
+	uint8_t	addr() const { return m_addr; }
+
+	request	ping(int timeout_ms = 0) const { return req(PROTO_CMD_PING, {}, timeout_ms); }
+	request	status(int timeout_ms = 0) const { return req(PROTO_CMD_STATUS_REQ, {}, timeout_ms); }
+
+	request	set_fan_mode(proto_fan_mode_t mode, int timeout_ms = 0) const
+	{
+		uint8_t	arg = (uint8_t)mode;
+
+		return req(PROTO_CMD_SET_FAN_MODE, std::span<const uint8_t>(&arg, 1), timeout_ms);
+	}
+
+	request	set_fan_state(proto_fan_state_t state, int timeout_ms = 0) const
+	{
+		uint8_t	arg = (uint8_t)state;
+
+		return req(PROTO_CMD_SET_FAN_STATE, std::span<const uint8_t>(&arg, 1), timeout_ms);
+	}
+
+	request	set_threshold(int16_t temp_x100, int timeout_ms = 0) const
+	{
+		uint8_t	arg[2] = { (uint8_t)((uint16_t)temp_x100 >> 8), (uint8_t)temp_x100 };
+
+		return req(PROTO_CMD_SET_THRESHOLD, arg, timeout_ms);
+	}
+
+private:
+	request	req(uint8_t cmd, std::span<const uint8_t> payload, int timeout_ms) const
+	{
+		return request(*m_port, m_addr, cmd, payload, timeout_ms);
+	}
+
+	port	*m_port;
+	uint8_t	m_addr;
+};
+
+}
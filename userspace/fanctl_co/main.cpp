@@ -0,0 +1,265 @@
+/*
+ * fanctl_co
+ * ---------
+ * Poll many nodes on raw ttys from one thread, with the coroutine
+ * client (fanctl_co.hpp): one task per node, each awaiting its own
+ * requests.
+ *
+ *   fanctl_co [-a addrs] [-n rounds] [-i interval_ms] [-p depth]
+ *             [-t timeout_ms] <ping|status> tty...
+ *
+ * -a   node addresses on each tty, e.g. 1-8,12; 0 is unaddressed
+ *      (default 0)
+ * -n   requests per node (default 1)
+ * -i   pause between the requests of a node in ms (default 0)
+ * -p   requests in flight per tty, 1..255 (default 1); keep 1 on a
+ *      half-duplex RS-485 bus
+ * -t   request timeout in ms (default 1000)
+ *
+ * Prints one row per node and a summary on stderr. Exit status is 1
+ * when any request failed.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <getopt.h>
+
+#include "fanctl_co.hpp"
+
+#define ADDR_NR	256
+
+typedef struct {
+	const char	*dev;
+	fanctl::node	node;
+	unsigned	ok;
+	unsigned	failed;
+	int		last_err;
+	uint64_t	rtt_sum_ns;
+	uint64_t	rtt_max_ns;
+	bool		have_status;
+	fanctl_status	status;
+}	target_t;
+
+typedef struct {
+	bool		ping;
+	unsigned	rounds;
+	unsigned	interval_ms;
+}	opts_t;
+
+static fanctl::task<void>	poll_node(fanctl::executor &ex, target_t *t, const opts_t *o)
+{
+	fanctl::reply	r;
+
+	for (unsigned i = 0; i < o->rounds; i++)
+	{
+		if (i && o->interval_ms)
+			co_await ex.sleep((int)o->interval_ms);
+		if (o->ping)
+			r = co_await t->node.ping();
+		else
+			r = co_await t->node.status();
+		if (r.result)
+		{
+			t->failed++;
+			t->last_err = r.result;
+			continue;
+		}
+		t->ok++;
+		t->rtt_sum_ns += r.rtt_ns;
+		if (r.rtt_ns > t->rtt_max_ns)
+			t->rtt_max_ns = r.rtt_ns;
+		if (!o->ping)
+		{
+			t->status = r.status;
+			t->have_status = true;
+		}
+	}
+}
+
+static bool	parse_uint(const char *s, unsigned lo, unsigned hi, unsigned *out)
+{
+	unsigned long	v;
+	char		*endp;
+
+	errno = 0;
+	v = strtoul(s, &endp, 0);
+	if (endp == s || *endp || errno || v < lo || v > hi)
+	{
+		fprintf(stderr, "invalid value '%s' (%u..%u)\n", s, lo, hi);
+		return false;
+	}
+	*out = (unsigned)v;
+	return true;
+}
+
+static bool	parse_addrs(const char *str, std::vector<uint8_t> &addrs)
+{
+	bool		seen[ADDR_NR];
+	unsigned long	lo;
+	unsigned long	hi;
+	const char	*p;
+	char		*endp;
+
+	memset(seen, 0, sizeof(seen));
+	addrs.clear();
+	p = str;
+	for (;;)
+	{
+		errno = 0;
+		lo = strtoul(p, &endp, 0);
+		if (endp == p || errno)
+			break;
+		hi = lo;
+		if (*endp == '-')
+		{
+			p = endp + 1;
+			hi = strtoul(p, &endp, 0);
+			if (endp == p || errno)
+				break;
+		}
+		if (lo > hi || hi >= PROTO_ADDR_BROADCAST)
+			break;
+		for (unsigned long a = lo; a <= hi; a++)
+		{
+			if (!seen[a])
+				addrs.push_back((uint8_t)a);
+			seen[a] = true;
+		}
+		if (!*endp)
+			return true;
+		if (*endp != ',')
+			break;
+		p = endp + 1;
+	}
+	fprintf(stderr, "invalid address list '%s'\n", str);
+	return false;
+}
+
+static void	print_row(const target_t *t)
+{
+	char	addr[8];
+
+	if (t->node.addr() == PROTO_ADDR_NONE)
+		snprintf(addr, sizeof(addr), "-");
+	else
+		snprintf(addr, sizeof(addr), "%u", t->node.addr());
+	printf("%-12s %-5s %6u %6u", t->dev, addr, t->ok, t->failed);
+	if (t->ok)
+		printf(" %10.3f %10.3f", t->rtt_sum_ns / 1e6 / t->ok, t->rtt_max_ns / 1e6);
+	else
+		printf(" %10s %10s", "-", "-");
+	if (t->have_status)
+		printf(" %8.2f %8.2f  %-6s  %s", t->status.temp_x100 / 100.0,
+			t->status.humidity_x100 / 100.0,
+			t->status.fan_mode == PROTO_FAN_MODE_MANUAL ? "MANUAL" : "AUTO",
+			t->status.fan_state == PROTO_FAN_STATE_ON ? "ON" : "OFF");
+	if (t->failed)
+		printf("  %s", strerror(-t->last_err));
+	printf("\n");
+}
+
+static void	usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-a addrs] [-n rounds] [-i interval_ms] [-p depth]\n"
+		"       [-t timeout_ms] <ping|status> tty...\n", prog);
+}
+
+int	main(int argc, char **argv)
+{
+	std::vector<std::unique_ptr<fanctl::port>>	ports;
+	std::vector<target_t>				targets;
+	std::vector<uint8_t>				addrs{ PROTO_ADDR_NONE };
+	fanctl::executor				ex;
+	opts_t						o{ false, 1, 0 };
+	unsigned					depth;
+	unsigned					timeout_ms;
+	unsigned					requests;
+	unsigned					max_inflight;
+	bool						failed;
+	uint64_t					t0;
+	double						ms;
+	int						c;
+	int						ret;
+
+	depth = 1;
+	timeout_ms = fanctl::DEFAULT_TIMEOUT_MS;
+	while ((c = getopt(argc, argv, "a:n:i:p:t:")) != -1)
+	{
+		if (c == 'a' && !parse_addrs(optarg, addrs))
+			return 1;
+		else if (c == 'n' && !parse_uint(optarg, 1, 1000000, &o.rounds))
+			return 1;
+		else if (c == 'i' && !parse_uint(optarg, 0, 3600000, &o.interval_ms))
+			return 1;
+		else if (c == 'p' && !parse_uint(optarg, 1, fanctl::MAX_INFLIGHT, &depth))
+			return 1;
+		else if (c == 't' && !parse_uint(optarg, 1, 60000, &timeout_ms))
+			return 1;
+		else if (c == '?')
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (argc - optind < 2 || (strcmp(argv[optind], "ping") && strcmp(argv[optind], "status")))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if (!ex.ok())
+	{
+		perror("epoll");
+		return 1;
+	}
+	o.ping = !strcmp(argv[optind], "ping");
+	for (int i = optind + 1; i < argc; i++)
+	{
+		ports.push_back(std::make_unique<fanctl::port>(ex));
+		ret = ports.back()->open(argv[i]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(-ret));
+			return 1;
+		}
+		ports.back()->set_depth(depth);
+		ports.back()->set_timeout((int)timeout_ms);
+		for (uint8_t a : addrs)
+			targets.push_back(target_t{ argv[i], fanctl::node(*ports.back(), a), 0, 0, 0, 0, 0, false, {} });
+	}
+
+	t0 = fanctl::mono_ns();
+	for (target_t &t : targets)
+		ex.spawn(poll_node(ex, &t, &o));
+	ret = ex.run();
+	if (ret < 0)
+	{
+		fprintf(stderr, "epoll_wait: %s\n", strerror(-ret));
+		return 1;
+	}
+	ms = (fanctl::mono_ns() - t0) / 1e6;
+
+	printf("%-12s %-5s %6s %6s %10s %10s %8s %8s  %-6s  %s\n", "DEVICE", "ADDR", "OK",
+		"FAILED", "RTT_MS", "MAX_MS", "TEMP_C", "HUMID_%", "MODE", "STATE");
+	failed = false;
+	for (const target_t &t : targets)
+	{
+		print_row(&t);
+		failed |= t.failed != 0;
+	}
+	requests = 0;
+	max_inflight = 0;
+	for (const std::unique_ptr<fanctl::port> &p : ports)
+	{
+		requests += (unsigned)p->stats().completed;
+		if (p->stats().max_inflight > max_inflight)
+			max_inflight = p->stats().max_inflight;
+	}
+	fflush(stdout);
+	fprintf(stderr, "%u requests to %zu nodes on %zu ttys in %.1f ms (%.0f/s), up to %u in flight per tty\n",
+		requests, targets.size(), ports.size(), ms, ms > 0 ? requests * 1000.0 / ms : 0.0, max_inflight);
+	return failed;
+}
@@ -0,0 +1,753 @@
+/*
+ * fanctl_fleet
+ * ------------
+ * Run one command on every fan node reachable from this host at once
+ * and print the results as one table.
+ *
+ *   fanctl_fleet [-d dev]... [-a addrs] [-t timeout_ms] [-r retries]
+ *                [-p depth] [-j max_open]
+ *                <ping|status|auto|manual|on|off|threshold <tempC>>
+ *
+ * -d   device to query, a fanctl chardev or a raw tty; repeatable.
+ *      Default: every /dev/fanctl*, /dev/ttyFAN*, /dev/ttyUSB* and
+ *      /dev/ttyACM*, once per real path
+ * -a   node addresses on each device, e.g. 1-8,12; 0 is unaddressed
+ *      (default 0)
+ * -t   request timeout on a raw tty in ms (default 1000; the driver
+ *      applies its own)
+ * -r   retries of a request that timed out (default 0)
+ * -p   requests in flight per raw tty, 1..32 (default 1)
+ * -j   devices open at once (default 64)
+ *
+ * Each device is opened through libfanctl, or through fanctld when it
+ * serves that device, and all of them are driven from one epoll loop:
+ * a sweep takes about one RTT plus one timeout, whatever the number of
+ * devices. The nodes of one bus are asked one at a time unless -p is
+ * given; on a half-duplex RS-485 bus, pipelined replies collide.
+ *
+ * Ttys with a line discipline attached are not probed: the driver owns
+ * them and they are reached through its chardev.
+ *
+ * Exit status is 1 when any target failed.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+#include "proto.h"
+#include "libfanctl.h"
+#include "client.h"
+#include "util.h"
+
+#define MAX_DEPTH	32
+#define MAX_EVENTS	64
+#define ADDR_NR		256
+
+#define VIA_TTY		0
+#define VIA_DEV		1
+#define VIA_DAEMON	2
+
+typedef struct {
+	int			result; // 0 or -errno
+	bool			done;
+	uint8_t			addr;
+	uint8_t			via; // VIA_*
+	struct fanctl_status	status; // STATUS
+	uint64_t		rtt_ns; // 0: not measured
+}	row_t;
+
+typedef struct fleet	fleet_t;
+
+typedef struct {
+	fanctl_req_t	req;
+	fleet_t		*fl;
+	row_t		*row; // NULL: free
+	unsigned	dev;
+	unsigned	tries;
+	uint32_t	tag; // through fanctld
+	uint64_t	deadline_ns; // through fanctld
+}	slot_t;
+
+typedef struct {
+	char		path[PATH_MAX]; // as given or found
+	char		real[PATH_MAX]; // to skip duplicates
+	int		kind; // FANCTL_TR_*
+	fanctl_t	*h;
+	int		dfd; // fanctld connection, -1: the device itself
+	row_t		*rows; // one per address
+	size_t		next; // next address to ask
+	unsigned	busy; // slots in flight
+	bool		open;
+	bool		finished;
+	slot_t		slots[MAX_DEPTH];
+}	fdev_t;
+
+struct fleet {
+	fdev_t		*devs;
+	size_t		ndevs;
+	uint8_t		addrs[ADDR_NR];
+	size_t		naddrs;
+	uint8_t		op;
+	int16_t		arg;
+	int		timeout_ms;
+	unsigned	retries;
+	unsigned	depth;
+	unsigned	max_open;
+	int		epfd;
+	size_t		next_dev; // next device to open
+	unsigned	nopen;
+	size_t		left; // devices not finished
+	uint32_t	tags;
+};
+
+static uint64_t	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Devices ------------------------------------------------------------------ */
+
+/* Transport for a device, -EBUSY when a line discipline owns the tty */
+static int	dev_kind(const char *path)
+{
+	int	fd;
+	int	ldisc;
+	int	kind;
+
+	fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	kind = FANCTL_TR_IOCTL;
+	if (isatty(fd))
+	{
+		kind = FANCTL_TR_SERIAL;
+		if (ioctl(fd, TIOCGETD, &ldisc) == 0 && ldisc != N_TTY)
+			kind = -EBUSY;
+	}
+	close(fd);
+	return kind;
+}
+
+static bool	dev_add(fleet_t *fl, const char *path, bool discovered)
+{
+	char	real[PATH_MAX];
+	fdev_t	*d;
+	size_t	i;
+
+	if (!realpath(path, real))
+	{
+		if (discovered)
+			return true;
+		snprintf(real, sizeof(real), "%s", path); // reported as failed
+	}
+	for (i = 0; i < fl->ndevs; i++)
+	{
+		if (!strcmp(fl->devs[i].real, real))
+			return true;
+	}
+	if (discovered && dev_kind(real) == -EBUSY)
+		return true;
+	d = realloc(fl->devs, (fl->ndevs + 1) * sizeof(*d));
+	if (!d)
+	{
+		perror("realloc");
+		return false;
+	}
+	fl->devs = d;
+	d = &fl->devs[fl->ndevs++];
+	memset(d, 0, sizeof(*d));
+	snprintf(d->path, sizeof(d->path), "%s", path);
+	snprintf(d->real, sizeof(d->real), "%s", real);
+	d->dfd = -1;
+	return true;
+}
+
+static bool	discover(fleet_t *fl)
+{
+	static const char	*patterns[] = {
+		"/dev/fanctl*", "/dev/ttyFAN*", "/dev/ttyUSB*", "/dev/ttyACM*",
+	};
+	glob_t			g;
+	size_t			i;
+	size_t			j;
+	bool			ok;
+
+	ok = true;
+	for (i = 0; i < sizeof(patterns) / sizeof(patterns[0]) && ok; i++)
+	{
+		if (glob(patterns[i], 0, NULL, &g) != 0)
+			continue;
+		for (j = 0; j < g.gl_pathc && ok; j++)
+			ok = dev_add(fl, g.gl_pathv[j], true);
+		globfree(&g);
+	}
+	return ok;
+}
+
+/* Requests ----------------------------------------------------------------- */
+
+static void	dev_fill(fleet_t *fl, fdev_t *d);
+
+static void	slot_done(slot_t *s, int result, const struct fanctl_status *st,
+			const struct fanctl_times *t);
+
+static void	on_req_done(fanctl_req_t *r)
+{
+	slot_t	*s;
+
+	s = r->user;
+	slot_done(s, r->result, &r->status, &r->times);
+}
+
+static void	slot_issue(slot_t *s)
+{
+	struct fanctld_req	req;
+	fdev_t			*d;
+	int			ret;
+
+	d = &s->fl->devs[s->dev];
+	s->tries++;
+	if (d->dfd >= 0)
+	{
+		memset(&req, 0, sizeof(req));
+		req.version = FANCTLD_VERSION;
+		req.op = s->fl->op;
+		req.addr = s->row->addr;
+		req.arg = s->fl->arg;
+		req.flags = FANCTLD_F_FRESH; // a sweep asks the node, not the cache
+		s->tag = ++s->fl->tags;
+		req.tag = s->tag;
+		s->deadline_ns = mono_ns() + FANCTLD_CALL_TIMEOUT_MS * 1000000ULL;
+		if (fanctld_send(d->dfd, &req) < 0)
+			slot_done(s, -errno, NULL, NULL);
+		return;
+	}
+	memset(&s->req, 0, sizeof(s->req));
+	s->req.op = s->fl->op;
+	s->req.addr = s->row->addr;
+	s->req.arg = s->fl->arg;
+	s->req.timeout_ms = s->fl->timeout_ms;
+	s->req.cb = on_req_done;
+	s->req.user = s;
+	ret = fanctl_submit(d->h, &s->req);
+	if (ret < 0)
+		slot_done(s, ret, NULL, NULL);
+}
+
+static void	slot_done(slot_t *s, int result, const struct fanctl_status *st,
+			const struct fanctl_times *t)
+{
+	fdev_t	*d;
+	row_t	*row;
+
+	if (result == -ETIMEDOUT && s->tries <= s->fl->retries)
+	{
+		slot_issue(s);
+		return;
+	}
+	d = &s->fl->devs[s->dev];
+	row = s->row;
+	row->result = result;
+	row->done = true;
+	if (result == 0 && st)
+		row->status = *st;
+	if (result == 0 && t && t->rx_ns > t->tx_ns && t->tx_ns)
+		row->rtt_ns = t->rx_ns - t->tx_ns;
+	s->row = NULL;
+	d->busy--;
+	dev_fill(s->fl, d);
+}
+
+/* Keep up to depth requests in flight on a device */
+static void	dev_fill(fleet_t *fl, fdev_t *d)
+{
+	unsigned	i;
+	slot_t		*s;
+
+	for (i = 0; i < fl->depth && d->next < fl->naddrs; i++)
+	{
+		s = &d->slots[i];
+		if (s->row)
+			continue;
+		s->fl = fl;
+		s->dev = (unsigned)(d - fl->devs);
+		s->row = &d->rows[d->next++];
+		s->tries = 0;
+		d->busy++;
+		slot_issue(s);
+	}
+	if (!d->busy && d->next == fl->naddrs)
+		d->finished = true; // closed by the loop, not from a callback
+}
+
+/* Fail whatever is left on a device, e.g. it could not be opened */
+static void	dev_fail(fleet_t *fl, fdev_t *d, int result)
+{
+	unsigned	i;
+
+	while (d->next < fl->naddrs)
+	{
+		d->rows[d->next].result = result;
+		d->rows[d->next++].done = true;
+	}
+	for (i = 0; i < MAX_DEPTH; i++)
+	{
+		if (d->slots[i].row)
+		{
+			d->slots[i].tries = fl->retries + 1;
+			slot_done(&d->slots[i], result, NULL, NULL);
+		}
+	}
+	d->finished = true;
+}
+
+static void	dev_start(fleet_t *fl, fdev_t *d)
+{
+	struct epoll_event	ev;
+	size_t			i;
+	int			fd;
+
+	for (i = 0; i < fl->naddrs; i++)
+		d->rows[i].addr = fl->addrs[i];
+	d->open = true;
+	fl->nopen++;
+	d->kind = dev_kind(d->path);
+	if (d->kind < 0)
+	{
+		dev_fail(fl, d, d->kind);
+		return;
+	}
+	d->dfd = fanctld_open_for((uint8_t)d->kind, d->path);
+	if (d->dfd < 0)
+	{
+		d->h = fanctl_open(d->path, d->kind);
+		if (!d->h)
+		{
+			dev_fail(fl, d, -errno);
+			return;
+		}
+	}
+	for (i = 0; i < fl->naddrs; i++)
+	{
+		if (d->dfd >= 0)
+			d->rows[i].via = VIA_DAEMON;
+		else
+			d->rows[i].via = d->kind == FANCTL_TR_SERIAL ? VIA_TTY : VIA_DEV;
+	}
+	fd = d->dfd >= 0 ? d->dfd : fanctl_fd(d->h);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = (uint32_t)(d - fl->devs);
+	if (epoll_ctl(fl->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		dev_fail(fl, d, -errno);
+		return;
+	}
+	dev_fill(fl, d);
+}
+
+static void	dev_close(fleet_t *fl, fdev_t *d)
+{
+	if (d->dfd >= 0)
+		close(d->dfd); // also leaves the epoll set
+	fanctl_close(d->h);
+	d->dfd = -1;
+	d->h = NULL;
+	d->open = false;
+	fl->nopen--;
+	fl->left--;
+}
+
+/* Responses from fanctld, matched to the slots by tag */
+static void	daemon_read(fleet_t *fl, fdev_t *d)
+{
+	struct fanctld_resp	resp;
+	unsigned		i;
+	ssize_t			n;
+
+	for (;;)
+	{
+		n = fanctld_recv(d->dfd, &resp, sizeof(resp), 0);
+		if (n < 0)
+		{
+			if (errno != ETIMEDOUT)
+				dev_fail(fl, d, -errno);
+			return;
+		}
+		if ((size_t)n < sizeof(resp))
+			continue;
+		for (i = 0; i < fl->depth; i++)
+		{
+			if (d->slots[i].row && d->slots[i].tag == resp.tag)
+			{
+				slot_done(&d->slots[i], resp.result, &resp.status, &resp.times);
+				break;
+			}
+		}
+	}
+}
+
+/* Expire fanctld requests; ms until the next deadline, -1 none */
+static int	daemon_expire(fleet_t *fl)
+{
+	uint64_t	now;
+	uint64_t	next;
+	size_t		i;
+	unsigned	j;
+	slot_t		*s;
+
+	now = mono_ns();
+	next = 0;
+	for (i = 0; i < fl->ndevs; i++)
+	{
+		if (!fl->devs[i].open || fl->devs[i].dfd < 0)
+			continue;
+		for (j = 0; j < fl->depth; j++)
+		{
+			s = &fl->devs[i].slots[j];
+			if (!s->row)
+				continue;
+			if (s->deadline_ns <= now)
+				slot_done(s, -ETIMEDOUT, NULL, NULL);
+			else if (!next || s->deadline_ns < next)
+				next = s->deadline_ns;
+		}
+	}
+	if (!next)
+		return -1;
+	return (int)((next - now + 999999) / 1000000);
+}
+
+/* Sweep ------------------------------------------------------------------- */
+
+static bool	sweep(fleet_t *fl)
+{
+	struct epoll_event	ev[MAX_EVENTS];
+	fdev_t			*d;
+	int			timeout;
+	int			ret;
+	int			n;
+	int			i;
+	size_t			k;
+
+	fl->left = fl->ndevs;
+	while (fl->left)
+	{
+		while (fl->nopen < fl->max_open && fl->next_dev < fl->ndevs)
+			dev_start(fl, &fl->devs[fl->next_dev++]);
+		timeout = daemon_expire(fl);
+		for (k = 0; k < fl->ndevs; k++)
+		{
+			if (fl->devs[k].open && fl->devs[k].finished)
+				dev_close(fl, &fl->devs[k]);
+		}
+		if (!fl->left || (fl->nopen < fl->max_open && fl->next_dev < fl->ndevs))
+			continue;
+		n = epoll_wait(fl->epfd, ev, MAX_EVENTS, timeout);
+		if (n < 0 && errno != EINTR)
+		{
+			perror("epoll_wait");
+			return false;
+		}
+		for (i = 0; i < n; i++)
+		{
+			d = &fl->devs[ev[i].data.u32];
+			if (!d->open || d->finished)
+				continue;
+			if (d->dfd >= 0)
+			{
+				daemon_read(fl, d);
+				continue;
+			}
+			ret = fanctl_run(d->h, 0);
+			if (ret < 0)
+				dev_fail(fl, d, ret);
+		}
+	}
+	return true;
+}
+
+/* Output ------------------------------------------------------------------- */
+
+static const char	*result_str(int result)
+{
+	switch (result)
+	{
+		case 0:
+			return "ok";
+		case -ETIMEDOUT:
+			return "timeout";
+		case -EOPNOTSUPP:
+			return "invalid-arg";
+		case -EBUSY:
+			return "state";
+		case -ENOLINK:
+			return "no-link";
+	}
+	return strerrorname_np(-result) ? strerrorname_np(-result) : "error";
+}
+
+static void	print_table(const fleet_t *fl)
+{
+	static const char	*via[] = { "tty", "dev", "fanctld" };
+	const fdev_t		*d;
+	const row_t		*r;
+	const char		*mode;
+	const char		*state;
+	char			addr[8];
+	int			w;
+	size_t			i;
+	size_t			j;
+
+	w = (int)strlen("DEVICE");
+	for (i = 0; i < fl->ndevs; i++)
+	{
+		if ((int)strlen(fl->devs[i].path) > w)
+			w = (int)strlen(fl->devs[i].path);
+	}
+	printf("%-*s  %-4s  %-7s  %-11s  %8s  %7s  %7s  %-6s  %-5s  %s\n", w, "DEVICE",
+		"ADDR", "VIA", "RESULT", "RTT_MS", "TEMP_C", "HUMID_%", "MODE", "STATE", "ERRORS");
+	for (i = 0; i < fl->ndevs; i++)
+	{
+		d = &fl->devs[i];
+		for (j = 0; j < fl->naddrs; j++)
+		{
+			r = &d->rows[j];
+			if (r->addr == FANCTL_ADDR_NONE)
+				snprintf(addr, sizeof(addr), "-");
+			else
+				snprintf(addr, sizeof(addr), "%u", r->addr);
+			printf("%-*s  %-4s  %-7s  %-11s  ", w, d->path, addr,
+				d->kind < 0 ? "-" : via[r->via], result_str(r->result));
+			if (r->rtt_ns)
+				printf("%8.3f  ", (double)r->rtt_ns / 1e6);
+			else
+				printf("%8s  ", "-");
+			if (r->result || fl->op != FANCTL_OP_STATUS)
+			{
+				printf("%7s  %7s  %-6s  %-5s  %s\n", "-", "-", "-", "-", "-");
+				continue;
+			}
+			mode = r->status.fan_mode == PROTO_FAN_MODE_AUTO ? "AUTO"
+				: r->status.fan_mode == PROTO_FAN_MODE_MANUAL ? "MANUAL" : "?";
+			state = r->status.fan_state == PROTO_FAN_STATE_ON ? "ON"
+				: r->status.fan_state == PROTO_FAN_STATE_OFF ? "OFF" : "?";
+			printf("%7.2f  %7.2f  %-6s  %-5s  0x%04x\n", (double)r->status.temp_x100 / 100.0,
+				(double)r->status.humidity_x100 / 100.0, mode, state, r->status.errors);
+		}
+	}
+}
+
+/* Arguments ---------------------------------------------------------------- */
+
+static void	usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-d dev]... [-a addrs] [-t timeout_ms] [-r retries] [-p depth] [-j max_open]\n"
+		"       <ping|status|auto|manual|on|off|threshold <tempC>>\n", prog);
+}
+
+/* Address list such as 0,1-8,12 */
+static bool	parse_addrs(fleet_t *fl, const char *str)
+{
+	bool		seen[ADDR_NR];
+	unsigned long	lo;
+	unsigned long	hi;
+	unsigned long	a;
+	const char	*p;
+	char		*endp;
+
+	memset(seen, 0, sizeof(seen));
+	fl->naddrs = 0;
+	p = str;
+	for (;;)
+	{
+		errno = 0;
+		lo = strtoul(p, &endp, 0);
+		if (endp == p || errno)
+			break;
+		hi = lo;
+		if (*endp == '-')
+		{
+			p = endp + 1;
+			hi = strtoul(p, &endp, 0);
+			if (endp == p || errno)
+				break;
+		}
+		if (lo > hi || hi >= ADDR_NR)
+			break;
+		for (a = lo; a <= hi; a++)
+		{
+			if (!seen[a])
+				fl->addrs[fl->naddrs++] = (uint8_t)a;
+			seen[a] = true;
+		}
+		if (*endp == '\0')
+			return true;
+		if (*endp != ',')
+			break;
+		p = endp + 1;
+	}
+	fprintf(stderr, "wrong address list: %s\n", str);
+	return false;
+}
+
+static bool	parse_uint(const char *str, unsigned min, unsigned max, unsigned *out)
+{
+	unsigned long	v;
+	char		*endp;
+
+	errno = 0;
+	v = strtoul(str, &endp, 0);
+	if (endp == str || *endp != '\0' || errno || v < min || v > max)
+	{
+		fprintf(stderr, "wrong value: %s (%u..%u)\n", str, min, max);
+		return false;
+	}
+	*out = (unsigned)v;
+	return true;
+}
+
+static bool	parse_cmd(fleet_t *fl, int argc, char **argv)
+{
+	const char	*cmd;
+	float		temp;
+	int		err;
+
+	cmd = argv[0];
+	if (!strcmp(cmd, "threshold"))
+	{
+		if (argc != 2)
+			return false;
+		temp = parse_temp_str(argv[1], &err);
+		if (err == PARSE_TEMP_ERR_FORMAT)
+			fprintf(stderr, "Wrong number format\n");
+		else if (err == PARSE_TEMP_ERR_RANGE)
+			fprintf(stderr, "Available threshold: -40°C <= temp <= 80°C\n");
+		fl->op = FANCTL_OP_SET_THRESHOLD;
+		fl->arg = (int16_t)(temp * 100.0f);
+		return err == PARSE_TEMP_ERR_OK;
+	}
+	if (argc != 1)
+		return false;
+	if (!strcmp(cmd, "ping"))
+		fl->op = FANCTL_OP_PING;
+	else if (!strcmp(cmd, "status"))
+		fl->op = FANCTL_OP_STATUS;
+	else if (!strcmp(cmd, "auto") || !strcmp(cmd, "manual"))
+	{
+		fl->op = FANCTL_OP_SET_FAN_MODE;
+		fl->arg = !strcmp(cmd, "auto") ? PROTO_FAN_MODE_AUTO : PROTO_FAN_MODE_MANUAL;
+	}
+	else if (!strcmp(cmd, "on") || !strcmp(cmd, "off"))
+	{
+		fl->op = FANCTL_OP_SET_FAN_STATE;
+		fl->arg = !strcmp(cmd, "on") ? PROTO_FAN_STATE_ON : PROTO_FAN_STATE_OFF;
+	}
+	else
+		return false;
+	return true;
+}
+
+int	main(int argc, char **argv)
+{
+	fleet_t		fl;
+	uint64_t	t0;
+	unsigned	v;
+	unsigned	ok;
+	unsigned	failed;
+	size_t		i;
+	size_t		j;
+	int		c;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.naddrs = 1; // addrs[0] = FANCTL_ADDR_NONE
+	fl.timeout_ms = FANCTL_TIMEOUT_MS;
+	fl.depth = 1;
+	fl.max_open = 64;
+	while ((c = getopt(argc, argv, "+d:a:t:r:p:j:")) != -1)
+	{
+		if (c == 'd' && !dev_add(&fl, optarg, false))
+			return 1;
+		else if (c == 'a' && !parse_addrs(&fl, optarg))
+			return 1;
+		else if (c == 't' && !parse_uint(optarg, 1, 60000, &v))
+			return 1;
+		else if (c == 'r' && !parse_uint(optarg, 0, 100, &fl.retries))
+			return 1;
+		else if (c == 'p' && !parse_uint(optarg, 1, MAX_DEPTH, &fl.depth))
+			return 1;
+		else if (c == 'j' && !parse_uint(optarg, 1, 4096, &fl.max_open))
+			return 1;
+		else if (c == '?')
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		if (c == 't')
+			fl.timeout_ms = (int)v;
+	}
+	if (optind >= argc || !parse_cmd(&fl, argc - optind, argv + optind))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if (!fl.ndevs && !discover(&fl))
+		return 1;
+	if (!fl.ndevs)
+	{
+		fprintf(stderr, "no devices found\n");
+		return 1;
+	}
+	for (i = 0; i < fl.ndevs; i++)
+	{
+		fl.devs[i].rows = calloc(fl.naddrs, sizeof(row_t));
+		if (!fl.devs[i].rows)
+		{
+			perror("calloc");
+			return 1;
+		}
+	}
+	fl.epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (fl.epfd < 0)
+	{
+		perror("epoll_create1");
+		return 1;
+	}
+
+	t0 = mono_ns();
+	if (!sweep(&fl))
+		return 1;
+	print_table(&fl);
+	ok = 0;
+	failed = 0;
+	for (i = 0; i < fl.ndevs; i++)
+	{
+		for (j = 0; j < fl.naddrs; j++)
+		{
+			if (fl.devs[i].rows[j].result == 0)
+				ok++;
+			else
+				failed++;
+		}
+		free(fl.devs[i].rows);
+	}
+	fprintf(stderr, "%zu targets on %zu devices: %u ok, %u failed in %.1f ms\n",
+		fl.ndevs * fl.naddrs, fl.ndevs, ok, failed, (double)(mono_ns() - t0) / 1e6);
+	free(fl.devs);
+	close(fl.epfd);
+	return failed ? 1 : 0;
+}
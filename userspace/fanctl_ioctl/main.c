@@ -1,7 +1,28 @@
 /*
  * fanctl - Userspace CLI
  * ----------------------
- * A minimal ioctl-based CLI wrapper for `/dev/fanctl`.
+ * A minimal ioctl-based CLI wrapper for `/dev/fanctl`. Node commands
+ * go through libfanctl (userspace/libfanctl).
+ *
+ * When fanctld serves /dev/fanctl, node commands go through the daemon
+ * (cached status, shared connection); qstats, link and bench always use
+ * the device directly.
+ *
+ * `batch [-p depth] [script]` runs a script (fanctl_cli/batch.h, stdin
+ * by default) with the device opened once. The driver has one request on
+ * the wire, so commands run in order; through fanctld up to `depth`
+ * (default 8) are sent at once and matched back by tag.
+ *
+ * `watch [-i interval_ms] [-n count] [-f csv|json|bin] [-B] [-S dir]`
+ * writes one status record per interval to stdout (fanctl_cli/watch.h),
+ * or appends it to the fanstore history in `dir`. On the device, link
+ * state changes (POLLPRI) are written as `link` records in between;
+ * fanctld does not forward them.
+ *
+ * `bench [-n count] [-r rate] [-c concurrency] [-o ops] [-T tempC] [-j]`
+ * times `count` requests of each type around the ioctl() call, one open
+ * file per concurrent request, and prints latency percentiles and ops/s
+ * (fanctl_cli/bench.h).
  */
 
 #include <stdio.h>
@@ -12,128 +33,486 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
+#include <poll.h>
 
 #include "fanctl_uapi.h"
+#include "libfanctl.h"
+#include "client.h"
+#include "batch.h"
+#include "watch.h"
+#include "bench.h"
 
-static int open_dev(const char *path)
+static int	g_dfd = -1; // fanctld connection, -1: use the device
+static fanctl_t	*g_h; // the device, when not through fanctld
+static uint8_t	g_addr = FANCTL_ADDR_NONE; // node for node commands
+
+/* CLOCK_MONOTONIC in ns, same clock as the driver's ktime_get() */
+static uint64_t mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* One node request, through fanctld or on the device; fails like an ioctl (errno set) */
+static int node_req(uint8_t op, int16_t arg, struct fanctl_status *st, struct fanctl_times *t)
 {
-	int	fd;
-	
-	fd = open(path, O_RDWR);
-	if (fd < 0)
+	struct fanctld_req	req;
+	struct fanctld_resp	resp;
+	int			ret;
+
+	if (g_dfd < 0)
 	{
-		perror("open");
+		ret = fanctl_call(g_h, op, g_addr, arg, st, t);
+		errno = -ret;
+		return ret < 0 ? -1 : 0;
 	}
-	return fd;
+	memset(&req, 0, sizeof(req));
+	req.version = FANCTLD_VERSION;
+	req.op = op;
+	req.addr = g_addr;
+	req.arg = arg;
+	req.tag = op;
+	if (fanctld_call(g_dfd, &req, &resp, sizeof(resp)) < 0)
+		return -1;
+	if (resp.result)
+	{
+		errno = -resp.result;
+		return -1;
+	}
+	if (st)
+		*st = resp.status;
+	if (t)
+		*t = resp.times;
+	return 0;
+}
+
+static void print_times(const struct fanctl_times *t)
+{
+	printf("  rtt       = %.3f ms\n", (double)(t->rx_ns - t->tx_ns) / 1e6);
+	printf("  age       = %.3f ms\n", (double)(mono_ns() - t->rx_ns) / 1e6);
 }
 
-static int do_ping(int fd)
+static int do_ping(void)
 {
-	if (ioctl(fd, FANCTL_IOC_PING) < 0)
+	struct fanctl_times	t;
+
+	if (node_req(FANCTL_OP_PING, 0, NULL, &t) < 0)
 	{
-		perror("ioctl(PING)");
+		perror("ping");
 		return -1;
 	}
-	printf("PONG\n");
+	if (!t.rx_ns) // older driver
+		printf("PONG\n");
+	else
+		printf("PONG (rtt %.3f ms)\n", (double)(t.rx_ns - t.tx_ns) / 1e6);
 	return 0;
 }
 
-static int do_status(int fd)
+static void print_status(const struct fanctl_status *st)
+{
+	printf("Status:\n");
+	printf("  temp      = %.2f °C\n", (float)st->temp_x100 / 100.0f);
+	printf("  humid     = %.2f %%\n", (float)st->humidity_x100 / 100.0f);
+	printf("  fan_mode  = %s\n", st->fan_mode == 0 ? "AUTO" : "MANUAL");
+	printf("  fan_state = %s\n", st->fan_state == 1 ? "ON" : "OFF");
+	printf("  errors    = 0x%04x\n", st->errors);
+}
+
+static int do_status(void)
 {
 	struct fanctl_status	st;
+	struct fanctl_times	t;
 
-	memset(&st, 0, sizeof(st));
-	if (ioctl(fd, FANCTL_IOC_GET_STATUS, &st) < 0)
+	if (node_req(FANCTL_OP_STATUS, 0, &st, &t) < 0)
 	{
-		perror("ioctl(GET_STATUS)");
+		perror("status");
 		return -1;
 	}
-	printf("Status:\n");
-	printf("  temp      = %.2f °C\n", (float)st.temp_x100 / 100.0f);
-	printf("  humid     = %.2f %%\n", (float)st.humidity_x100 / 100.0f);
-	printf("  fan_mode  = %s\n", st.fan_mode == 0 ? "AUTO" : "MANUAL");
-	printf("  fan_state = %s\n", st.fan_state == 1 ? "ON" : "OFF");
-	printf("  errors    = 0x%04x\n", st.errors);
+	print_status(&st);
+	if (t.rx_ns) // older drivers have no timing
+		print_times(&t);
 	return 0;
 }
 
-static int do_set_fan_mode(int fd, uint8_t mode)
+static int do_set(uint8_t op, int16_t arg)
 {
-	if (ioctl(fd, FANCTL_IOC_SET_FAN_MODE, &mode) < 0)
+	if (node_req(op, arg, NULL, NULL) < 0)
 	{
-		perror("ioctl(SET_FAN_MODE)");
+		perror(fanctl_op_name(op));
 		return -1;
 	}
 	printf("OK\n");
 	return 0;
 }
 
-static int do_set_fan_state(int fd, uint8_t state)
+/*
+ * Upper bound (us) of the histogram bucket holding the given percentile.
+ * Bucket 0 holds waits below 1us, bucket i holds [2^(i-1), 2^i) us.
+ */
+static uint64_t qstats_percentile_us(const struct fanctl_qclass_stats *qs, int pct)
+{
+	uint64_t	total;
+	uint64_t	rank;
+	uint64_t	seen;
+	int		i;
+
+	total = 0;
+	for (i = 0; i < FANCTL_QSTATS_HIST_BUCKETS; i++)
+		total += qs->wait_hist[i];
+	if (total == 0)
+		return 0;
+	rank = (total * pct + 99) / 100;
+	seen = 0;
+	for (i = 0; i < FANCTL_QSTATS_HIST_BUCKETS; i++)
+	{
+		seen += qs->wait_hist[i];
+		if (seen >= rank)
+			break;
+	}
+	if (i >= FANCTL_QSTATS_HIST_BUCKETS)
+		i = FANCTL_QSTATS_HIST_BUCKETS - 1;
+	return (uint64_t)1 << i;
+}
+
+static int do_qstats(int fd)
 {
-	if (ioctl(fd, FANCTL_IOC_SET_FAN_STATE, &state) < 0)
+	struct fanctl_qstats		qs;
+	const struct fanctl_qclass_stats	*c;
+	static const char		*names[FANCTL_PRIO_NR] = { "ctrl", "poll" };
+	int				i;
+
+	memset(&qs, 0, sizeof(qs));
+	if (ioctl(fd, FANCTL_IOC_GET_QSTATS, &qs) < 0)
 	{
-		perror("ioctl(SET_FAN_STATE)");
+		perror("ioctl(GET_QSTATS)");
 		return -1;
 	}
-	printf("OK\n");
+	printf("Request queues:\n");
+	for (i = 0; i < FANCTL_PRIO_NR; i++)
+	{
+		c = &qs.cls[i];
+		printf("  %s:\n", names[i]);
+		printf("    depth     = %u (max %u)\n", c->depth, c->depth_max);
+		printf("    requests  = %llu\n", (unsigned long long)c->requests);
+		printf("    wait avg  = %llu us\n", c->requests ?
+			(unsigned long long)(c->wait_ns_total / c->requests / 1000) : 0ULL);
+		printf("    wait p50  < %llu us\n", (unsigned long long)qstats_percentile_us(c, 50));
+		printf("    wait p99  < %llu us\n", (unsigned long long)qstats_percentile_us(c, 99));
+		printf("    wait max  = %llu us\n", (unsigned long long)(c->wait_ns_max / 1000));
+	}
 	return 0;
 }
 
-static int do_set_threshold(int fd, float temp_c)
+static const char *link_state_str(uint8_t state)
 {
-	int16_t x100 = (int16_t)(temp_c * 100.0f);
+	if (state == FANCTL_LINK_UP)
+		return "UP";
+	if (state == FANCTL_LINK_DEGRADED)
+		return "DEGRADED";
+	return "DOWN";
+}
+
+static int print_link(int fd)
+{
+	struct fanctl_link	l;
 
-	if (ioctl(fd, FANCTL_IOC_SET_THRESHOLD, &x100) < 0)
+	memset(&l, 0, sizeof(l));
+	if (ioctl(fd, FANCTL_IOC_GET_LINK, &l) < 0)
 	{
-		perror("ioctl(SET_THRESHOLD)");
+		perror("ioctl(GET_LINK)");
 		return -1;
 	}
-	printf("OK\n");
+	printf("link=%s attached=%u misses=%u changes=%u", link_state_str(l.state),
+		l.attached, l.misses, l.changes);
+	if (l.attached && l.last_rx_ns)
+		printf(" last_rx=%.3fs ago", (double)(mono_ns() - l.last_rx_ns) / 1e9);
+	printf("\n");
+	fflush(stdout);
+	return 0;
+}
+
+/* Print the link state, and with `follow` every change reported by poll(). */
+static int do_link(int fd, int follow)
+{
+	struct pollfd	pfd;
+
+	if (print_link(fd) < 0)
+		return -1;
+	while (follow)
+	{
+		pfd.fd = fd;
+		pfd.events = POLLPRI;
+		if (poll(&pfd, 1, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			return -1;
+		}
+		if (print_link(fd) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void batch_print(void *ctx, const batch_rec_t *r)
+{
+	(void)ctx;
+	if (r->result)
+		fprintf(stderr, "line %d: %s: %s\n", r->line, batch_op_name(r->op),
+			strerror(-r->result));
+	else if (r->op == FANCTLD_OP_PING)
+		printf("PONG\n");
+	else if (r->op == FANCTLD_OP_STATUS)
+		print_status(&r->status);
+	else
+		printf("OK\n");
+}
+
+static int do_batch(int argc, char **argv)
+{
+	batch_daemon_t	d;
+	batch_fanctl_t	f;
+	batch_ops_t	ops;
+	const char	*path;
+	unsigned	depth;
+	batch_t		*b;
+	FILE		*in;
+	int		ret;
+	int		i;
+
+	depth = 8;
+	path = "-";
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			depth = (unsigned)atoi(argv[++i]);
+		else
+			path = argv[i];
+	}
+	if (depth < 1 || depth > 64)
+	{
+		fprintf(stderr, "depth must be 1-64\n");
+		return -1;
+	}
+	in = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!in)
+	{
+		perror(path);
+		return -1;
+	}
+	b = batch_load(in, strcmp(path, "-") ? path : "stdin");
+	if (in != stdin)
+		fclose(in);
+	if (!b)
+		return -1;
+	if (g_dfd >= 0)
+	{
+		d.fd = g_dfd;
+		d.addr = g_addr;
+		batch_daemon_ops(&ops, &d);
+		ops.depth = depth;
+	}
+	else
+	{
+		f.h = g_h;
+		f.addr = g_addr;
+		batch_fanctl_ops(&ops, &f); // one request on the wire, depth 1
+	}
+	ops.print = batch_print;
+	ret = batch_run(b, &ops);
+	fflush(stdout);
+	batch_summary(b, stderr);
+	batch_free(b);
+	return ret == 0 ? 0 : -1;
+}
+
+/* The ioctl blocks for the exchange, so a sample completes in tick() */
+static int watch_ioctl_tick(void *ctx, watch_t *w, uint32_t sample)
+{
+	struct fanctl_status	st;
+	struct fanctl_times	t;
+	struct watch_rec	r;
+	int			ret;
+
+	(void)ctx;
+	ret = fanctl_call(g_h, FANCTL_OP_STATUS, g_addr, 0, &st, &t);
+	watch_status_rec(&r, sample, ret, &st,
+		!ret && t.rx_ns > t.tx_ns ? (uint32_t)((t.rx_ns - t.tx_ns) / 1000) : 0);
+	watch_record(w, &r);
+	return 0;
+}
+
+/* POLLPRI: the link state changed, reading it rearms the event */
+static int watch_ioctl_ready(void *ctx, watch_t *w, short revents)
+{
+	struct fanctl_link	l;
+	struct watch_rec	r;
+
+	(void)revents;
+	memset(&l, 0, sizeof(l));
+	memset(&r, 0, sizeof(r));
+	r.kind = WATCH_KIND_LINK;
+	if (ioctl(*(int *)ctx, FANCTL_IOC_GET_LINK, &l) < 0)
+	{
+		perror("ioctl(GET_LINK)");
+		return -1;
+	}
+	r.link = l.state;
+	r.errors = l.misses;
+	watch_record(w, &r);
+	return 0;
+}
+
+static int do_watch(int fd, int argc, char **argv)
+{
+	watch_daemon_t	d;
+	watch_ops_t	ops;
+	watch_cfg_t	cfg;
+
+	if (!watch_parse_args(argc, argv, &cfg))
+	{
+		fprintf(stderr, "usage: " WATCH_USAGE "\n");
+		return -1;
+	}
+	cfg.addr = g_addr;
+	if (g_dfd >= 0)
+	{
+		d.fd = g_dfd;
+		watch_daemon_ops(&ops, &d);
+	}
+	else
+	{
+		memset(&ops, 0, sizeof(ops));
+		ops.ctx = &fd;
+		ops.fd = fd;
+		ops.events = POLLPRI;
+		ops.tick = watch_ioctl_tick;
+		ops.ready = watch_ioctl_ready;
+	}
+	return watch_run(&cfg, &ops) == 0 ? 0 : -1;
+}
+
+static int do_bench(int argc, char **argv)
+{
+	bench_cfg_t	cfg;
+
+	if (!bench_parse_args(argc, argv, &cfg))
+	{
+		fprintf(stderr, "usage: " BENCH_USAGE "\n");
+		return -1;
+	}
+	cfg.addr = g_addr;
+	return bench_run(g_h, &cfg) == 0 ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-a <addr>] <cmd>\n"
+		"cmd:\n  ping\n  status\n  auto\n  manual\n  on\n  off\n"
+		"  threshold <tempC>\n  qstats\n  link [-f]\n  batch [-p depth] [script]\n"
+		"  " WATCH_USAGE "\n  " BENCH_USAGE "\n"
+		"-a <addr>: node address on a multi-drop bus (1-254, 255 = broadcast SET_*)\n",
+		prog);
+}
+
+static int parse_addr(const char *str, uint8_t *addr)
+{
+	unsigned long	v;
+	char		*endp;
+
+	errno = 0;
+	v = strtoul(str, &endp, 0);
+	if (endp == str || *endp != '\0' || errno == ERANGE || v > 255)
+	{
+		fprintf(stderr, "wrong address format\n");
+		return -1;
+	}
+	*addr = (uint8_t)v;
 	return 0;
 }
 
 int main(int argc, char **argv)
 {
-	const char	*cmd = argv[1];
+	const char	*cmd;
 	int		fd;
 	int		rc;
 	float		temp;
 	char		*endp;
 
-	if (argc < 2)
+	if (argc < 2 || (!strcmp(argv[1], "-a") && argc < 4))
 	{
-		fprintf(stderr, "Usage:\n  %s ping\n  %s status\n  %s auto\n"
-			"  %s manual\n  %s on\n  %s off\n  %s threshold <tempC>\n",
-			argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+		usage(argv[0]);
 		return 1;
 	}
-	fd = open_dev("/dev/fanctl");
-	if (fd < 0)
-		return 1;
+	if (!strcmp(argv[1], "-a"))
+	{
+		if (parse_addr(argv[2], &g_addr) < 0)
+			return 1;
+		argv += 2;
+		argc -= 2;
+	}
+	cmd = argv[1];
+	if (strcmp(cmd, "qstats") && strcmp(cmd, "link") && strcmp(cmd, "bench"))
+		g_dfd = fanctld_open_for(FANCTLD_KIND_IOCTL, "/dev/fanctl");
+	fd = -1;
+	if (g_dfd < 0)
+	{
+		g_h = fanctl_open("/dev/fanctl", FANCTL_TR_IOCTL);
+		if (!g_h)
+		{
+			perror("open");
+			return 1;
+		}
+		fd = fanctl_dev_fd(g_h);
+	}
 	rc = 0;
 	if (!strcmp(cmd, "ping"))
 	{
-		rc = do_ping(fd);
+		rc = do_ping();
 	}
 	else if (!strcmp(cmd, "status"))
 	{
-		rc = do_status(fd);
+		rc = do_status();
 	}
 	else if (!strcmp(cmd, "auto"))
 	{
-		rc = do_set_fan_mode(fd, 0);
+		rc = do_set(FANCTL_OP_SET_FAN_MODE, 0);
 	}
 	else if (!strcmp(cmd, "manual"))
 	{
-		rc = do_set_fan_mode(fd, 1);
+		rc = do_set(FANCTL_OP_SET_FAN_MODE, 1);
 	}
 	else if (!strcmp(cmd, "on"))
 	{
-		rc = do_set_fan_state(fd, 1);
+		rc = do_set(FANCTL_OP_SET_FAN_STATE, 1);
 	}
 	else if (!strcmp(cmd, "off"))
 	{
-		rc = do_set_fan_state(fd, 0);
+		rc = do_set(FANCTL_OP_SET_FAN_STATE, 0);
+	}
+	else if (!strcmp(cmd, "link"))
+	{
+		rc = do_link(fd, argc >= 3 && !strcmp(argv[2], "-f"));
+	}
+	else if (!strcmp(cmd, "qstats"))
+	{
+		rc = do_qstats(fd);
+	}
+	else if (!strcmp(cmd, "batch"))
+	{
+		rc = do_batch(argc - 1, argv + 1);
+	}
+	else if (!strcmp(cmd, "watch"))
+	{
+		rc = do_watch(fd, argc - 1, argv + 1);
+	}
+	else if (!strcmp(cmd, "bench"))
+	{
+		rc = do_bench(argc - 1, argv + 1);
 	}
 	else if (!strcmp(cmd, "threshold"))
 	{
@@ -151,7 +530,7 @@ int main(int argc, char **argv)
 				rc = -1;
 			}
 			else
-				rc = do_set_threshold(fd, temp);
+				rc = do_set(FANCTL_OP_SET_THRESHOLD, (int16_t)(temp * 100.0f));
 		}
 	}
 	else
@@ -159,7 +538,9 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Unknown command: %s\n", cmd);
 		rc = -1;
 	}
-	close(fd);
+	fanctl_close(g_h);
+	if (g_dfd >= 0)
+		close(g_dfd);
 	if (rc == -1)
 		return 1;
 	return 0;
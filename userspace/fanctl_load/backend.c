@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include "fanctl_uapi.h"
+#include "proto.h"
+#include "serial.h"
+#include "sclient.h"
+#include "backend.h"
+
+#define SERIAL_TIMEOUT_MS	1000 // as libfanctl
+
+struct backend {
+	bool		serial;
+	const char	*dev;
+	int		addr; // -1: point-to-point
+	int		fd; // serial: shared fd
+	sclient_t	*sc; // serial: every worker's request pipelined on fd
+	pthread_mutex_t	lock; // serial: sc and the waiters' conditions
+	pthread_t	io; // serial: runs sc
+	bool		stop;
+	bool		dead; // serial: tty failed
+};
+
+typedef struct {
+	pthread_cond_t	cond;
+	bool		done;
+	int		result;
+	proto_frame_t	resp;
+}	serial_wait_t;
+
+/* Serial I/O thread: completes responses and deadlines of all workers */
+static void	*serial_io(void *arg)
+{
+	backend_t	*be;
+	struct pollfd	pfd;
+
+	be = arg;
+	pfd.fd = sclient_fd(be->sc);
+	pfd.events = POLLIN;
+	while (!__atomic_load_n(&be->stop, __ATOMIC_RELAXED))
+	{
+		if (poll(&pfd, 1, 100) <= 0 || !(pfd.revents & POLLIN))
+			continue;
+		pthread_mutex_lock(&be->lock);
+		if (sclient_run(be->sc, 0) < 0) // waiters get -EIO
+			be->dead = true;
+		pthread_mutex_unlock(&be->lock);
+		if (be->dead)
+			break;
+	}
+	return NULL;
+}
+
+backend_t	*backend_open_ioctl(const char *dev, int addr)
+{
+	backend_t	*be;
+	int		fd;
+
+	fd = open(dev, O_RDWR); // probe once, workers open their own file
+	if (fd < 0)
+	{
+		perror("open");
+		return NULL;
+	}
+	close(fd);
+	be = calloc(1, sizeof(*be));
+	if (!be)
+		return NULL;
+	be->dev = dev;
+	be->addr = addr;
+	be->fd = -1;
+	return be;
+}
+
+backend_t	*backend_open_serial(const char *dev)
+{
+	backend_t	*be;
+
+	be = calloc(1, sizeof(*be));
+	if (!be)
+		return NULL;
+	be->serial = true;
+	be->dev = dev;
+	be->addr = -1;
+	be->fd = serial_open(dev, 115200);
+	if (be->fd < 0)
+	{
+		free(be);
+		return NULL;
+	}
+	be->sc = sclient_attach(be->fd);
+	pthread_mutex_init(&be->lock, NULL);
+	if (!be->sc || pthread_create(&be->io, NULL, serial_io, be))
+	{
+		sclient_free(be->sc);
+		pthread_mutex_destroy(&be->lock);
+		close(be->fd);
+		free(be);
+		return NULL;
+	}
+	return be;
+}
+
+int	backend_worker_fd(backend_t *be)
+{
+	fanctl_u8	addr;
+	int		fd;
+
+	if (be->serial)
+		return be->fd;
+	fd = open(be->dev, O_RDWR);
+	if (fd < 0)
+	{
+		perror("open");
+		return -1;
+	}
+	if (be->addr >= 0)
+	{
+		addr = (fanctl_u8)be->addr;
+		if (ioctl(fd, FANCTL_IOC_SET_ADDR, &addr) < 0)
+		{
+			perror("ioctl(SET_ADDR)");
+			close(fd);
+			return -1;
+		}
+	}
+	return fd;
+}
+
+void	backend_worker_close(backend_t *be, int fd)
+{
+	if (!be->serial && fd >= 0)
+		close(fd);
+}
+
+static load_result_t	do_ioctl(int fd, load_cmd_t cmd, int16_t threshold_x100, int *err)
+{
+	struct fanctl_status	st;
+	fanctl_u8		mode;
+	fanctl_s16		x100;
+	int			ret;
+
+	switch (cmd)
+	{
+		case LOAD_CMD_STATUS:
+			ret = ioctl(fd, FANCTL_IOC_GET_STATUS, &st);
+			break;
+		case LOAD_CMD_PING:
+			ret = ioctl(fd, FANCTL_IOC_PING);
+			break;
+		case LOAD_CMD_THRESHOLD:
+			x100 = threshold_x100;
+			ret = ioctl(fd, FANCTL_IOC_SET_THRESHOLD, &x100);
+			break;
+		case LOAD_CMD_AUTO:
+		default:
+			mode = PROTO_FAN_MODE_AUTO;
+			ret = ioctl(fd, FANCTL_IOC_SET_FAN_MODE, &mode);
+			break;
+	}
+	if (ret == 0)
+		return LOAD_OK;
+	*err = errno;
+	return errno == ETIMEDOUT ? LOAD_TIMEOUT : LOAD_ERROR;
+}
+
+static void	serial_done(void *arg, int result, const proto_frame_t *resp)
+{
+	serial_wait_t	*w;
+
+	w = arg; // called with be->lock held
+	w->result = result;
+	if (resp)
+		w->resp = *resp;
+	w->done = true;
+	pthread_cond_signal(&w->cond);
+}
+
+static load_result_t	do_serial(backend_t *be, load_cmd_t cmd, int16_t threshold_x100, int *err)
+{
+	serial_wait_t	w;
+	uint8_t		payload[2];
+	uint8_t		len;
+	uint8_t		c;
+	int		ret;
+
+	len = 0;
+	switch (cmd)
+	{
+		case LOAD_CMD_STATUS:
+			c = PROTO_CMD_STATUS_REQ;
+			break;
+		case LOAD_CMD_PING:
+			c = PROTO_CMD_PING;
+			break;
+		case LOAD_CMD_THRESHOLD:
+			c = PROTO_CMD_SET_THRESHOLD;
+			payload[0] = (uint8_t)((uint16_t)threshold_x100 >> 8);
+			payload[1] = (uint8_t)threshold_x100;
+			len = 2;
+			break;
+		case LOAD_CMD_AUTO:
+		default:
+			c = PROTO_CMD_SET_FAN_MODE;
+			payload[0] = PROTO_FAN_MODE_AUTO;
+			len = 1;
+			break;
+	}
+	w.done = false;
+	w.result = 0;
+	pthread_cond_init(&w.cond, NULL);
+	pthread_mutex_lock(&be->lock);
+	ret = be->dead ? -EIO : sclient_submit(be->sc, PROTO_ADDR_NONE, c, payload, len,
+			SERIAL_TIMEOUT_MS, serial_done, &w);
+	while (ret >= 0 && !w.done)
+		pthread_cond_wait(&w.cond, &be->lock);
+	pthread_mutex_unlock(&be->lock);
+	pthread_cond_destroy(&w.cond);
+	if (ret >= 0)
+		ret = w.result;
+	if (ret == -ETIMEDOUT) // no (valid) response within the deadline
+	{
+		*err = ETIMEDOUT;
+		return LOAD_TIMEOUT;
+	}
+	if (ret < 0)
+	{
+		*err = -ret;
+		return LOAD_ERROR;
+	}
+	if (w.resp.cmd == PROTO_CMD_ACK && w.resp.len >= 2 && w.resp.payload[1] != PROTO_ERR_OK)
+	{
+		*err = EPROTO;
+		return LOAD_ERROR;
+	}
+	return LOAD_OK;
+}
+
+load_result_t	backend_do(backend_t *be, int fd, load_cmd_t cmd, int16_t threshold_x100,
+			int *err)
+{
+	*err = 0;
+	if (be->serial)
+		return do_serial(be, cmd, threshold_x100, err);
+	return do_ioctl(fd, cmd, threshold_x100, err);
+}
+
+void	backend_close(backend_t *be)
+{
+	if (be->serial)
+	{
+		__atomic_store_n(&be->stop, true, __ATOMIC_RELAXED);
+		pthread_join(be->io, NULL);
+		sclient_free(be->sc);
+		close(be->fd);
+		pthread_mutex_destroy(&be->lock);
+	}
+	free(be);
+}
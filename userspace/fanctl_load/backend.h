@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Request paths under test
+ * - ioctl:  /dev/fanctl, one open file per worker (the driver serializes)
+ * - serial: raw tty through the sclient of fanctl_serial, one shared fd;
+ *           the workers' requests are pipelined on it and matched back
+ *           by SEQ, an I/O thread completes them
+ */
+
+typedef enum {
+	LOAD_CMD_STATUS,
+	LOAD_CMD_PING,
+	LOAD_CMD_THRESHOLD,
+	LOAD_CMD_AUTO,
+	LOAD_CMD_NR,
+}	load_cmd_t;
+
+typedef enum {
+	LOAD_OK,
+	LOAD_TIMEOUT,
+	LOAD_ERROR,
+}	load_result_t;
+
+typedef struct backend	backend_t;
+
+backend_t	*backend_open_ioctl(const char *dev, int addr);
+backend_t	*backend_open_serial(const char *dev);
+int		backend_worker_fd(backend_t *be);
+void		backend_worker_close(backend_t *be, int fd);
+load_result_t	backend_do(backend_t *be, int fd, load_cmd_t cmd, int16_t threshold_x100,
+			int *err);
+void		backend_close(backend_t *be);
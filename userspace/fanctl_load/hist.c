@@ -0,0 +1,102 @@
+#include <string.h>
+
+#include "hist.h"
+
+static int	hist_slot(uint64_t v)
+{
+	int	shift;
+
+	if (v < 2 * HIST_SUB)
+		return (int)v;
+	if (v >> HIST_MAX_BITS)
+		return HIST_SLOTS - 1;
+	shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB + (int)((v >> shift) - HIST_SUB);
+}
+
+/* Lowest value recorded in `slot` */
+uint64_t	hist_slot_value(int slot)
+{
+	int	shift;
+
+	if (slot < 2 * HIST_SUB)
+		return (uint64_t)slot;
+	shift = slot / HIST_SUB - 1;
+	return (uint64_t)(slot % HIST_SUB + HIST_SUB) << shift;
+}
+
+void	hist_init(hist_t *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+void	hist_record(hist_t *h, uint64_t v)
+{
+	h->slots[hist_slot(v)]++;
+	h->count++;
+	h->total += v;
+	if (v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+}
+
+void	hist_merge(hist_t *dst, const hist_t *src)
+{
+	int	i;
+
+	for (i = 0; i < HIST_SLOTS; i++)
+		dst->slots[i] += src->slots[i];
+	dst->count += src->count;
+	dst->total += src->total;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/* p in [0, 100]; the highest value of the matching slot, capped at max */
+uint64_t	hist_percentile(const hist_t *h, double p)
+{
+	uint64_t	rank;
+	uint64_t	seen;
+	uint64_t	v;
+	int		i;
+
+	if (h->count == 0)
+		return 0;
+	rank = (uint64_t)(p / 100.0 * (double)h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	seen = 0;
+	for (i = 0; i < HIST_SLOTS; i++)
+	{
+		seen += h->slots[i];
+		if (seen >= rank)
+		{
+			v = i + 1 < HIST_SLOTS ? hist_slot_value(i + 1) - 1 : h->max;
+			return v < h->max ? v : h->max;
+		}
+	}
+	return h->max;
+}
+
+/* Non-empty slots as [[lowest_ns, count], ...] */
+void	hist_print_json(const hist_t *h, FILE *out)
+{
+	const char	*sep;
+	int		i;
+
+	sep = "";
+	fputc('[', out);
+	for (i = 0; i < HIST_SLOTS; i++)
+	{
+		if (!h->slots[i])
+			continue;
+		fprintf(out, "%s[%llu,%llu]", sep, (unsigned long long)hist_slot_value(i),
+			(unsigned long long)h->slots[i]);
+		sep = ",";
+	}
+	fputc(']', out);
+}
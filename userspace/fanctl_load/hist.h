@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Log-linear latency histogram (HdrHistogram layout)
+ * --------------------------------------------------
+ * Values (ns) below 2 * HIST_SUB are recorded exactly, above that every
+ * power of two is split into HIST_SUB linear sub-buckets, so any
+ * recorded value is known within 1 / HIST_SUB (< 1%).
+ * Range: 0 .. 2^HIST_MAX_BITS ns (~18 minutes).
+ */
+
+#define HIST_SUB_BITS	7
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS	40
+#define HIST_SLOTS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+	uint64_t	count;
+	uint64_t	min;
+	uint64_t	max;
+	uint64_t	total;
+	uint64_t	slots[HIST_SLOTS];
+}	hist_t;
+
+void		hist_init(hist_t *h);
+void		hist_record(hist_t *h, uint64_t v);
+void		hist_merge(hist_t *dst, const hist_t *src);
+uint64_t	hist_percentile(const hist_t *h, double p);
+uint64_t	hist_slot_value(int slot);
+void		hist_print_json(const hist_t *h, FILE *out);
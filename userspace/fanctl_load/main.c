@@ -0,0 +1,446 @@
+/*
+ * fanctl_load
+ * -----------
+ * End-to-end load generator: N worker threads issue a weighted command
+ * mix against /dev/fanctl (ioctl path) or a raw tty (sclient path), and
+ * report throughput, errors, timeouts and a log-linear latency histogram.
+ *
+ *   fanctl_load [-d dev | -s tty] [-a addr] [-c workers] [-r rate]
+ *               [-t seconds | -n count] [-w warmup_s] [-m mix] [-j] [-L label]
+ *
+ * -d   fanctl chardev (default /dev/fanctl)
+ * -s   raw serial tty instead of the driver (legacy fanctl_serial path)
+ * -a   node address (ioctl path only, FANCTL_IOC_SET_ADDR per worker)
+ * -c   concurrent workers (default 1)
+ * -r   total target rate in requests/s, 0 = closed loop (default 0)
+ * -t   run time in seconds (default 10)
+ * -n   stop after this many requests instead
+ * -w   warmup in seconds, not recorded (default 0)
+ * -m   command mix "status=8,ping=1,threshold=1,auto=0" (default status=1)
+ * -j   print a single JSON object on stdout instead of the text report
+ * -L   free-form label copied to the JSON output
+ *
+ * With -r every worker follows a fixed schedule and latency is taken from
+ * the intended send time, so a stalled link shows up in the tail instead
+ * of silently lowering the offered load (coordinated omission).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/utsname.h>
+
+#include "backend.h"
+#include "hist.h"
+
+#define MAX_WORKERS	64
+
+static const char	*g_cmd_names[LOAD_CMD_NR] = {
+	[LOAD_CMD_STATUS]	= "status",
+	[LOAD_CMD_PING]		= "ping",
+	[LOAD_CMD_THRESHOLD]	= "threshold",
+	[LOAD_CMD_AUTO]		= "auto",
+};
+
+typedef struct {
+	backend_t	*be;
+	unsigned	weights[LOAD_CMD_NR];
+	unsigned	weight_sum;
+	int		workers;
+	double		rate; // total, requests/s
+	int64_t		start_ns;
+	int64_t		rec_ns; // recording starts after warmup
+	int64_t		end_ns;
+	uint64_t	max_reqs; // 0: time bound
+	uint64_t	issued; // atomic, -n accounting
+}	load_cfg_t;
+
+typedef struct {
+	load_cfg_t	*cfg;
+	pthread_t	thread;
+	int		id;
+	uint64_t	rng;
+	hist_t		hist;
+	uint64_t	ok[LOAD_CMD_NR];
+	uint64_t	timeouts[LOAD_CMD_NR];
+	uint64_t	errors[LOAD_CMD_NR];
+	int		last_err;
+	int64_t		first_ns;
+	int64_t		last_ns;
+}	worker_t;
+
+static volatile sig_atomic_t	g_stop;
+
+static void	on_signal(int sig)
+{
+	(void)sig;
+	g_stop = 1;
+}
+
+static int64_t	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void	sleep_until(int64_t t_ns)
+{
+	struct timespec	ts;
+
+	ts.tv_sec = t_ns / 1000000000LL;
+	ts.tv_nsec = t_ns % 1000000000LL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !g_stop)
+		;
+}
+
+static uint64_t	xorshift(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+/* "status=8,ping=1" -> weights */
+static bool	parse_mix(load_cfg_t *cfg, const char *spec)
+{
+	char		name[16];
+	unsigned	w;
+	int		n;
+	int		i;
+
+	memset(cfg->weights, 0, sizeof(cfg->weights));
+	cfg->weight_sum = 0;
+	while (*spec)
+	{
+		if (sscanf(spec, "%15[a-z]=%u%n", name, &w, &n) != 2)
+			return false;
+		for (i = 0; i < LOAD_CMD_NR; i++)
+			if (!strcmp(name, g_cmd_names[i]))
+				break;
+		if (i == LOAD_CMD_NR)
+			return false;
+		cfg->weights[i] = w;
+		cfg->weight_sum += w;
+		spec += n;
+		if (*spec == ',')
+			spec++;
+		else if (*spec)
+			return false;
+	}
+	return cfg->weight_sum > 0;
+}
+
+static load_cmd_t	pick_cmd(worker_t *w)
+{
+	unsigned	r;
+	int		i;
+
+	r = (unsigned)(xorshift(&w->rng) % w->cfg->weight_sum);
+	for (i = 0; i < LOAD_CMD_NR - 1; i++)
+	{
+		if (r < w->cfg->weights[i])
+			break;
+		r -= w->cfg->weights[i];
+	}
+	return (load_cmd_t)i;
+}
+
+static void	*worker_main(void *arg)
+{
+	worker_t	*w;
+	load_cfg_t	*cfg;
+	load_cmd_t	cmd;
+	load_result_t	res;
+	int64_t		period_ns;
+	int64_t		next_ns;
+	int64_t		t0;
+	int64_t		t1;
+	int16_t		x100;
+	int		err;
+	int		fd;
+
+	w = arg;
+	cfg = w->cfg;
+	fd = backend_worker_fd(cfg->be);
+	if (fd < 0)
+		return NULL;
+	period_ns = cfg->rate > 0 ? (int64_t)(1e9 * cfg->workers / cfg->rate) : 0;
+	// stagger workers across one period so the offered load is smooth
+	next_ns = cfg->start_ns + (period_ns * w->id) / cfg->workers;
+	while (!g_stop)
+	{
+		if (cfg->max_reqs && __atomic_fetch_add(&cfg->issued, 1, __ATOMIC_RELAXED) >= cfg->max_reqs)
+			break;
+		if (period_ns)
+		{
+			sleep_until(next_ns);
+			t0 = next_ns; // intended start, see header
+			next_ns += period_ns;
+		}
+		else
+			t0 = mono_ns();
+		if (!cfg->max_reqs && t0 >= cfg->end_ns)
+			break;
+		cmd = pick_cmd(w);
+		x100 = (int16_t)(2000 + xorshift(&w->rng) % 1000); // 20.00 .. 29.99 °C
+		res = backend_do(cfg->be, fd, cmd, x100, &err);
+		t1 = mono_ns();
+		if (t0 < cfg->rec_ns)
+			continue;
+		if (!w->first_ns)
+			w->first_ns = t0;
+		w->last_ns = t1;
+		switch (res)
+		{
+			case LOAD_OK:
+				w->ok[cmd]++;
+				hist_record(&w->hist, (uint64_t)(t1 - t0));
+				break;
+			case LOAD_TIMEOUT:
+				w->timeouts[cmd]++;
+				break;
+			case LOAD_ERROR:
+			default:
+				w->errors[cmd]++;
+				w->last_err = err;
+				break;
+		}
+	}
+	backend_worker_close(cfg->be, fd);
+	return NULL;
+}
+
+typedef struct {
+	hist_t		hist;
+	uint64_t	ok[LOAD_CMD_NR];
+	uint64_t	timeouts[LOAD_CMD_NR];
+	uint64_t	errors[LOAD_CMD_NR];
+	uint64_t	n_ok;
+	uint64_t	n_timeouts;
+	uint64_t	n_errors;
+	int		last_err;
+	double		elapsed_s;
+}	load_sum_t;
+
+static void	summarize(worker_t *workers, int n, load_sum_t *sum)
+{
+	int64_t	first;
+	int64_t	last;
+	int	i;
+	int	c;
+
+	memset(sum, 0, sizeof(*sum));
+	hist_init(&sum->hist);
+	first = INT64_MAX;
+	last = 0;
+	for (i = 0; i < n; i++)
+	{
+		hist_merge(&sum->hist, &workers[i].hist);
+		for (c = 0; c < LOAD_CMD_NR; c++)
+		{
+			sum->ok[c] += workers[i].ok[c];
+			sum->timeouts[c] += workers[i].timeouts[c];
+			sum->errors[c] += workers[i].errors[c];
+		}
+		if (workers[i].last_err)
+			sum->last_err = workers[i].last_err;
+		if (workers[i].first_ns && workers[i].first_ns < first)
+			first = workers[i].first_ns;
+		if (workers[i].last_ns > last)
+			last = workers[i].last_ns;
+	}
+	for (c = 0; c < LOAD_CMD_NR; c++)
+	{
+		sum->n_ok += sum->ok[c];
+		sum->n_timeouts += sum->timeouts[c];
+		sum->n_errors += sum->errors[c];
+	}
+	sum->elapsed_s = last > first ? (double)(last - first) / 1e9 : 0;
+}
+
+static const double	g_pcts[] = { 50, 90, 99, 99.9, 99.99 };
+
+static void	print_text(const load_sum_t *s)
+{
+	uint64_t	total;
+	size_t		i;
+	int		c;
+
+	total = s->n_ok + s->n_timeouts + s->n_errors;
+	printf("requests: %llu in %.3f s, %.1f ops/s\n", (unsigned long long)total, s->elapsed_s,
+		s->elapsed_s > 0 ? (double)s->n_ok / s->elapsed_s : 0.0);
+	printf("ok: %llu, timeouts: %llu, errors: %llu",
+		(unsigned long long)s->n_ok, (unsigned long long)s->n_timeouts,
+		(unsigned long long)s->n_errors);
+	if (s->last_err)
+		printf(" (last: %s)", strerror(s->last_err));
+	printf("\n");
+	for (c = 0; c < LOAD_CMD_NR; c++)
+		if (s->ok[c] + s->timeouts[c] + s->errors[c])
+			printf("  %-9s ok %llu, timeouts %llu, errors %llu\n", g_cmd_names[c],
+				(unsigned long long)s->ok[c], (unsigned long long)s->timeouts[c],
+				(unsigned long long)s->errors[c]);
+	if (!s->hist.count)
+		return;
+	printf("latency (µs): min %.1f, mean %.1f, max %.1f\n", (double)s->hist.min / 1e3,
+		(double)s->hist.total / (double)s->hist.count / 1e3, (double)s->hist.max / 1e3);
+	for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+		printf("  p%-6g %10.1f\n", g_pcts[i], (double)hist_percentile(&s->hist, g_pcts[i]) / 1e3);
+}
+
+static void	print_json(const load_sum_t *s, const load_cfg_t *cfg, const char *path,
+			bool serial, const char *label)
+{
+	struct utsname	un;
+	const char	*sep;
+	size_t		i;
+	int		c;
+
+	uname(&un);
+	printf("{\"label\":\"%s\",\"host\":\"%s\",\"kernel\":\"%s\",", label ? label : "",
+		un.nodename, un.release);
+	printf("\"backend\":\"%s\",\"device\":\"%s\",\"workers\":%d,\"rate\":%g,\"mix\":{",
+		serial ? "serial" : "ioctl", path, cfg->workers, cfg->rate);
+	sep = "";
+	for (c = 0; c < LOAD_CMD_NR; c++)
+	{
+		if (!cfg->weights[c])
+			continue;
+		printf("%s\"%s\":%u", sep, g_cmd_names[c], cfg->weights[c]);
+		sep = ",";
+	}
+	printf("},\"elapsed_s\":%.6f,\"ok\":%llu,\"timeouts\":%llu,\"errors\":%llu,"
+		"\"ops_per_s\":%.3f,\"per_cmd\":{", s->elapsed_s, (unsigned long long)s->n_ok,
+		(unsigned long long)s->n_timeouts, (unsigned long long)s->n_errors,
+		s->elapsed_s > 0 ? (double)s->n_ok / s->elapsed_s : 0.0);
+	sep = "";
+	for (c = 0; c < LOAD_CMD_NR; c++)
+	{
+		if (!(s->ok[c] + s->timeouts[c] + s->errors[c]))
+			continue;
+		printf("%s\"%s\":{\"ok\":%llu,\"timeouts\":%llu,\"errors\":%llu}", sep,
+			g_cmd_names[c], (unsigned long long)s->ok[c],
+			(unsigned long long)s->timeouts[c], (unsigned long long)s->errors[c]);
+		sep = ",";
+	}
+	printf("},\"latency_ns\":{\"min\":%llu,\"max\":%llu,\"mean\":%.0f",
+		(unsigned long long)(s->hist.count ? s->hist.min : 0),
+		(unsigned long long)s->hist.max,
+		s->hist.count ? (double)s->hist.total / (double)s->hist.count : 0.0);
+	for (i = 0; i < sizeof(g_pcts) / sizeof(g_pcts[0]); i++)
+		printf(",\"p%g\":%llu", g_pcts[i],
+			(unsigned long long)hist_percentile(&s->hist, g_pcts[i]));
+	printf(",\"histogram\":");
+	fflush(stdout);
+	hist_print_json(&s->hist, stdout);
+	printf("}}\n");
+}
+
+static void	usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-d dev | -s tty] [-a addr] [-c workers] [-r rate]\n"
+			"       [-t seconds | -n count] [-w warmup_s] [-m mix] [-j] [-L label]\n"
+			"mix: status=<w>,ping=<w>,threshold=<w>,auto=<w>\n", prog);
+}
+
+int	main(int argc, char **argv)
+{
+	static worker_t	workers[MAX_WORKERS];
+	load_cfg_t	cfg;
+	load_sum_t	sum;
+	const char	*path;
+	const char	*label;
+	double		duration;
+	double		warmup;
+	bool		serial;
+	bool		json;
+	int		addr;
+	int		opt;
+	int		i;
+
+	memset(&cfg, 0, sizeof(cfg));
+	path = "/dev/fanctl";
+	label = NULL;
+	duration = 10;
+	warmup = 0;
+	serial = false;
+	json = false;
+	addr = -1;
+	cfg.workers = 1;
+	parse_mix(&cfg, "status=1");
+	while ((opt = getopt(argc, argv, "d:s:a:c:r:t:n:w:m:jL:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd': path = optarg; serial = false; break;
+			case 's': path = optarg; serial = true; break;
+			case 'a': addr = (int)strtol(optarg, NULL, 0); break;
+			case 'c': cfg.workers = atoi(optarg); break;
+			case 'r': cfg.rate = atof(optarg); break;
+			case 't': duration = atof(optarg); break;
+			case 'n': cfg.max_reqs = strtoull(optarg, NULL, 0); break;
+			case 'w': warmup = atof(optarg); break;
+			case 'j': json = true; break;
+			case 'L': label = optarg; break;
+			case 'm':
+				if (!parse_mix(&cfg, optarg))
+				{
+					fprintf(stderr, "Invalid mix: %s\n", optarg);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (cfg.workers < 1 || cfg.workers > MAX_WORKERS || addr > 0xFF || cfg.rate < 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if (serial && addr >= 0)
+		fprintf(stderr, "Warning: -a ignored on the serial path\n");
+	cfg.be = serial ? backend_open_serial(path) : backend_open_ioctl(path, addr);
+	if (!cfg.be)
+		return 1;
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	cfg.start_ns = mono_ns();
+	cfg.rec_ns = cfg.start_ns + (int64_t)(warmup * 1e9);
+	cfg.end_ns = cfg.rec_ns + (int64_t)(duration * 1e9);
+	if (cfg.max_reqs && warmup > 0)
+		fprintf(stderr, "Warning: warmup requests count towards -n\n");
+	for (i = 0; i < cfg.workers; i++)
+	{
+		workers[i].cfg = &cfg;
+		workers[i].id = i;
+		workers[i].rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(i + 1);
+		hist_init(&workers[i].hist);
+		if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0)
+		{
+			perror("pthread_create");
+			g_stop = 1;
+			cfg.workers = i;
+			break;
+		}
+	}
+	for (i = 0; i < cfg.workers; i++)
+		pthread_join(workers[i].thread, NULL);
+	summarize(workers, cfg.workers, &sum);
+	if (json)
+		print_json(&sum, &cfg, path, serial, label);
+	else
+		print_text(&sum);
+	backend_close(cfg.be);
+	return sum.n_ok ? 0 : 1;
+}
@@ -1,175 +1,262 @@
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
+#include "proto.h"
 #include "cmd.h"
-#include "req.h"
+#include "serial.h"
+#include "util.h"
+#include "client.h"
+#include "batch.h"
+#include "watch.h"
+#include "bench.h"
 
-static void	decode_status_resp(proto_frame_t *resp)
+static void	print_status(const struct fanctl_status *st)
 {
-	int16_t		temp_x100;
-	uint16_t	humidity_x100;
-	uint8_t		fan_mode;
-	uint8_t		fan_state;
-	uint16_t	errors;
-	int		pos;
-	uint8_t		*payload;
-	
-	pos = 0;
-	payload = resp->payload;
-	temp_x100 = (int16_t)((payload[pos] << 8) | payload[pos + 1]);
-	pos += 2;
-	humidity_x100 = payload[pos++];
-	humidity_x100 = (humidity_x100 << 8) | payload[pos++];
-	fan_mode = payload[pos++];
-	fan_state = payload[pos++];
-	errors = payload[pos++];
-	errors = (errors << 8) | payload[pos];
 	printf("Status:");
-	printf(" temperature=%.2f°C", (float)temp_x100 / 100.0f);
-	printf(" humidity=%.2f%%", (float)humidity_x100 / 100.0f);
+	printf(" temperature=%.2f°C", (float)st->temp_x100 / 100.0f);
+	printf(" humidity=%.2f%%", (float)st->humidity_x100 / 100.0f);
 	printf(" fan_mode=");
-	if (fan_mode == PROTO_FAN_MODE_AUTO)
+	if (st->fan_mode == PROTO_FAN_MODE_AUTO)
 		printf("AUTO");
-	else if (fan_mode == PROTO_FAN_MODE_MANUAL)
+	else if (st->fan_mode == PROTO_FAN_MODE_MANUAL)
 		printf("MANUAL");
 	else
 		printf("UNKNOWN");
 	printf(" fan_state=");
-	if (fan_state == PROTO_FAN_STATE_ON)
+	if (st->fan_state == PROTO_FAN_STATE_ON)
 		printf("ON");
-	else if (fan_state == PROTO_FAN_STATE_OFF)
+	else if (st->fan_state == PROTO_FAN_STATE_OFF)
 		printf("OFF");
 	else
 		printf("UNKNOWN");
-	printf(" errors=0x%04x\n", errors);
+	printf(" errors=0x%04x\n", st->errors);
 }
 
-static void	decode_ack(proto_frame_t *resp)
+/*
+ * Result of a SET_*, as libfanctl and fanctld report the node's ACK:
+ * -EOPNOTSUPP for an invalid argument, -EBUSY for the wrong state.
+ * Anything else didn't get an ACK.
+ */
+static bool	print_ack(uint8_t op, int result)
 {
-	uint8_t	orig_cmd;
-	uint8_t	res;
-
-	orig_cmd = resp->payload[0];
-	res = resp->payload[1];
-	if (orig_cmd == PROTO_CMD_SET_FAN_MODE)
+	if (result && result != -EOPNOTSUPP && result != -EBUSY)
+		return false;
+	if (op == FANCTL_OP_SET_FAN_MODE)
 		printf("Set fan mode ");
-	else if (orig_cmd == PROTO_CMD_SET_FAN_STATE)
+	else if (op == FANCTL_OP_SET_FAN_STATE)
 		printf("Set fan state ");
-	else if (orig_cmd == PROTO_CMD_SET_THRESHOLD)
+	else if (op == FANCTL_OP_SET_THRESHOLD)
 		printf("Set threshold ");
-	if (res == PROTO_ERR_OK)
+	if (result == 0)
 		printf("OK\n");
-	else if (res == PROTO_ERR_INVALID_ARG)
+	else if (result == -EOPNOTSUPP)
 		printf("FAILED: invalid arg\n");
-	else if (res == PROTO_ERR_STATE)
+	else
 		printf("FAILED: state\n");
+	return true;
 }
 
-bool	do_ping(int fd)
+/* One command, tried up to 3 times while it times out */
+static int	call_retry(fanctl_t *h, uint8_t op, int16_t arg, struct fanctl_status *st)
 {
-	proto_frame_t	resp;
-	bool		ok;
+	int	ret;
 
-	ok = false;
-	for (int i = 0; i < 3; i++)
-	{
-		if (req_w8(fd, PROTO_CMD_PING, NULL, 0, &resp))
-		{
-			ok = true;
-			break;
-		}
-	}
-	if (!ok || resp.cmd != PROTO_CMD_PONG)
+	ret = -ETIMEDOUT;
+	for (int i = 0; i < 3 && ret == -ETIMEDOUT; i++)
+		ret = fanctl_call(h, op, FANCTL_ADDR_NONE, arg, st, NULL);
+	if (ret < 0 && ret != -ETIMEDOUT && ret != -EOPNOTSUPP && ret != -EBUSY)
+		fprintf(stderr, "%s: %s\n", fanctl_op_name(op), strerror(-ret));
+	return ret;
+}
+
+bool	do_ping(fanctl_t *h)
+{
+	if (call_retry(h, FANCTL_OP_PING, 0, NULL) < 0)
 		return false;
 	printf("PONG\n");
 	return true;
 }
 
-bool	do_status(int fd)
+bool	do_status(fanctl_t *h)
 {
-	proto_frame_t	resp;
-	bool		ok;
+	struct fanctl_status	st;
 
-	ok = false;
-	for (int i = 0; i < 3; i++)
-	{
-		if (req_w8(fd, PROTO_CMD_STATUS_REQ, NULL, 0, &resp))
-		{
-			ok = true;
-			break;
-		}
-	}
-	if (!ok || resp.cmd != PROTO_CMD_STATUS_RESP || resp.len != sizeof(status_resp_t))
+	if (call_retry(h, FANCTL_OP_STATUS, 0, &st) < 0)
 		return false;
-	decode_status_resp(&resp);
+	print_status(&st);
 	return true;
 }
 
-bool	do_set_fan_mode(int fd, uint8_t mode)
+bool	do_set_fan_mode(fanctl_t *h, uint8_t mode)
+{
+	return print_ack(FANCTL_OP_SET_FAN_MODE, call_retry(h, FANCTL_OP_SET_FAN_MODE, mode, NULL));
+}
+
+bool	do_set_fan_state(fanctl_t *h, uint8_t state)
 {
-	proto_frame_t	resp;
-	uint8_t		payload[1];
-	bool		ok;
+	return print_ack(FANCTL_OP_SET_FAN_STATE, call_retry(h, FANCTL_OP_SET_FAN_STATE, state, NULL));
+}
+
+bool	do_set_threshold(fanctl_t *h, float temp)
+{
+	return print_ack(FANCTL_OP_SET_THRESHOLD,
+		call_retry(h, FANCTL_OP_SET_THRESHOLD, (int16_t)(temp * 100.0f), NULL));
+}
 
+/* Same command through fanctld, when it serves this tty, with the same output */
+bool	do_daemon(int dfd, uint8_t op, int16_t arg)
+{
+	struct fanctld_req	req;
+	struct fanctld_resp	dresp;
+	bool			ok;
+
+	memset(&req, 0, sizeof(req));
+	req.version = FANCTLD_VERSION;
+	req.op = op;
+	req.arg = arg;
 	ok = false;
-	payload[0] = mode;
 	for (int i = 0; i < 3; i++)
 	{
-		if (req_w8(fd, PROTO_CMD_SET_FAN_MODE, payload, 1, &resp))
+		req.tag = (uint32_t)i;
+		if (fanctld_call(dfd, &req, &dresp, sizeof(dresp)) < 0)
+			return false;
+		if (dresp.result != -ETIMEDOUT)
 		{
 			ok = true;
 			break;
 		}
 	}
-	if (!ok || resp.cmd != PROTO_CMD_ACK || resp.len != 2)
+	if (!ok || (dresp.result && op < FANCTLD_OP_SET_FAN_MODE))
 		return false;
-	decode_ack(&resp);
+	if (op == FANCTLD_OP_PING)
+	{
+		printf("PONG\n");
+		return true;
+	}
+	if (op == FANCTLD_OP_STATUS)
+	{
+		print_status(&dresp.status);
+		return true;
+	}
+	return print_ack(op, dresp.result);
+}
+
+/*
+ * Only listen to the tty for `seconds`, e.g. to capture a node's boot
+ * log with -w. Whatever arrives is counted, nothing is parsed.
+ */
+bool	do_record(int fd, int seconds)
+{
+	uint8_t	buf[256];
+	long	total;
+	int	deadline_ms;
+	int	n;
+
+	total = 0;
+	deadline_ms = get_curr_time_milli() + seconds * 1000;
+	while (get_curr_time_milli() < deadline_ms)
+	{
+		n = serial_read(fd, buf, sizeof(buf), 100);
+		if (n < 0)
+			return false;
+		total += n;
+	}
+	printf("Recorded %ld bytes\n", total);
 	return true;
 }
 
-bool	do_set_fan_state(int fd, uint8_t state)
+/*
+ * Batch mode (batch.h): the tty stays open with one libfanctl handle, so
+ * the parser and SEQ carry over from one command to the next and up to
+ * `depth` commands are pipelined. Through fanctld when it serves the tty.
+ */
+static void	batch_print(void *ctx, const batch_rec_t *r)
 {
-	proto_frame_t	resp;
-	uint8_t		payload[1];
-	bool		ok;
+	(void)ctx;
+	if (!r->result && r->op == FANCTL_OP_PING)
+		printf("PONG\n");
+	else if (!r->result && r->op == FANCTL_OP_STATUS)
+		print_status(&r->status);
+	else if (r->op < FANCTL_OP_SET_FAN_MODE || !print_ack(r->op, r->result))
+		fprintf(stderr, "line %d: %s: %s\n", r->line, batch_op_name(r->op),
+			strerror(-r->result));
+}
 
-	payload[0] = state;
-	ok = false;
-	for (int i = 0; i < 3; i++)
+bool	do_batch(fanctl_t *h, int dfd, FILE *in, const char *name, unsigned depth)
+{
+	batch_daemon_t	d;
+	batch_fanctl_t	f;
+	batch_ops_t	ops;
+	batch_t		*b;
+	int		ret;
+
+	b = batch_load(in, name);
+	if (!b)
+		return false;
+	if (dfd >= 0)
 	{
-		if (req_w8(fd, PROTO_CMD_SET_FAN_STATE, payload, 1, &resp))
-		{
-			ok = true;
-			break;
-		}
+		d.fd = dfd;
+		d.addr = FANCTL_ADDR_NONE;
+		batch_daemon_ops(&ops, &d);
+	}
+	else
+	{
+		f.h = h;
+		f.addr = FANCTL_ADDR_NONE;
+		batch_fanctl_ops(&ops, &f);
 	}
-	if (!ok || resp.cmd != PROTO_CMD_ACK || resp.len != 2)
+	ops.depth = depth;
+	ops.retries = 2; // as the single commands
+	ops.print = batch_print;
+	ret = batch_run(b, &ops);
+	fflush(stdout);
+	batch_summary(b, stderr);
+	batch_free(b);
+	return ret == 0;
+}
+
+/* Watch mode (watch.h), on the tty or through fanctld */
+bool	do_watch(fanctl_t *h, int dfd, int argc, char **argv)
+{
+	watch_daemon_t	d;
+	watch_fanctl_t	f;
+	watch_ops_t	ops;
+	watch_cfg_t	cfg;
+
+	if (!watch_parse_args(argc, argv, &cfg))
+	{
+		fprintf(stderr, "usage: " WATCH_USAGE "\n");
 		return false;
-	decode_ack(&resp);
-	return true;
+	}
+	if (dfd >= 0)
+	{
+		d.fd = dfd;
+		watch_daemon_ops(&ops, &d);
+	}
+	else
+	{
+		f.h = h;
+		watch_fanctl_ops(&ops, &f);
+	}
+	return watch_run(&cfg, &ops) == 0;
 }
 
-bool	do_set_threshold(int fd, float temp)
+/* Bench mode (bench.h), always on the tty itself */
+bool	do_bench(fanctl_t *h, int dfd, int argc, char **argv)
 {
-	proto_frame_t	resp;
-	uint8_t		payload[2];
-	int16_t		temp_x100;
-	bool		ok;
-
-	temp_x100 = (int16_t)(temp * 100.0f);
-	payload[0] = (uint8_t)((temp_x100 >> 8) & 0xFF);
-	payload[1] = (uint8_t)(temp_x100 & 0xFF);
-	ok = false;
-	for (int i = 0; i < 3; i++)
+	bench_cfg_t	cfg;
+
+	if (!bench_parse_args(argc, argv, &cfg))
 	{
-		if (req_w8(fd, PROTO_CMD_SET_THRESHOLD, payload, 2, &resp))
-		{
-			ok = true;
-			break;
-		}
+		fprintf(stderr, "usage: " BENCH_USAGE "\n");
+		return false;
 	}
-	if (!ok || resp.cmd != PROTO_CMD_ACK || resp.len != 2)
+	if (dfd >= 0)
+	{
+		fprintf(stderr, "fanctld serves this tty: stop it to bench the link itself\n");
 		return false;
-	decode_ack(&resp);
-	return true;
+	}
+	return bench_run(h, &cfg) == 0;
 }
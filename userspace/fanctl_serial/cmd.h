@@ -2,9 +2,17 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 
-bool	do_ping(int fd);
-bool	do_status(int fd);
-bool	do_set_fan_mode(int fd, uint8_t mode);
-bool	do_set_fan_state(int fd, uint8_t state);
-bool	do_set_threshold(int fd, float temp);
+#include "libfanctl.h"
+
+bool	do_ping(fanctl_t *h);
+bool	do_status(fanctl_t *h);
+bool	do_set_fan_mode(fanctl_t *h, uint8_t mode);
+bool	do_set_fan_state(fanctl_t *h, uint8_t state);
+bool	do_set_threshold(fanctl_t *h, float temp);
+bool	do_record(int fd, int seconds);
+bool	do_daemon(int dfd, uint8_t op, int16_t arg);
+bool	do_batch(fanctl_t *h, int dfd, FILE *in, const char *name, unsigned depth);
+bool	do_watch(fanctl_t *h, int dfd, int argc, char **argv);
+bool	do_bench(fanctl_t *h, int dfd, int argc, char **argv);
@@ -3,60 +3,137 @@
  * ----------------------
  * This userspace application directly communicates with the ESP32
  * over a raw serial device.
+ *
+ * -w file   capture every byte sent and received (common/fanctl_cap.h)
+ *
+ * `batch [-p depth] [script]` runs a script (batch.h, stdin by default)
+ * with the tty opened once, pipelining up to `depth` commands (default 4,
+ * the node queues 8).
+ *
+ * `watch [-i interval_ms] [-n count] [-f csv|json|bin] [-B] [-S dir]` keeps
+ * the tty open and writes one status record per interval to stdout
+ * (watch.h), or appends it to the fanstore history in `dir`.
+ *
+ * `bench [-n count] [-r rate] [-c concurrency] [-o ops] [-T tempC] [-j]`
+ * times `count` requests of each type and prints latency percentiles and
+ * ops/s (bench.h).
+ *
+ * When fanctld serves the same tty, commands go through the daemon, so
+ * in-flight responses are not flushed and the status may come from its
+ * cache. With -w the tty is always opened directly.
  */
 
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "proto.h"
 #include "serial.h"
 #include "cmd.h"
 #include "util.h"
+#include "client.h"
+#include "libfanctl.h"
+#include "watch.h"
+#include "bench.h"
+
+static bool	run_batch(fanctl_t *h, int dfd, int argc, char **argv)
+{
+	const char	*path;
+	unsigned	depth;
+	FILE		*in;
+	bool		res;
+	int		i;
+
+	depth = 4;
+	path = "-";
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			depth = (unsigned)atoi(argv[++i]);
+		else
+			path = argv[i];
+	}
+	if (depth < 1 || depth > FANCTL_MAX_INFLIGHT)
+	{
+		fprintf(stderr, "depth must be 1-%d\n", FANCTL_MAX_INFLIGHT);
+		return false;
+	}
+	in = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!in)
+	{
+		perror(path);
+		return false;
+	}
+	res = do_batch(h, dfd, in, strcmp(path, "-") ? path : "stdin", depth);
+	if (in != stdin)
+		fclose(in);
+	return res;
+}
 
 int main(int argc, char **argv)
 {
-	char	*port;
-	char	*cmd;
-	int	fd;
-	bool	res;
+	char		*port;
+	char		*cmd;
+	char		*cap_path;
+	char		*prog;
+	fanctl_t	*h;
+	int		dfd;
+	bool		res;
+	int		opt;
 
+	prog = argv[0];
+	cap_path = NULL;
+	while ((opt = getopt(argc, argv, "+w:")) != -1)
+	{
+		if (opt != 'w')
+			return 1;
+		cap_path = optarg;
+	}
+	argc -= optind - 1; // positional arguments keep their original indices
+	argv += optind - 1;
 	if (argc < 3)
 	{
-		printf("Usage: %s /dev/ttyXXX <ping|status|auto|manual|on|off|threshold <tempC>>\n", argv[0]);
+		printf("Usage: %s [-w capture] /dev/ttyXXX <ping|status|auto|manual|on|off|threshold <tempC>|record [seconds]|batch [-p depth] [script]|" WATCH_USAGE "|" BENCH_USAGE ">\n", prog);
 		return 1;
 	}
 	port = argv[1];
 	cmd = argv[2];
-	fd = serial_open(port, 115200);
-	if (fd < 0)
+	if (cap_path && !serial_capture_open(cap_path))
+		return 1;
+	h = NULL;
+	dfd = cap_path ? -1 : fanctld_open_for(FANCTLD_KIND_SERIAL, port);
+	if (dfd < 0)
+		h = fanctl_open(port, FANCTL_TR_SERIAL);
+	if (dfd < 0 && !h)
 	{
 		fprintf(stderr, "Failed to open %s\n", port);
 		return 1;
 	}
 	if (strcmp(cmd, "ping") == 0)
 	{
-		res = do_ping(fd);
+		res = dfd >= 0 ? do_daemon(dfd, FANCTLD_OP_PING, 0) : do_ping(h);
 	}
 	else if (strcmp(cmd, "status") == 0)
 	{
-		res = do_status(fd);
+		res = dfd >= 0 ? do_daemon(dfd, FANCTLD_OP_STATUS, 0) : do_status(h);
 	}
 	else if (strcmp(cmd, "auto") == 0)
 	{
-		res = do_set_fan_mode(fd, PROTO_FAN_MODE_AUTO);
+		res = dfd >= 0 ? do_daemon(dfd, FANCTLD_OP_SET_FAN_MODE, PROTO_FAN_MODE_AUTO) : do_set_fan_mode(h, PROTO_FAN_MODE_AUTO);
 	}
 	else if (strcmp(cmd, "manual") == 0)
 	{
-		res = do_set_fan_mode(fd, PROTO_FAN_MODE_MANUAL);
+		res = dfd >= 0 ? do_daemon(dfd, FANCTLD_OP_SET_FAN_MODE, PROTO_FAN_MODE_MANUAL) : do_set_fan_mode(h, PROTO_FAN_MODE_MANUAL);
 	}
 	else if (strcmp(cmd, "on") == 0)
 	{
-		res = do_set_fan_state(fd, PROTO_FAN_STATE_ON);
+		res = dfd >= 0 ? do_daemon(dfd, FANCTLD_OP_SET_FAN_STATE, PROTO_FAN_STATE_ON) : do_set_fan_state(h, PROTO_FAN_STATE_ON);
 	}
 	else if (strcmp(cmd, "off") == 0)
 	{
-		res = do_set_fan_state(fd, PROTO_FAN_STATE_OFF);
+		res = dfd >= 0 ? do_daemon(dfd, FANCTLD_OP_SET_FAN_STATE, PROTO_FAN_STATE_OFF) : do_set_fan_state(h, PROTO_FAN_STATE_OFF);
 	}
 	else if (strcmp(cmd, "threshold") == 0)
 	{
@@ -79,13 +156,38 @@ int main(int argc, char **argv)
 			fprintf(stderr, "Available threshold: -40°C <= temp <= 80°C\n");
 			return 1;
 		}
-		res = do_set_threshold(fd, temp);
+		res = dfd >= 0 ? do_daemon(dfd, FANCTLD_OP_SET_THRESHOLD, (int16_t)(temp * 100.0f)) : do_set_threshold(h, temp);
+	}
+	else if (strcmp(cmd, "record") == 0)
+	{
+		if (!cap_path)
+		{
+			fprintf(stderr, "record needs -w <capture>\n");
+			return 1;
+		}
+		res = do_record(fanctl_dev_fd(h), argc > 3 ? atoi(argv[3]) : 10);
+	}
+	else if (strcmp(cmd, "watch") == 0)
+	{
+		res = do_watch(h, dfd, argc - 2, argv + 2);
+	}
+	else if (strcmp(cmd, "bench") == 0)
+	{
+		res = do_bench(h, dfd, argc - 2, argv + 2);
+	}
+	else if (strcmp(cmd, "batch") == 0)
+	{
+		res = run_batch(h, dfd, argc - 2, argv + 2);
 	}
 	else
 	{
 		fprintf(stderr, "Unknown command: %s\n", cmd);
 		return 1;
 	}
+	fanctl_close(h);
+	serial_capture_close();
+	if (dfd >= 0)
+		close(dfd);
 	if (!res)
 	{
 		fprintf(stderr, "Failed to execute %s\n", cmd);
@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+
+#include "fanctl_cap.h"
+#include "serial.h"
+#include "sclient.h"
+
+#define RX_MASK		(SCLIENT_RX_RING - 1)
+
+typedef struct {
+	bool		in_use;
+	uint8_t		addr;
+	uint8_t		cmd;
+	uint64_t	deadline_ns;
+	sclient_cb_t	cb;
+	void		*arg;
+}	sclient_req_t;
+
+struct sclient {
+	int		tty;
+	int		epfd;
+	int		tfd;
+	bool		want_out; // EPOLLOUT registered on the tty
+	bool		corked; // queue frames, flush on uncork
+	uint8_t		rx[SCLIENT_RX_RING];
+	uint32_t	rx_head; // free-running, written by readv()
+	uint32_t	rx_tail; // free-running, consumed by the parser
+	proto_rx_t	parser;
+	uint8_t		tx[SCLIENT_TX_BUF];
+	size_t		tx_len;
+	sclient_req_t	reqs[256]; // indexed by SEQ
+	unsigned	inflight;
+	uint8_t		next_seq;
+	uint64_t	armed_ns; // timerfd expiry, 0 when disarmed
+	sclient_stats_t	st;
+};
+
+static uint64_t	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+sclient_t	*sclient_attach(int tty_fd)
+{
+	struct epoll_event	ev;
+	sclient_t		*sc;
+
+	sc = calloc(1, sizeof(*sc));
+	if (!sc)
+		return NULL;
+	sc->tty = tty_fd;
+	sc->epfd = epoll_create1(EPOLL_CLOEXEC);
+	sc->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (sc->epfd < 0 || sc->tfd < 0)
+	{
+		perror("sclient");
+		goto fail;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = sc->tty;
+	if (epoll_ctl(sc->epfd, EPOLL_CTL_ADD, sc->tty, &ev) < 0)
+	{
+		perror("epoll_ctl(tty)");
+		goto fail;
+	}
+	ev.data.fd = sc->tfd;
+	if (epoll_ctl(sc->epfd, EPOLL_CTL_ADD, sc->tfd, &ev) < 0)
+	{
+		perror("epoll_ctl(timerfd)");
+		goto fail;
+	}
+	proto_rx_init(&sc->parser);
+	return sc;
+fail:
+	sclient_free(sc);
+	return NULL;
+}
+
+void	sclient_free(sclient_t *sc)
+{
+	if (!sc)
+		return;
+	if (sc->epfd >= 0)
+		close(sc->epfd);
+	if (sc->tfd >= 0)
+		close(sc->tfd);
+	free(sc);
+}
+
+int	sclient_fd(const sclient_t *sc)
+{
+	return sc->epfd;
+}
+
+int	sclient_tty(const sclient_t *sc)
+{
+	return sc->tty;
+}
+
+unsigned	sclient_inflight(const sclient_t *sc)
+{
+	return sc->inflight;
+}
+
+void	sclient_stats(const sclient_t *sc, sclient_stats_t *out)
+{
+	*out = sc->st;
+}
+
+/* Deadlines ---------------------------------------------------------------- */
+
+static void	arm_timer(sclient_t *sc, uint64_t at_ns)
+{
+	struct itimerspec	its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = (time_t)(at_ns / 1000000000ULL);
+	its.it_value.tv_nsec = (long)(at_ns % 1000000000ULL);
+	timerfd_settime(sc->tfd, TFD_TIMER_ABSTIME, &its, NULL); // zero disarms
+	sc->armed_ns = at_ns;
+}
+
+static void	complete(sclient_t *sc, uint8_t seq, int result, const proto_frame_t *resp)
+{
+	sclient_req_t	r;
+
+	r = sc->reqs[seq];
+	sc->reqs[seq].in_use = false;
+	sc->inflight--;
+	if (result == -ETIMEDOUT)
+		sc->st.timeouts++;
+	else
+		sc->st.completed++;
+	if (r.cb)
+		r.cb(r.arg, result, resp); // may submit again
+}
+
+static void	expire(sclient_t *sc)
+{
+	uint64_t	now;
+	uint64_t	next;
+	int		i;
+
+	now = mono_ns();
+	for (i = 0; i < 256; i++)
+	{
+		if (sc->reqs[i].in_use && sc->reqs[i].deadline_ns <= now)
+			complete(sc, (uint8_t)i, -ETIMEDOUT, NULL);
+	}
+	next = 0;
+	for (i = 0; i < 256; i++)
+	{
+		if (sc->reqs[i].in_use && (next == 0 || sc->reqs[i].deadline_ns < next))
+			next = sc->reqs[i].deadline_ns;
+	}
+	arm_timer(sc, next);
+}
+
+static void	fail_all(sclient_t *sc, int result)
+{
+	int	i;
+
+	for (i = 0; i < 256; i++)
+	{
+		if (sc->reqs[i].in_use)
+			complete(sc, (uint8_t)i, result, NULL);
+	}
+	arm_timer(sc, 0);
+}
+
+/* TX ----------------------------------------------------------------------- */
+
+static void	want_out(sclient_t *sc, bool on)
+{
+	struct epoll_event	ev;
+
+	if (sc->want_out == on)
+		return;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | (on ? EPOLLOUT : 0);
+	ev.data.fd = sc->tty;
+	epoll_ctl(sc->epfd, EPOLL_CTL_MOD, sc->tty, &ev);
+	sc->want_out = on;
+}
+
+static int	flush_tx(sclient_t *sc)
+{
+	ssize_t	n;
+
+	while (sc->tx_len > 0)
+	{
+		n = write(sc->tty, sc->tx, sc->tx_len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				sc->st.tx_blocked++;
+				break; // rest goes out on EPOLLOUT
+			}
+			perror("write");
+			return -EIO;
+		}
+		serial_capture(FANCTL_CAP_DIR_TX, sc->tx, (size_t)n);
+		sc->st.tx_bytes += (uint64_t)n;
+		sc->tx_len -= (size_t)n;
+		memmove(sc->tx, sc->tx + n, sc->tx_len);
+	}
+	want_out(sc, sc->tx_len > 0);
+	return 0;
+}
+
+static int	queue_frame(sclient_t *sc, uint8_t addr, uint8_t cmd, uint8_t seq,
+			const uint8_t *payload, uint8_t len)
+{
+	uint8_t		buf[PROTO_MAX_FRAME];
+	uint16_t	flen;
+
+	if (!proto_build_frame_addr(addr, cmd, seq, payload, len, buf, &flen))
+		return -EINVAL;
+	if (sc->tx_len + flen > sizeof(sc->tx) && sc->corked && flush_tx(sc) < 0)
+		return -EIO;
+	if (sc->tx_len + flen > sizeof(sc->tx))
+		return -ENOBUFS;
+#ifdef DEBUG
+	printf("TX frame: ");
+	for (int i = 0; i < flen; i++)
+		printf("%02X ", buf[i]);
+	printf("\n");
+#endif
+	memcpy(sc->tx + sc->tx_len, buf, flen);
+	sc->tx_len += flen;
+	return sc->corked ? 0 : flush_tx(sc);
+}
+
+/* While corked, submitted frames are written together on uncork */
+int	sclient_cork(sclient_t *sc, bool on)
+{
+	sc->corked = on;
+	return on ? 0 : flush_tx(sc);
+}
+
+int	sclient_send(sclient_t *sc, uint8_t addr, uint8_t cmd, const uint8_t *payload,
+		uint8_t len)
+{
+	return queue_frame(sc, addr, cmd, sc->next_seq++, payload, len);
+}
+
+int	sclient_submit(sclient_t *sc, uint8_t addr, uint8_t cmd, const uint8_t *payload,
+		uint8_t len, int timeout_ms, sclient_cb_t cb, void *arg)
+{
+	sclient_req_t	*r;
+	uint8_t		seq;
+	int		ret;
+
+	if (addr == PROTO_ADDR_BROADCAST) // never answered, see sclient_send()
+		return -EINVAL;
+	if (sc->inflight >= SCLIENT_MAX_INFLIGHT)
+		return -EAGAIN;
+	seq = sc->next_seq;
+	while (sc->reqs[seq].in_use) // round-robin, a late reply hits a free slot
+		seq++;
+	ret = queue_frame(sc, addr, cmd, seq, payload, len);
+	if (ret < 0)
+		return ret;
+	sc->next_seq = (uint8_t)(seq + 1);
+	r = &sc->reqs[seq];
+	r->in_use = true;
+	r->addr = addr;
+	r->cmd = cmd & ~PROTO_CMD_F_TRACE;
+	r->deadline_ns = mono_ns() + (uint64_t)timeout_ms * 1000000ULL;
+	r->cb = cb;
+	r->arg = arg;
+	sc->inflight++;
+	sc->st.submitted++;
+	if (sc->inflight > sc->st.max_inflight)
+		sc->st.max_inflight = sc->inflight;
+	if (sc->armed_ns == 0 || r->deadline_ns < sc->armed_ns)
+		arm_timer(sc, r->deadline_ns);
+	return seq;
+}
+
+/* RX ----------------------------------------------------------------------- */
+
+static bool	resp_matches(uint8_t req_cmd, const proto_frame_t *f)
+{
+	switch (req_cmd)
+	{
+		case PROTO_CMD_PING:
+			return f->cmd == PROTO_CMD_PONG;
+		case PROTO_CMD_STATUS_REQ:
+			return f->cmd == PROTO_CMD_STATUS_RESP;
+		default:
+			return f->cmd == PROTO_CMD_ACK && f->len >= 1 && f->payload[0] == req_cmd;
+	}
+}
+
+static void	dispatch(sclient_t *sc, proto_frame_t *f)
+{
+	sclient_req_t	*r;
+
+	sc->st.rx_frames++;
+	proto_trace_strip(f, NULL); // node timings are fanctl_trace's business
+	r = &sc->reqs[f->seq];
+	if (!r->in_use || r->addr != f->addr || !resp_matches(r->cmd, f))
+	{
+		sc->st.stale++; // late reply to a timed-out request, or noise
+		return;
+	}
+	complete(sc, f->seq, 0, f);
+}
+
+static void	parse_rx(sclient_t *sc)
+{
+	proto_frame_t	f;
+	uint8_t		b;
+
+	while (sc->rx_tail != sc->rx_head)
+	{
+		b = sc->rx[sc->rx_tail & RX_MASK];
+		sc->rx_tail++;
+		if (proto_rx_feed(&sc->parser, b, &f))
+			dispatch(sc, &f);
+	}
+}
+
+static int	read_rx(sclient_t *sc)
+{
+	struct iovec	iov[2];
+	uint32_t	head;
+	uint32_t	space;
+	uint32_t	first;
+	ssize_t		n;
+
+	for (;;)
+	{
+		head = sc->rx_head & RX_MASK;
+		space = SCLIENT_RX_RING - (sc->rx_head - sc->rx_tail);
+		first = SCLIENT_RX_RING - head < space ? SCLIENT_RX_RING - head : space;
+		iov[0].iov_base = sc->rx + head;
+		iov[0].iov_len = first;
+		iov[1].iov_base = sc->rx;
+		iov[1].iov_len = space - first;
+		n = readv(sc->tty, iov, iov[1].iov_len ? 2 : 1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			perror("read");
+			return -EIO;
+		}
+		if (n == 0)
+		{
+			fprintf(stderr, "read: EOF (peer closed)\n");
+			return -EIO;
+		}
+		serial_capture(FANCTL_CAP_DIR_RX, iov[0].iov_base,
+			(size_t)n < first ? (size_t)n : first);
+		if ((uint32_t)n > first)
+			serial_capture(FANCTL_CAP_DIR_RX, sc->rx, (size_t)n - first);
+#ifdef DEBUG
+		printf("RX bytes: ");
+		for (ssize_t i = 0; i < n; i++)
+			printf("%02X ", sc->rx[(sc->rx_head + i) & RX_MASK]);
+		printf("\n");
+#endif
+		sc->rx_head += (uint32_t)n;
+		sc->st.rx_bytes += (uint64_t)n;
+		parse_rx(sc);
+		if ((uint32_t)n < space) // tty drained
+			return 0;
+	}
+}
+
+/* Loop --------------------------------------------------------------------- */
+
+int	sclient_run(sclient_t *sc, int timeout_ms)
+{
+	struct epoll_event	ev[4];
+	uint64_t		ticks;
+	int			ret;
+	int			n;
+	int			i;
+
+	n = epoll_wait(sc->epfd, ev, 4, timeout_ms);
+	if (n < 0)
+		return errno == EINTR ? 0 : -errno;
+	ret = 0;
+	for (i = 0; i < n && ret == 0; i++)
+	{
+		if (ev[i].data.fd == sc->tfd)
+		{
+			if (read(sc->tfd, &ticks, sizeof(ticks)) == sizeof(ticks))
+				expire(sc);
+			continue;
+		}
+		if (ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			ret = read_rx(sc);
+		if (ret == 0 && (ev[i].events & EPOLLOUT))
+			ret = flush_tx(sc);
+	}
+	if (ret < 0)
+		fail_all(sc, ret);
+	return ret;
+}
+
+/*
+ * Result of a matched response, as the driver reports it: 0, -EOPNOTSUPP
+ * (invalid argument), -EBUSY (wrong state) or -EPROTO. `st` is filled
+ * from a STATUS_RESP and may be NULL otherwise.
+ */
+int	sclient_decode(const proto_frame_t *resp, struct fanctl_status *st)
+{
+	const uint8_t	*p;
+
+	p = resp->payload;
+	if (resp->cmd == PROTO_CMD_PONG)
+		return 0;
+	if (resp->cmd == PROTO_CMD_STATUS_RESP)
+	{
+		if (resp->len < sizeof(status_resp_t) || !st)
+			return -EPROTO;
+		st->temp_x100 = (int16_t)((p[0] << 8) | p[1]);
+		st->humidity_x100 = (uint16_t)((p[2] << 8) | p[3]);
+		st->fan_mode = p[4];
+		st->fan_state = p[5];
+		st->errors = (uint16_t)((p[6] << 8) | p[7]);
+		return 0;
+	}
+	if (resp->cmd != PROTO_CMD_ACK || resp->len < 2)
+		return -EPROTO;
+	if (p[1] == PROTO_ERR_OK)
+		return 0;
+	if (p[1] == PROTO_ERR_INVALID_ARG)
+		return -EOPNOTSUPP;
+	if (p[1] == PROTO_ERR_STATE)
+		return -EBUSY;
+	return -EPROTO;
+}
+
+/* Synchronous call --------------------------------------------------------- */
+
+typedef struct {
+	bool		done;
+	int		result;
+	proto_frame_t	*out;
+}	call_wait_t;
+
+static void	call_done(void *arg, int result, const proto_frame_t *resp)
+{
+	call_wait_t	*w;
+
+	w = arg;
+	w->done = true;
+	w->result = result;
+	if (resp && w->out)
+		*w->out = *resp;
+}
+
+int	sclient_call(sclient_t *sc, uint8_t addr, uint8_t cmd, const uint8_t *payload,
+		uint8_t len, int timeout_ms, proto_frame_t *out)
+{
+	call_wait_t	w;
+	int		ret;
+
+	memset(&w, 0, sizeof(w));
+	w.out = out;
+	ret = sclient_submit(sc, addr, cmd, payload, len, timeout_ms, call_done, &w);
+	if (ret < 0)
+		return ret;
+	while (!w.done)
+	{
+		ret = sclient_run(sc, -1);
+		if (ret < 0 && !w.done)
+			return ret;
+	}
+	return w.result;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "proto.h"
+#include "fanctl_uapi.h"
+
+/*
+ * Event-driven serial client
+ * --------------------------
+ * Non-blocking request engine for the raw tty path:
+ *  - RX ring buffer, filled with readv() and drained by the frame parser
+ *  - TX buffer, flushed whenever the tty takes more (EPOLLOUT)
+ *  - in-flight table indexed by SEQ, so up to SCLIENT_MAX_INFLIGHT
+ *    requests can be pipelined on the link
+ *  - per-request deadlines on a single timerfd, armed for the earliest
+ * Everything happens in sclient_run(). sclient_fd() is an epoll fd that
+ * becomes readable when there is work, so a client can be nested in
+ * another event loop. Not thread-safe: callers serialize sclient_* calls.
+ *
+ * Pipelining needs a peer that queues requests (fan_node, fansim) and a
+ * point-to-point or full-duplex link; a half-duplex RS-485 bus needs one
+ * request at a time.
+ */
+
+#define SCLIENT_RX_RING		4096 // power of two
+#define SCLIENT_TX_BUF		4096
+#define SCLIENT_MAX_INFLIGHT	255 // one SEQ stays free so a stale reply can't match
+
+/*
+ * result: 0 and the response frame (trace trailer stripped),
+ *         -ETIMEDOUT, or -EIO when the tty failed (resp is NULL)
+ */
+typedef void	(*sclient_cb_t)(void *arg, int result, const proto_frame_t *resp);
+
+typedef struct sclient	sclient_t;
+
+typedef struct {
+	uint64_t	submitted;
+	uint64_t	completed;
+	uint64_t	timeouts;
+	uint64_t	stale; // responses with no matching request
+	uint64_t	rx_bytes;
+	uint64_t	rx_frames;
+	uint64_t	tx_bytes;
+	uint64_t	tx_blocked; // writes that hit EAGAIN
+	unsigned	max_inflight;
+}	sclient_stats_t;
+
+sclient_t	*sclient_attach(int tty_fd); // fd from serial_open(), not owned
+void		sclient_free(sclient_t *sc);
+int		sclient_fd(const sclient_t *sc);
+int		sclient_tty(const sclient_t *sc);
+unsigned	sclient_inflight(const sclient_t *sc);
+void		sclient_stats(const sclient_t *sc, sclient_stats_t *out);
+int		sclient_submit(sclient_t *sc, uint8_t addr, uint8_t cmd, const uint8_t *payload,
+			uint8_t len, int timeout_ms, sclient_cb_t cb, void *arg);
+int		sclient_cork(sclient_t *sc, bool on);
+int		sclient_send(sclient_t *sc, uint8_t addr, uint8_t cmd, const uint8_t *payload,
+			uint8_t len);
+int		sclient_run(sclient_t *sc, int timeout_ms);
+int		sclient_decode(const proto_frame_t *resp, struct fanctl_status *st);
+int		sclient_call(sclient_t *sc, uint8_t addr, uint8_t cmd, const uint8_t *payload,
+			uint8_t len, int timeout_ms, proto_frame_t *out);
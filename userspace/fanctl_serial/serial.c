@@ -6,6 +6,62 @@
 #include <poll.h>
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "fanctl_cap.h"
+
+/*
+ * Optional byte-stream capture: every chunk written to or read from the
+ * tty is appended to a file in the driver's capture format
+ * (common/fanctl_cap.h), so tools/fanreplay reads both.
+ */
+static FILE	*g_cap;
+
+bool	serial_capture_open(const char *path)
+{
+	g_cap = fopen(path, "wb");
+	if (!g_cap)
+	{
+		perror(path);
+		return false;
+	}
+	return true;
+}
+
+void	serial_capture_close(void)
+{
+	if (g_cap)
+		fclose(g_cap);
+	g_cap = NULL;
+}
+
+void	serial_capture(uint8_t dir, const uint8_t *data, size_t len)
+{
+	uint8_t			buf[sizeof(struct fanctl_cap_rec) + FANCTL_CAP_MAX_CHUNK];
+	struct fanctl_cap_rec	rec;
+	struct timespec		ts;
+	size_t			chunk;
+
+	if (!g_cap)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	memset(&rec, 0, sizeof(rec));
+	rec.ts_ns = (fanctl_u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	rec.magic = FANCTL_CAP_MAGIC;
+	rec.dir = dir;
+	while (len > 0)
+	{
+		chunk = len < FANCTL_CAP_MAX_CHUNK ? len : FANCTL_CAP_MAX_CHUNK;
+		rec.len = (fanctl_u16)chunk;
+		memcpy(buf, &rec, sizeof(rec));
+		memcpy(buf + sizeof(rec), data, chunk);
+		fwrite(buf, sizeof(rec) + chunk, 1, g_cap); // one call per record
+		data += chunk;
+		len -= chunk;
+	}
+	fflush(g_cap); // keep the capture usable if the tool is killed
+}
 
 static speed_t	baud_rate(int baud)
 {
@@ -60,6 +116,7 @@ bool	serial_write(int fd, const uint8_t *buf, uint16_t len)
 			perror("open");
 			return false;
 		}
+		serial_capture(FANCTL_CAP_DIR_TX, buf + offset, (size_t)n);
 		offset += (uint16_t)n;
 	}
 	return true;
@@ -101,5 +158,6 @@ int	serial_read(int fd, uint8_t *buf, int cap, int timeout_ms)
 		fprintf(stderr, "read: EOF (peer closed)\n");
 		return -1;
 	}
+	serial_capture(FANCTL_CAP_DIR_RX, buf, (size_t)n);
 	return n;
 }
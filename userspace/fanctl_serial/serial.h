@@ -2,7 +2,11 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 int	serial_open(const char *dev, int baud);
 bool	serial_write(int fd, const uint8_t *buf, uint16_t len);
 int	serial_read(int fd, uint8_t *buf, int cap, int timeout_ms);
+bool	serial_capture_open(const char *path);
+void	serial_capture_close(void);
+void	serial_capture(uint8_t dir, const uint8_t *data, size_t len); // FANCTL_CAP_DIR_*
@@ -0,0 +1 @@
+#include "../fanctl_load/hist.c"
@@ -0,0 +1,316 @@
+/*
+ * fanctl_trace
+ * ------------
+ * Per-request latency breakdown from host and node timestamps, see
+ * common/fanctl_trace.h for the record format.
+ *
+ *   fanctl_trace [-k slowest] [-v] [file ...]
+ *   fanctl_trace -s tty [-a addr] [-c cmd] [-n count] [-i interval_ms]
+ *                [-o file] [-k slowest] [-v]
+ *
+ * Without -s, reads trace records written by the driver (stdin when no
+ * file is given):
+ *
+ *   echo 2 > /sys/kernel/debug/fanctl/trace_enable
+ *   ... run the workload ...
+ *   echo 0 > /sys/kernel/debug/fanctl/trace_enable
+ *   cat /sys/kernel/debug/fanctl/trace[0-9]* | fanctl_trace
+ *
+ * -s   probe a raw tty itself (no driver): send flagged requests one at a
+ *      time and record the same timestamps from userspace
+ * -a   node address for the probe (default: unaddressed frames)
+ * -c   probe command, status or ping (default status)
+ * -n   number of probe requests (default 100)
+ * -i   pause between probe requests in ms (default 0)
+ * -o   also write the probe records to this file
+ * -k   print the waterfall of the N slowest requests (default 5)
+ * -v   print the waterfall of every request
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "proto.h"
+#include "serial.h"
+#include "report.h"
+
+#define PROBE_TIMEOUT_MS	1000
+
+typedef struct {
+	struct fanctl_trace_rec	*recs;
+	size_t			n;
+	size_t			cap;
+}	rec_buf_t;
+
+static unsigned long long	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct fanctl_trace_rec	*rec_push(rec_buf_t *b)
+{
+	struct fanctl_trace_rec	*p;
+	size_t			cap;
+
+	if (b->n == b->cap)
+	{
+		cap = b->cap ? b->cap * 2 : 1024;
+		p = realloc(b->recs, cap * sizeof(*p));
+		if (!p)
+		{
+			perror("realloc");
+			return NULL;
+		}
+		b->recs = p;
+		b->cap = cap;
+	}
+	p = &b->recs[b->n++];
+	memset(p, 0, sizeof(*p));
+	return p;
+}
+
+/* Append the records of a driver trace stream, skipping malformed ones */
+static bool	load_stream(rec_buf_t *b, FILE *in, const char *name, size_t *bad)
+{
+	struct fanctl_trace_rec	rec;
+	struct fanctl_trace_rec	*p;
+
+	while (fread(&rec, sizeof(rec), 1, in) == 1)
+	{
+		if (rec.magic != FANCTL_TRACE_MAGIC)
+		{
+			(*bad)++;
+			continue;
+		}
+		p = rec_push(b);
+		if (!p)
+			return false;
+		*p = rec;
+	}
+	if (ferror(in))
+	{
+		perror(name);
+		return false;
+	}
+	return true;
+}
+
+static int	cmp_submit(const void *a, const void *b)
+{
+	const struct fanctl_trace_rec	*ra;
+	const struct fanctl_trace_rec	*rb;
+
+	ra = a;
+	rb = b;
+	return ra->submit_ns < rb->submit_ns ? -1 : ra->submit_ns > rb->submit_ns ? 1 : 0;
+}
+
+/*
+ * Send one flagged request and wait for its response. Without a driver
+ * there is no scheduler, so the wire is granted on submission.
+ */
+static void	probe_one(int fd, uint8_t addr, uint8_t cmd, uint8_t seq,
+			struct fanctl_trace_rec *r)
+{
+	uint8_t			buf[PROTO_MAX_FRAME];
+	uint8_t			rbuf[128];
+	uint16_t		len;
+	proto_rx_t		rx;
+	proto_frame_t		f;
+	proto_trace_t		t;
+	unsigned long long	deadline;
+	int			n;
+	int			i;
+
+	r->magic = FANCTL_TRACE_MAGIC;
+	r->addr = addr;
+	r->cmd = cmd;
+	r->seq = seq;
+	r->submit_ns = mono_ns();
+	r->grant_ns = r->submit_ns;
+	if (!proto_build_frame_addr(addr, cmd | PROTO_CMD_F_TRACE, seq, NULL, 0, buf, &len)
+		|| !serial_write(fd, buf, len))
+	{
+		r->result = -EIO;
+		r->done_ns = mono_ns();
+		return;
+	}
+	r->tx_ns = mono_ns();
+	r->result = -ETIMEDOUT;
+	proto_rx_init(&rx);
+	deadline = r->tx_ns + PROBE_TIMEOUT_MS * 1000000ULL;
+	while (r->result == -ETIMEDOUT && mono_ns() < deadline)
+	{
+		n = serial_read(fd, rbuf, sizeof(rbuf), (int)((deadline - mono_ns()) / 1000000) + 1);
+		if (n < 0)
+		{
+			r->result = -EIO;
+			break;
+		}
+		for (i = 0; i < n; i++)
+		{
+			if (!proto_rx_feed(&rx, rbuf[i], &f) || f.seq != seq
+				|| (addr != PROTO_ADDR_NONE && f.addr != addr))
+				continue;
+			r->rx_ns = mono_ns();
+			if (proto_trace_strip(&f, &t))
+			{
+				r->flags |= FANCTL_TRACE_F_NODE;
+				r->node_parse_us = t.parse_us;
+				r->node_dequeue_us = t.dequeue_us;
+				r->node_handler_us = t.handler_us;
+				r->node_send_us = t.send_us;
+			}
+			r->result = 0;
+			break;
+		}
+	}
+	r->done_ns = mono_ns();
+}
+
+static bool	probe(rec_buf_t *b, const char *dev, uint8_t addr, uint8_t cmd,
+			int count, int interval_ms)
+{
+	struct fanctl_trace_rec	*r;
+	int			fd;
+	int			i;
+
+	fd = serial_open(dev, 115200);
+	if (fd < 0)
+		return false;
+	for (i = 0; i < count; i++)
+	{
+		r = rec_push(b);
+		if (!r)
+			break;
+		probe_one(fd, addr, cmd, (uint8_t)i, r);
+		if (r->result == -EIO)
+		{
+			fprintf(stderr, "%s: I/O error\n", dev);
+			break;
+		}
+		if (interval_ms > 0)
+			usleep((useconds_t)interval_ms * 1000);
+	}
+	close(fd);
+	return true;
+}
+
+static void	usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-k slowest] [-v] [file ...]\n"
+		"       %s -s tty [-a addr] [-c status|ping] [-n count] [-i interval_ms]\n"
+		"          [-o file] [-k slowest] [-v]\n", prog, prog);
+}
+
+int	main(int argc, char **argv)
+{
+	rec_buf_t	b;
+	const char	*tty;
+	const char	*out_path;
+	FILE		*f;
+	size_t		bad;
+	uint8_t		addr;
+	uint8_t		cmd;
+	int		count;
+	int		interval_ms;
+	int		slowest;
+	bool		all;
+	bool		ok;
+	int		opt;
+	int		i;
+
+	memset(&b, 0, sizeof(b));
+	tty = NULL;
+	out_path = NULL;
+	bad = 0;
+	addr = PROTO_ADDR_NONE;
+	cmd = PROTO_CMD_STATUS_REQ;
+	count = 100;
+	interval_ms = 0;
+	slowest = 5;
+	all = false;
+	while ((opt = getopt(argc, argv, "s:a:c:n:i:o:k:vh")) != -1)
+	{
+		switch (opt)
+		{
+			case 's': tty = optarg; break;
+			case 'a': addr = (uint8_t)strtoul(optarg, NULL, 0); break;
+			case 'c':
+				if (!strcmp(optarg, "status"))
+					cmd = PROTO_CMD_STATUS_REQ;
+				else if (!strcmp(optarg, "ping"))
+					cmd = PROTO_CMD_PING;
+				else
+				{
+					usage(argv[0]);
+					return 2;
+				}
+				break;
+			case 'n': count = atoi(optarg); break;
+			case 'i': interval_ms = atoi(optarg); break;
+			case 'o': out_path = optarg; break;
+			case 'k': slowest = atoi(optarg); break;
+			case 'v': all = true; break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+
+	if (tty)
+	{
+		ok = probe(&b, tty, addr, cmd, count, interval_ms);
+		if (ok && out_path)
+		{
+			f = fopen(out_path, "wb");
+			if (!f || fwrite(b.recs, sizeof(*b.recs), b.n, f) != b.n)
+			{
+				perror(out_path);
+				ok = false;
+			}
+			if (f)
+				fclose(f);
+		}
+	}
+	else if (optind == argc)
+		ok = load_stream(&b, stdin, "stdin", &bad);
+	else
+	{
+		ok = true;
+		for (i = optind; ok && i < argc; i++)
+		{
+			f = fopen(argv[i], "rb");
+			if (!f)
+			{
+				perror(argv[i]);
+				ok = false;
+				break;
+			}
+			ok = load_stream(&b, f, argv[i], &bad);
+			fclose(f);
+		}
+	}
+	if (!ok)
+	{
+		free(b.recs);
+		return 1;
+	}
+	if (bad)
+		fprintf(stderr, "skipped %zu malformed records\n", bad);
+
+	// per-CPU streams are merged in submission order
+	qsort(b.recs, b.n, sizeof(*b.recs), cmp_submit);
+	trace_print_report(stdout, b.recs, b.n, slowest, all);
+	free(b.recs);
+	return 0;
+}
@@ -0,0 +1 @@
+#include "../../common/proto.c"
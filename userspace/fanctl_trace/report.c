@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "proto.h"
+#include "hist.h"
+#include "report.h"
+
+const char	*g_seg_names[SEG_NR] = {
+	[SEG_QUEUE]		= "queue",
+	[SEG_TX]		= "tx",
+	[SEG_LINK]		= "link",
+	[SEG_NODE_QUEUE]	= "node_queue",
+	[SEG_NODE_WAKE]		= "node_wake",
+	[SEG_NODE_HANDLER]	= "node_handler",
+	[SEG_RX]		= "rx",
+	[SEG_TOTAL]		= "total",
+};
+
+// waterfall glyph per segment
+static const char	g_seg_glyph[SEG_NR] = {
+	[SEG_QUEUE]		= '.',
+	[SEG_TX]		= '>',
+	[SEG_LINK]		= '~',
+	[SEG_NODE_QUEUE]	= 'q',
+	[SEG_NODE_WAKE]		= 'w',
+	[SEG_NODE_HANDLER]	= 'H',
+	[SEG_RX]		= '<',
+};
+
+static long long	span(unsigned long long from, unsigned long long to)
+{
+	if (!from || !to || to < from)
+		return -1;
+	return (long long)(to - from);
+}
+
+// node clock is µs and wraps, only differences are used
+static long long	node_span(unsigned from_us, unsigned to_us)
+{
+	return (long long)(fanctl_u32)(to_us - from_us) * 1000;
+}
+
+void	trace_segments(const struct fanctl_trace_rec *r, long long out[SEG_NR])
+{
+	long long	rtt;
+	long long	node;
+	int		i;
+
+	for (i = 0; i < SEG_NR; i++)
+		out[i] = -1;
+	out[SEG_QUEUE] = span(r->submit_ns, r->grant_ns);
+	out[SEG_TX] = span(r->grant_ns, r->tx_ns);
+	out[SEG_RX] = span(r->rx_ns, r->done_ns);
+	out[SEG_TOTAL] = span(r->submit_ns, r->done_ns);
+	rtt = span(r->tx_ns, r->rx_ns);
+	if (rtt < 0)
+		return;
+	out[SEG_LINK] = rtt;
+	if (!(r->flags & FANCTL_TRACE_F_NODE))
+		return;
+	node = node_span(r->node_parse_us, r->node_send_us);
+	if (node > rtt) // clock drift or a bogus trailer: keep the host view
+		return;
+	out[SEG_LINK] = rtt - node;
+	out[SEG_NODE_QUEUE] = node_span(r->node_parse_us, r->node_dequeue_us);
+	out[SEG_NODE_WAKE] = node_span(r->node_dequeue_us, r->node_handler_us);
+	out[SEG_NODE_HANDLER] = node_span(r->node_handler_us, r->node_send_us);
+}
+
+static void	put_run(FILE *out, char c, long long ns, double scale, double *col, int *done)
+{
+	int	end;
+
+	if (ns <= 0)
+		return;
+	*col += ns * scale;
+	end = (int)(*col + 0.5);
+	if (end <= *done) // keep every present segment visible
+		end = *done + 1;
+	for (; *done < end; (*done)++)
+		fputc(c, out);
+}
+
+/*
+ * One line per request, time flowing left to right:
+ *   ....>>~~~~qqwwHHH~~~~<<
+ * The link segment is drawn as two halves around the node segments; how
+ * it splits between request and response is not measured.
+ */
+void	trace_print_waterfall(FILE *out, const struct fanctl_trace_rec *r, int width)
+{
+	long long	seg[SEG_NR];
+	double		scale;
+	double		col;
+	int		done;
+	int		i;
+
+	trace_segments(r, seg);
+	fprintf(out, "%02X/%02X seq %3u %4d %9.1f us |", r->addr, r->cmd, r->seq,
+		r->result, seg[SEG_TOTAL] < 0 ? 0.0 : seg[SEG_TOTAL] / 1e3);
+	if (seg[SEG_TOTAL] <= 0)
+	{
+		fprintf(out, "\n");
+		return;
+	}
+	scale = (double)width / seg[SEG_TOTAL];
+	col = 0;
+	done = 0;
+	put_run(out, g_seg_glyph[SEG_QUEUE], seg[SEG_QUEUE], scale, &col, &done);
+	put_run(out, g_seg_glyph[SEG_TX], seg[SEG_TX], scale, &col, &done);
+	put_run(out, g_seg_glyph[SEG_LINK], seg[SEG_LINK] / 2, scale, &col, &done);
+	for (i = SEG_NODE_QUEUE; i <= SEG_NODE_HANDLER; i++)
+		put_run(out, g_seg_glyph[i], seg[i], scale, &col, &done);
+	put_run(out, g_seg_glyph[SEG_LINK], seg[SEG_LINK] - seg[SEG_LINK] / 2, scale, &col, &done);
+	put_run(out, g_seg_glyph[SEG_RX], seg[SEG_RX], scale, &col, &done);
+	fprintf(out, "|\n");
+}
+
+static const struct fanctl_trace_rec	*g_sort_recs;
+
+static int	cmp_total_desc(const void *a, const void *b)
+{
+	const struct fanctl_trace_rec	*ra;
+	const struct fanctl_trace_rec	*rb;
+	unsigned long long		ta;
+	unsigned long long		tb;
+
+	ra = &g_sort_recs[*(const size_t *)a];
+	rb = &g_sort_recs[*(const size_t *)b];
+	ta = ra->done_ns - ra->submit_ns;
+	tb = rb->done_ns - rb->submit_ns;
+	return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+void	trace_print_report(FILE *out, const struct fanctl_trace_rec *recs, size_t n,
+		int slowest, bool all)
+{
+	static hist_t	hists[SEG_NR];
+	long long	seg[SEG_NR];
+	size_t		*order;
+	size_t		errors;
+	size_t		traced;
+	size_t		i;
+	int		s;
+
+	errors = 0;
+	traced = 0;
+	for (s = 0; s < SEG_NR; s++)
+		hist_init(&hists[s]);
+	for (i = 0; i < n; i++)
+	{
+		if (recs[i].result)
+		{
+			errors++;
+			continue;
+		}
+		if (recs[i].flags & FANCTL_TRACE_F_NODE)
+			traced++;
+		trace_segments(&recs[i], seg);
+		for (s = 0; s < SEG_NR; s++)
+			if (seg[s] >= 0)
+				hist_record(&hists[s], (uint64_t)seg[s]);
+	}
+
+	if (all)
+	{
+		for (i = 0; i < n; i++)
+			trace_print_waterfall(out, &recs[i], 60);
+		fprintf(out, "\n");
+	}
+
+	fprintf(out, "requests %zu, failed %zu, with node timestamps %zu\n\n",
+		n, errors, traced);
+	fprintf(out, "%-13s %8s %10s %10s %10s %6s\n",
+		"segment", "count", "p50 us", "p99 us", "mean us", "share");
+	for (s = 0; s < SEG_NR; s++)
+	{
+		if (!hists[s].count)
+			continue;
+		fprintf(out, "%-13s %8llu %10.1f %10.1f %10.1f %5.1f%%\n", g_seg_names[s],
+			(unsigned long long)hists[s].count,
+			hist_percentile(&hists[s], 50.0) / 1e3,
+			hist_percentile(&hists[s], 99.0) / 1e3,
+			hists[s].total / 1e3 / hists[s].count,
+			hists[SEG_TOTAL].total ? 100.0 * hists[s].total / hists[SEG_TOTAL].total : 0.0);
+	}
+
+	if (slowest <= 0 || !n)
+		return;
+	order = malloc(n * sizeof(*order));
+	if (!order)
+		return;
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	g_sort_recs = recs;
+	qsort(order, n, sizeof(*order), cmp_total_desc);
+	fprintf(out, "\nslowest requests (addr/cmd, %c queue, %c tx, %c link, "
+		"%c node queue, %c node wake, %c handler, %c rx):\n",
+		g_seg_glyph[SEG_QUEUE], g_seg_glyph[SEG_TX], g_seg_glyph[SEG_LINK],
+		g_seg_glyph[SEG_NODE_QUEUE], g_seg_glyph[SEG_NODE_WAKE],
+		g_seg_glyph[SEG_NODE_HANDLER], g_seg_glyph[SEG_RX]);
+	for (i = 0; i < n && i < (size_t)slowest; i++)
+		trace_print_waterfall(out, &recs[order[i]], 60);
+	free(order);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "fanctl_trace.h"
+
+/*
+ * Request latency breakdown
+ * -------------------------
+ * A trace record is cut into consecutive segments. Host and node clocks
+ * are not synchronized, so the node segments come from node timestamp
+ * differences and the link segment is what is left of the host
+ * tx -> rx interval once the node time is taken out.
+ */
+
+typedef enum {
+	SEG_QUEUE,	// submit -> grant: waiting for the wire (scheduler)
+	SEG_TX,		// grant -> tx: bus guard, frame written to the tty
+	SEG_LINK,	// (tx -> rx) - (parse -> send): wire both ways + node RX window
+	SEG_NODE_QUEUE,	// parse -> dequeue: node command queue
+	SEG_NODE_WAKE,	// dequeue -> handler: handler task dispatch and logging
+	SEG_NODE_HANDLER,// handler -> send: command handler
+	SEG_RX,		// rx -> done: response frame to the caller
+	SEG_TOTAL,	// submit -> done
+	SEG_NR,
+}	seg_t;
+
+extern const char	*g_seg_names[SEG_NR];
+
+/* Segment durations of one record in ns, -1 when not available */
+void	trace_segments(const struct fanctl_trace_rec *r, long long out[SEG_NR]);
+void	trace_print_waterfall(FILE *out, const struct fanctl_trace_rec *r, int width);
+void	trace_print_report(FILE *out, const struct fanctl_trace_rec *recs, size_t n,
+		int slowest, bool all);
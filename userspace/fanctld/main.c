@@ -0,0 +1,956 @@
+/*
+ * fanctld
+ * -------
+ * Long-running daemon that owns the transport (/dev/fanctl or a raw
+ * tty) and serves local clients over a Unix socket (common/fanctld_proto.h).
+ *
+ *   fanctld [-d dev | -s tty [-p depth]] [-S socket] [-C cache_ms] [-v]
+ *           [-M textfile [-I interval_ms]] [-m metrics_socket]
+ *
+ * -d   fanctl chardev (default /dev/fanctl)
+ * -s   raw serial tty instead of the driver
+ * -S   socket path (default $FANCTLD_SOCK or /run/fanctld.sock)
+ * -p   requests pipelined on the tty, 1..32 (default 1)
+ * -C   default max age of a cached status in ms, 0 = no cache (default 500)
+ * -v   log every exchange
+ * -M   write metrics (metrics.h) to this file every -I ms (default
+ *      10000) and on exit, replaced atomically; for node_exporter's
+ *      textfile collector, name it *.prom
+ * -m   serve the same metrics on a Unix stream socket: each connection
+ *      gets one copy and is closed (e.g. `nc -U`)
+ *
+ * The main thread runs an epoll loop over the listening socket, the
+ * clients, a signalfd and an eventfd. Exchanges run on a transport
+ * thread, which reports completions through the eventfd: one at a time
+ * by default, or up to -p at once on a tty, matched back by SEQ. Only
+ * pipeline on a point-to-point or full-duplex link whose nodes queue
+ * requests; a half-duplex RS-485 bus takes one request at a time.
+ *
+ * - STATUS is answered from the per-node cache when it is recent enough.
+ * - STATUS and PING join an identical request that is already queued or
+ *   on the wire, unless a SET_* to the same node was queued after it.
+ * - SET_* invalidates the node's cache when it is queued, so a status
+ *   requested after it is never older than it.
+ *
+ * Clients that don't read their responses are disconnected once their
+ * socket buffer is full. Counters are printed on exit. Metrics come from
+ * the exchanges clients cause; producing them never touches the wire.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include "fanctld_proto.h"
+#include "client.h"
+#include "metrics.h"
+#include "transport.h"
+
+#define MAX_CLIENTS	256
+#define MAX_SCRAPES	8
+#define MAX_EVENTS	64
+#define ADDR_NR		256
+
+#define EV_LISTEN	0xFFFFFFFFu
+#define EV_DONE		0xFFFFFFFEu
+#define EV_SIGNAL	0xFFFFFFFDu
+#define EV_METRICS	0xFFFFFFFCu // textfile timer
+#define EV_SCRAPE_LISTEN 0xFFFFFFFBu
+#define EV_SCRAPE	0x80000000u // | slot in g_scrapes
+
+typedef struct {
+	uint32_t	client; // slot in g_clients
+	uint32_t	gen; // client generation, detects a reused slot
+	uint32_t	tag;
+	uint8_t		flags; // FANCTLD_RF_*
+}	waiter_t;
+
+typedef struct job {
+	struct job		*next;
+	uint8_t			op;
+	uint8_t			addr;
+	int16_t			arg;
+	uint32_t		gen; // g_addr_gen[addr] when queued
+	waiter_t		*waiters;
+	size_t			nwait;
+	size_t			capwait;
+	int			result;
+	struct fanctl_status	status;
+	struct fanctl_times	times;
+}	job_t;
+
+typedef struct {
+	int		fd;
+	uint32_t	gen;
+}	client_t;
+
+typedef struct {
+	bool			valid;
+	struct fanctl_status	status;
+	struct fanctl_times	times;
+}	cache_t;
+
+// a metrics socket connection, written as it drains
+typedef struct {
+	int	fd;
+	char	*buf;
+	size_t	len;
+	size_t	off;
+}	scrape_t;
+
+static transport_t	g_tr;
+static bool		g_verbose;
+static unsigned		g_cache_ms = 500;
+
+// shared with the transport thread, under g_lock
+static pthread_mutex_t	g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	g_cond = PTHREAD_COND_INITIALIZER;
+static job_t		*g_pending; // FIFO
+static job_t		*g_pending_tail;
+static job_t		*g_inflight; // on the wire, up to g_depth
+static unsigned		g_ninflight;
+static job_t		*g_done; // LIFO, order doesn't matter
+static bool		g_quit;
+static int		g_done_fd; // eventfd
+static int		g_wake_fd; // eventfd, wakes a pipelining transport thread
+static unsigned		g_depth = 1;
+
+// main thread only
+static client_t		g_clients[MAX_CLIENTS];
+static cache_t		g_cache[ADDR_NR];
+static uint32_t		g_addr_gen[ADDR_NR];
+static counters_t	g_cnt;
+static scrape_t		g_scrapes[MAX_SCRAPES];
+static const char	*g_metrics_file;
+static int		g_epfd;
+
+static uint64_t	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void	*transport_main(void *arg)
+{
+	job_t		*job;
+	uint64_t	one;
+
+	(void)arg;
+	one = 1;
+	pthread_mutex_lock(&g_lock);
+	for (;;)
+	{
+		while (!g_pending && !g_quit)
+			pthread_cond_wait(&g_cond, &g_lock);
+		if (g_quit)
+			break;
+		job = g_pending;
+		g_pending = job->next;
+		if (!g_pending)
+			g_pending_tail = NULL;
+		job->next = NULL;
+		g_inflight = job;
+		pthread_mutex_unlock(&g_lock);
+
+		job->result = transport_do(&g_tr, job->op, job->addr, job->arg,
+				&job->status, &job->times);
+
+		pthread_mutex_lock(&g_lock);
+		g_inflight = NULL;
+		job->next = g_done;
+		g_done = job;
+		if (write(g_done_fd, &one, sizeof(one)) < 0)
+			perror("eventfd");
+	}
+	pthread_mutex_unlock(&g_lock);
+	return NULL;
+}
+
+/* Called from transport_run() on the transport thread */
+static void	pipe_done(void *ctx, int result)
+{
+	job_t		*job;
+	job_t		**pp;
+	uint64_t	one;
+
+	job = ctx;
+	job->result = result;
+	one = 1;
+	pthread_mutex_lock(&g_lock);
+	for (pp = &g_inflight; *pp && *pp != job; pp = &(*pp)->next)
+		;
+	if (*pp)
+		*pp = job->next;
+	g_ninflight--;
+	job->next = g_done;
+	g_done = job;
+	if (write(g_done_fd, &one, sizeof(one)) < 0)
+		perror("eventfd");
+	pthread_mutex_unlock(&g_lock);
+}
+
+/*
+ * Pipelined variant for a tty: keeps up to g_depth jobs on the wire and
+ * sleeps in poll() on the serial client and g_wake_fd instead of g_cond.
+ * On quit, the jobs on the wire are completed or time out first.
+ */
+static void	*transport_main_pipe(void *arg)
+{
+	struct pollfd	pfd[2];
+	job_t		*job;
+	uint64_t	n;
+	int		ret;
+
+	(void)arg;
+	pfd[0].fd = transport_fd(&g_tr);
+	pfd[0].events = POLLIN;
+	pfd[1].fd = g_wake_fd;
+	pfd[1].events = POLLIN;
+	pthread_mutex_lock(&g_lock);
+	for (;;)
+	{
+		while (g_pending && !g_quit && g_ninflight < g_depth)
+		{
+			job = g_pending;
+			g_pending = job->next;
+			if (!g_pending)
+				g_pending_tail = NULL;
+			job->next = g_inflight;
+			g_inflight = job;
+			g_ninflight++;
+			pthread_mutex_unlock(&g_lock);
+			ret = -EIO;
+			if (pfd[0].fd >= 0)
+				ret = transport_submit(&g_tr, job->op, job->addr, job->arg,
+						&job->status, &job->times, pipe_done, job);
+			if (ret < 0)
+				pipe_done(job, ret);
+			pthread_mutex_lock(&g_lock);
+		}
+		if (g_quit && !g_ninflight)
+			break;
+		pthread_mutex_unlock(&g_lock);
+
+		if (poll(pfd, 2, -1) < 0 && errno != EINTR)
+			perror("poll");
+		if ((pfd[1].revents & POLLIN) && read(g_wake_fd, &n, sizeof(n)) < 0)
+			perror("eventfd");
+		if ((pfd[0].revents & POLLIN) && transport_run(&g_tr, 0) < 0)
+		{
+			fprintf(stderr, "fanctld: %s failed, requests fail with EIO\n", g_tr.dev);
+			pfd[0].fd = -1; // jobs on the wire were failed with it
+		}
+
+		pthread_mutex_lock(&g_lock);
+	}
+	pthread_mutex_unlock(&g_lock);
+	return NULL;
+}
+
+static void	transport_wake(void)
+{
+	uint64_t	one;
+
+	one = 1;
+	pthread_cond_signal(&g_cond);
+	if (g_depth > 1 && write(g_wake_fd, &one, sizeof(one)) < 0)
+		perror("eventfd");
+}
+
+/* clients ------------------------------------------------------------------ */
+
+static void	client_close(uint32_t slot)
+{
+	epoll_ctl(g_epfd, EPOLL_CTL_DEL, g_clients[slot].fd, NULL);
+	close(g_clients[slot].fd);
+	g_clients[slot].fd = -1;
+	g_clients[slot].gen++;
+}
+
+static void	client_send(uint32_t slot, const void *msg, size_t len)
+{
+	if (send(g_clients[slot].fd, msg, len, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)len)
+		return;
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+		g_cnt.dropped++;
+	client_close(slot);
+}
+
+static void	reply(uint32_t slot, const struct fanctld_req *req, int result, uint8_t flags,
+			const struct fanctl_status *st, const struct fanctl_times *times)
+{
+	struct fanctld_resp	resp;
+	uint64_t		now;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.version = FANCTLD_VERSION;
+	resp.op = req->op;
+	resp.addr = req->addr;
+	resp.flags = flags;
+	resp.result = result;
+	resp.tag = req->tag;
+	if (st)
+		resp.status = *st;
+	if (times)
+	{
+		resp.times = *times;
+		now = mono_ns();
+		if (times->rx_ns && now > times->rx_ns)
+			resp.age_us = (uint32_t)((now - times->rx_ns) / 1000);
+	}
+	client_send(slot, &resp, sizeof(resp));
+}
+
+static void	reply_info(uint32_t slot, const struct fanctld_req *req)
+{
+	struct fanctld_info	info;
+
+	memset(&info, 0, sizeof(info));
+	info.version = FANCTLD_VERSION;
+	info.op = FANCTLD_OP_INFO;
+	info.kind = g_tr.kind;
+	info.tag = req->tag;
+	snprintf(info.dev, sizeof(info.dev), "%s", g_tr.dev);
+	client_send(slot, &info, sizeof(info));
+}
+
+/* requests ----------------------------------------------------------------- */
+
+static bool	job_add_waiter(job_t *job, uint32_t slot, uint32_t tag, uint8_t flags)
+{
+	waiter_t	*w;
+	size_t		cap;
+
+	if (job->nwait == job->capwait)
+	{
+		cap = job->capwait ? job->capwait * 2 : 4;
+		w = realloc(job->waiters, cap * sizeof(*w));
+		if (!w)
+			return false;
+		job->waiters = w;
+		job->capwait = cap;
+	}
+	w = &job->waiters[job->nwait++];
+	w->client = slot;
+	w->gen = g_clients[slot].gen;
+	w->tag = tag;
+	w->flags = flags;
+	return true;
+}
+
+static bool	is_set(uint8_t op)
+{
+	return op >= FANCTLD_OP_SET_FAN_MODE;
+}
+
+/*
+ * Latest queued or in-flight job identical to (op, addr) with no SET_*
+ * to that node queued after it. Called with g_lock held.
+ */
+static job_t	*find_coalesce(uint8_t op, uint8_t addr)
+{
+	job_t	*cand;
+	job_t	*j;
+
+	cand = NULL;
+	for (j = g_inflight; j; j = j->next)
+		if (j->op == op && j->addr == addr)
+			cand = j;
+	for (j = g_pending; j; j = j->next)
+	{
+		if (j->op == op && j->addr == addr)
+			cand = j;
+		else if (is_set(j->op) && (j->addr == addr || j->addr == FANCTL_ADDR_BROADCAST))
+			cand = NULL;
+	}
+	return cand;
+}
+
+static void	invalidate(uint8_t addr)
+{
+	int	i;
+
+	if (addr != FANCTL_ADDR_BROADCAST)
+	{
+		g_addr_gen[addr]++;
+		g_cache[addr].valid = false;
+		return;
+	}
+	for (i = 0; i < ADDR_NR; i++)
+	{
+		g_addr_gen[i]++;
+		g_cache[i].valid = false;
+	}
+}
+
+static bool	serve_cached(uint32_t slot, const struct fanctld_req *req)
+{
+	const cache_t	*c;
+	uint64_t	max_age_ns;
+
+	c = &g_cache[req->addr];
+	max_age_ns = (uint64_t)(req->max_age_ms ? req->max_age_ms : g_cache_ms) * 1000000ULL;
+	if (!c->valid || !max_age_ns || (req->flags & FANCTLD_F_FRESH)
+		|| mono_ns() - c->times.rx_ns > max_age_ns)
+		return false;
+	g_cnt.cached++;
+	reply(slot, req, 0, FANCTLD_RF_CACHED, &c->status, &c->times);
+	return true;
+}
+
+static void	handle_req(uint32_t slot, const struct fanctld_req *req)
+{
+	job_t	*job;
+	bool	ok;
+
+	g_cnt.requests++;
+	if (req->version != FANCTLD_VERSION)
+	{
+		reply(slot, req, -EPROTO, 0, NULL, NULL);
+		return;
+	}
+	if (req->op == FANCTLD_OP_INFO)
+	{
+		reply_info(slot, req);
+		return;
+	}
+	if (req->op >= FANCTLD_OP_NR
+		|| (req->addr == FANCTL_ADDR_BROADCAST && !is_set(req->op)))
+	{
+		reply(slot, req, -EINVAL, 0, NULL, NULL);
+		return;
+	}
+	if (req->op == FANCTLD_OP_STATUS && serve_cached(slot, req))
+		return;
+
+	pthread_mutex_lock(&g_lock);
+	job = is_set(req->op) ? NULL : find_coalesce(req->op, req->addr);
+	if (job)
+	{
+		ok = job_add_waiter(job, slot, req->tag, FANCTLD_RF_COALESCED);
+		pthread_mutex_unlock(&g_lock);
+		if (!ok)
+			reply(slot, req, -ENOMEM, 0, NULL, NULL);
+		else
+			g_cnt.coalesced++;
+		return;
+	}
+	pthread_mutex_unlock(&g_lock);
+
+	job = calloc(1, sizeof(*job));
+	if (!job || !job_add_waiter(job, slot, req->tag, 0))
+	{
+		free(job);
+		reply(slot, req, -ENOMEM, 0, NULL, NULL);
+		return;
+	}
+	job->op = req->op;
+	job->addr = req->addr;
+	job->arg = req->arg;
+	if (is_set(req->op))
+		invalidate(req->addr);
+	job->gen = g_addr_gen[req->addr];
+
+	pthread_mutex_lock(&g_lock);
+	if (g_pending_tail)
+		g_pending_tail->next = job;
+	else
+		g_pending = job;
+	g_pending_tail = job;
+	transport_wake();
+	pthread_mutex_unlock(&g_lock);
+}
+
+static void	complete_job(job_t *job)
+{
+	struct fanctld_req	req;
+	const waiter_t		*w;
+	cache_t			*c;
+	size_t			i;
+
+	g_cnt.exchanges++;
+	if (job->result)
+		g_cnt.errors++;
+	metrics_exchange(job->addr, job->op, job->result, &job->status, &job->times);
+	if (g_verbose)
+		fprintf(stderr, "fanctld: op %u addr %02X -> %d (%zu waiter(s), rtt %.3f ms)\n",
+			job->op, job->addr, job->result, job->nwait,
+			job->times.rx_ns ? (job->times.rx_ns - job->times.tx_ns) / 1e6 : 0.0);
+	// a SET_* queued while this status was on the wire makes it stale
+	if (job->op == FANCTLD_OP_STATUS && !job->result && job->gen == g_addr_gen[job->addr])
+	{
+		c = &g_cache[job->addr];
+		c->valid = true;
+		c->status = job->status;
+		c->times = job->times;
+		if (!c->times.rx_ns)
+			c->times.rx_ns = mono_ns();
+	}
+	memset(&req, 0, sizeof(req));
+	req.op = job->op;
+	req.addr = job->addr;
+	for (i = 0; i < job->nwait; i++)
+	{
+		w = &job->waiters[i];
+		if (g_clients[w->client].fd < 0 || g_clients[w->client].gen != w->gen)
+			continue; // client went away
+		req.tag = w->tag;
+		reply(w->client, &req, job->result, w->flags,
+			job->op == FANCTLD_OP_STATUS ? &job->status : NULL, &job->times);
+	}
+	free(job->waiters);
+	free(job);
+}
+
+static void	on_done(void)
+{
+	uint64_t	n;
+	job_t		*list;
+	job_t		*next;
+
+	if (read(g_done_fd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+		perror("eventfd");
+	pthread_mutex_lock(&g_lock);
+	list = g_done;
+	g_done = NULL;
+	pthread_mutex_unlock(&g_lock);
+	for (; list; list = next)
+	{
+		next = list->next;
+		complete_job(list);
+	}
+}
+
+static void	on_client(uint32_t slot)
+{
+	struct fanctld_req	req;
+	ssize_t			n;
+
+	while (g_clients[slot].fd >= 0)
+	{
+		memset(&req, 0, sizeof(req));
+		n = recv(g_clients[slot].fd, &req, sizeof(req), MSG_DONTWAIT);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (n <= 0)
+		{
+			client_close(slot);
+			return;
+		}
+		if ((size_t)n != sizeof(req))
+		{
+			reply(slot, &req, -EPROTO, 0, NULL, NULL);
+			continue;
+		}
+		handle_req(slot, &req);
+	}
+}
+
+static void	on_accept(int lfd)
+{
+	struct epoll_event	ev;
+	uint32_t		slot;
+	int			fd;
+
+	for (;;)
+	{
+		fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				perror("accept");
+			return;
+		}
+		for (slot = 0; slot < MAX_CLIENTS && g_clients[slot].fd >= 0; slot++)
+			;
+		if (slot == MAX_CLIENTS)
+		{
+			fprintf(stderr, "fanctld: too many clients\n");
+			close(fd);
+			continue;
+		}
+		ev.events = EPOLLIN;
+		ev.data.u32 = slot;
+		if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		{
+			perror("epoll_ctl");
+			close(fd);
+			continue;
+		}
+		g_clients[slot].fd = fd;
+		g_cnt.clients++;
+	}
+}
+
+/* metrics ------------------------------------------------------------------ */
+
+static void	metrics_file(void)
+{
+	size_t	len;
+	char	*buf;
+	int	ret;
+
+	buf = metrics_render(&g_tr, &g_cnt, &len);
+	ret = buf ? metrics_write_file(g_metrics_file, buf, len) : -ENOMEM;
+	if (ret < 0)
+		fprintf(stderr, "fanctld: %s: %s\n", g_metrics_file, strerror(-ret));
+	free(buf);
+}
+
+static void	scrape_close(uint32_t slot)
+{
+	scrape_t	*s;
+
+	s = &g_scrapes[slot];
+	epoll_ctl(g_epfd, EPOLL_CTL_DEL, s->fd, NULL);
+	close(s->fd);
+	free(s->buf);
+	s->fd = -1;
+	s->buf = NULL;
+}
+
+static void	on_scrape(uint32_t slot)
+{
+	scrape_t	*s;
+	ssize_t		n;
+
+	s = &g_scrapes[slot];
+	while (s->off < s->len)
+	{
+		n = send(s->fd, s->buf + s->off, s->len - s->off, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (n <= 0)
+			break;
+		s->off += (size_t)n;
+	}
+	scrape_close(slot);
+}
+
+static void	on_scrape_accept(int lfd)
+{
+	struct epoll_event	ev;
+	scrape_t		*s;
+	uint32_t		slot;
+	int			fd;
+
+	for (;;)
+	{
+		fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			return;
+		for (slot = 0; slot < MAX_SCRAPES && g_scrapes[slot].fd >= 0; slot++)
+			;
+		if (slot == MAX_SCRAPES)
+		{
+			close(fd);
+			continue;
+		}
+		s = &g_scrapes[slot];
+		s->buf = metrics_render(&g_tr, &g_cnt, &s->len);
+		ev.events = EPOLLOUT;
+		ev.data.u32 = EV_SCRAPE | slot;
+		if (!s->buf || epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		{
+			free(s->buf);
+			s->buf = NULL;
+			close(fd);
+			continue;
+		}
+		s->fd = fd;
+		s->off = 0;
+	}
+}
+
+/* setup -------------------------------------------------------------------- */
+
+static int	listen_on(const char *path)
+{
+	struct sockaddr_un	sa;
+	int			fd;
+	int			probe;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		fprintf(stderr, "fanctld: socket path too long\n");
+		return -1;
+	}
+	probe = fanctld_connect();
+	if (probe >= 0)
+	{
+		fprintf(stderr, "fanctld: already running on %s\n", path);
+		close(probe);
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		perror("socket");
+		return -1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+	unlink(path); // stale socket of a daemon that died
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 64) < 0)
+	{
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	chmod(path, 0660); // owner and group, like /dev/fanctl
+	return fd;
+}
+
+static int	listen_metrics(const char *path)
+{
+	struct sockaddr_un	sa;
+	int			fd;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		fprintf(stderr, "fanctld: metrics socket path too long\n");
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		perror("socket");
+		return -1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 16) < 0)
+	{
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	chmod(path, 0666); // read-only data, for a collector running as another user
+	return fd;
+}
+
+static bool	epoll_add(int fd, uint32_t id)
+{
+	struct epoll_event	ev;
+
+	ev.events = EPOLLIN;
+	ev.data.u32 = id;
+	if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		perror("epoll_ctl");
+		return false;
+	}
+	return true;
+}
+
+static void	usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-d dev | -s tty [-p depth]] [-S socket] [-C cache_ms] [-v]\n"
+		"       [-M textfile [-I interval_ms]] [-m metrics_socket]\n", prog);
+}
+
+int	main(int argc, char **argv)
+{
+	struct epoll_event	evs[MAX_EVENTS];
+	struct itimerspec	its;
+	const char		*dev;
+	const char		*sock;
+	const char		*msock;
+	unsigned		interval_ms;
+	uint64_t		exp;
+	uint8_t			kind;
+	pthread_t		thread;
+	sigset_t		mask;
+	bool			running;
+	int			lfd;
+	int			sfd;
+	int			mfd;
+	int			tfd;
+	int			opt;
+	int			n;
+	int			i;
+
+	dev = "/dev/fanctl";
+	kind = FANCTLD_KIND_IOCTL;
+	sock = getenv(FANCTLD_SOCK_ENV);
+	if (!sock || !*sock)
+		sock = FANCTLD_SOCK_PATH;
+	msock = NULL;
+	interval_ms = 10000;
+	while ((opt = getopt(argc, argv, "d:s:S:C:p:M:I:m:vh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd': dev = optarg; kind = FANCTLD_KIND_IOCTL; break;
+			case 's': dev = optarg; kind = FANCTLD_KIND_SERIAL; break;
+			case 'S': sock = optarg; setenv(FANCTLD_SOCK_ENV, sock, 1); break;
+			case 'C': g_cache_ms = (unsigned)atoi(optarg); break;
+			case 'p': g_depth = (unsigned)atoi(optarg); break;
+			case 'M': g_metrics_file = optarg; break;
+			case 'I': interval_ms = (unsigned)atoi(optarg); break;
+			case 'm': msock = optarg; break;
+			case 'v': g_verbose = true; break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	if (g_depth < 1 || g_depth > 32 || interval_ms < 100)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+	if (g_depth > 1 && kind != FANCTLD_KIND_SERIAL)
+	{
+		fprintf(stderr, "fanctld: -p ignored, the driver serializes requests\n");
+		g_depth = 1;
+	}
+	for (i = 0; i < MAX_CLIENTS; i++)
+		g_clients[i].fd = -1;
+	for (i = 0; i < MAX_SCRAPES; i++)
+		g_scrapes[i].fd = -1;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL); // inherited by the transport thread
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!transport_open(&g_tr, kind, dev))
+		return 1;
+	lfd = listen_on(sock);
+	if (lfd < 0)
+	{
+		transport_close(&g_tr);
+		return 1;
+	}
+	g_epfd = epoll_create1(EPOLL_CLOEXEC);
+	g_done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (g_epfd < 0 || g_done_fd < 0 || g_wake_fd < 0 || sfd < 0 || !epoll_add(lfd, EV_LISTEN)
+		|| !epoll_add(g_done_fd, EV_DONE) || !epoll_add(sfd, EV_SIGNAL))
+	{
+		perror("fanctld");
+		unlink(sock);
+		return 1;
+	}
+	mfd = -1;
+	tfd = -1;
+	if (msock)
+	{
+		mfd = listen_metrics(msock);
+		if (mfd < 0 || !epoll_add(mfd, EV_SCRAPE_LISTEN))
+		{
+			unlink(sock);
+			return 1;
+		}
+	}
+	if (g_metrics_file)
+	{
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = interval_ms / 1000;
+		its.it_value.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+		its.it_interval = its.it_value;
+		tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (tfd < 0 || timerfd_settime(tfd, 0, &its, NULL) < 0 || !epoll_add(tfd, EV_METRICS))
+		{
+			perror("timerfd");
+			unlink(sock);
+			return 1;
+		}
+		metrics_file();
+	}
+	if (pthread_create(&thread, NULL, g_depth > 1 ? transport_main_pipe : transport_main, NULL))
+	{
+		perror("pthread_create");
+		unlink(sock);
+		return 1;
+	}
+	if (g_depth > 1)
+		fprintf(stderr, "fanctld: %s on %s, pipeline depth %u\n", dev, sock, g_depth);
+	else
+		fprintf(stderr, "fanctld: %s on %s\n", dev, sock);
+
+	running = true;
+	while (running)
+	{
+		n = epoll_wait(g_epfd, evs, MAX_EVENTS, -1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+		for (i = 0; i < n; i++)
+		{
+			if (evs[i].data.u32 == EV_LISTEN)
+				on_accept(lfd);
+			else if (evs[i].data.u32 == EV_DONE)
+				on_done();
+			else if (evs[i].data.u32 == EV_SIGNAL)
+				running = false;
+			else if (evs[i].data.u32 == EV_METRICS)
+			{
+				if (read(tfd, &exp, sizeof(exp)) == sizeof(exp))
+					metrics_file();
+			}
+			else if (evs[i].data.u32 == EV_SCRAPE_LISTEN)
+				on_scrape_accept(mfd);
+			else if (evs[i].data.u32 & EV_SCRAPE)
+				on_scrape(evs[i].data.u32 & ~EV_SCRAPE);
+			else
+				on_client(evs[i].data.u32);
+		}
+	}
+
+	pthread_mutex_lock(&g_lock);
+	g_quit = true;
+	transport_wake();
+	pthread_mutex_unlock(&g_lock);
+	pthread_join(thread, NULL); // waits for the exchanges on the wire, if any
+	on_done(); // their counts, for the last metrics
+	if (g_metrics_file)
+		metrics_file();
+	unlink(sock);
+	close(lfd);
+	if (msock)
+	{
+		unlink(msock);
+		close(mfd);
+	}
+	for (i = 0; i < MAX_CLIENTS; i++)
+		if (g_clients[i].fd >= 0)
+			client_close((uint32_t)i);
+	for (i = 0; i < MAX_SCRAPES; i++)
+		if (g_scrapes[i].fd >= 0)
+			scrape_close((uint32_t)i);
+	transport_close(&g_tr);
+	fprintf(stderr, "fanctld: requests %llu, cached %llu, coalesced %llu, exchanges %llu "
+		"(errors %llu), clients %llu (dropped %llu)\n",
+		(unsigned long long)g_cnt.requests, (unsigned long long)g_cnt.cached,
+		(unsigned long long)g_cnt.coalesced, (unsigned long long)g_cnt.exchanges,
+		(unsigned long long)g_cnt.errors, (unsigned long long)g_cnt.clients,
+		(unsigned long long)g_cnt.dropped);
+	return 0;
+}
@@ -0,0 +1,322 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "fanctld_proto.h"
+#include "metrics.h"
+
+#define ADDR_NR		256
+
+typedef struct {
+	bool			seen;
+	bool			have_status;
+	struct fanctl_status	status;
+	uint64_t		status_ns; // CLOCK_MONOTONIC
+	uint64_t		exchanges[FANCTLD_OP_NR];
+	uint64_t		timeouts;
+	uint64_t		rejected; // SET_* refused by the node
+	uint64_t		failures; // anything else
+	uint64_t		rtt[METRICS_RTT_NR + 1]; // last: +Inf
+	uint64_t		rtt_ns;
+	uint64_t		rtt_count;
+}	node_t;
+
+static node_t	g_nodes[ADDR_NR];
+
+// upper bounds of the RTT buckets
+static const uint64_t	g_rtt_le_ns[METRICS_RTT_NR] = {
+	1000000, 2000000, 5000000, 10000000, 20000000,
+	50000000, 100000000, 200000000, 500000000, 1000000000,
+};
+
+static const char	*g_class_names[FANCTL_PRIO_NR] = { "ctrl", "poll" };
+
+static uint64_t	mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void	metrics_exchange(uint8_t addr, uint8_t op, int result, const struct fanctl_status *st,
+		const struct fanctl_times *times)
+{
+	node_t		*n;
+	uint64_t	rtt;
+	int		i;
+
+	n = &g_nodes[addr];
+	n->seen = true;
+	if (op < FANCTLD_OP_NR)
+		n->exchanges[op]++;
+	if (result == -ETIMEDOUT)
+		n->timeouts++;
+	else if (result == -EOPNOTSUPP || result == -EBUSY)
+		n->rejected++;
+	else if (result)
+		n->failures++;
+	if (result == 0 && op == FANCTLD_OP_STATUS)
+	{
+		n->have_status = true;
+		n->status = *st;
+		n->status_ns = times->rx_ns ? times->rx_ns : mono_ns();
+	}
+	if (result != 0 || !times->tx_ns || times->rx_ns <= times->tx_ns)
+		return;
+	rtt = times->rx_ns - times->tx_ns;
+	for (i = 0; i < METRICS_RTT_NR && rtt > g_rtt_le_ns[i]; i++)
+		;
+	n->rtt[i]++;
+	n->rtt_ns += rtt;
+	n->rtt_count++;
+}
+
+/* Rendering ---------------------------------------------------------------- */
+
+static void	family(FILE *f, const char *name, const char *type, const char *help)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* Label value, escaped as the format wants */
+static void	put_label(FILE *f, const char *s)
+{
+	for (; *s; s++)
+	{
+		if (*s == '\\' || *s == '"')
+			fputc('\\', f);
+		if (*s == '\n')
+			fputs("\\n", f);
+		else
+			fputc(*s, f);
+	}
+}
+
+/* Start a node sample: name and the labels every node sample has */
+static void	node_labels(FILE *f, const char *name, const char *dev, int addr)
+{
+	fprintf(f, "%s{device=\"", name);
+	put_label(f, dev);
+	fprintf(f, "\",addr=\"%d\"", addr);
+}
+
+static void	render_nodes(FILE *f, const char *dev, uint64_t now)
+{
+	const node_t	*n;
+	uint64_t	cum;
+	int		a;
+	int		i;
+
+	family(f, "fanctl_node_temperature_celsius", "gauge", "Temperature in the last status.");
+	for (a = 0; a < ADDR_NR; a++)
+		if (g_nodes[a].have_status)
+		{
+			node_labels(f, "fanctl_node_temperature_celsius", dev, a);
+			fprintf(f, "} %.2f\n", g_nodes[a].status.temp_x100 / 100.0);
+		}
+	family(f, "fanctl_node_humidity_percent", "gauge", "Relative humidity in the last status.");
+	for (a = 0; a < ADDR_NR; a++)
+		if (g_nodes[a].have_status)
+		{
+			node_labels(f, "fanctl_node_humidity_percent", dev, a);
+			fprintf(f, "} %.2f\n", g_nodes[a].status.humidity_x100 / 100.0);
+		}
+	family(f, "fanctl_node_fan_manual", "gauge", "Fan mode in the last status, 0 auto, 1 manual.");
+	for (a = 0; a < ADDR_NR; a++)
+		if (g_nodes[a].have_status)
+		{
+			node_labels(f, "fanctl_node_fan_manual", dev, a);
+			fprintf(f, "} %u\n", g_nodes[a].status.fan_mode);
+		}
+	family(f, "fanctl_node_fan_on", "gauge", "Fan state in the last status, 0 off, 1 on.");
+	for (a = 0; a < ADDR_NR; a++)
+		if (g_nodes[a].have_status)
+		{
+			node_labels(f, "fanctl_node_fan_on", dev, a);
+			fprintf(f, "} %u\n", g_nodes[a].status.fan_state);
+		}
+	family(f, "fanctl_node_error_flags", "gauge", "Error bitfield in the last status.");
+	for (a = 0; a < ADDR_NR; a++)
+		if (g_nodes[a].have_status)
+		{
+			node_labels(f, "fanctl_node_error_flags", dev, a);
+			fprintf(f, "} %u\n", g_nodes[a].status.errors);
+		}
+	family(f, "fanctl_node_status_age_seconds", "gauge", "Age of the last status.");
+	for (a = 0; a < ADDR_NR; a++)
+		if (g_nodes[a].have_status)
+		{
+			node_labels(f, "fanctl_node_status_age_seconds", dev, a);
+			fprintf(f, "} %.3f\n", now > g_nodes[a].status_ns
+				? (now - g_nodes[a].status_ns) / 1e9 : 0.0);
+		}
+
+	family(f, "fanctl_node_exchanges_total", "counter", "Requests sent to the node, by op.");
+	for (a = 0; a < ADDR_NR; a++)
+		for (i = 1; g_nodes[a].seen && i < FANCTLD_OP_NR; i++)
+		{
+			node_labels(f, "fanctl_node_exchanges_total", dev, a);
+			fprintf(f, ",op=\"%s\"} %llu\n", fanctl_op_name((uint8_t)i),
+				(unsigned long long)g_nodes[a].exchanges[i]);
+		}
+	family(f, "fanctl_node_failures_total", "counter",
+		"Failed exchanges: timeout, rejected (SET_* refused by the node) or other.");
+	for (a = 0; a < ADDR_NR; a++)
+	{
+		n = &g_nodes[a];
+		if (!n->seen)
+			continue;
+		node_labels(f, "fanctl_node_failures_total", dev, a);
+		fprintf(f, ",reason=\"timeout\"} %llu\n", (unsigned long long)n->timeouts);
+		node_labels(f, "fanctl_node_failures_total", dev, a);
+		fprintf(f, ",reason=\"rejected\"} %llu\n", (unsigned long long)n->rejected);
+		node_labels(f, "fanctl_node_failures_total", dev, a);
+		fprintf(f, ",reason=\"other\"} %llu\n", (unsigned long long)n->failures);
+	}
+	family(f, "fanctl_node_rtt_seconds", "histogram", "Round trip of successful exchanges.");
+	for (a = 0; a < ADDR_NR; a++)
+	{
+		n = &g_nodes[a];
+		if (!n->seen)
+			continue;
+		cum = 0;
+		for (i = 0; i <= METRICS_RTT_NR; i++)
+		{
+			cum += n->rtt[i];
+			node_labels(f, "fanctl_node_rtt_seconds_bucket", dev, a);
+			if (i < METRICS_RTT_NR)
+				fprintf(f, ",le=\"%g\"} %llu\n", g_rtt_le_ns[i] / 1e9, (unsigned long long)cum);
+			else
+				fprintf(f, ",le=\"+Inf\"} %llu\n", (unsigned long long)cum);
+		}
+		node_labels(f, "fanctl_node_rtt_seconds_sum", dev, a);
+		fprintf(f, "} %.9f\n", n->rtt_ns / 1e9);
+		node_labels(f, "fanctl_node_rtt_seconds_count", dev, a);
+		fprintf(f, "} %llu\n", (unsigned long long)n->rtt_count);
+	}
+}
+
+/* Link and queue statistics of the driver, from its ioctls */
+static void	render_driver(FILE *f, const char *dev, int fd)
+{
+	const struct fanctl_qclass_stats	*c;
+	struct fanctl_qstats			qs;
+	struct fanctl_link			l;
+	uint64_t				cum;
+	int					k;
+	int					i;
+
+	if (ioctl(fd, FANCTL_IOC_GET_LINK, &l) == 0)
+	{
+		family(f, "fanctl_driver_link_state", "gauge", "Link state, 0 up, 1 degraded, 2 down.");
+		fputs("fanctl_driver_link_state{device=\"", f);
+		put_label(f, dev);
+		fprintf(f, "\"} %u\n", l.state);
+		family(f, "fanctl_driver_link_misses", "gauge", "Consecutive missed responses.");
+		fputs("fanctl_driver_link_misses{device=\"", f);
+		put_label(f, dev);
+		fprintf(f, "\"} %u\n", l.misses);
+		family(f, "fanctl_driver_link_changes_total", "counter", "Link state changes.");
+		fputs("fanctl_driver_link_changes_total{device=\"", f);
+		put_label(f, dev);
+		fprintf(f, "\"} %u\n", l.changes);
+	}
+	if (ioctl(fd, FANCTL_IOC_GET_QSTATS, &qs) < 0)
+		return;
+	family(f, "fanctl_driver_queue_depth", "gauge", "Requests queued in the driver.");
+	for (k = 0; k < FANCTL_PRIO_NR; k++)
+	{
+		fputs("fanctl_driver_queue_depth{device=\"", f);
+		put_label(f, dev);
+		fprintf(f, "\",class=\"%s\"} %u\n", g_class_names[k], qs.cls[k].depth);
+	}
+	family(f, "fanctl_driver_queue_wait_seconds", "histogram",
+		"Time requests waited in the driver for the wire.");
+	for (k = 0; k < FANCTL_PRIO_NR; k++)
+	{
+		c = &qs.cls[k];
+		cum = 0;
+		for (i = 0; i < FANCTL_QSTATS_HIST_BUCKETS; i++)
+		{
+			cum += c->wait_hist[i];
+			fputs("fanctl_driver_queue_wait_seconds_bucket{device=\"", f);
+			put_label(f, dev);
+			fprintf(f, "\",class=\"%s\",le=", g_class_names[k]);
+			if (i < FANCTL_QSTATS_HIST_BUCKETS - 1) // bucket i: < 2^i us
+				fprintf(f, "\"%g\"} %llu\n", (double)(1u << i) / 1e6, (unsigned long long)cum);
+			else
+				fprintf(f, "\"+Inf\"} %llu\n", (unsigned long long)cum);
+		}
+		fputs("fanctl_driver_queue_wait_seconds_sum{device=\"", f);
+		put_label(f, dev);
+		fprintf(f, "\",class=\"%s\"} %.9f\n", g_class_names[k], c->wait_ns_total / 1e9);
+		fputs("fanctl_driver_queue_wait_seconds_count{device=\"", f);
+		put_label(f, dev);
+		fprintf(f, "\",class=\"%s\"} %llu\n", g_class_names[k], (unsigned long long)cum);
+	}
+}
+
+static void	counter(FILE *f, const char *name, const char *help, uint64_t v)
+{
+	family(f, name, "counter", help);
+	fprintf(f, "%s %llu\n", name, (unsigned long long)v);
+}
+
+char	*metrics_render(const transport_t *t, const counters_t *cnt, size_t *len)
+{
+	char	*buf;
+	FILE	*f;
+
+	f = open_memstream(&buf, len);
+	if (!f)
+		return NULL;
+	render_nodes(f, t->dev, mono_ns());
+	if (t->kind == FANCTLD_KIND_IOCTL)
+		render_driver(f, t->dev, fanctl_dev_fd(t->h));
+	counter(f, "fanctld_requests_total", "Client requests.", cnt->requests);
+	counter(f, "fanctld_cached_total", "STATUS requests answered from the cache.", cnt->cached);
+	counter(f, "fanctld_coalesced_total", "Requests joined to an identical one.", cnt->coalesced);
+	counter(f, "fanctld_exchanges_total", "Exchanges on the wire.", cnt->exchanges);
+	counter(f, "fanctld_exchange_errors_total", "Exchanges that failed.", cnt->errors);
+	counter(f, "fanctld_clients_total", "Client connections.", cnt->clients);
+	counter(f, "fanctld_dropped_clients_total", "Clients disconnected for not reading.",
+		cnt->dropped);
+	if (fclose(f) != 0)
+	{
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+/* Written next to path and renamed over it, so a collector never reads half a file */
+int	metrics_write_file(const char *path, const char *buf, size_t len)
+{
+	char	tmp[PATH_MAX];
+	int	fd;
+	int	ret;
+
+	if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+		return -ENAMETOOLONG;
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+	ret = 0;
+	if (write(fd, buf, len) != (ssize_t)len)
+		ret = errno ? -errno : -EIO;
+	if (close(fd) < 0 && !ret)
+		ret = -errno;
+	if (!ret && rename(tmp, path) < 0)
+		ret = -errno;
+	if (ret)
+		unlink(tmp);
+	return ret;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fanctl_uapi.h"
+#include "transport.h"
+
+/*
+ * Metrics
+ * -------
+ * Per-node values and counters, kept from the exchanges the daemon
+ * already makes, and rendered in the Prometheus text format (the one
+ * node_exporter's textfile collector reads, and that OpenMetrics
+ * scrapers accept too):
+ *  - last temperature, humidity, fan mode and state, error flags and
+ *    the age of that status
+ *  - exchanges per op, timeouts, rejected SET_* and other failures
+ *  - a histogram of the exchange RTT (driver or sclient timestamps)
+ *  - the daemon's counters and, on /dev/fanctl, the driver's link
+ *    state and request queue statistics (ioctls that don't touch the
+ *    wire)
+ * Rendering never issues a request: the values are only as fresh as
+ * the traffic through the daemon, e.g. a `fanctl watch` client. Main
+ * thread only.
+ */
+
+#define METRICS_RTT_NR	10
+
+typedef struct {
+	uint64_t	requests;
+	uint64_t	cached;
+	uint64_t	coalesced;
+	uint64_t	exchanges;
+	uint64_t	errors;
+	uint64_t	clients;
+	uint64_t	dropped; // clients disconnected because they didn't read
+}	counters_t;
+
+void	metrics_exchange(uint8_t addr, uint8_t op, int result, const struct fanctl_status *st,
+		const struct fanctl_times *times);
+char	*metrics_render(const transport_t *t, const counters_t *cnt, size_t *len); // malloc()ed
+int	metrics_write_file(const char *path, const char *buf, size_t len); // 0 or -errno
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fanctld_proto.h"
+#include "transport.h"
+
+bool	transport_open(transport_t *t, uint8_t kind, const char *dev)
+{
+	memset(t, 0, sizeof(*t));
+	t->kind = kind;
+	snprintf(t->dev, sizeof(t->dev), "%s", dev);
+	t->h = fanctl_open(dev, kind); // on a tty, the only tcflush is here
+	if (!t->h)
+		perror(dev);
+	return t->h != NULL;
+}
+
+void	transport_close(transport_t *t)
+{
+	fanctl_close(t->h);
+	t->h = NULL;
+}
+
+static void	log_error(uint8_t op, int result)
+{
+	if (result && result != -ETIMEDOUT && result != -ENOLINK
+		&& result != -EOPNOTSUPP && result != -EBUSY)
+		fprintf(stderr, "fanctld: %s: %s\n", fanctl_op_name(op), strerror(-result));
+}
+
+int	transport_do(transport_t *t, uint8_t op, uint8_t addr, int16_t arg,
+		struct fanctl_status *st, struct fanctl_times *times)
+{
+	int	ret;
+
+	if (op == FANCTLD_OP_INFO || op >= FANCTLD_OP_NR)
+		return -EINVAL;
+	ret = fanctl_call(t->h, op, addr, arg, st, times);
+	log_error(op, ret);
+	return ret;
+}
+
+typedef struct {
+	fanctl_req_t		req;
+	struct fanctl_status	*st;
+	struct fanctl_times	*times;
+	transport_cb_t		cb;
+	void			*ctx;
+}	transport_req_t;
+
+static void	transport_done(fanctl_req_t *req)
+{
+	transport_req_t	*r;
+
+	r = req->user;
+	*r->st = req->status;
+	*r->times = req->times;
+	log_error(req->op, req->result);
+	r->cb(r->ctx, req->result);
+	free(r);
+}
+
+int	transport_submit(transport_t *t, uint8_t op, uint8_t addr, int16_t arg,
+		struct fanctl_status *st, struct fanctl_times *times,
+		transport_cb_t cb, void *ctx)
+{
+	transport_req_t	*r;
+	int		ret;
+
+	if (op == FANCTLD_OP_INFO || op >= FANCTLD_OP_NR)
+		return -EINVAL;
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return -ENOMEM;
+	r->req.op = op;
+	r->req.addr = addr;
+	r->req.arg = arg;
+	r->req.cb = transport_done;
+	r->req.user = r;
+	r->st = st;
+	r->times = times;
+	r->cb = cb;
+	r->ctx = ctx;
+	ret = fanctl_submit(t->h, &r->req);
+	if (ret < 0)
+		free(r);
+	return ret;
+}
+
+int	transport_fd(const transport_t *t)
+{
+	return fanctl_fd(t->h);
+}
+
+int	transport_run(transport_t *t, int timeout_ms)
+{
+	int	ret;
+
+	ret = fanctl_run(t->h, timeout_ms);
+	return ret < 0 ? ret : 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "proto.h"
+#include "fanctl_uapi.h"
+#include "libfanctl.h"
+
+/*
+ * Transport owned by the daemon
+ * -----------------------------
+ * A libfanctl handle on either the driver (/dev/fanctl) or a raw tty
+ * (fanctl_serial path). It is opened once, so responses are never
+ * flushed between requests. Calls run on the daemon's transport thread
+ * only.
+ *
+ * transport_do() blocks for one exchange. transport_submit() puts a
+ * request on the wire and returns; transport_run() completes responses
+ * and deadlines through the callback, so on a tty several requests can
+ * be pipelined (libfanctl.h).
+ */
+
+typedef struct {
+	uint8_t		kind; // FANCTLD_KIND_*
+	fanctl_t	*h;
+	char		dev[104];
+}	transport_t;
+
+// result as transport_do(); st/times are filled before the call
+typedef void	(*transport_cb_t)(void *ctx, int result);
+
+bool	transport_open(transport_t *t, uint8_t kind, const char *dev);
+void	transport_close(transport_t *t);
+int	transport_do(transport_t *t, uint8_t op, uint8_t addr, int16_t arg,
+		struct fanctl_status *st, struct fanctl_times *times);
+int	transport_submit(transport_t *t, uint8_t op, uint8_t addr, int16_t arg,
+		struct fanctl_status *st, struct fanctl_times *times,
+		transport_cb_t cb, void *ctx);
+int	transport_fd(const transport_t *t);
+int	transport_run(transport_t *t, int timeout_ms);
@@ -0,0 +1,537 @@
+/*
+ * fanstore
+ * --------
+ * Query and feed the status history kept by `fanctl watch -S dir`.
+ *
+ *   fanstore query [-f from] [-t to] [-o csv|json] [-s] <dir>
+ *   fanstore rollup [-f from] [-t to] [-p points] [-o csv|json] <dir>
+ *   fanstore info <dir>
+ *   fanstore ingest <dir>
+ *
+ * query   prints the samples of a time range, scanned straight from the
+ *         mapped segments; blocks outside the range are skipped by the
+ *         index. -f/-t are epoch seconds, `now`, or relative to now:
+ *         -30s, -10m, -2h, -1d (default: everything). -s prints a
+ *         summary of the range instead of the samples
+ * rollup  prints about `points` (default 1000) min/avg/max buckets over
+ *         the range, read from the coarsest rollup finer than a point
+ *         (rollup.h), or aggregated from the samples when the points
+ *         are shorter than 10 s. Buckets overlapping -f/-t are whole
+ * info    one line per segment: blocks, samples, bytes per sample, span
+ * ingest  appends binary watch records (`watch -f bin`) read from stdin,
+ *         e.g. a watch run elsewhere piped over ssh; link events are
+ *         skipped
+ *
+ * Readers don't take the store lock and may run while it is written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "proto.h"
+#include "rollup.h"
+#include "store.h"
+#include "watch.h"
+
+typedef enum {
+	OUT_CSV,
+	OUT_JSON,
+}	out_t;
+
+typedef struct {
+	out_t		out;
+	bool		summary;
+	uint8_t		addr;
+	uint64_t	count;
+	uint64_t	failed;
+	int64_t		first_ms;
+	int64_t		last_ms;
+	int32_t		temp_min;
+	int32_t		temp_max;
+	int64_t		temp_sum;
+	int64_t		humidity_sum;
+	uint64_t	fan_on;
+	uint16_t	errors_max;
+}	query_t;
+
+// output of `rollup`: source buckets merged into points of `width`
+typedef struct {
+	out_t		out;
+	int64_t		width;
+	rollup_bucket_t	cur;
+	bool		have;
+	uint64_t	read; // rollup buckets or samples
+	uint64_t	points;
+}	series_t;
+
+
+static int64_t	now_ms(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static double	mono_s(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* `now`, epoch seconds, or -<n>s|m|h|d relative to now */
+static bool	parse_time(const char *str, int64_t *ms)
+{
+	long long	v;
+	char		*end;
+	int64_t		unit;
+
+	if (!strcmp(str, "now"))
+	{
+		*ms = now_ms();
+		return true;
+	}
+	errno = 0;
+	v = strtoll(str, &end, 10);
+	if (end == str || errno || (str[0] == '-') == (*end == '\0'))
+	{
+		fprintf(stderr, "wrong time: %s\n", str);
+		return false;
+	}
+	if (str[0] != '-')
+	{
+		*ms = (int64_t)v * 1000;
+		return true;
+	}
+	unit = *end == 's' ? 1000 : *end == 'm' ? 60000 : *end == 'h' ? 3600000
+		: *end == 'd' ? 86400000 : 0;
+	if (!unit || end[1])
+	{
+		fprintf(stderr, "wrong time: %s\n", str);
+		return false;
+	}
+	*ms = now_ms() + (int64_t)v * unit;
+	return true;
+}
+
+static void	print_x100(int32_t v)
+{
+	printf("%s%d.%02d", v < 0 ? "-" : "", abs(v) / 100, abs(v) % 100);
+}
+
+/* Query -------------------------------------------------------------------- */
+
+static int	query_cb(void *ctx, const store_sample_t *s)
+{
+	query_t	*q;
+
+	q = ctx;
+	if (!q->count++)
+		q->first_ms = s->ts_ms;
+	q->last_ms = s->ts_ms;
+	if (s->result)
+		q->failed++;
+	else
+	{
+		if (q->count - q->failed == 1 || s->temp_x100 < q->temp_min)
+			q->temp_min = s->temp_x100;
+		if (q->count - q->failed == 1 || s->temp_x100 > q->temp_max)
+			q->temp_max = s->temp_x100;
+		q->temp_sum += s->temp_x100;
+		q->humidity_sum += s->humidity_x100;
+		q->fan_on += s->fan_state == PROTO_FAN_STATE_ON;
+		if (s->errors > q->errors_max)
+			q->errors_max = s->errors;
+	}
+	if (q->summary)
+		return 0;
+	if (q->out == OUT_CSV)
+	{
+		printf("%lld,%u,%d,", (long long)s->ts_ms, q->addr, s->result);
+		print_x100(s->temp_x100);
+		putchar(',');
+		print_x100(s->humidity_x100);
+		printf(",%u,%u,%u,%u\n", s->fan_mode, s->fan_state, s->errors, s->rtt_us);
+		return 0;
+	}
+	printf("{\"ts_ms\":%lld,\"addr\":%u,\"result\":%d", (long long)s->ts_ms, q->addr, s->result);
+	if (!s->result)
+	{
+		printf(",\"temp_c\":");
+		print_x100(s->temp_x100);
+		printf(",\"humidity_pct\":");
+		print_x100(s->humidity_x100);
+		printf(",\"fan_mode\":%u,\"fan_state\":%u,\"errors\":%u",
+			s->fan_mode, s->fan_state, s->errors);
+	}
+	printf(",\"rtt_us\":%u}\n", s->rtt_us);
+	return 0;
+}
+
+static void	print_summary(const query_t *q, const store_scan_t *sc, double secs)
+{
+	uint64_t	ok;
+
+	ok = q->count - q->failed;
+	printf("samples   %llu (%llu failed)\n", (unsigned long long)q->count,
+		(unsigned long long)q->failed);
+	if (q->count)
+		printf("span      %lld .. %lld ms (%.1f s)\n", (long long)q->first_ms,
+			(long long)q->last_ms, (double)(q->last_ms - q->first_ms) / 1000.0);
+	if (ok)
+	{
+		printf("temp      min ");
+		print_x100(q->temp_min);
+		printf(" avg %.2f max ", (double)q->temp_sum / 100.0 / (double)ok);
+		print_x100(q->temp_max);
+		printf(" °C\nhumidity  avg %.2f %%\nfan on    %.1f %%\nerrors    max %u\n",
+			(double)q->humidity_sum / 100.0 / (double)ok,
+			100.0 * (double)q->fan_on / (double)ok, q->errors_max);
+	}
+	printf("scan      %llu segments, %llu blocks decoded, %llu skipped, %llu bad, "
+		"%.3f ms\n", (unsigned long long)sc->segments, (unsigned long long)sc->blocks,
+		(unsigned long long)sc->skipped, (unsigned long long)sc->bad, secs * 1000.0);
+}
+
+static int	do_query(int argc, char **argv)
+{
+	store_scan_t	sc;
+	query_t		q;
+	int64_t		from;
+	int64_t		to;
+	int64_t		min;
+	int64_t		max;
+	double		t0;
+	int		ret;
+	int		c;
+
+	memset(&q, 0, sizeof(q));
+	from = 1;
+	to = INT64_MAX;
+	while ((c = getopt(argc, argv, "f:t:o:s")) != -1)
+	{
+		if (c == 'f' && !parse_time(optarg, &from))
+			return 1;
+		else if (c == 't' && !parse_time(optarg, &to))
+			return 1;
+		else if (c == 'o' && !strcmp(optarg, "json"))
+			q.out = OUT_JSON;
+		else if (c == 'o' && strcmp(optarg, "csv"))
+			return -1;
+		else if (c == 's')
+			q.summary = true;
+		else if (c == '?')
+			return -1;
+	}
+	if (optind != argc - 1)
+		return -1;
+	store_span(argv[optind], &q.addr, &min, &max);
+	if (!q.summary && q.out == OUT_CSV)
+		printf("ts_ms,addr,result,temp_c,humidity_pct,fan_mode,fan_state,errors,rtt_us\n");
+	t0 = mono_s();
+	ret = store_scan(argv[optind], from, to, query_cb, &q, &sc);
+	if (ret < 0)
+	{
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(-ret));
+		return 1;
+	}
+	if (q.summary)
+		print_summary(&q, &sc, mono_s() - t0);
+	if (sc.bad)
+		fprintf(stderr, "%s: %llu corrupt blocks skipped\n", argv[optind],
+			(unsigned long long)sc.bad);
+	return 0;
+}
+
+/* Rollup ------------------------------------------------------------------- */
+
+static void	series_emit(series_t *se)
+{
+	const rollup_bucket_t	*b;
+	uint32_t		ok;
+
+	b = &se->cur;
+	ok = b->count - b->failed;
+	se->points++;
+	if (se->out == OUT_JSON)
+		printf("{\"start_ms\":%lld,\"count\":%u,\"failed\":%u", (long long)b->start_ms,
+			b->count, b->failed);
+	else
+		printf("%lld,%u,%u", (long long)b->start_ms, b->count, b->failed);
+	if (!ok)
+	{
+		printf(se->out == OUT_JSON ? "}\n" : ",,,,,,,,,,\n");
+		return;
+	}
+	printf(se->out == OUT_JSON ? ",\"temp_min\":" : ",");
+	print_x100(b->temp_min);
+	printf(se->out == OUT_JSON ? ",\"temp_avg\":%.2f,\"temp_max\":" : ",%.2f,",
+		(double)b->temp_sum / 100.0 / ok);
+	print_x100(b->temp_max);
+	printf(se->out == OUT_JSON ? ",\"humidity_min\":" : ",");
+	print_x100(b->humidity_min);
+	printf(se->out == OUT_JSON ? ",\"humidity_avg\":%.2f,\"humidity_max\":" : ",%.2f,",
+		(double)b->humidity_sum / 100.0 / ok);
+	print_x100(b->humidity_max);
+	printf(se->out == OUT_JSON ? ",\"fan_on_pct\":%.1f,\"errors_max\":%u,\"rtt_avg_us\":%.0f,"
+		"\"rtt_max_us\":%u}\n" : ",%.1f,%u,%.0f,%u\n", 100.0 * b->fan_on / ok, b->errors_max,
+		(double)b->rtt_sum / ok, b->rtt_max);
+}
+
+static void	series_push(series_t *se, const rollup_bucket_t *b)
+{
+	int64_t	start;
+
+	start = b->start_ms - b->start_ms % se->width;
+	if (se->have && se->cur.start_ms != start)
+	{
+		series_emit(se);
+		se->have = false;
+	}
+	if (!se->have)
+		rollup_bucket_init(&se->cur, start);
+	se->have = true;
+	rollup_bucket_merge(&se->cur, b);
+}
+
+static int	series_bucket_cb(void *ctx, const rollup_bucket_t *b)
+{
+	series_t	*se;
+
+	se = ctx;
+	se->read++;
+	series_push(se, b);
+	return 0;
+}
+
+static int	series_sample_cb(void *ctx, const store_sample_t *s)
+{
+	rollup_bucket_t	b;
+	series_t	*se;
+
+	se = ctx;
+	se->read++;
+	rollup_bucket_init(&b, s->ts_ms);
+	rollup_bucket_add(&b, s);
+	series_push(se, &b);
+	return 0;
+}
+
+static int	do_rollup(int argc, char **argv)
+{
+	store_scan_t	sc;
+	series_t	se;
+	unsigned long	points;
+	uint8_t		addr;
+	int64_t		from;
+	int64_t		to;
+	int64_t		min;
+	int64_t		max;
+	int64_t		step;
+	double		t0;
+	char		*end;
+	int		res;
+	int		ret;
+	int		c;
+
+	memset(&se, 0, sizeof(se));
+	from = 1;
+	to = INT64_MAX;
+	points = 1000;
+	while ((c = getopt(argc, argv, "f:t:p:o:")) != -1)
+	{
+		if (c == 'f' && !parse_time(optarg, &from))
+			return 1;
+		else if (c == 't' && !parse_time(optarg, &to))
+			return 1;
+		else if (c == 'p')
+		{
+			points = strtoul(optarg, &end, 10);
+			if (end == optarg || *end || !points)
+				return -1;
+		}
+		else if (c == 'o' && !strcmp(optarg, "json"))
+			se.out = OUT_JSON;
+		else if (c == 'o' && strcmp(optarg, "csv"))
+			return -1;
+		else if (c == '?')
+			return -1;
+	}
+	if (optind != argc - 1)
+		return -1;
+	if (se.out == OUT_CSV)
+		printf("start_ms,count,failed,temp_min,temp_avg,temp_max,humidity_min,humidity_avg,"
+			"humidity_max,fan_on_pct,errors_max,rtt_avg_us,rtt_max_us\n");
+	store_span(argv[optind], &addr, &min, &max);
+	if (!min || from > max || to < min)
+		return 0;
+	// the point width, from the part of the range that has data
+	step = ((to < max ? to : max) - (from > min ? from : min) + 1) / (int64_t)points;
+	for (res = ROLLUP_NR - 1; res >= 0 && rollup_res_ms[res] > step; res--)
+		;
+	t0 = mono_s();
+	ret = -ENOENT;
+	if (res >= 0)
+	{
+		se.width = step - step % rollup_res_ms[res];
+		ret = rollup_scan(argv[optind], rollup_res_ms[res], from, to, series_bucket_cb, &se);
+	}
+	if (ret == -ENOENT)
+	{
+		if (res >= 0)
+			fprintf(stderr, "%s: no rollups, reading the samples\n", argv[optind]);
+		res = -1;
+		se.width = step > 0 ? step : 1;
+		ret = store_scan(argv[optind], from, to, series_sample_cb, &se, &sc);
+	}
+	if (ret < 0)
+	{
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(-ret));
+		return 1;
+	}
+	if (se.have)
+		series_emit(&se);
+	fflush(stdout);
+	if (res >= 0)
+		fprintf(stderr, "%us rollup: %llu buckets", rollup_res_ms[res] / 1000,
+			(unsigned long long)se.read);
+	else
+		fprintf(stderr, "samples: %llu", (unsigned long long)se.read);
+	fprintf(stderr, " -> %llu points of %.3f s, %.3f ms\n", (unsigned long long)se.points,
+		(double)se.width / 1000.0, (mono_s() - t0) * 1000.0);
+	return 0;
+}
+
+/* Info --------------------------------------------------------------------- */
+
+static int	count_cb(void *ctx, const rollup_bucket_t *b)
+{
+	(void)b;
+	(*(uint64_t *)ctx)++;
+	return 0;
+}
+
+static void	info_cb(void *ctx, const store_seg_info_t *seg)
+{
+	(void)ctx;
+	printf("%08u  %-4u  %6u  %6u  %3u  %10llu  %7.2f  %lld  %lld\n", seg->seq, seg->addr,
+		seg->blocks, seg->sealed, seg->bad, (unsigned long long)seg->samples,
+		seg->samples ? (double)seg->bytes / (double)seg->samples : 0.0,
+		(long long)seg->min_ms, (long long)seg->max_ms);
+}
+
+static int	do_info(int argc, char **argv)
+{
+	uint64_t	n;
+	int		ret;
+	int		i;
+
+	if (argc != 2)
+		return -1;
+	printf("SEGMENT   ADDR  BLOCKS  SEALED  BAD     SAMPLES  B/SAMPLE  MIN_MS  MAX_MS\n");
+	ret = store_info(argv[1], info_cb, NULL);
+	if (ret < 0)
+	{
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(-ret));
+		return 1;
+	}
+	for (i = 0; i < ROLLUP_NR; i++)
+	{
+		n = 0;
+		if (rollup_scan(argv[1], rollup_res_ms[i], 1, INT64_MAX, count_cb, &n) == 0)
+			printf("rollup %5us  %llu buckets\n", rollup_res_ms[i] / 1000,
+				(unsigned long long)n);
+	}
+	return 0;
+}
+
+/* Ingest ------------------------------------------------------------------- */
+
+static int	do_ingest(int argc, char **argv)
+{
+	struct watch_rec	r;
+	store_sample_t		s;
+	store_t			*st;
+	uint64_t		n;
+	int			ret;
+
+	if (argc != 2)
+		return -1;
+	st = NULL;
+	n = 0;
+	ret = 0;
+	while (fread(&r, sizeof(r), 1, stdin) == 1)
+	{
+		if (r.magic != WATCH_MAGIC)
+		{
+			fprintf(stderr, "ingest: not a watch -f bin stream\n");
+			ret = -EINVAL;
+			break;
+		}
+		if (r.kind != WATCH_KIND_STATUS)
+			continue;
+		if (!st)
+		{
+			ret = store_open(&st, argv[1], r.addr); // the series' node is the first record's
+			if (ret < 0)
+				break;
+		}
+		memset(&s, 0, sizeof(s));
+		s.ts_ms = (int64_t)(r.ts_ns / 1000000);
+		s.result = r.result;
+		s.temp_x100 = r.temp_x100;
+		s.humidity_x100 = r.humidity_x100;
+		s.fan_mode = r.fan_mode;
+		s.fan_state = r.fan_state;
+		s.errors = r.errors;
+		s.rtt_us = r.rtt_us;
+		ret = store_append(st, &s);
+		if (ret < 0)
+			break;
+		n++;
+	}
+	store_close(st);
+	if (ret < 0 && ret != -EINVAL)
+		fprintf(stderr, "%s: %s\n", argv[1], ret == -EBUSY ? "already has a writer"
+			: ret == -EXDEV ? "history of another node" : strerror(-ret));
+	fprintf(stderr, "ingest: %llu samples\n", (unsigned long long)n);
+	return ret < 0;
+}
+
+static void	usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s query [-f from] [-t to] [-o csv|json] [-s] <dir>\n"
+		"       %s rollup [-f from] [-t to] [-p points] [-o csv|json] <dir>\n"
+		"       %s info <dir>\n"
+		"       %s ingest <dir>   < watch -f bin records\n", prog, prog, prog, prog);
+}
+
+int	main(int argc, char **argv)
+{
+	int	ret;
+
+	if (argc < 2)
+		ret = -1;
+	else if (!strcmp(argv[1], "query"))
+		ret = do_query(argc - 1, argv + 1);
+	else if (!strcmp(argv[1], "rollup"))
+		ret = do_rollup(argc - 1, argv + 1);
+	else if (!strcmp(argv[1], "info"))
+		ret = do_info(argc - 1, argv + 1);
+	else if (!strcmp(argv[1], "ingest"))
+		ret = do_ingest(argc - 1, argv + 1);
+	else
+		ret = -1;
+	if (ret < 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	return ret;
+}
@@ -0,0 +1,325 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "proto.h"
+#include "rollup.h"
+
+const uint32_t	rollup_res_ms[ROLLUP_NR] = { 10000, 60000, 3600000 };
+
+struct rollup {
+	int		fd;
+	uint8_t		*map;
+	size_t		size;
+	uint32_t	res_ms;
+};
+
+static int	rollup_path(char *buf, size_t len, const char *dir, uint32_t res_ms)
+{
+	if ((size_t)snprintf(buf, len, "%s/rollup-%us.ftr", dir, res_ms / 1000) >= len)
+		return -ENAMETOOLONG;
+	return 0;
+}
+
+static rollup_hdr_t	*hdr(uint8_t *map)
+{
+	return (rollup_hdr_t *)map;
+}
+
+static rollup_bucket_t	*buckets(uint8_t *map)
+{
+	return (rollup_bucket_t *)(map + sizeof(rollup_hdr_t));
+}
+
+static size_t	file_size(uint64_t nbuckets)
+{
+	return sizeof(rollup_hdr_t) + (size_t)nbuckets * sizeof(rollup_bucket_t);
+}
+
+/* First bucket starting at or after start_ms, n if none */
+static uint64_t	lower_bound(const rollup_bucket_t *b, uint64_t n, int64_t start_ms)
+{
+	uint64_t	lo;
+	uint64_t	hi;
+	uint64_t	mid;
+
+	lo = 0;
+	hi = n;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (b[mid].start_ms < start_ms)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Buckets ------------------------------------------------------------------ */
+
+void	rollup_bucket_init(rollup_bucket_t *b, int64_t start_ms)
+{
+	memset(b, 0, sizeof(*b));
+	b->start_ms = start_ms;
+}
+
+void	rollup_bucket_add(rollup_bucket_t *b, const store_sample_t *s)
+{
+	bool	first;
+
+	b->count++;
+	if (s->result)
+	{
+		b->failed++;
+		return;
+	}
+	first = b->count - b->failed == 1;
+	if (first || s->temp_x100 < b->temp_min)
+		b->temp_min = s->temp_x100;
+	if (first || s->temp_x100 > b->temp_max)
+		b->temp_max = s->temp_x100;
+	if (first || s->humidity_x100 < b->humidity_min)
+		b->humidity_min = s->humidity_x100;
+	if (first || s->humidity_x100 > b->humidity_max)
+		b->humidity_max = s->humidity_x100;
+	b->temp_sum += s->temp_x100;
+	b->humidity_sum += s->humidity_x100;
+	b->rtt_sum += s->rtt_us;
+	if (s->rtt_us > b->rtt_max)
+		b->rtt_max = s->rtt_us;
+	b->fan_on += s->fan_state == PROTO_FAN_STATE_ON;
+	if (s->errors > b->errors_max)
+		b->errors_max = s->errors;
+}
+
+void	rollup_bucket_merge(rollup_bucket_t *dst, const rollup_bucket_t *src)
+{
+	bool	first;
+
+	if (src->count == src->failed)
+	{
+		dst->count += src->count;
+		dst->failed += src->failed;
+		return;
+	}
+	first = dst->count == dst->failed;
+	if (first || src->temp_min < dst->temp_min)
+		dst->temp_min = src->temp_min;
+	if (first || src->temp_max > dst->temp_max)
+		dst->temp_max = src->temp_max;
+	if (first || src->humidity_min < dst->humidity_min)
+		dst->humidity_min = src->humidity_min;
+	if (first || src->humidity_max > dst->humidity_max)
+		dst->humidity_max = src->humidity_max;
+	dst->count += src->count;
+	dst->failed += src->failed;
+	dst->temp_sum += src->temp_sum;
+	dst->humidity_sum += src->humidity_sum;
+	dst->rtt_sum += src->rtt_sum;
+	if (src->rtt_max > dst->rtt_max)
+		dst->rtt_max = src->rtt_max;
+	dst->fan_on += src->fan_on;
+	if (src->errors_max > dst->errors_max)
+		dst->errors_max = src->errors_max;
+}
+
+/* Writer ------------------------------------------------------------------- */
+
+static int	grow(rollup_t *ru, uint64_t nbuckets)
+{
+	size_t	size;
+	void	*map;
+
+	size = file_size(nbuckets + ROLLUP_GROW);
+	if (ftruncate(ru->fd, (off_t)size) < 0)
+		return -errno;
+	map = ru->map ? mremap(ru->map, ru->size, size, MREMAP_MAYMOVE)
+		: mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ru->fd, 0);
+	if (map == MAP_FAILED)
+		return -errno;
+	ru->map = map;
+	ru->size = size;
+	return 0;
+}
+
+/*
+ * Open or create the rollup at res_ms and drop its last bucket: raw
+ * samples from *resume_ms on must be added again.
+ */
+int	rollup_open(rollup_t **rup, const char *dir, uint32_t res_ms, int64_t *resume_ms)
+{
+	struct stat	sb;
+	rollup_hdr_t	*h;
+	rollup_t	*ru;
+	char		path[PATH_MAX];
+	uint64_t	n;
+	int		ret;
+
+	*rup = NULL;
+	ret = rollup_path(path, sizeof(path), dir, res_ms);
+	if (ret < 0)
+		return ret;
+	ru = calloc(1, sizeof(*ru));
+	if (!ru)
+		return -ENOMEM;
+	ru->res_ms = res_ms;
+	ru->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (ru->fd < 0 || fstat(ru->fd, &sb) < 0)
+	{
+		ret = -errno;
+		goto fail;
+	}
+	if ((size_t)sb.st_size < sizeof(rollup_hdr_t))
+		ret = grow(ru, 0);
+	else
+	{
+		ru->size = (size_t)sb.st_size;
+		ru->map = mmap(NULL, ru->size, PROT_READ | PROT_WRITE, MAP_SHARED, ru->fd, 0);
+		ret = ru->map == MAP_FAILED ? -errno : 0;
+		if (ret < 0)
+			ru->map = NULL;
+	}
+	if (ret < 0)
+		goto fail;
+	h = hdr(ru->map);
+	if (!h->magic) // new, or created by a writer that died right away
+	{
+		memset(h, 0, sizeof(*h));
+		h->magic = ROLLUP_MAGIC;
+		h->version = ROLLUP_VERSION;
+		h->res_ms = res_ms;
+		h->bucket_size = sizeof(rollup_bucket_t);
+	}
+	else if (h->magic != ROLLUP_MAGIC || h->version != ROLLUP_VERSION || h->res_ms != res_ms
+		|| h->bucket_size != sizeof(rollup_bucket_t) || file_size(h->nbuckets) > ru->size)
+	{
+		ret = -EINVAL;
+		goto fail;
+	}
+	n = h->nbuckets;
+	*resume_ms = n ? buckets(ru->map)[n - 1].start_ms : 1;
+	if (n)
+		__atomic_store_n(&h->nbuckets, n - 1, __ATOMIC_RELEASE);
+	*rup = ru;
+	return 0;
+
+fail:
+	if (ru->map)
+		munmap(ru->map, ru->size);
+	if (ru->fd >= 0)
+		close(ru->fd);
+	free(ru);
+	return ret;
+}
+
+int	rollup_add(rollup_t *ru, const store_sample_t *s)
+{
+	rollup_bucket_t	*b;
+	rollup_hdr_t	*h;
+	int64_t		start;
+	uint64_t	n;
+	uint64_t	i;
+	int		ret;
+
+	start = s->ts_ms - s->ts_ms % ru->res_ms;
+	h = hdr(ru->map);
+	n = h->nbuckets;
+	b = buckets(ru->map);
+	if (n && b[n - 1].start_ms == start)
+	{
+		rollup_bucket_add(&b[n - 1], s);
+		return 0;
+	}
+	if (n && start < b[n - 1].start_ms)
+	{
+		i = lower_bound(b, n, start); // late sample
+		if (i < n && b[i].start_ms == start)
+			rollup_bucket_add(&b[i], s);
+		return 0;
+	}
+	if (file_size(n + 1) > ru->size)
+	{
+		ret = grow(ru, n + 1);
+		if (ret < 0)
+			return ret;
+		h = hdr(ru->map);
+		b = buckets(ru->map);
+	}
+	rollup_bucket_init(&b[n], start);
+	rollup_bucket_add(&b[n], s);
+	__atomic_store_n(&h->nbuckets, n + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void	rollup_sync(rollup_t *ru)
+{
+	msync(ru->map, file_size(hdr(ru->map)->nbuckets), MS_ASYNC);
+}
+
+void	rollup_close(rollup_t *ru)
+{
+	if (!ru)
+		return;
+	msync(ru->map, ru->size, MS_SYNC);
+	munmap(ru->map, ru->size);
+	close(ru->fd);
+	free(ru);
+}
+
+/* Readers ------------------------------------------------------------------ */
+
+int	rollup_scan(const char *dir, uint32_t res_ms, int64_t from_ms, int64_t to_ms,
+		rollup_cb_t cb, void *ctx)
+{
+	const rollup_bucket_t	*b;
+	const rollup_hdr_t	*h;
+	struct stat		sb;
+	char			path[PATH_MAX];
+	uint8_t			*map;
+	uint64_t		n;
+	uint64_t		i;
+	int			fd;
+	int			ret;
+
+	ret = rollup_path(path, sizeof(path), dir, res_ms);
+	if (ret < 0)
+		return ret;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(rollup_hdr_t))
+	{
+		close(fd);
+		return -ENOENT;
+	}
+	map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -errno;
+	h = (const rollup_hdr_t *)map;
+	n = __atomic_load_n(&h->nbuckets, __ATOMIC_ACQUIRE);
+	if (!h->magic)
+		n = 0; // being created
+	else if (h->magic != ROLLUP_MAGIC || h->res_ms != res_ms
+		|| h->bucket_size != sizeof(rollup_bucket_t) || file_size(n) > (size_t)sb.st_size)
+	{
+		munmap(map, (size_t)sb.st_size);
+		return -EINVAL;
+	}
+	b = buckets(map);
+	for (i = lower_bound(b, n, from_ms - from_ms % res_ms); i < n && b[i].start_ms <= to_ms; i++)
+	{
+		if (cb(ctx, &b[i]))
+			break;
+	}
+	munmap(map, (size_t)sb.st_size);
+	return 0;
+}
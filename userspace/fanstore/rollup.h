@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "store.h"
+
+/*
+ * Rollups: pre-aggregated history at coarser resolutions
+ * ------------------------------------------------------
+ * Next to its segments, a store keeps one rollup file per resolution,
+ * rollup-10s.ftr, rollup-60s.ftr and rollup-3600s.ftr: a rollup_hdr_t
+ * and an array of fixed-size buckets sorted by start time, mapped
+ * whole like the segments.
+ *
+ * The store writer adds every sample to the bucket it falls in, in
+ * place, and appends a bucket when a sample starts a new one; `nbuckets`
+ * is stored last. The buckets are derived data: on open, the writer
+ * drops the last bucket of each file and rebuilds it (and anything
+ * after) from the raw samples, so a crash or a store written before
+ * rollups existed converges to the segments. A sample older than the
+ * last bucket updates its bucket if there is one, and is only kept raw
+ * otherwise.
+ *
+ * Readers may see the newest bucket mid-update.
+ */
+
+#define ROLLUP_MAGIC		0x31525446 // "FTR1"
+#define ROLLUP_VERSION		1
+#define ROLLUP_NR		3
+#define ROLLUP_GROW		4096 // buckets per file extension
+
+extern const uint32_t	rollup_res_ms[ROLLUP_NR]; // finest first
+
+typedef struct {
+	uint32_t	magic; // ROLLUP_MAGIC
+	uint16_t	version;
+	uint16_t	rsvd0;
+	uint32_t	res_ms;
+	uint32_t	bucket_size; // sizeof(rollup_bucket_t)
+	uint64_t	nbuckets; // buckets in use
+	uint8_t		rsvd[40];
+}	rollup_hdr_t;
+
+/* Aggregate of the samples in [start_ms, start_ms + res_ms) */
+typedef struct {
+	int64_t		start_ms;
+	uint32_t	count; // samples
+	uint32_t	failed; // result != 0; the fields below are over the others
+	int64_t		temp_sum; // 0.01°C
+	int64_t		humidity_sum; // 0.01%
+	int64_t		rtt_sum; // µs
+	int16_t		temp_min;
+	int16_t		temp_max;
+	uint16_t	humidity_min;
+	uint16_t	humidity_max;
+	uint32_t	fan_on; // samples with the fan on
+	uint16_t	errors_max;
+	uint16_t	rsvd0;
+	uint32_t	rtt_max;
+	uint32_t	rsvd1;
+}	rollup_bucket_t;
+
+_Static_assert(sizeof(rollup_hdr_t) == 64, "rollup_hdr_t is a file format");
+_Static_assert(sizeof(rollup_bucket_t) == 64, "rollup_bucket_t is a file format");
+
+typedef struct rollup	rollup_t;
+
+typedef int	(*rollup_cb_t)(void *ctx, const rollup_bucket_t *b); // non-zero stops
+
+// writer, used by store.c; all return 0 or -errno
+int	rollup_open(rollup_t **ru, const char *dir, uint32_t res_ms, int64_t *resume_ms);
+int	rollup_add(rollup_t *ru, const store_sample_t *s);
+void	rollup_sync(rollup_t *ru);
+void	rollup_close(rollup_t *ru);
+
+// readers; -ENOENT when the store has no rollup at res_ms
+int	rollup_scan(const char *dir, uint32_t res_ms, int64_t from_ms, int64_t to_ms,
+		rollup_cb_t cb, void *ctx);
+
+// bucket arithmetic, also for aggregating raw samples
+void	rollup_bucket_init(rollup_bucket_t *b, int64_t start_ms);
+void	rollup_bucket_add(rollup_bucket_t *b, const store_sample_t *s);
+void	rollup_bucket_merge(rollup_bucket_t *dst, const rollup_bucket_t *src);
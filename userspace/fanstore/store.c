@@ -0,0 +1,834 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rollup.h"
+#include "store.h"
+
+#define VARINT_MAX	10
+#define PAGE		4096
+
+/* Column regions of a block, after the header; a region ends where the next starts */
+static const uint16_t	g_col_off[STORE_COL_NR + 1] = {
+	[STORE_COL_TS]		= 64,
+	[STORE_COL_TEMP]	= 576,
+	[STORE_COL_HUMIDITY]	= 1152,
+	[STORE_COL_FLAGS]	= 1728,
+	[STORE_COL_RESULT]	= 2240,
+	[STORE_COL_ERRORS]	= 2752,
+	[STORE_COL_RTT]		= 3264,
+	[STORE_COL_NR]		= STORE_BLOCK_SIZE,
+};
+
+/*
+ * Running values of a block's columns: what the next sample is encoded
+ * against, and where each column ends. The writer keeps one for its
+ * open block, readers rebuild it while decoding.
+ */
+typedef struct {
+	int64_t		ts;
+	int64_t		delta; // last ts delta
+	int32_t		temp;
+	int32_t		humidity;
+	uint8_t		flags;
+	uint16_t	errors;
+	int64_t		rtt;
+	uint16_t	end[STORE_COL_NR];
+	uint32_t	count;
+}	col_state_t;
+
+struct store {
+	char		dir[PATH_MAX];
+	uint8_t		addr;
+	int		lock_fd;
+	int		fd;
+	uint8_t		*map;
+	uint32_t	seq;
+	int		blk; // open block, -1: none
+	uint32_t	nblk; // blocks started in the segment
+	col_state_t	cs;
+	rollup_t	*ru[ROLLUP_NR];
+};
+
+// rebuilding the rollups' tails on open
+typedef struct {
+	store_t		*st;
+	int64_t		resume_ms[ROLLUP_NR];
+	int		ret;
+}	resume_t;
+
+static int64_t	now_ms(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* CRC-32 (IEEE, reflected) ------------------------------------------------- */
+
+static uint32_t	crc32(const uint8_t *p, size_t len)
+{
+	static uint32_t	table[256];
+	uint32_t	crc;
+	uint32_t	c;
+	int		i;
+	int		k;
+
+	if (!table[1])
+	{
+		for (i = 0; i < 256; i++)
+		{
+			c = (uint32_t)i;
+			for (k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	}
+	crc = 0xFFFFFFFFu;
+	while (len--)
+		crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFFu;
+}
+
+/* Column codec ------------------------------------------------------------- */
+
+static uint64_t	zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t	unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint8_t	put_varint(uint8_t *p, uint64_t v)
+{
+	uint8_t	n;
+
+	n = 0;
+	while (v >= 0x80)
+	{
+		p[n++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+	return n;
+}
+
+/* Next varint of a column, false past the end of its region */
+static bool	get_varint(const uint8_t *blk, uint16_t *pos, uint16_t limit, uint64_t *v)
+{
+	unsigned	shift;
+	uint8_t		b;
+
+	*v = 0;
+	for (shift = 0; shift < 64 && *pos < limit; shift += 7)
+	{
+		b = blk[(*pos)++];
+		*v |= (uint64_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static void	col_init(col_state_t *cs, int64_t base_ms)
+{
+	int	c;
+
+	memset(cs, 0, sizeof(*cs));
+	cs->ts = base_ms;
+	for (c = 0; c < STORE_COL_NR; c++)
+		cs->end[c] = g_col_off[c];
+}
+
+/*
+ * Encode a sample against cs into one buffer per column. A failed sample
+ * repeats the previous status values, which encode in one byte each.
+ */
+static void	col_encode(const col_state_t *cs, const store_sample_t *s,
+			uint8_t buf[STORE_COL_NR][VARINT_MAX], uint8_t len[STORE_COL_NR])
+{
+	int64_t	delta;
+	bool	ok;
+
+	ok = s->result == 0;
+	delta = s->ts_ms - cs->ts;
+	len[STORE_COL_TS] = put_varint(buf[STORE_COL_TS], zigzag(delta - cs->delta));
+	len[STORE_COL_TEMP] = put_varint(buf[STORE_COL_TEMP],
+		zigzag(ok ? (int64_t)s->temp_x100 - cs->temp : 0));
+	len[STORE_COL_HUMIDITY] = put_varint(buf[STORE_COL_HUMIDITY],
+		zigzag(ok ? (int64_t)s->humidity_x100 - cs->humidity : 0));
+	buf[STORE_COL_FLAGS][0] = ok ? (uint8_t)((s->fan_mode & 3) | (s->fan_state & 3) << 2)
+		: cs->flags;
+	len[STORE_COL_FLAGS] = 1;
+	len[STORE_COL_RESULT] = put_varint(buf[STORE_COL_RESULT], zigzag(-(int64_t)s->result));
+	len[STORE_COL_ERRORS] = put_varint(buf[STORE_COL_ERRORS], ok ? s->errors : cs->errors);
+	len[STORE_COL_RTT] = put_varint(buf[STORE_COL_RTT], zigzag((int64_t)s->rtt_us - cs->rtt));
+}
+
+static void	col_apply(col_state_t *cs, const store_sample_t *s, const uint8_t len[STORE_COL_NR])
+{
+	int	c;
+
+	cs->delta = s->ts_ms - cs->ts;
+	cs->ts = s->ts_ms;
+	if (s->result == 0)
+	{
+		cs->temp = s->temp_x100;
+		cs->humidity = s->humidity_x100;
+		cs->flags = (uint8_t)((s->fan_mode & 3) | (s->fan_state & 3) << 2);
+		cs->errors = s->errors;
+	}
+	cs->rtt = s->rtt_us;
+	for (c = 0; c < STORE_COL_NR; c++)
+		cs->end[c] += len[c];
+	cs->count++;
+}
+
+/* Decode the next sample of a block, false if a column is corrupt */
+static bool	col_decode(const uint8_t *blk, col_state_t *cs, store_sample_t *s)
+{
+	uint64_t	v[STORE_COL_NR];
+	uint16_t	pos;
+	int		c;
+
+	for (c = 0; c < STORE_COL_NR; c++)
+	{
+		if (c == STORE_COL_FLAGS)
+		{
+			if (cs->end[c] >= g_col_off[c + 1])
+				return false;
+			v[c] = blk[cs->end[c]++];
+			continue;
+		}
+		pos = cs->end[c];
+		if (!get_varint(blk, &pos, g_col_off[c + 1], &v[c]))
+			return false;
+		cs->end[c] = pos;
+	}
+	memset(s, 0, sizeof(*s));
+	cs->delta += unzigzag(v[STORE_COL_TS]);
+	cs->ts += cs->delta;
+	cs->temp += (int32_t)unzigzag(v[STORE_COL_TEMP]);
+	cs->humidity += (int32_t)unzigzag(v[STORE_COL_HUMIDITY]);
+	cs->flags = (uint8_t)v[STORE_COL_FLAGS];
+	cs->errors = (uint16_t)v[STORE_COL_ERRORS];
+	cs->rtt += unzigzag(v[STORE_COL_RTT]);
+	cs->count++;
+	s->ts_ms = cs->ts;
+	s->result = -(int32_t)unzigzag(v[STORE_COL_RESULT]);
+	s->rtt_us = (uint32_t)cs->rtt;
+	if (s->result)
+		return true;
+	s->temp_x100 = (int16_t)cs->temp;
+	s->humidity_x100 = (uint16_t)cs->humidity;
+	s->fan_mode = cs->flags & 3;
+	s->fan_state = cs->flags >> 2 & 3;
+	s->errors = cs->errors;
+	return true;
+}
+
+/* Segments ----------------------------------------------------------------- */
+
+static store_index_t	*seg_index(uint8_t *map)
+{
+	return (store_index_t *)(map + STORE_INDEX_OFF);
+}
+
+static uint8_t	*seg_block(uint8_t *map, uint32_t b)
+{
+	return map + STORE_DATA_OFF + (size_t)b * STORE_BLOCK_SIZE;
+}
+
+static int	seg_path(char *buf, size_t len, const char *dir, uint32_t seq, bool tmp)
+{
+	if ((size_t)snprintf(buf, len, tmp ? "%s/.%08u.fts.tmp" : "%s/%08u.fts", dir, seq) >= len)
+		return -ENAMETOOLONG;
+	return 0;
+}
+
+static int	seg_check(const uint8_t *map)
+{
+	const store_seg_hdr_t	*h;
+
+	h = (const store_seg_hdr_t *)map;
+	if (h->magic != STORE_MAGIC || h->version != STORE_VERSION
+		|| h->block_size != STORE_BLOCK_SIZE || h->nblocks != STORE_SEG_BLOCKS)
+		return -EINVAL;
+	return 0;
+}
+
+/* Map a whole segment, NULL and errno on failure */
+static uint8_t	*seg_map(const char *path, bool rw, int *fdp)
+{
+	struct stat	sb;
+	uint8_t		*map;
+	int		fd;
+	int		ret;
+
+	fd = open(path, (rw ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	map = MAP_FAILED;
+	if (fstat(fd, &sb) < 0)
+		ret = errno;
+	else if ((size_t)sb.st_size != STORE_SEG_SIZE)
+		ret = EINVAL;
+	else
+	{
+		map = mmap(NULL, STORE_SEG_SIZE, PROT_READ | (rw ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+		ret = map == MAP_FAILED ? errno : -seg_check(map);
+	}
+	if (ret)
+	{
+		if (map != MAP_FAILED)
+			munmap(map, STORE_SEG_SIZE);
+		close(fd);
+		errno = ret;
+		return NULL;
+	}
+	if (fdp)
+		*fdp = fd;
+	else
+		close(fd);
+	return map;
+}
+
+/* Segment numbers of a store, sorted */
+static int	seg_list(const char *dir, uint32_t **seqs, size_t *n)
+{
+	char	pattern[PATH_MAX];
+	glob_t	g;
+	size_t	i;
+	int	ret;
+
+	*seqs = NULL;
+	*n = 0;
+	snprintf(pattern, sizeof(pattern), "%s/[0-9]*.fts", dir);
+	ret = glob(pattern, 0, NULL, &g);
+	if (ret == GLOB_NOMATCH)
+		return 0;
+	if (ret)
+		return -EIO;
+	*seqs = calloc(g.gl_pathc, sizeof(**seqs));
+	if (!*seqs)
+	{
+		globfree(&g);
+		return -ENOMEM;
+	}
+	for (i = 0; i < g.gl_pathc; i++) // zero-padded names: glob order is numeric
+		(*seqs)[(*n)++] = (uint32_t)strtoul(strrchr(g.gl_pathv[i], '/') + 1, NULL, 10);
+	globfree(&g);
+	return 0;
+}
+
+/* Writer ------------------------------------------------------------------- */
+
+static void	seg_unmap(store_t *st)
+{
+	if (!st->map)
+		return;
+	msync(st->map, STORE_SEG_SIZE, MS_SYNC);
+	munmap(st->map, STORE_SEG_SIZE);
+	close(st->fd);
+	st->map = NULL;
+}
+
+/* New segment, created under a temporary name so readers never see it half made */
+static int	seg_create(store_t *st, uint32_t seq)
+{
+	store_seg_hdr_t	h;
+	char		tmp[PATH_MAX];
+	char		path[PATH_MAX];
+	int		fd;
+	int		ret;
+
+	if (seg_path(tmp, sizeof(tmp), st->dir, seq, true) < 0
+		|| seg_path(path, sizeof(path), st->dir, seq, false) < 0)
+		return -ENAMETOOLONG;
+	fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+	memset(&h, 0, sizeof(h));
+	h.magic = STORE_MAGIC;
+	h.version = STORE_VERSION;
+	h.addr = st->addr;
+	h.seq = seq;
+	h.block_size = STORE_BLOCK_SIZE;
+	h.nblocks = STORE_SEG_BLOCKS;
+	h.created_ms = now_ms();
+	ret = 0;
+	if (ftruncate(fd, (off_t)STORE_SEG_SIZE) < 0 || pwrite(fd, &h, sizeof(h), 0) != sizeof(h)
+		|| fsync(fd) < 0 || rename(tmp, path) < 0)
+		ret = -errno;
+	close(fd);
+	if (ret < 0)
+	{
+		unlink(tmp);
+		return ret;
+	}
+	fd = open(st->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd >= 0)
+	{
+		fsync(fd); // the rename
+		close(fd);
+	}
+	st->map = seg_map(path, true, &st->fd);
+	if (!st->map)
+		return -errno;
+	st->seq = seq;
+	st->blk = -1;
+	st->nblk = 0;
+	return 0;
+}
+
+/* Reopen the last segment and rebuild the open block's state from its columns */
+static int	seg_resume(store_t *st, uint32_t seq)
+{
+	store_block_hdr_t	*bh;
+	store_index_t		*idx;
+	store_sample_t		s;
+	char			path[PATH_MAX];
+	uint8_t			*blk;
+	uint32_t		count;
+
+	if (seg_path(path, sizeof(path), st->dir, seq, false) < 0)
+		return -ENAMETOOLONG;
+	st->map = seg_map(path, true, &st->fd);
+	if (!st->map)
+		return -errno;
+	if (((store_seg_hdr_t *)st->map)->addr != st->addr)
+	{
+		seg_unmap(st);
+		return -EXDEV; // another node's store
+	}
+	st->seq = seq;
+	st->blk = -1;
+	idx = seg_index(st->map);
+	for (st->nblk = 0; st->nblk < STORE_SEG_BLOCKS && idx[st->nblk].min_ms; st->nblk++)
+		;
+	if (!st->nblk)
+		return 0;
+	blk = seg_block(st->map, st->nblk - 1);
+	bh = (store_block_hdr_t *)blk;
+	if (bh->sealed || bh->magic != STORE_MAGIC)
+		return 0;
+	col_init(&st->cs, bh->base_ms);
+	count = bh->count;
+	while (st->cs.count < count && st->cs.count < STORE_BLOCK_MAX && col_decode(blk, &st->cs, &s))
+		;
+	st->blk = (int)st->nblk - 1;
+	if (st->cs.count != count)
+		bh->count = st->cs.count; // corrupt tail: keep what decodes
+	return 0;
+}
+
+static int	resume_cb(void *ctx, const store_sample_t *s)
+{
+	resume_t	*r;
+	int		i;
+
+	r = ctx;
+	for (i = 0; i < ROLLUP_NR && !r->ret; i++)
+	{
+		if (s->ts_ms >= r->resume_ms[i])
+			r->ret = rollup_add(r->st->ru[i], s);
+	}
+	return r->ret;
+}
+
+/* Open the rollups and add back the samples their last bucket covered */
+static int	rollups_open(store_t *st)
+{
+	store_scan_t	stats;
+	resume_t	r;
+	int64_t		from;
+	int		ret;
+	int		i;
+
+	memset(&r, 0, sizeof(r));
+	r.st = st;
+	from = INT64_MAX;
+	for (i = 0; i < ROLLUP_NR; i++)
+	{
+		ret = rollup_open(&st->ru[i], st->dir, rollup_res_ms[i], &r.resume_ms[i]);
+		if (ret < 0)
+			return ret;
+		if (r.resume_ms[i] < from)
+			from = r.resume_ms[i];
+	}
+	ret = store_scan(st->dir, from, INT64_MAX, resume_cb, &r, &stats);
+	return ret < 0 ? ret : r.ret;
+}
+
+int	store_open(store_t **stp, const char *dir, uint8_t addr)
+{
+	store_t		*st;
+	uint32_t	*seqs;
+	char		path[PATH_MAX];
+	size_t		n;
+	int		ret;
+
+	*stp = NULL;
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+		return -errno;
+	st = calloc(1, sizeof(*st));
+	if (!st)
+		return -ENOMEM;
+	st->addr = addr;
+	st->fd = -1;
+	if ((size_t)snprintf(st->dir, sizeof(st->dir), "%s", dir) >= sizeof(st->dir)
+		|| (size_t)snprintf(path, sizeof(path), "%s/LOCK", dir) >= sizeof(path))
+	{
+		free(st);
+		return -ENAMETOOLONG;
+	}
+	st->lock_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (st->lock_fd < 0)
+	{
+		ret = -errno;
+		free(st);
+		return ret;
+	}
+	if (flock(st->lock_fd, LOCK_EX | LOCK_NB) < 0)
+	{
+		ret = errno == EWOULDBLOCK ? -EBUSY : -errno;
+		close(st->lock_fd);
+		free(st);
+		return ret;
+	}
+	ret = seg_list(dir, &seqs, &n);
+	if (ret == 0)
+		ret = n ? seg_resume(st, seqs[n - 1]) : seg_create(st, 0);
+	free(seqs);
+	if (ret == 0)
+		ret = rollups_open(st);
+	if (ret < 0)
+	{
+		store_close(st);
+		return ret;
+	}
+	*stp = st;
+	return 0;
+}
+
+/* Write the column lengths and CRC, then the sealed flag readers check first */
+static void	block_seal(store_t *st)
+{
+	uint8_t			copy[STORE_BLOCK_SIZE];
+	store_block_hdr_t	*bh;
+	uint8_t			*blk;
+	size_t			ipage;
+	int			c;
+
+	blk = seg_block(st->map, (uint32_t)st->blk);
+	bh = (store_block_hdr_t *)blk;
+	for (c = 0; c < STORE_COL_NR; c++)
+		bh->len[c] = (uint16_t)(st->cs.end[c] - g_col_off[c]);
+	memcpy(copy, blk, sizeof(copy));
+	((store_block_hdr_t *)copy)->sealed = 1;
+	((store_block_hdr_t *)copy)->crc = 0;
+	bh->crc = crc32(copy, sizeof(copy));
+	__atomic_store_n(&bh->sealed, 1, __ATOMIC_RELEASE);
+	msync(blk, STORE_BLOCK_SIZE, MS_SYNC);
+	ipage = (STORE_INDEX_OFF + (size_t)st->blk * sizeof(store_index_t)) & ~(size_t)(PAGE - 1);
+	msync(st->map + ipage, PAGE, MS_SYNC);
+	for (c = 0; c < ROLLUP_NR; c++)
+		rollup_sync(st->ru[c]);
+	st->blk = -1;
+}
+
+static int	block_start(store_t *st, int64_t ts_ms)
+{
+	store_block_hdr_t	*bh;
+	store_index_t		*idx;
+	int			ret;
+
+	if (st->nblk == STORE_SEG_BLOCKS)
+	{
+		seg_unmap(st);
+		ret = seg_create(st, st->seq + 1);
+		if (ret < 0)
+			return ret;
+	}
+	st->blk = (int)st->nblk++;
+	bh = (store_block_hdr_t *)seg_block(st->map, (uint32_t)st->blk);
+	memset(bh, 0, sizeof(*bh));
+	bh->magic = STORE_MAGIC;
+	bh->base_ms = ts_ms;
+	col_init(&st->cs, ts_ms);
+	idx = &seg_index(st->map)[st->blk];
+	idx->max_ms = ts_ms;
+	__atomic_store_n(&idx->min_ms, ts_ms, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static bool	fits(const col_state_t *cs, const uint8_t len[STORE_COL_NR])
+{
+	int	c;
+
+	if (cs->count >= STORE_BLOCK_MAX)
+		return false;
+	for (c = 0; c < STORE_COL_NR; c++)
+	{
+		if (cs->end[c] + len[c] > g_col_off[c + 1])
+			return false;
+	}
+	return true;
+}
+
+int	store_append(store_t *st, const store_sample_t *s)
+{
+	uint8_t			buf[STORE_COL_NR][VARINT_MAX];
+	uint8_t			len[STORE_COL_NR];
+	store_block_hdr_t	*bh;
+	store_index_t		*idx;
+	uint8_t			*blk;
+	int			ret;
+	int			c;
+
+	if (s->ts_ms <= 0)
+		return -EINVAL; // 0 marks unused index entries
+	if (st->blk >= 0)
+	{
+		col_encode(&st->cs, s, buf, len);
+		if (!fits(&st->cs, len))
+			block_seal(st);
+	}
+	if (st->blk < 0)
+	{
+		ret = block_start(st, s->ts_ms);
+		if (ret < 0)
+			return ret;
+		col_encode(&st->cs, s, buf, len); // always fits an empty block
+	}
+	blk = seg_block(st->map, (uint32_t)st->blk);
+	for (c = 0; c < STORE_COL_NR; c++)
+		memcpy(blk + st->cs.end[c], buf[c], len[c]);
+	idx = &seg_index(st->map)[st->blk];
+	if (s->ts_ms < idx->min_ms)
+		__atomic_store_n(&idx->min_ms, s->ts_ms, __ATOMIC_RELAXED);
+	if (s->ts_ms > idx->max_ms)
+		__atomic_store_n(&idx->max_ms, s->ts_ms, __ATOMIC_RELAXED);
+	bh = (store_block_hdr_t *)blk;
+	__atomic_store_n(&bh->count, st->cs.count + 1, __ATOMIC_RELEASE); // commit
+	col_apply(&st->cs, s, len);
+	for (c = 0; c < ROLLUP_NR; c++)
+	{
+		ret = rollup_add(st->ru[c], s);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+/* The open block stays open: the next store_open() appends to it */
+int	store_close(store_t *st)
+{
+	int	i;
+
+	if (!st)
+		return 0;
+	for (i = 0; i < ROLLUP_NR; i++)
+		rollup_close(st->ru[i]);
+	seg_unmap(st);
+	close(st->lock_fd);
+	free(st);
+	return 0;
+}
+
+/* Readers ------------------------------------------------------------------ */
+
+/* Committed samples of a block; -1 for a sealed block failing its CRC */
+static int	block_count(const uint8_t *blk)
+{
+	uint8_t			copy[STORE_BLOCK_SIZE];
+	const store_block_hdr_t	*bh;
+	uint32_t		crc;
+
+	bh = (const store_block_hdr_t *)blk;
+	if (!__atomic_load_n(&bh->sealed, __ATOMIC_ACQUIRE))
+		return bh->magic == STORE_MAGIC ? (int)__atomic_load_n(&bh->count, __ATOMIC_ACQUIRE) : 0;
+	memcpy(copy, blk, sizeof(copy));
+	((store_block_hdr_t *)copy)->crc = 0;
+	crc = crc32(copy, sizeof(copy));
+	if (crc != bh->crc || bh->magic != STORE_MAGIC || bh->count > STORE_BLOCK_MAX)
+		return -1;
+	return (int)bh->count;
+}
+
+int	store_scan(const char *dir, int64_t from_ms, int64_t to_ms, store_cb_t cb, void *ctx,
+		store_scan_t *stats)
+{
+	const store_index_t	*idx;
+	store_sample_t		s;
+	col_state_t		cs;
+	uint32_t		*seqs;
+	char			path[PATH_MAX];
+	uint8_t			*map;
+	uint8_t			*blk;
+	size_t			n;
+	size_t			i;
+	uint32_t		b;
+	int64_t			min;
+	int			count;
+	int			stop;
+	int			ret;
+
+	memset(stats, 0, sizeof(*stats));
+	ret = seg_list(dir, &seqs, &n);
+	stop = 0;
+	for (i = 0; i < n && ret == 0 && !stop; i++)
+	{
+		if (seg_path(path, sizeof(path), dir, seqs[i], false) < 0)
+			ret = -ENAMETOOLONG;
+		map = ret ? NULL : seg_map(path, false, NULL);
+		if (!map)
+			continue; // rotated away or not ours
+		stats->segments++;
+		idx = seg_index(map);
+		for (b = 0; b < STORE_SEG_BLOCKS && !stop; b++)
+		{
+			min = __atomic_load_n(&idx[b].min_ms, __ATOMIC_ACQUIRE);
+			if (!min)
+				break;
+			if (min > to_ms || idx[b].max_ms < from_ms)
+			{
+				stats->skipped++;
+				continue;
+			}
+			blk = seg_block(map, b);
+			count = block_count(blk);
+			if (count < 0)
+			{
+				stats->bad++;
+				continue;
+			}
+			stats->blocks++;
+			col_init(&cs, ((store_block_hdr_t *)blk)->base_ms);
+			while ((int)cs.count < count && !stop)
+			{
+				if (!col_decode(blk, &cs, &s))
+				{
+					stats->bad++;
+					break;
+				}
+				if (s.ts_ms < from_ms || s.ts_ms > to_ms)
+					continue;
+				stats->samples++;
+				stop = cb(ctx, &s);
+			}
+		}
+		munmap(map, STORE_SEG_SIZE);
+	}
+	free(seqs);
+	return ret;
+}
+
+int	store_info(const char *dir, store_info_cb_t cb, void *ctx)
+{
+	const store_index_t	*idx;
+	store_seg_info_t	si;
+	store_sample_t		s;
+	col_state_t		cs;
+	uint32_t		*seqs;
+	char			path[PATH_MAX];
+	uint8_t			*map;
+	uint8_t			*blk;
+	size_t			n;
+	size_t			i;
+	uint32_t		b;
+	int			count;
+	int			c;
+	int			ret;
+
+	ret = seg_list(dir, &seqs, &n);
+	for (i = 0; i < n && ret == 0; i++)
+	{
+		if (seg_path(path, sizeof(path), dir, seqs[i], false) < 0)
+			ret = -ENAMETOOLONG;
+		map = ret ? NULL : seg_map(path, false, NULL);
+		if (!map)
+			continue;
+		memset(&si, 0, sizeof(si));
+		si.seq = seqs[i];
+		si.addr = ((store_seg_hdr_t *)map)->addr;
+		idx = seg_index(map);
+		for (b = 0; b < STORE_SEG_BLOCKS && idx[b].min_ms; b++)
+		{
+			blk = seg_block(map, b);
+			si.blocks++;
+			if (!si.min_ms || idx[b].min_ms < si.min_ms)
+				si.min_ms = idx[b].min_ms;
+			if (idx[b].max_ms > si.max_ms)
+				si.max_ms = idx[b].max_ms;
+			count = block_count(blk);
+			if (count < 0)
+			{
+				si.bad++;
+				continue;
+			}
+			si.sealed += ((store_block_hdr_t *)blk)->sealed != 0;
+			col_init(&cs, ((store_block_hdr_t *)blk)->base_ms);
+			while ((int)cs.count < count && col_decode(blk, &cs, &s))
+				;
+			si.samples += cs.count;
+			for (c = 0; c < STORE_COL_NR; c++)
+				si.bytes += (uint64_t)(cs.end[c] - g_col_off[c]);
+		}
+		munmap(map, STORE_SEG_SIZE);
+		cb(ctx, &si);
+	}
+	free(seqs);
+	return ret;
+}
+
+/* Time span from the segment indexes alone, without decoding */
+int	store_span(const char *dir, uint8_t *addr, int64_t *min_ms, int64_t *max_ms)
+{
+	const store_index_t	*idx;
+	uint32_t		*seqs;
+	char			path[PATH_MAX];
+	uint8_t			*map;
+	size_t			n;
+	size_t			i;
+	uint32_t		b;
+	int			ret;
+
+	*min_ms = 0;
+	*max_ms = 0;
+	ret = seg_list(dir, &seqs, &n);
+	for (i = 0; i < n && ret == 0; i++)
+	{
+		if (seg_path(path, sizeof(path), dir, seqs[i], false) < 0)
+			ret = -ENAMETOOLONG;
+		map = ret ? NULL : seg_map(path, false, NULL);
+		if (!map)
+			continue;
+		*addr = ((store_seg_hdr_t *)map)->addr;
+		idx = seg_index(map);
+		for (b = 0; b < STORE_SEG_BLOCKS && idx[b].min_ms; b++)
+		{
+			if (!*min_ms || idx[b].min_ms < *min_ms)
+				*min_ms = idx[b].min_ms;
+			if (idx[b].max_ms > *max_ms)
+				*max_ms = idx[b].max_ms;
+		}
+		munmap(map, STORE_SEG_SIZE);
+	}
+	free(seqs);
+	return ret;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * fanstore: on-disk status history of one node
+ * --------------------------------------------
+ * A store is a directory of fixed-size segment files, 00000000.fts,
+ * 00000001.fts, ... Each is mapped whole (MAP_SHARED) by the writer and
+ * by readers, and is never parsed as text.
+ *
+ * Segment layout, in host byte order like the other binary formats here:
+ *
+ *   0        store_seg_hdr_t
+ *   4096     index: STORE_SEG_BLOCKS x store_index_t, min/max ts per block
+ *   20480    blocks: STORE_SEG_BLOCKS x STORE_BLOCK_SIZE
+ *
+ * A block holds up to STORE_BLOCK_MAX samples, column by column. Each
+ * column has a fixed region of the block and only ever grows at its
+ * end:
+ *
+ *   ts        zigzag varint delta of delta (ms), from the block base
+ *   temp      zigzag varint delta (0.01°C)
+ *   humidity  zigzag varint delta (0.01%)
+ *   flags     one byte: fan_mode | fan_state << 2
+ *   result    zigzag varint of -result (0: ok)
+ *   errors    varint
+ *   rtt       zigzag varint delta (µs)
+ *
+ * A sample at 1 Hz with a steady reading takes 7-8 bytes, against 40 in
+ * a watch_rec. The block is sealed (column lengths and CRC-32 written)
+ * when a column region can't take the next value.
+ *
+ * Appends are crash safe: the column bytes and the block's index entry
+ * are written first, then the block's sample count is stored, and that
+ * store is the commit. Bytes past the count are ignored and overwritten
+ * by the next append, so a crashed writer loses at most the sample it
+ * was appending. A sealed block whose CRC doesn't match (torn by a power
+ * loss) is skipped by readers. Segments are msync()ed when a block is
+ * sealed and on close.
+ *
+ * One writer per store (flock on the store's LOCK file); any number of
+ * readers, also while it writes. The writer also keeps the store's
+ * rollups up to date (rollup.h).
+ */
+
+#define STORE_MAGIC		0x31535446 // "FTS1"
+#define STORE_VERSION		1
+#define STORE_BLOCK_SIZE	4096
+#define STORE_BLOCK_MAX		512
+#define STORE_SEG_BLOCKS	1024
+#define STORE_INDEX_OFF		4096
+#define STORE_DATA_OFF		(STORE_INDEX_OFF + STORE_SEG_BLOCKS * sizeof(store_index_t))
+#define STORE_SEG_SIZE		(STORE_DATA_OFF + (size_t)STORE_SEG_BLOCKS * STORE_BLOCK_SIZE)
+
+enum {
+	STORE_COL_TS,
+	STORE_COL_TEMP,
+	STORE_COL_HUMIDITY,
+	STORE_COL_FLAGS,
+	STORE_COL_RESULT,
+	STORE_COL_ERRORS,
+	STORE_COL_RTT,
+	STORE_COL_NR,
+};
+
+typedef struct {
+	uint32_t	magic; // STORE_MAGIC
+	uint16_t	version;
+	uint8_t		addr; // node address of the series
+	uint8_t		rsvd0;
+	uint32_t	seq; // segment number, same as the file name
+	uint32_t	block_size; // STORE_BLOCK_SIZE
+	uint32_t	nblocks; // STORE_SEG_BLOCKS
+	uint32_t	rsvd1;
+	int64_t		created_ms;
+}	store_seg_hdr_t;
+
+/* Written before the samples it covers are committed */
+typedef struct {
+	int64_t		min_ms; // 0: block not started
+	int64_t		max_ms;
+}	store_index_t;
+
+typedef struct {
+	uint32_t	magic; // STORE_MAGIC
+	uint32_t	count; // committed samples, the commit point
+	int64_t		base_ms; // first timestamp
+	uint32_t	sealed;
+	uint32_t	crc; // CRC-32 of the block with crc = 0, once sealed
+	uint16_t	len[STORE_COL_NR]; // column bytes, once sealed
+	uint8_t		rsvd[64 - 24 - 2 * STORE_COL_NR];
+}	store_block_hdr_t;
+
+_Static_assert(sizeof(store_seg_hdr_t) == 32, "store_seg_hdr_t is a file format");
+_Static_assert(sizeof(store_index_t) == 16, "store_index_t is a file format");
+_Static_assert(sizeof(store_block_hdr_t) == 64, "store_block_hdr_t is a file format");
+
+/* One status sample, decoded */
+typedef struct {
+	int64_t		ts_ms; // CLOCK_REALTIME
+	int32_t		result; // 0 or -errno; the status fields are 0 unless 0
+	int16_t		temp_x100;
+	uint16_t	humidity_x100;
+	uint8_t		fan_mode;
+	uint8_t		fan_state;
+	uint16_t	errors;
+	uint32_t	rtt_us; // 0: unknown
+}	store_sample_t;
+
+typedef struct store	store_t;
+
+// stats of a scan
+typedef struct {
+	uint64_t	segments;
+	uint64_t	blocks; // decoded
+	uint64_t	skipped; // pruned by the index
+	uint64_t	bad; // sealed blocks failing their CRC
+	uint64_t	samples; // in range
+}	store_scan_t;
+
+// one segment, for store_info()
+typedef struct {
+	uint32_t	seq;
+	uint8_t		addr;
+	uint32_t	blocks; // started
+	uint32_t	sealed;
+	uint32_t	bad;
+	uint64_t	samples;
+	uint64_t	bytes; // column bytes of the samples
+	int64_t		min_ms;
+	int64_t		max_ms;
+}	store_seg_info_t;
+
+typedef int	(*store_cb_t)(void *ctx, const store_sample_t *s); // non-zero stops
+typedef void	(*store_info_cb_t)(void *ctx, const store_seg_info_t *seg);
+
+// writer, all return 0 or -errno
+int	store_open(store_t **st, const char *dir, uint8_t addr); // creates the directory
+int	store_append(store_t *st, const store_sample_t *s);
+int	store_close(store_t *st);
+
+// readers
+int	store_scan(const char *dir, int64_t from_ms, int64_t to_ms, store_cb_t cb, void *ctx,
+		store_scan_t *stats);
+int	store_info(const char *dir, store_info_cb_t cb, void *ctx);
+int	store_span(const char *dir, uint8_t *addr, int64_t *min_ms, int64_t *max_ms); // 0s if empty
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "client.h"
+
+/* Connect to the daemon socket, -1 (quietly) when no daemon listens */
+int	fanctld_connect(void)
+{
+	struct sockaddr_un	sa;
+	const char		*path;
+	int			fd;
+
+	path = getenv(FANCTLD_SOCK_ENV);
+	if (!path)
+		path = FANCTLD_SOCK_PATH;
+	if (!*path || strlen(path) >= sizeof(sa.sun_path))
+		return -1;
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int	fanctld_send(int fd, const struct fanctld_req *req)
+{
+	if (send(fd, req, sizeof(*req), MSG_NOSIGNAL) != (ssize_t)sizeof(*req))
+		return -1;
+	return 0;
+}
+
+/* Next message from the daemon: its length, -1 with errno ETIMEDOUT */
+ssize_t	fanctld_recv(int fd, void *resp, size_t len, int timeout_ms)
+{
+	struct pollfd	pfd;
+	ssize_t		n;
+	int		pr;
+
+	for (;;)
+	{
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pr = poll(&pfd, 1, timeout_ms);
+		if (pr < 0 && errno == EINTR)
+			continue;
+		if (pr <= 0)
+		{
+			if (pr == 0)
+				errno = ETIMEDOUT;
+			return -1;
+		}
+		n = recv(fd, resp, len, 0);
+		if (n == 0)
+			errno = ECONNRESET;
+		return n > 0 ? n : -1;
+	}
+}
+
+/* Send one request and wait for the response with the same tag */
+int	fanctld_call(int fd, const struct fanctld_req *req, void *resp, size_t len)
+{
+	ssize_t	n;
+
+	if (fanctld_send(fd, req) < 0)
+		return -1;
+	for (;;)
+	{
+		n = fanctld_recv(fd, resp, len, FANCTLD_CALL_TIMEOUT_MS);
+		if (n < 0)
+			return -1;
+		// tag sits at the same offset in fanctld_resp and fanctld_info
+		if ((size_t)n >= offsetof(struct fanctld_resp, tag) + sizeof(req->tag)
+			&& ((struct fanctld_resp *)resp)->tag == req->tag)
+			return 0;
+	}
+}
+
+/*
+ * Connect only if the daemon serves `dev` over the given transport, so
+ * a CLI never silently talks to another device than the one it names.
+ */
+int	fanctld_open_for(uint8_t kind, const char *dev)
+{
+	struct fanctld_req	req;
+	struct fanctld_info	info;
+	char			a[PATH_MAX];
+	char			b[PATH_MAX];
+	int			fd;
+
+	fd = fanctld_connect();
+	if (fd < 0)
+		return -1;
+	memset(&req, 0, sizeof(req));
+	req.version = FANCTLD_VERSION;
+	req.op = FANCTLD_OP_INFO;
+	memset(&info, 0, sizeof(info));
+	if (fanctld_call(fd, &req, &info, sizeof(info)) < 0
+		|| info.version != FANCTLD_VERSION || info.op != FANCTLD_OP_INFO
+		|| info.kind != kind)
+	{
+		close(fd);
+		return -1;
+	}
+	info.dev[sizeof(info.dev) - 1] = '\0';
+	if (!realpath(dev, a) || !realpath(info.dev, b) || strcmp(a, b))
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "fanctld_proto.h"
+
+/*
+ * fanctld client side, used by the CLIs: they go through the daemon
+ * when one is running for the same device, and open it directly
+ * otherwise.
+ */
+
+#define FANCTLD_CALL_TIMEOUT_MS	5000
+
+int	fanctld_connect(void);
+int	fanctld_open_for(uint8_t kind, const char *dev);
+int	fanctld_call(int fd, const struct fanctld_req *req, void *resp, size_t len);
+int	fanctld_send(int fd, const struct fanctld_req *req);
+ssize_t	fanctld_recv(int fd, void *resp, size_t len, int timeout_ms);
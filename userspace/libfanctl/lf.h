@@ -0,0 +1,48 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "libfanctl.h"
+
+/*
+ * libfanctl internals
+ * -------------------
+ * The handle owns an epoll fd (fanctl_fd()) watching an eventfd, which
+ * signals completions queued from outside fanctl_run(), and the
+ * backend's own fd if it has one. Backends finish a request with
+ * lf_complete(); fanctl_run() then calls the callbacks in order.
+ */
+
+#define LF_EV_DONE	0 // epoll data: the completion eventfd
+#define LF_EV_BACKEND	1 // epoll data: the backend's fd
+
+typedef struct {
+	int	(*open)(fanctl_t *h);
+	void	(*close)(fanctl_t *h);
+	int	(*submit)(fanctl_t *h, fanctl_req_t *r);
+	int	(*run)(fanctl_t *h); // backend fd readable, must not block
+	int	(*call)(fanctl_t *h, fanctl_req_t *r); // idle handle, NULL: submit and wait
+	int	(*cork)(fanctl_t *h, bool on); // NULL: batches are plain submits
+}	lf_backend_t;
+
+struct fanctl {
+	int			kind; // FANCTL_TR_*
+	int			fd; // device or tty
+	char			dev[104];
+	const lf_backend_t	*be;
+	void			*priv; // backend state
+	int			epfd;
+	int			evfd;
+	pthread_mutex_t		lock; // done list, and backend queues
+	fanctl_req_t		*done; // FIFO
+	fanctl_req_t		*done_tail;
+	unsigned		inflight; // submitted, callback not run yet
+};
+
+extern const lf_backend_t	lf_ioctl_backend;
+extern const lf_backend_t	lf_serial_backend;
+
+uint64_t	lf_mono_ns(void);
+int		lf_watch(fanctl_t *h, int fd);
+// wake: called outside fanctl_run(), e.g. from a worker thread
+void		lf_complete(fanctl_t *h, fanctl_req_t *r, int result, bool wake);
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "lf.h"
+
+/*
+ * Driver backend: each request is one blocking ioctl on the device.
+ * Submitted requests go to a worker thread, started on the first
+ * submit, which runs them in order and hands them back through the
+ * completion eventfd. The driver selects the node per open file, so
+ * SET_ADDR is only issued when the address changes.
+ */
+
+typedef struct {
+	pthread_t	thread;
+	pthread_cond_t	cond; // under h->lock
+	bool		started;
+	bool		stop;
+	fanctl_req_t	*queue; // FIFO
+	fanctl_req_t	*queue_tail;
+	int		cur_addr; // selected on the fd, -1 none yet
+}	lf_ioctl_t;
+
+static int	ioctl_be_open(fanctl_t *h)
+{
+	lf_ioctl_t	*io;
+
+	h->fd = open(h->dev, O_RDWR | O_CLOEXEC);
+	if (h->fd < 0)
+		return -errno;
+	io = calloc(1, sizeof(*io));
+	if (!io)
+	{
+		close(h->fd);
+		h->fd = -1;
+		return -ENOMEM;
+	}
+	pthread_cond_init(&io->cond, NULL);
+	io->cur_addr = -1;
+	h->priv = io;
+	return 0;
+}
+
+static void	ioctl_be_close(fanctl_t *h)
+{
+	lf_ioctl_t	*io;
+
+	io = h->priv;
+	pthread_mutex_lock(&h->lock);
+	io->stop = true;
+	pthread_cond_signal(&io->cond);
+	pthread_mutex_unlock(&h->lock);
+	if (io->started)
+		pthread_join(io->thread, NULL);
+	pthread_cond_destroy(&io->cond);
+	free(io);
+	close(h->fd);
+}
+
+/* One exchange, on the caller's thread or the worker */
+static int	ioctl_be_call(fanctl_t *h, fanctl_req_t *r)
+{
+	struct fanctl_status_ext	ext;
+	lf_ioctl_t			*io;
+	uint8_t				v;
+
+	io = h->priv;
+	if (io->cur_addr != r->addr)
+	{
+		if (ioctl(h->fd, FANCTL_IOC_SET_ADDR, &r->addr) < 0)
+			return -errno;
+		io->cur_addr = r->addr;
+	}
+	v = (uint8_t)r->arg;
+	switch (r->op)
+	{
+		case FANCTL_OP_PING:
+			if (ioctl(h->fd, FANCTL_IOC_PING_EXT, &r->times) == 0)
+				return 0;
+			if (errno != ENOTTY || ioctl(h->fd, FANCTL_IOC_PING) < 0) // older driver
+				return -errno;
+			return 0;
+		case FANCTL_OP_STATUS:
+			memset(&ext, 0, sizeof(ext));
+			if (ioctl(h->fd, FANCTL_IOC_GET_STATUS_EXT, &ext) < 0
+				&& (errno != ENOTTY || ioctl(h->fd, FANCTL_IOC_GET_STATUS, &ext.status) < 0))
+				return -errno;
+			r->status = ext.status;
+			r->times = ext.times;
+			return 0;
+		case FANCTL_OP_SET_FAN_MODE:
+			return ioctl(h->fd, FANCTL_IOC_SET_FAN_MODE, &v) < 0 ? -errno : 0;
+		case FANCTL_OP_SET_FAN_STATE:
+			return ioctl(h->fd, FANCTL_IOC_SET_FAN_STATE, &v) < 0 ? -errno : 0;
+		case FANCTL_OP_SET_THRESHOLD:
+			return ioctl(h->fd, FANCTL_IOC_SET_THRESHOLD, &r->arg) < 0 ? -errno : 0;
+	}
+	return -EINVAL;
+}
+
+static void	*ioctl_be_worker(void *arg)
+{
+	fanctl_t	*h;
+	lf_ioctl_t	*io;
+	fanctl_req_t	*r;
+	int		ret;
+
+	h = arg;
+	io = h->priv;
+	pthread_mutex_lock(&h->lock);
+	for (;;)
+	{
+		while (!io->queue && !io->stop)
+			pthread_cond_wait(&io->cond, &h->lock);
+		if (io->stop)
+			break;
+		r = io->queue;
+		io->queue = r->next;
+		if (!io->queue)
+			io->queue_tail = NULL;
+		pthread_mutex_unlock(&h->lock);
+		ret = ioctl_be_call(h, r);
+		lf_complete(h, r, ret, true);
+		pthread_mutex_lock(&h->lock);
+	}
+	pthread_mutex_unlock(&h->lock);
+	return NULL;
+}
+
+static int	ioctl_be_submit(fanctl_t *h, fanctl_req_t *r)
+{
+	lf_ioctl_t	*io;
+	int		ret;
+
+	io = h->priv;
+	if (!io->started)
+	{
+		ret = pthread_create(&io->thread, NULL, ioctl_be_worker, h);
+		if (ret)
+			return -ret;
+		io->started = true;
+	}
+	pthread_mutex_lock(&h->lock);
+	if (io->queue_tail)
+		io->queue_tail->next = r;
+	else
+		io->queue = r;
+	io->queue_tail = r;
+	pthread_cond_signal(&io->cond);
+	pthread_mutex_unlock(&h->lock);
+	return 0;
+}
+
+static int	ioctl_be_run(fanctl_t *h)
+{
+	(void)h;
+	return 0; // completions come through the eventfd
+}
+
+const lf_backend_t	lf_ioctl_backend = {
+	.open	= ioctl_be_open,
+	.close	= ioctl_be_close,
+	.submit	= ioctl_be_submit,
+	.run	= ioctl_be_run,
+	.call	= ioctl_be_call,
+};
@@ -0,0 +1,107 @@
+#include <errno.h>
+#include <unistd.h>
+
+#include "proto.h"
+#include "serial.h"
+#include "sclient.h"
+#include "lf.h"
+
+/*
+ * Raw tty backend: requests are encoded here and pipelined by sclient,
+ * which matches responses by SEQ. times are taken around the exchange
+ * on the host: tx when the frame is queued, rx when the response frame
+ * is complete.
+ */
+
+static const uint8_t	g_cmds[FANCTL_OP_NR] = {
+	[FANCTL_OP_PING]		= PROTO_CMD_PING,
+	[FANCTL_OP_STATUS]		= PROTO_CMD_STATUS_REQ,
+	[FANCTL_OP_SET_FAN_MODE]	= PROTO_CMD_SET_FAN_MODE,
+	[FANCTL_OP_SET_FAN_STATE]	= PROTO_CMD_SET_FAN_STATE,
+	[FANCTL_OP_SET_THRESHOLD]	= PROTO_CMD_SET_THRESHOLD,
+};
+
+static int	serial_be_open(fanctl_t *h)
+{
+	int	ret;
+
+	h->fd = serial_open(h->dev, 115200);
+	if (h->fd < 0)
+		return errno ? -errno : -ENODEV;
+	h->priv = sclient_attach(h->fd);
+	if (!h->priv)
+		ret = -ENOMEM;
+	else
+		ret = lf_watch(h, sclient_fd(h->priv));
+	if (ret < 0)
+	{
+		sclient_free(h->priv);
+		close(h->fd);
+		h->fd = -1;
+	}
+	return ret;
+}
+
+static void	serial_be_close(fanctl_t *h)
+{
+	sclient_free(h->priv);
+	close(h->fd);
+}
+
+static void	serial_be_done(void *arg, int result, const proto_frame_t *resp)
+{
+	fanctl_req_t	*r;
+
+	r = arg;
+	if (result == 0)
+	{
+		r->times.rx_ns = lf_mono_ns();
+		result = sclient_decode(resp, &r->status);
+	}
+	lf_complete(r->owner, r, result, false);
+}
+
+static int	serial_be_submit(fanctl_t *h, fanctl_req_t *r)
+{
+	uint8_t	payload[2];
+	uint8_t	len;
+	int	ret;
+
+	len = 0;
+	if (r->op == FANCTL_OP_SET_FAN_MODE || r->op == FANCTL_OP_SET_FAN_STATE)
+		payload[len++] = (uint8_t)r->arg;
+	else if (r->op == FANCTL_OP_SET_THRESHOLD)
+	{
+		payload[len++] = (uint8_t)((uint16_t)r->arg >> 8);
+		payload[len++] = (uint8_t)r->arg;
+	}
+	r->times.tx_ns = lf_mono_ns();
+	if (r->addr == FANCTL_ADDR_BROADCAST)
+	{
+		ret = sclient_send(h->priv, r->addr, g_cmds[r->op], payload, len);
+		if (ret == 0)
+			lf_complete(h, r, 0, true);
+		return ret;
+	}
+	ret = sclient_submit(h->priv, r->addr, g_cmds[r->op], payload, len,
+			r->timeout_ms > 0 ? r->timeout_ms : FANCTL_TIMEOUT_MS, serial_be_done, r);
+	return ret < 0 ? ret : 0;
+}
+
+static int	serial_be_run(fanctl_t *h)
+{
+	return sclient_run(h->priv, 0);
+}
+
+static int	serial_be_cork(fanctl_t *h, bool on)
+{
+	return sclient_cork(h->priv, on);
+}
+
+const lf_backend_t	lf_serial_backend = {
+	.open	= serial_be_open,
+	.close	= serial_be_close,
+	.submit	= serial_be_submit,
+	.run	= serial_be_run,
+	.cork	= serial_be_cork,
+};
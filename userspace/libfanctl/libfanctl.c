@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "fanctld_proto.h"
+#include "lf.h"
+
+_Static_assert(FANCTL_TR_IOCTL == FANCTLD_KIND_IOCTL && FANCTL_TR_SERIAL == FANCTLD_KIND_SERIAL,
+	"transport kinds are shared with fanctld");
+_Static_assert(FANCTL_OP_PING == FANCTLD_OP_PING && FANCTL_OP_STATUS == FANCTLD_OP_STATUS
+	&& FANCTL_OP_SET_FAN_MODE == FANCTLD_OP_SET_FAN_MODE
+	&& FANCTL_OP_SET_FAN_STATE == FANCTLD_OP_SET_FAN_STATE
+	&& FANCTL_OP_SET_THRESHOLD == FANCTLD_OP_SET_THRESHOLD && FANCTL_OP_NR == FANCTLD_OP_NR,
+	"ops are shared with fanctld");
+
+uint64_t	lf_mono_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int	lf_watch(fanctl_t *h, int fd)
+{
+	struct epoll_event	ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = LF_EV_BACKEND;
+	return epoll_ctl(h->epfd, EPOLL_CTL_ADD, fd, &ev) < 0 ? -errno : 0;
+}
+
+void	lf_complete(fanctl_t *h, fanctl_req_t *r, int result, bool wake)
+{
+	uint64_t	one;
+	bool		first;
+
+	r->result = result;
+	r->next = NULL;
+	pthread_mutex_lock(&h->lock);
+	first = !h->done;
+	if (h->done_tail)
+		h->done_tail->next = r;
+	else
+		h->done = r;
+	h->done_tail = r;
+	pthread_mutex_unlock(&h->lock);
+	one = 1;
+	if (wake && first && write(h->evfd, &one, sizeof(one)) < 0)
+		perror("libfanctl: eventfd");
+}
+
+/* Handle ------------------------------------------------------------------- */
+
+static int	guess_kind(const char *dev)
+{
+	int	fd;
+	int	kind;
+
+	fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	kind = isatty(fd) ? FANCTL_TR_SERIAL : FANCTL_TR_IOCTL;
+	close(fd);
+	return kind;
+}
+
+fanctl_t	*fanctl_open(const char *dev, int kind)
+{
+	struct epoll_event	ev;
+	fanctl_t		*h;
+	int			ret;
+
+	if (kind == FANCTL_TR_AUTO)
+		kind = guess_kind(dev);
+	if (kind != FANCTL_TR_IOCTL && kind != FANCTL_TR_SERIAL)
+	{
+		errno = kind < 0 ? -kind : EINVAL;
+		return NULL;
+	}
+	h = calloc(1, sizeof(*h));
+	if (!h)
+		return NULL;
+	h->kind = kind;
+	h->fd = -1;
+	h->be = kind == FANCTL_TR_SERIAL ? &lf_serial_backend : &lf_ioctl_backend;
+	snprintf(h->dev, sizeof(h->dev), "%s", dev);
+	pthread_mutex_init(&h->lock, NULL);
+	h->epfd = epoll_create1(EPOLL_CLOEXEC);
+	h->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (h->epfd < 0 || h->evfd < 0)
+		goto fail;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = LF_EV_DONE;
+	if (epoll_ctl(h->epfd, EPOLL_CTL_ADD, h->evfd, &ev) < 0)
+		goto fail;
+	ret = h->be->open(h);
+	if (ret < 0)
+	{
+		errno = -ret;
+		goto fail;
+	}
+	return h;
+
+fail:
+	ret = errno;
+	if (h->epfd >= 0)
+		close(h->epfd);
+	if (h->evfd >= 0)
+		close(h->evfd);
+	pthread_mutex_destroy(&h->lock);
+	free(h);
+	errno = ret;
+	return NULL;
+}
+
+void	fanctl_close(fanctl_t *h)
+{
+	if (!h)
+		return;
+	h->be->close(h);
+	close(h->epfd);
+	close(h->evfd);
+	pthread_mutex_destroy(&h->lock);
+	free(h);
+}
+
+int	fanctl_kind(const fanctl_t *h)
+{
+	return h->kind;
+}
+
+const char	*fanctl_dev(const fanctl_t *h)
+{
+	return h->dev;
+}
+
+int	fanctl_dev_fd(const fanctl_t *h)
+{
+	return h->fd;
+}
+
+int	fanctl_fd(const fanctl_t *h)
+{
+	return h->epfd;
+}
+
+unsigned	fanctl_inflight(const fanctl_t *h)
+{
+	return h->inflight;
+}
+
+const char	*fanctl_op_name(uint8_t op)
+{
+	static const char	*names[FANCTL_OP_NR] = {
+		[FANCTL_OP_PING]		= "ping",
+		[FANCTL_OP_STATUS]		= "status",
+		[FANCTL_OP_SET_FAN_MODE]	= "set_fan_mode",
+		[FANCTL_OP_SET_FAN_STATE]	= "set_fan_state",
+		[FANCTL_OP_SET_THRESHOLD]	= "set_threshold",
+	};
+
+	return op < FANCTL_OP_NR && names[op] ? names[op] : "?";
+}
+
+/* Requests ----------------------------------------------------------------- */
+
+static int	prepare(fanctl_t *h, fanctl_req_t *r)
+{
+	if (r->op == 0 || r->op >= FANCTL_OP_NR)
+		return -EINVAL;
+	if (r->addr == FANCTL_ADDR_BROADCAST && r->op < FANCTL_OP_SET_FAN_MODE)
+		return -EINVAL; // nodes never answer broadcasts
+	r->result = 0;
+	r->done = false;
+	r->next = NULL;
+	r->owner = h;
+	memset(&r->status, 0, sizeof(r->status));
+	memset(&r->times, 0, sizeof(r->times));
+	return 0;
+}
+
+int	fanctl_submit(fanctl_t *h, fanctl_req_t *r)
+{
+	int	ret;
+
+	if (h->inflight >= FANCTL_MAX_INFLIGHT)
+		return -EAGAIN;
+	ret = prepare(h, r);
+	if (ret == 0)
+		ret = h->be->submit(h, r);
+	if (ret == 0)
+		h->inflight++;
+	return ret;
+}
+
+int	fanctl_submit_batch(fanctl_t *h, fanctl_req_t **reqs, unsigned n)
+{
+	unsigned	i;
+	int		ret;
+
+	ret = h->be->cork ? h->be->cork(h, true) : 0;
+	for (i = 0; i < n && ret == 0; i++)
+	{
+		ret = fanctl_submit(h, reqs[i]);
+		if (ret < 0)
+			break;
+	}
+	if (h->be->cork && h->be->cork(h, false) < 0 && ret == 0)
+		ret = -EIO; // the requests fail from fanctl_run()
+	return i > 0 ? (int)i : ret;
+}
+
+int	fanctl_run(fanctl_t *h, int timeout_ms)
+{
+	struct epoll_event	ev[2];
+	fanctl_req_t		*list;
+	fanctl_req_t		*r;
+	uint64_t		cnt;
+	int			ret;
+	int			done;
+	int			n;
+	int			i;
+
+	pthread_mutex_lock(&h->lock);
+	if (h->done)
+		timeout_ms = 0;
+	pthread_mutex_unlock(&h->lock);
+	n = epoll_wait(h->epfd, ev, 2, timeout_ms);
+	if (n < 0)
+		return errno == EINTR ? 0 : -errno;
+	ret = 0;
+	for (i = 0; i < n; i++)
+	{
+		if (ev[i].data.u32 == LF_EV_BACKEND)
+			ret = h->be->run(h);
+		else if (read(h->evfd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+			ret = -errno;
+	}
+
+	pthread_mutex_lock(&h->lock);
+	list = h->done;
+	h->done = NULL;
+	h->done_tail = NULL;
+	pthread_mutex_unlock(&h->lock);
+	done = 0;
+	while (list)
+	{
+		r = list;
+		list = r->next;
+		r->next = NULL;
+		r->done = true;
+		h->inflight--;
+		done++;
+		if (r->cb)
+			r->cb(r); // may submit again
+	}
+	return ret < 0 ? ret : done;
+}
+
+int	fanctl_do(fanctl_t *h, fanctl_req_t *r)
+{
+	fanctl_cb_t	cb;
+	int		ret;
+
+	if (h->be->call && !h->inflight)
+	{
+		ret = prepare(h, r);
+		if (ret == 0)
+			ret = h->be->call(h, r);
+		r->result = ret;
+		r->done = true;
+		return ret;
+	}
+	cb = r->cb;
+	r->cb = NULL;
+	ret = fanctl_submit(h, r);
+	while (ret == 0 && !r->done)
+	{
+		ret = fanctl_run(h, -1);
+		if (ret > 0)
+			ret = 0;
+	}
+	r->cb = cb;
+	if (!r->done)
+		r->result = ret;
+	return r->result;
+}
+
+int	fanctl_call(fanctl_t *h, uint8_t op, uint8_t addr, int16_t arg,
+		struct fanctl_status *st, struct fanctl_times *times)
+{
+	fanctl_req_t	r;
+	int		ret;
+
+	memset(&r, 0, sizeof(r));
+	r.op = op;
+	r.addr = addr;
+	r.arg = arg;
+	ret = fanctl_do(h, &r);
+	if (st)
+		*st = r.status;
+	if (times)
+		*times = r.times;
+	return ret;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fanctl_uapi.h"
+
+/*
+ * libfanctl
+ * ---------
+ * One request API for a fan node, over either transport:
+ *  - FANCTL_TR_IOCTL:  the driver's character device (/dev/fanctl)
+ *  - FANCTL_TR_SERIAL: a raw tty, through the sclient engine
+ *    (fanctl_serial/sclient.h)
+ *
+ * A request is a caller-owned fanctl_req_t. It can be run three ways:
+ *  - fanctl_do() / fanctl_call() block until it completes
+ *  - fanctl_submit() returns at once; the callback runs from
+ *    fanctl_run() when it completes. fanctl_fd() is pollable (POLLIN)
+ *    so a handle can sit in an external epoll loop.
+ *  - fanctl_submit_batch() submits several at once, in one write() on
+ *    a tty
+ *
+ * On a tty up to FANCTL_MAX_INFLIGHT requests are pipelined on the wire.
+ * The driver has one request on the wire, so on the device submitted
+ * requests are queued to a worker thread (started on first use) and run
+ * in order; blocking calls on an idle handle run on the caller's thread.
+ *
+ * Callbacks only run inside fanctl_run() / fanctl_do() on the caller's
+ * thread and may submit again. A handle is used by one thread at a time.
+ * All functions return 0 or -errno unless noted.
+ */
+
+#define FANCTL_TIMEOUT_MS	1000 // serial request timeout, as the driver's
+#define FANCTL_MAX_INFLIGHT	255
+
+// transports, same values as FANCTLD_KIND_*
+#define FANCTL_TR_AUTO		-1 // a tty is serial, anything else the driver
+#define FANCTL_TR_IOCTL		0
+#define FANCTL_TR_SERIAL	1
+
+// request ops, same values as FANCTLD_OP_*
+#define FANCTL_OP_PING			0x01
+#define FANCTL_OP_STATUS		0x02
+#define FANCTL_OP_SET_FAN_MODE		0x03 // arg: PROTO_FAN_MODE_*
+#define FANCTL_OP_SET_FAN_STATE		0x04 // arg: PROTO_FAN_STATE_*
+#define FANCTL_OP_SET_THRESHOLD		0x05 // arg: 0.01°C
+#define FANCTL_OP_NR			0x06
+
+typedef struct fanctl		fanctl_t;
+typedef struct fanctl_req	fanctl_req_t;
+
+typedef void	(*fanctl_cb_t)(fanctl_req_t *req);
+
+struct fanctl_req {
+	// set by the caller
+	uint8_t			op; // FANCTL_OP_*
+	uint8_t			addr; // FANCTL_ADDR_NONE point-to-point, BROADCAST SET_* only
+	int16_t			arg;
+	int			timeout_ms; // serial, 0: FANCTL_TIMEOUT_MS
+	fanctl_cb_t		cb; // fanctl_submit() only, may be NULL
+	void			*user;
+	// set on completion
+	int			result; // 0, -ETIMEDOUT, -EOPNOTSUPP (invalid arg), -EBUSY (state), ...
+	struct fanctl_status	status; // STATUS
+	struct fanctl_times	times; // CLOCK_MONOTONIC; on a tty, submit and completion
+	// library
+	struct fanctl_req	*next;
+	struct fanctl		*owner;
+	bool			done;
+};
+
+fanctl_t	*fanctl_open(const char *dev, int kind); // NULL and errno on failure
+void		fanctl_close(fanctl_t *h); // requests in flight are dropped
+int		fanctl_kind(const fanctl_t *h);
+const char	*fanctl_dev(const fanctl_t *h);
+int		fanctl_dev_fd(const fanctl_t *h); // device or tty, e.g. for FANCTL_IOC_GET_LINK
+
+int		fanctl_do(fanctl_t *h, fanctl_req_t *req); // req->result, cb not called
+int		fanctl_call(fanctl_t *h, uint8_t op, uint8_t addr, int16_t arg,
+			struct fanctl_status *st, struct fanctl_times *times);
+
+int		fanctl_submit(fanctl_t *h, fanctl_req_t *req);
+int		fanctl_submit_batch(fanctl_t *h, fanctl_req_t **reqs, unsigned n); // submitted or -errno
+int		fanctl_fd(const fanctl_t *h);
+int		fanctl_run(fanctl_t *h, int timeout_ms); // completed or -errno
+unsigned	fanctl_inflight(const fanctl_t *h);
+
+const char	*fanctl_op_name(uint8_t op);